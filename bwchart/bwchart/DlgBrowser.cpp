@@ -11,6 +11,7 @@
 #include "replay.h"
 #include "dirutil.h"
 #include "bwdb.h"
+#include "names.h"
 #include "progressdlg.h"
 #include "regparam.h"
 #include <io.h>
@@ -29,6 +30,9 @@ static char THIS_FILE[] = __FILE__;
 
 #define WATCHFILE "!replay.rep"
 #define CORRUPTED_DIR "corrupted"
+#define BROWSE_COLUMNS 18 // columns of replay list
+#define COL_ACTIVITY 17 // column with player curves
+#define MAXSIMILAR 50 // replays listed by Find similar openings
 
 BEGIN_MESSAGE_MAP(DlgBrowser, CDialog)
 	//{{AFX_MSG_MAP(DlgBrowser)
@@ -51,6 +55,7 @@ BEGIN_MESSAGE_MAP(DlgBrowser, CDialog)
 	ON_EN_CHANGE(IDC_FPLAYER, OnChangeFplayer)
 	ON_WM_TIMER()
 	ON_NOTIFY(LVN_GETDISPINFO, IDC_REPS, OnGetdispinfoReps)
+	ON_NOTIFY(NM_CUSTOMDRAW, IDC_REPS, OnCustomdrawReps)
 	ON_NOTIFY(LVN_ITEMCHANGED, IDC_LISTPLAYERS, OnItemchangedListplayers)
 	ON_NOTIFY(LVN_ITEMCHANGED, IDC_LISTBOS, OnItemchangedListBos)
 	ON_NOTIFY(NM_RCLICK, IDC_LISTPLAYERS, OnRclickListplayers)
@@ -95,6 +100,7 @@ BEGIN_MESSAGE_MAP(DlgBrowser, CDialog)
 	ON_COMMAND(ID__WATCHREPLAYINBW_SC,OnWatchReplaySC)
 	ON_COMMAND(ID__WATCHREPLAYINBW_AUTO,OnWatchReplay)
 	ON_COMMAND(ID__UPDATEAKAS,OnUpdateAkas)
+	ON_COMMAND(ID__FINDSIMILAR,OnFindSimilar)
 	ON_COMMAND(ID__OPENDIRECTORY,OnOpenDirectory)
 	ON_COMMAND(ID_G_LISTREPLAYS,OnListReplays)
 	ON_COMMAND(ID__FILE_MOVETORECYCLEBIN,OnMoveToBin)
@@ -108,7 +114,7 @@ END_MESSAGE_MAP()
 //--------------------------------------------------------------------------------------------------------------
 
 DlgBrowser::DlgBrowser(CWnd* pParent /*=NULL*/)
-	: CDialog(DlgBrowser::IDD, pParent)
+	: CDialog(DlgBrowser::IDD, pParent), m_browseIndex(BROWSE_COLUMNS)
 {
 	//{{AFX_DATA_INIT(DlgBrowser)
 	m_rootdir = _T("");
@@ -146,6 +152,9 @@ DlgBrowser::DlgBrowser(CWnd* pParent /*=NULL*/)
 	m_reftimer=0;
 	m_noRepaint=false;
 	m_bDBLoaded=false;
+	m_browseIndexDirty=false;
+	m_boSearchDirty=false;
+	m_aggregatedLists=false;
 
 	//selected replay
 	m_selectedReplay=0;
@@ -186,6 +195,15 @@ DlgBrowser::DlgBrowser(CWnd* pParent /*=NULL*/)
 	m_currentSortIdx3=0;
 	memset(m_Descending4,1,sizeof(m_Descending4));
 	m_currentSortIdx4=0;
+
+	// string columns of sort index (player and map columns sort name ids by main name)
+	int strcols[]={0,7,8,11,12};
+	for(int i=0;i<sizeof(strcols)/sizeof(strcols[0]);i++)
+		m_browseIndex.SetColumnType(strcols[i],BrowseIndex::COL_STRING);
+	int namecols[]={1,3,5};
+	for(int i=0;i<sizeof(namecols)/sizeof(namecols[0]);i++)
+		m_browseIndex.SetColumnType(namecols[i],BrowseIndex::COL_NAME);
+	m_browseIndex.SetNameSource(_GetSortName,this);
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -412,8 +430,8 @@ BOOL DlgBrowser::OnInitDialog()
 {
 	UINT repCol[]={IDS_COL_REPLAYNAME,IDS_COL_PLAYER1,IDS_COL_APM1,IDS_COL_PLAYER2,IDS_COL_APM2	
 		,IDS_COL_MAP,IDS_COL_DURATION,IDS_COL_TYPE	,IDS_COL_RWAAUTHOR,IDS_COL_GAMEDATE,IDS_COL_ENGINE	
-		,IDS_COL_COMMENT,IDS_COL_DIRECTORY,IDS_COL_FILEDATE,IDS_COL_POS1,IDS_COL_POS2,IDS_HACKCOUNT};
-	int repWidth[]={195,120,45,120,45,125,60,40,110,80,55,300,300,80,45,45,45};
+		,IDS_COL_COMMENT,IDS_COL_DIRECTORY,IDS_COL_FILEDATE,IDS_COL_POS1,IDS_COL_POS2,IDS_HACKCOUNT,IDS_COL_ACTIVITY};
+	int repWidth[]={195,120,45,120,45,125,60,40,110,80,55,300,300,80,45,45,45,100};
 
 	UINT plCol[]={IDS_COL_PLAYERNAME,IDS_COL_AVGAPM,IDS_COL_APMPM,IDS_COL_PERCDEV	,IDS_COL_AVGGAMEDURATION
 		,IDS_COL_GAMESPLAYED,IDS_COL_ZERGPERC,IDS_COL_RANPERC,IDS_COL_TOSSPERC,
@@ -423,8 +441,8 @@ BOOL DlgBrowser::OnInitDialog()
 	UINT mapCol[]={IDS_COL_MAPNAME,IDS_COL_AVGAPM,IDS_COL_AVGGAMEDURATION,IDS_COL_GAMESPLAYED};
 	int mapWidth[]={155,80,120,100};
 
-	UINT boCol[]={IDS_COL_BOCOUNT,IDS_COL_BOPERCENT,IDS_COL_BOCONTENT};
-	int boWidth[]={50,40,600};
+	UINT boCol[]={IDS_COL_BOCOUNT,IDS_COL_BOPERCENT,IDS_COL_BOCONTENT,IDS_COL_BONEXT};
+	int boWidth[]={50,40,600,300};
 	
 	CDialog::OnInitDialog();
 
@@ -528,71 +546,162 @@ void DlgBrowser::_AddBuildOrder(const CString& bo, ReplayInfo *rep, int pidx)
 	pbo->m_bo.FromString(bo);
 	pbo->m_desc = bo;
 	m_bos.Add(pbo);
+	m_boSearchDirty=true;
 }
 
 //-----------------------------------------------------------------------------------------------------------------
 
 // add replay
-ReplayInfo * DlgBrowser::_AddReplay(const ReplayInfo& tmpRep)
+ReplayInfo * DlgBrowser::_AddReplay(const ReplayInfo& tmpRep, bool aggregate)
 {
-	AkaList *akalist = &MAINWND->pGetAkas()->m_akalist;
-	AkaList *akalistmap = &MAINWND->pGetAkas()->m_akalistMap;
-
 	m_allPlayers.RemoveAll();
+	m_allPlayerIds.RemoveAll();
 
 	// create replay
 	ReplayInfo *rep = new ReplayInfo(tmpRep);
 	assert(rep!=0);
 
-	// for each player in the replay
-	int k=0;
-	for(; k<rep->m_playerCount; k++)
-	{
-		// trim player name
+	// trim player & map names
+	for(int k=0; k<rep->m_playerCount; k++)
 		rep->m_player[k].TrimRight();
-		const char *pname=rep->m_player[k];
-
-		// do we know that player already?
-		//if(!_FindAllPlayer(pname)) m_allPlayers.Add(pname);
-
-		// do we have an aka for that player?
-		const Aka *aka = akalist->GetAkaFromName(pname);
-		if(aka!=0) pname = aka->MainName();
-		rep->m_mainName[k]=pname;
-		
-		//ASSERT(!(strncmp(pname,"Obi-1_ElkyNobi",14)==0 && aka==0));
+	rep->m_map.TrimRight();
 
-		// update player data
-		_AddPlayer(pname, rep, k);
+	// intern names, apply akas
+	_ResolveNames(rep);
 
-		// add build order
+	// add build orders
+	for(int k=0; k<rep->m_playerCount; k++)
 		if(!rep->m_bo[k].IsEmpty())
 			_AddBuildOrder(rep->m_bo[k],rep,k);
-	}
-
-	// trim map name
-	rep->m_map.TrimRight();
-	const char *pname=rep->m_map;
 
 	// do we know that map already?
-	if(!_FindAllMap(pname)) m_allMaps.Add(pname);
+	if(_MarkName(m_allMapIds,rep->m_mapId)) m_allMaps.Add(rep->m_map);
 
-	// do we have an aka for that map?
-	const Aka *aka = akalistmap->GetAkaFromName(pname);
-	if(aka!=0) {pname = aka->MainName(); rep->m_mainMap=pname;}
-	else pname = BWChartDB::ClarifyMapName(rep->m_mainMap,pname);
-
-	// update map data
-	_AddMap(pname, rep, k);
+	// update players & map data
+	if(aggregate) _AggregateReplay(rep,1);
 
 	// insert replay 
 	m_replays.Add(rep);
+	_IndexReplay(rep);
 
 	return rep;
 }
 
 //-----------------------------------------------------------------------------------------------------------------
 
+// intern player & map names of a replay (if not done yet), and set their main names from akas
+void DlgBrowser::_ResolveNames(ReplayInfo *rep)
+{
+	AkaList *akalist = &MAINWND->pGetAkas()->m_akalist;
+	AkaList *akalistmap = &MAINWND->pGetAkas()->m_akalistMap;
+	NameTable& names = NameTable::Shared();
+
+	// for each player in the replay
+	for(int k=0; k<rep->m_playerCount; k++)
+	{
+		if(rep->m_playerId[k]<0)
+		{
+			// share the kept string if it's spelled the same
+			rep->m_playerId[k] = names.Intern(rep->m_player[k]);
+			const CString& name = names.GetName(rep->m_playerId[k]);
+			if(name==rep->m_player[k]) rep->m_player[k]=name;
+		}
+
+		// do we have an aka for that player?
+		const Aka *aka = akalist->GetAkaFromId(rep->m_playerId[k]);
+		rep->m_mainName[k] = aka!=0 ? aka->GetMainName() : rep->m_player[k];
+	}
+
+	// same for map
+	if(rep->m_mapId<0)
+	{
+		rep->m_mapId = names.Intern(rep->m_map);
+		const CString& name = names.GetName(rep->m_mapId);
+		if(name==rep->m_map) rep->m_map=name;
+	}
+
+	// do we have an aka for that map?
+	const Aka *aka = akalistmap->GetAkaFromId(rep->m_mapId);
+	if(aka!=0 || rep->m_map==names.GetName(rep->m_mapId)) rep->m_mainMap = _GetMainName(rep->m_mapId,true);
+	else BWChartDB::ClarifyMapName(rep->m_mainMap,rep->m_map);
+}
+
+// main name of a player or map name id (aka main name, or the name itself clarified for maps)
+const CString& DlgBrowser::_GetMainName(int id, bool map)
+{
+	AkaList *akalist = map ? &MAINWND->pGetAkas()->m_akalistMap : &MAINWND->pGetAkas()->m_akalist;
+	const Aka *aka = akalist->GetAkaFromId(id);
+	if(aka!=0) return aka->GetMainName();
+	const CString& name = NameTable::Shared().GetName(id);
+	if(!map) return name;
+
+	// clarified names are computed once per map
+	if(id>=m_clarifiedMaps.GetSize()) m_clarifiedMaps.SetSize(id+1,1024);
+	if(m_clarifiedMaps[id].IsEmpty()) BWChartDB::ClarifyMapName(m_clarifiedMaps[id],name);
+	return m_clarifiedMaps[id];
+}
+
+// names of the name columns of the sort index
+const char *DlgBrowser::_GetSortName(void *context, int col, int id)
+{
+	DlgBrowser *dlg = (DlgBrowser *)context;
+	return dlg->_GetMainName(id,col==5);
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
+// store sort keys of a replay (columns are the replay list columns)
+void DlgBrowser::_IndexReplay(ReplayInfo *rep)
+{
+	CString str;
+	if(rep->m_row<0)
+	{
+		// new row: filter bitmaps
+		rep->m_row = m_browseIndex.AddRow();
+		m_filterIndex.AddRow(rep->m_row,rep->GetMatchup(),rep->m_isRWA,rep->m_hackCount>0,rep->m_mapId,rep->m_playerId,rep->m_playerCount);
+		m_indexedReplays.SetAtGrow(rep->m_row,rep);
+	}
+	int row = rep->m_row;
+	m_browseIndex.SetString(row,0,rep->Name());
+	m_browseIndex.SetName(row,1,rep->m_playerCount>0 ? rep->m_playerId[0] : -1);
+	m_browseIndex.SetInt(row,2,rep->m_apm[0]);
+	m_browseIndex.SetName(row,3,rep->m_playerCount>1 ? rep->m_playerId[1] : -1);
+	m_browseIndex.SetInt(row,4,rep->m_apm[1]);
+	m_browseIndex.SetName(row,5,rep->m_mapId);
+	m_browseIndex.SetInt(row,6,rep->m_duration);
+	m_browseIndex.SetString(row,7,rep->GameType());
+	m_browseIndex.SetString(row,8,rep->m_author);
+	m_browseIndex.SetInt(row,9,rep->DateKey());
+	m_browseIndex.SetInt(row,10,((int)rep->m_engineType)<<8 | rep->m_engineVersion);
+	m_browseIndex.SetString(row,11,rep->m_comment);
+	m_browseIndex.SetString(row,12,rep->Dir(str));
+	m_browseIndex.SetInt(row,13,rep->FileDateKey());
+	m_browseIndex.SetInt(row,14,rep->m_start[0]);
+	m_browseIndex.SetInt(row,15,rep->m_start[1]);
+	m_browseIndex.SetInt(row,16,rep->m_hackCount);
+	int peak=0;
+	for(int k=0;k<rep->m_playerCount && rep->GetSparkline(k)!=0;k++)
+		peak = max(peak,rep->GetSparkline(k)->GetMax(ReplaySparkline::S_APM));
+	m_browseIndex.SetInt(row,COL_ACTIVITY,peak);
+}
+
+// rebuild sort index from scratch (drops rows of deleted replays and strings nobody uses)
+void DlgBrowser::_BuildBrowseIndex()
+{
+	m_browseIndex.Clear();
+	m_filterIndex.Clear();
+	m_indexedReplays.RemoveAll();
+	for(int i=0; i<m_replays.GetSize(); i++)
+	{
+		ReplayInfo *rep = (ReplayInfo *)m_replays.GetAt(i);
+		rep->m_row=-1;
+		_IndexReplay(rep);
+	}
+	m_browseIndexDirty=false;
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
 const CStringArray *DlgBrowser::GetPlayers() const
 {
 	// if complete players list not yet built
@@ -603,15 +712,9 @@ const CStringArray *DlgBrowser::GetPlayers() const
 		{
 			ReplayInfo *rep = (ReplayInfo *)m_replays.GetAt(i);
 			assert(rep!=0);
-			// for each player in the replay
+			// for each player in the replay we dont know yet
 			for(int k=0; k<rep->m_playerCount; k++)
-			{
-				// trim player name
-				const char *pname=rep->m_player[k];
-
-				// do we know that player already?
-				if(!_FindAllPlayer(pname)) m_allPlayers.Add(pname);
-			}
+				if(_MarkName(m_allPlayerIds,rep->m_playerId[k])) m_allPlayers.Add(rep->m_player[k]);
 		}
 	}
 	return &m_allPlayers;
@@ -620,61 +723,111 @@ const CStringArray *DlgBrowser::GetPlayers() const
 //-----------------------------------------------------------------------------------------------------------------
 
 // update player data
-void DlgBrowser::_AddPlayer(const char *pname, ReplayInfo *rep, int k)
+void DlgBrowser::_AddPlayer(const char *pname, const AggregateStats& stats, int sign)
 {
 	PlayerInfo *pl = _FindPlayer(pname);
-	if(pl==0) {pl = new PlayerInfo; m_players.Add(pl); pl->m_name = pname; assert(pl!=0);}
-	pl->m_apm += rep->m_apm[k];
-	pl->m_games++;
-	pl->m_duration+=rep->m_duration;
-	if(rep->m_race[k]==IStarcraftPlayer::RACE_TERRAN)
+	if(pl==0) 
 	{
-		pl->m_apmAsT += rep->m_apm[k];
-		pl->m_gamesAsT++;
+		pl = new PlayerInfo; assert(pl!=0);
+		m_players.Add(pl);
+		pl->m_name = pname;
+		CString key(pname);
+		key.MakeLower();
+		m_playerNames.SetAt(key,pl);
 	}
-	else if(rep->m_race[k]==IStarcraftPlayer::RACE_ZERG)
+	pl->AddStats(stats,sign);
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
+// update map data
+void DlgBrowser::_AddMap(const char *pname, const AggregateStats& stats, int sign)
+{
+	MapInfo *map = _FindMap(pname);
+	if(map==0) 
 	{
-		pl->m_apmAsZ += rep->m_apm[k];
-		pl->m_gamesAsZ++;
+		map = new MapInfo; assert(map!=0);
+		m_maps.Add(map);
+		map->m_name = pname;
+		CString key(pname);
+		key.MakeLower();
+		m_mapNames.SetAt(key,map);
 	}
-	if(rep->m_race[k]==IStarcraftPlayer::RACE_PROTOSS)
+	map->AddStats(stats,sign);
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
+// add (sign=1) or remove (sign=-1) replay from players and maps data (main names must be set)
+void DlgBrowser::_AggregateReplay(ReplayInfo *rep, int sign)
+{
+	AggregateStats stats;
+	for(int k=0; k<rep->m_playerCount; k++)
 	{
-		pl->m_apmAsP += rep->m_apm[k];
-		pl->m_gamesAsP++;
+		rep->GetPlayerStats(k,stats);
+		_AddPlayer(rep->m_mainName[k],stats,sign);
 	}
-
-	pl->AddRace(rep->m_race[k]);
-	pl->AddApmDev(rep->m_apmDev[k]);
+	rep->GetMapStats(stats);
+	_AddMap(rep->m_mainMap,stats,sign);
 }
 
 //-----------------------------------------------------------------------------------------------------------------
 
-// update map data
-void DlgBrowser::_AddMap(const char *pname, ReplayInfo *rep, int k)
+// is it the browsed directory (same comparison as the database keys)
+bool DlgBrowser::_IsRootDir(const char *dir) const
 {
-	MapInfo *map = _FindMap(pname);
-	if(map==0) {map = new MapInfo; m_maps.Add(map); map->m_name = pname; assert(map!=0);}
-	for(k=0; k<rep->m_playerCount; k++)
+	CString root(m_rootdir);
+	CString other(dir);
+	root.TrimRight('\\');
+	other.TrimRight('\\');
+	return root.CompareNoCase(other)==0;
+}
+
+// build players and maps from the database aggregates (same replays as ProcessEntry)
+void DlgBrowser::_LoadAggregatedLists()
+{
+	AkaList *akalist = &MAINWND->pGetAkas()->m_akalist;
+	AkaList *akalistmap = &MAINWND->pGetAkas()->m_akalistMap;
+	const ReplayAggregates *aggregates = BWChartDB::GetAggregates();
+	CString mainMap;
+
+	for(int i=0; i<aggregates->GetCount(); i++)
 	{
-		map->m_apm += rep->m_apm[k];
-		map->m_apmCount++;
+		// only for replays in the browsed directory
+		const AggregateStats& stats = aggregates->GetStats(i);
+		if(stats.m_games<=0) continue;
+		if(!m_recursive && !_IsRootDir(aggregates->GetDir(i))) continue;
+
+		// do we have an aka for that name?
+		const char *pname = aggregates->GetName(i);
+		if(aggregates->GetKind(i)==ReplayAggregates::KIND_PLAYER)
+		{
+			const Aka *aka = akalist->GetAkaFromName(pname);
+			if(aka!=0) pname = aka->MainName();
+			_AddPlayer(pname,stats,1);
+		}
+		else
+		{
+			const Aka *aka = akalistmap->GetAkaFromName(pname);
+			if(aka!=0) pname = aka->MainName();
+			else pname = BWChartDB::ClarifyMapName(mainMap,pname);
+			_AddMap(pname,stats,1);
+		}
 	}
-	map->m_duration+=rep->m_duration;
-	map->m_games++;
+	m_aggregatedLists=true;
 }
 
 //-----------------------------------------------------------------------------------------------------------------
 
 void DlgBrowser::RefreshAkas()
 {
-	AkaList *akalist = &MAINWND->pGetAkas()->m_akalist;
-	AkaList *akalistmap = &MAINWND->pGetAkas()->m_akalistMap;
-	const Aka *aka;
 	CWaitCursor wait;
 
 	// clear players & map list
 	m_players.RemoveAll();
+	m_playerNames.RemoveAll();
 	m_maps.RemoveAll();
+	m_mapNames.RemoveAll();
 
 	// for each replay
 	for(int i=0; i<m_replays.GetSize(); i++)
@@ -682,31 +835,18 @@ void DlgBrowser::RefreshAkas()
 		// get replay
 		ReplayInfo *rep = (ReplayInfo *)m_replays.GetAt(i);
 
-		// for each player
-		int k=0;
-		for(; k<rep->m_playerCount; k++)
-		{
-			// do we have an aka for that player?
-			const char *pname = rep->m_player[k];
-			aka = akalist->GetAkaFromName(pname);
-			if(aka!=0) pname=aka->MainName();
-			rep->m_mainName[k] = pname;
-
-			// update player data
-			_AddPlayer(pname, rep, k);
-		}
-
-		// do we have an aka for that map?
-		const char *pname=rep->m_map;
-		aka = akalistmap->GetAkaFromName(pname);
-		if(aka!=0) {pname = aka->MainName(); rep->m_mainMap=pname;}
-		else pname = BWChartDB::ClarifyMapName(rep->m_mainMap,pname);
+		// apply akas (by name id)
+		_ResolveNames(rep);
 
-		// update map data
-		_AddMap(pname, rep, k);
+		// update players & map data (unless they come from the database)
+		if(!m_aggregatedLists) _AggregateReplay(rep,1);
 	}
 
+	// players & maps from the database
+	if(m_aggregatedLists) _LoadAggregatedLists();
+
 	// display all
+	m_browseIndexDirty=true;
 	_DisplayList();
 }
 
@@ -793,6 +933,7 @@ bool DlgBrowser::_LoadReplay(const char *path, const CTime& creationDate, Replay
 		// list all players
 		tmpRep.m_playerCount = min(ReplayInfo::MAXPLAYER,m_replay.GetPlayerCount());
 		int j=0;
+		tmpRep.m_sparks.RemoveAll();
 		for(int k=0; k<tmpRep.m_playerCount; k++)
 		{
 			// keep only "enabled" players, skip observers
@@ -803,7 +944,10 @@ bool DlgBrowser::_LoadReplay(const char *path, const CTime& creationDate, Replay
 			tmpRep.m_apmDev[j]= list->GetStandardAPMDev(-1,-1);
 			tmpRep.m_race[j] = list->GetRaceIdx();
 			tmpRep.m_start[j] = list->GetStartingLocation();
-			list->GetFinalBuildOrder(tmpRep.m_bo[j]);
+			list->GetFinalBuildOrder(tmpRep.m_bo[j],tmpRep.m_boTimes[j]);
+			ReplaySparkline spark;
+			list->GetSparkline(spark);
+			tmpRep.SetSparkline(j,spark);
 			j++;
 		}
 		tmpRep.m_playerCount=j;
@@ -836,9 +980,14 @@ static void _ProcessPaint()
 //-----------------------------------------------------------------------------------------------------------------
 
 ReplayInfo * DlgBrowser::_ProcessReplay(const char *dir, CFileFind& finder)
+{
+	return _ProcessReplay(dir,finder.GetFileName(),false);
+}
+
+// reparse = true if replay was modified since it was added in database
+ReplayInfo * DlgBrowser::_ProcessReplay(const char *dir, const char *name, bool reparse)
 {
 	ReplayInfo *rep=0;
-	CString tmpPath;
 	ReplayInfo tmpRep;
 	bool bAddToFile=true;
 	bool bAddToMem=true;
@@ -847,23 +996,33 @@ ReplayInfo * DlgBrowser::_ProcessReplay(const char *dir, CFileFind& finder)
 	_ProcessPaint();
 
 	// ignore our "watch replay" file
-	if(finder.GetFileName().CollateNoCase(WATCHFILE)==0) return 0;
+	if(CString(name).CollateNoCase(WATCHFILE)==0) return 0;
 
 	// do we have that replay already?
 	char buffini[2048];
-	BWChartDB::ReadEntry(BWChartDB::FILE_MAIN,dir,finder.GetFileName(),buffini,sizeof(buffini));
+	buffini[0]=0;
+	if(!reparse) BWChartDB::ReadEntry(BWChartDB::FILE_MAIN,dir,name,buffini,sizeof(buffini));
+
+	// record made with older discard rules, parse it again
+	if(buffini[0]!=0 && atoi(buffini)<ReplayInfo::VER_CURRENT) buffini[0]=0;
+
+	// record written by the headless ingestion, parse it to detect hacks
+	if(buffini[0]!=0 && !ReplayInfo::HasHackCount(buffini)) buffini[0]=0;
 	if(buffini[0]!=0)
 	{
 		// load it from database
-		if(!tmpRep.ExtractInfo(dir,finder.GetFileName(),buffini)) return 0;
+		if(!tmpRep.ExtractInfo(dir,name,buffini)) return 0;
 		bAddToFile=false;
 	}
 	else  
 	{
 		// parse it
-		CTime cdate;
-		finder.GetCreationTime(cdate);
-		if((bAddToMem=_LoadReplay(finder.GetFilePath(),cdate, tmpRep)))
+		CString path(dir);
+		if(path.Right(1)!="\\") path+="\\";
+		path+=name;
+		CFileStatus status;
+		CTime cdate = CFile::GetStatus(path,status) ? status.m_ctime : CTime::GetCurrentTime();
+		if((bAddToMem=_LoadReplay(path,cdate, tmpRep)))
 		{
 			if(tmpRep.m_playerCount>0) 
 				m_addedReplays++;
@@ -871,7 +1030,7 @@ ReplayInfo * DlgBrowser::_ProcessReplay(const char *dir, CFileFind& finder)
 		else
 		{
 			// corrupted replay
-			m_corrupted.Add(finder.GetFilePath());
+			m_corrupted.Add(path);
 		}
 	}
 
@@ -891,75 +1050,158 @@ ReplayInfo * DlgBrowser::_ProcessReplay(const char *dir, CFileFind& finder)
 
 //-----------------------------------------------------------------------------------------------------------------
 
-void DlgBrowser::_BrowseReplays(const char *dir, int& count, int &idx, bool bCount)
+// replay file was renamed or moved, move its database entries
+void DlgBrowser::_MoveReplayEntries(const char *oldDir, const char *oldName, const char *dir, const char *name)
 {
-	CFileFind finder;
-	char mask[255];
-	strcpy(mask,dir);
-	if(mask[strlen(mask)-1]!='\\') strcat(mask,"\\");
-	strcat(mask,"*.*");
-
-	// load all replays
-	BOOL bWorking = finder.FindFile(mask);
-	while (bWorking)
+	int files[]={BWChartDB::FILE_MAIN,BWChartDB::FILE_COMMENTS,BWChartDB::FILE_BOS,BWChartDB::FILE_FAVORITES,BWChartDB::FILE_SPARKS};
+	for(int i=0;i<sizeof(files)/sizeof(files[0]);i++)
 	{
-		// find next package
-		bWorking = finder.FindNextFile();
-
-		//dir?
-		if(finder.IsDirectory() && m_recursive)
+		// entries are moved as bytes (sparklines are binary), bigger ones are read again
+		char buffini[4096];
+		char *data = buffini;
+		int size = BWChartDB::ReadData(files[i],oldDir,oldName,buffini,sizeof(buffini));
+		if(size<=0) continue;
+		if(size>=(int)sizeof(buffini))
 		{
-			// . & ..
-			if(finder.IsDots()) continue;
-
-			// skip corrupted
-			if(finder.GetFileName()==CORRUPTED_DIR) continue;
-
-			// recurse
-			char subdir[255];
-			strcpy(subdir,dir);
-			if(subdir[strlen(subdir)-1]!='\\') strcat(subdir,"\\");
-			strcat(subdir,finder.GetFileName());
-			_BrowseReplays(subdir, count, idx, bCount);
-			continue;
+			data = (char*)malloc(size+1);
+			BWChartDB::ReadData(files[i],oldDir,oldName,data,size+1);
 		}
+		BWChartDB::WriteData(files[i],dir,name,data,size);
+		BWChartDB::Delete(files[i],oldDir,oldName);
+		if(data!=buffini) free(data);
+	}
+}
 
-		// rep file?
-		CString ext;
-		ext=finder.GetFileName().Right(4);
-		if(ext.CompareNoCase(".rep")!=0) continue;
+//-----------------------------------------------------------------------------------------------------------------
+
+static CString _SubPath(const char *dir, const char *name)
+{
+	CString path(dir);
+	if(path.Right(1)!="\\") path+="\\";
+	path+=name;
+	return path;
+}
 
-		if(bCount)
+// scan a directory: its content is compared with the previous scan, and only new or modified replays are parsed.
+// A directory with the same time as last scan didnt get files added, removed or renamed, so it isnt listed
+// (replays modified in place there are seen the next time the directory changes).
+void DlgBrowser::_ScanReplays(const char *dir, const ManifestStat& dirStat, const ScanManifest& previous, ScanManifest& current, int &idx)
+{
+	int i;
+	int prevDir = previous.FindDirectory(dir);
+	int curDir = current.AddDirectory(dir,dirStat);
+	bool unchanged = prevDir>=0 && dirStat.m_mtime!=0 && previous.GetDirectoryStat(prevDir).m_mtime==dirStat.m_mtime;
+	if(unchanged)
+	{
+		// same content as last scan
+		for(i=0; i<previous.GetFileCount(prevDir); i++)
 		{
-			count++;
+			int file = previous.GetFile(prevDir,i);
+			current.AddFile(curDir,previous.GetFileName(file),previous.GetFileStat(file));
 		}
-		else
+		for(i=0; i<previous.GetSubdirectoryCount(prevDir); i++)
+			current.AddSubdirectory(curDir,previous.GetSubdirectory(prevDir,i));
+	}
+	else
+	{
+		// list directory
+		CFileFind finder;
+		CString mask = _SubPath(dir,"*.*");
+		BOOL bWorking = finder.FindFile(mask);
+		while (bWorking)
 		{
-			// process replay
-			_ProcessReplay(dir,finder);
+			// find next package
+			bWorking = finder.FindNextFile();
 
-			// update progress bar
-			idx++;
-			if(m_progDlg!=0) m_progDlg->m_progress.SetPos((100*idx)/count);
-			else m_progress.SetPos((100*idx)/count);
+			//dir?
+			if(finder.IsDirectory())
+			{
+				// . & .. & corrupted
+				if(finder.IsDots() || finder.GetFileName()==CORRUPTED_DIR) continue;
+				current.AddSubdirectory(curDir,finder.GetFileName());
+				continue;
+			}
+
+			// rep file?
+			CString ext;
+			ext=finder.GetFileName().Right(4);
+			if(ext.CompareNoCase(".rep")!=0) continue;
+
+			// file signature (file id only for new or modified files)
+			ManifestStat stat;
+			FILETIME ftime;
+			finder.GetLastWriteTime(&ftime);
+			stat.m_size = (unsigned long)finder.GetLength();
+			stat.m_mtime = ((ManifestValue)ftime.dwHighDateTime<<32)|ftime.dwLowDateTime;
+			int prevFile = previous.FindFile(prevDir,finder.GetFileName());
+			if(prevFile>=0 && previous.GetFileStat(prevFile).SameContent(stat)) stat.m_fileid = previous.GetFileStat(prevFile).m_fileid;
+			else ScanManifest::Stat(finder.GetFilePath(),stat,true);
+			current.AddFile(curDir,finder.GetFileName(),stat);
 		}
 	}
-}
 
+	// process replays (total is last scan count, or replays listed so far)
+	int total = max(previous.GetTotalFileCount(),current.GetTotalFileCount());
+	for(i=0; i<current.GetFileCount(curDir); i++)
+	{
+		int file = current.GetFile(curDir,i);
+		const char *name = current.GetFileName(file);
+		const ManifestStat& stat = current.GetFileStat(file);
+		bool reparse=false;
+		if(!unchanged)
+		{
+			int prevFile = previous.FindFile(prevDir,name);
+			if(prevFile>=0) 
+			{
+				// modified?
+				reparse = !previous.GetFileStat(prevFile).SameContent(stat);
+			}
+			else
+			{
+				// renamed or moved (and no longer at its previous place)?
+				int moved = previous.FindFileByID(stat);
+				if(moved>=0 && previous.GetFileStat(moved).SameContent(stat))
+				{
+					const char *oldDir = previous.GetDirectoryPath(previous.GetFileDirectory(moved));
+					ManifestStat oldStat;
+					if(!ScanManifest::Stat(_SubPath(oldDir,previous.GetFileName(moved)),oldStat,false))
+						_MoveReplayEntries(oldDir,previous.GetFileName(moved),dir,name);
+				}
+			}
+		}
+		_ProcessReplay(dir,name,reparse);
+
+		// update progress bar
+		idx++;
+		int pos = idx<total ? (100*idx)/total : 99;
+		if(m_progDlg!=0) m_progDlg->m_progress.SetPos(pos);
+		else m_progress.SetPos(pos);
+	}
+
+	// recurse
+	if(!m_recursive) return;
+	for(i=0; i<current.GetSubdirectoryCount(curDir); i++)
+	{
+		CString subdir = _SubPath(dir,current.GetSubdirectory(curDir,i));
+		ManifestStat stat;
+		if(ScanManifest::Stat(subdir,stat,false)) _ScanReplays(subdir,stat,previous,current,idx);
+	}
+}
 
 //--------------------------------------------------------------------------------------------------------------
 
-bool DlgBrowser::_InsertReplayVirtual(ReplayInfo *rep, const DlgFilter* filter)
+// indexed = true if replay was selected with the filter index (rwa, match up, player and map filters are already checked)
+bool DlgBrowser::_InsertReplayVirtual(ReplayInfo *rep, const DlgFilter* filter, bool indexed)
 {
 	// check filter
 	if(filter!=0)
 	{
 		// rwa only?
-		if(filter->m_rwaOnly && !rep->m_isRWA) return false;
+		if(!indexed && filter->m_rwaOnly && !rep->m_isRWA) return false;
 
 		// filter match up
 		int mu = rep->GetMatchup();
-		if(filter->m_muT || filter->m_muZ || filter->m_muP)
+		if(!indexed && (filter->m_muT || filter->m_muZ || filter->m_muP))
 		{
 			if(!filter->m_muT && (mu==ReplayInfo::MU_TvT || mu==ReplayInfo::MU_TvZ || mu==ReplayInfo::MU_PvT)) return false;
 			if(!filter->m_muZ && (mu==ReplayInfo::MU_TvZ || mu==ReplayInfo::MU_PvZ || mu==ReplayInfo::MU_ZvZ)) return false;
@@ -968,7 +1210,7 @@ bool DlgBrowser::_InsertReplayVirtual(ReplayInfo *rep, const DlgFilter* filter)
 		}
 
 		// filter player name
-		if(filter->m_pfilteron)
+		if(!indexed && filter->m_pfilteron)
 		{
 			int found=0;
 			for(int k=0;found<filter->m_filterPlayerCount && k<rep->m_playerCount;k++)
@@ -978,7 +1220,7 @@ bool DlgBrowser::_InsertReplayVirtual(ReplayInfo *rep, const DlgFilter* filter)
 		}
 
 		// filter map name
-		if(filter->m_mapFilterOn)
+		if(!indexed && filter->m_mapFilterOn)
 		{
 			if(!filter->MatchMapName(rep->m_mainMap)) 
 				return false;
@@ -1095,6 +1337,60 @@ bool DlgBrowser::_InsertBOVirtual(BuildOrder *pbo, const DlgFilter *filter)
 
 //--------------------------------------------------------------------------------------------------------------
 
+// select replays matching rwa, match up, player and map filters with bitmaps
+void DlgBrowser::_SelectReplays(const DlgFilter& filter, ReplayBitmap& selected)
+{
+	int i;
+	selected = m_filterIndex.GetAll();
+
+	// rwa only?
+	if(filter.m_rwaOnly) selected.And(m_filterIndex.GetRWA());
+
+	// filter match up
+	if(filter.m_muT || filter.m_muZ || filter.m_muP)
+	{
+		ReplayBitmap mus;
+		for(int mu=0;mu<ReplayFilterIndex::MAXMATCHUPS;mu++)
+		{
+			if(!filter.m_muT && (mu==ReplayInfo::MU_TvT || mu==ReplayInfo::MU_TvZ || mu==ReplayInfo::MU_PvT)) continue;
+			if(!filter.m_muZ && (mu==ReplayInfo::MU_TvZ || mu==ReplayInfo::MU_PvZ || mu==ReplayInfo::MU_ZvZ)) continue;
+			if(!filter.m_muP && (mu==ReplayInfo::MU_PvT || mu==ReplayInfo::MU_PvZ || mu==ReplayInfo::MU_PvP)) continue;
+			if(!filter.m_muXvX && (mu==ReplayInfo::MU_PvP || mu==ReplayInfo::MU_ZvZ || mu==ReplayInfo::MU_TvT)) continue;
+			mus.Or(m_filterIndex.GetMatchup(mu));
+		}
+		selected.And(mus);
+	}
+
+	// filter player name (main names are matched once per name id, not once per replay)
+	if(filter.m_pfilteron)
+	{
+		bool *match = new bool[m_filterIndex.GetNameIdCount()+1];
+		for(i=0;i<m_filterIndex.GetNameIdCount();i++)
+			match[i] = m_filterIndex.HasName(i) && filter.MatchPlayerName(_GetMainName(i,false));
+		ReplayBitmap players;
+		m_filterIndex.SelectPlayers(match,filter.m_filterPlayerCount,players);
+		selected.And(players);
+		delete[]match;
+	}
+
+	// filter map name
+	if(filter.m_mapFilterOn)
+	{
+		bool *match = new bool[m_filterIndex.GetMapIdCount()+1];
+		for(i=0;i<m_filterIndex.GetMapIdCount();i++)
+			match[i] = m_filterIndex.HasMap(i) && filter.MatchMapName(_GetMainName(i,true));
+		ReplayBitmap maps;
+		m_filterIndex.SelectMaps(match,maps);
+		selected.And(maps);
+		delete[]match;
+	}
+
+	// positions are for 1v1 only
+	if(filter.m_posfilteron) selected.And(m_filterIndex.GetPlayerCount(2));
+}
+
+//--------------------------------------------------------------------------------------------------------------
+
 void DlgBrowser::_InsertPlayerVirtual(PlayerInfo *ply, const DlgFilter *filter)
 {
 //	ASSERT(!(strncmp(ply->m_name,"Obi-1",5)==0));
@@ -1162,14 +1458,27 @@ void DlgBrowser::_ClearAll()
 	m_listPlayers.DeleteAllItems();
 	m_listMaps.DeleteAllItems();
 	m_replays.RemoveAll();
+	m_browseIndex.Clear();
+	m_filterIndex.Clear();
+	m_indexedReplays.RemoveAll();
+	m_browseIndexDirty=false;
 	m_players.RemoveAll();
+	m_playerNames.RemoveAll();
 	m_maps.RemoveAll();
+	m_mapNames.RemoveAll();
+	m_aggregatedLists=false;
 	m_allPlayers.RemoveAll();
+	m_allPlayerIds.RemoveAll();
 	m_allMaps.RemoveAll();
+	m_allMapIds.RemoveAll();
 	m_addedReplays=0;
 	m_corrupted.RemoveAll();
 	m_bos.RemoveAll();
 	m_filteredBos.RemoveAll();
+	m_boTrie.Clear();
+	m_boSearch.Clear();
+	m_boSearchReps.RemoveAll();
+	m_boSearchDirty=false;
 }
 
 //-----------------------------------------------------------------------------------------------------------------
@@ -1180,7 +1489,7 @@ void DlgBrowser::ProcessEntry(const char * section, const char *entry, const cha
 	ReplayInfo tmpRep;
 
 	// load replay (reppath,repname,data must be in regular format)
-	CString rdata(BWChartDB::ConverFromHex(data));
+	CString rdata(data);
 	tmpRep.ExtractInfo(section,entry,(char*)(const char*)rdata);
 
 	// add replay
@@ -1190,12 +1499,12 @@ void DlgBrowser::ProcessEntry(const char * section, const char *entry, const cha
 		{
 			CString dir;
 			tmpRep.Dir(dir);
-			if(dir==m_rootdir) 
-				_AddReplay(tmpRep);
+			if(_IsRootDir(dir)) 
+				_AddReplay(tmpRep,false);
 		}
 		else
 		{
-			_AddReplay(tmpRep);
+			_AddReplay(tmpRep,false);
 		}
 	}
 
@@ -1216,6 +1525,7 @@ void DlgBrowser::Load()
 	// load entries from replay database
 	DWORD now = GetTickCount();
 	LoadFile(BWChartDB::FILE_MAIN);
+	_LoadAggregatedLists();
 	now = GetTickCount() - now;
 	//CString debug;
 	//debug.Format("%lu\r\n",now);
@@ -1299,13 +1609,20 @@ void DlgBrowser::Refresh(bool bMsg)
 	// clear all
 	_ClearAll();
 
-	// count available replays
-	int count=0;
-	int idx=0;
-	_BrowseReplays(m_rootdir, count, idx, true);
+	// previous scan of the library
+	CString manifestFile;
+	BWChartDB::GetDatabaseFileName(manifestFile, BWChartDB::FILE_MANIFEST);
+	ScanManifest previous;
+	ScanManifest current;
+	previous.Load(manifestFile);
 
-	// load them
-	_BrowseReplays(m_rootdir, count, idx, false);
+	// scan replays (aggregates are written once at the end)
+	int idx=0;
+	ManifestStat rootStat;
+	BWChartDB::BeginUpdate();
+	if(ScanManifest::Stat(m_rootdir,rootStat,false)) _ScanReplays(m_rootdir,rootStat,previous,current,idx);
+	BWChartDB::EndUpdate();
+	current.Save(manifestFile);
 
 	// display players & maps
 	_DisplayList();
@@ -1369,46 +1686,27 @@ ReplayInfo* DlgBrowser::_FindReplay(const char *path) const
 
 PlayerInfo* DlgBrowser::_FindPlayer(const char *name) const
 {
-	for(int i=0; i<m_players.GetSize(); i++)
-	{
-		PlayerInfo *rep = (PlayerInfo *)m_players.GetAt(i);
-		if(rep->m_name.CompareNoCase(name)==0) 
-			return rep;
-	}
-	return 0;
-}
-
-bool DlgBrowser::_FindAllPlayer(const char *name) const
-{
-	for(int i=0; i<m_allPlayers.GetSize(); i++)
-	{
-		CString ply = (CString)m_allPlayers.GetAt(i);
-		if(ply.CompareNoCase(name)==0) 
-			return true;
-	}
-	return false;
+	CString key(name);
+	key.MakeLower();
+	void *pl;
+	return m_playerNames.Lookup(key,pl) ? (PlayerInfo *)pl : 0;
 }
 
 MapInfo* DlgBrowser::_FindMap(const char *name)	const
 {
-	for(int i=0; i<m_maps.GetSize(); i++)
-	{
-		MapInfo *rep = (MapInfo *)m_maps.GetAt(i);
-		if(rep->m_name.CompareNoCase(name)==0) 
-			return rep;
-	}
-	return 0;
+	CString key(name);
+	key.MakeLower();
+	void *map;
+	return m_mapNames.Lookup(key,map) ? (MapInfo *)map : 0;
 }
 
-bool DlgBrowser::_FindAllMap(const char *name) const
+// mark name id as known, false if it was already
+bool DlgBrowser::_MarkName(CByteArray& known, int id)
 {
-	for(int i=0; i<m_allMaps.GetSize(); i++)
-	{
-		CString map = (CString)m_allMaps.GetAt(i);
-		if(map.CompareNoCase(name)==0) 
-			return true;
-	}
-	return false;
+	if(id>=known.GetSize()) known.SetSize(id+1,1024);
+	if(known[id]!=0) return false;
+	known[id]=1;
+	return true;
 }
 
 //------------------------------------------------------------------------------------
@@ -1435,6 +1733,10 @@ int CALLBACK CompareBuildOrder(LPARAM lParam1, LPARAM lParam2, LPARAM lParamSort
 		case 2:
 			diff = _stricmp(bo1->m_desc,bo2->m_desc);
 			break;
+		// continuations
+		case 3:
+			diff = _stricmp(bo1->m_next,bo2->m_next);
+			break;
 	}
 
 	return gbAscendingBo ? diff : -diff;
@@ -1555,8 +1857,6 @@ bool gbAscending=false;
 int CALLBACK CompareReplay(LPARAM lParam1, LPARAM lParam2, LPARAM lParamSort)
 {
 	int diff=0;
-	CString str1;
-	CString str2;
 	ReplayInfo *rep1 = (ReplayInfo *)lParam1;
 	ReplayInfo *rep2 = (ReplayInfo *)lParam2;
 
@@ -1604,7 +1904,7 @@ int CALLBACK CompareReplay(LPARAM lParam1, LPARAM lParam2, LPARAM lParamSort)
 			break;
 		// game date
 		case 9 :
-			diff = strcmp(rep1->DateForCompare(str1),rep2->DateForCompare(str2));
+			diff = rep1->DateKey() - rep2->DateKey();
 			break;
 		// engine
 		case 10 :
@@ -1627,7 +1927,7 @@ int CALLBACK CompareReplay(LPARAM lParam1, LPARAM lParam2, LPARAM lParamSort)
 			break;
 		// file date
 		case 13 :
-			diff = strcmp(rep1->FileDate(str1),rep2->FileDate(str2));
+			diff = rep1->FileDateKey() - rep2->FileDateKey();
 			break;
 		// player 1 starting location
 		case 14:
@@ -1651,13 +1951,6 @@ int CALLBACK CompareReplay(LPARAM lParam1, LPARAM lParam2, LPARAM lParamSort)
 
 //------------------------------------------------------------------------------------
 
-static LPARAM lParamSort=0;
-
-int QCompareReplay( const void *arg1, const void *arg2 )
-{
-	return CompareReplay((LPARAM)*(CObject**)arg1, (LPARAM)*(CObject**)arg2, lParamSort);
-}
-
 // sort list
 void DlgBrowser::_SortReplay(int item, bool reverse)
 {
@@ -1674,11 +1967,22 @@ void DlgBrowser::_SortReplay(int item, bool reverse)
 		if(item>=0) m_currentSortIdx = item;
 	}
 
-	// sort items
-	gbAscending = !m_Descending[m_currentSortIdx];
-	//m_reps.SortItems(CompareReplay,m_currentSortIdx);
-	lParamSort = m_currentSortIdx;
-	qsort(m_filterReplays.GetData(),	m_filterReplays.GetSize(), sizeof(CObject*),QCompareReplay);
+	// sort rows of filtered replays on precomputed keys
+	if(m_browseIndexDirty) _BuildBrowseIndex();
+	int count = m_filterReplays.GetSize();
+	if(count<2) return;
+	int *rows = new int[count];
+	ReplayInfo **reps = new ReplayInfo*[m_browseIndex.GetRowCount()];
+	for(int i=0;i<count;i++)
+	{
+		ReplayInfo *rep = (ReplayInfo *)m_filterReplays.GetAt(i);
+		rows[i] = rep->m_row;
+		reps[rep->m_row] = rep;
+	}
+	m_browseIndex.Sort(m_currentSortIdx,!m_Descending[m_currentSortIdx],rows,count);
+	for(int i=0;i<count;i++) m_filterReplays.SetAt(i,reps[rows[i]]);
+	delete[]reps;
+	delete[]rows;
 }
 
 //------------------------------------------------------------------------------------
@@ -1991,6 +2295,7 @@ void DlgBrowser::OnEditcomment()
 	{
 		// save replay in database
 		m_selectedReplay->Save(BWChartDB::FILE_MAIN);
+		_IndexReplay(m_selectedReplay);
 		// update also favorites database
 		//???????????
 		// update list
@@ -2703,23 +3008,33 @@ void DlgBrowser::_DisplayList(bool rebuildBos)
 	DlgFilter filter;
 	_BuildFilter(filter);
 
-	// display reps
-	for(int i=0; i<m_replays.GetSize(); i++)
+	// display reps: select them with bitmaps, then check remaining filters on each of them
+	if(m_browseIndexDirty) _BuildBrowseIndex();
+	ReplayBitmap selected;
+	_SelectReplays(filter, selected);
+	int count = selected.GetCardinality();
+	unsigned int *rows = new unsigned int[count+1];
+	selected.ToArray(rows);
+	m_filterReplays.SetSize(0,count);
+	for(int i=0; i<count; i++)
 	{
-		ReplayInfo *rep=(ReplayInfo *)m_replays.GetAt(i);
-		if(_InsertReplayVirtual(rep, &filter))
+		ReplayInfo *rep=(ReplayInfo *)m_indexedReplays.GetAt(rows[i]);
+		if(_InsertReplayVirtual(rep, &filter, true))
 		  	m_filterReplays.Add(rep);
 	}
+	delete[]rows;
 	m_reps.SetItemCountEx(m_filterReplays.GetSize(), LVSICF_NOSCROLL|LVSICF_NOINVALIDATEALL);
 
 	// display players
 	for(int i=0; i<m_players.GetSize(); i++)
-		_InsertPlayerVirtual((PlayerInfo *)m_players.GetAt(i), &filter);
+		if(((PlayerInfo *)m_players.GetAt(i))->m_games>0)
+			_InsertPlayerVirtual((PlayerInfo *)m_players.GetAt(i), &filter);
 	m_listPlayers.SetItemCountEx(m_filterPlayers.GetSize(), LVSICF_NOSCROLL|LVSICF_NOINVALIDATEALL);
 
 	// display maps
 	for(int i=0; i<m_maps.GetSize(); i++)
-		_InsertMap((MapInfo *)m_maps.GetAt(i), i);
+		if(((MapInfo *)m_maps.GetAt(i))->m_games>0)
+			_InsertMap((MapInfo *)m_maps.GetAt(i), i);
 
 	// build tree of unique build orders (with counting)
 	if(rebuildBos)
@@ -2736,7 +3051,7 @@ void DlgBrowser::_DisplayList(bool rebuildBos)
 
 //--------------------------------------------------------------------------------------------------------------
 
-// IBOLister implementation
+// add a build order to the list
 void DlgBrowser::AddBO(BONodeList* bo, int count)
 {
 	BuildOrder *pbo = new BuildOrder(0,0);
@@ -2748,6 +3063,146 @@ void DlgBrowser::AddBO(BONodeList* bo, int count)
 
 //--------------------------------------------------------------------------------------------------------------
 
+// BOTrie lister
+void DlgBrowser::_ListTrieBO(void *context, const unsigned short *nodes, int length, int count)
+{
+	DlgBrowser *dlg = (DlgBrowser *)context;
+
+	BONodeList bo;
+	for(int i=0; i<length; i++) bo.AddNode(new BONode(nodes[i]&0xFF,nodes[i]>>8));
+	dlg->AddBO(&bo,count);
+
+	BuildOrder *pbo = (BuildOrder *)dlg->m_filteredBos.GetAt(dlg->m_filteredBos.GetSize()-1);
+	dlg->_DescribeContinuations(nodes,length,pbo->m_next);
+}
+
+//--------------------------------------------------------------------------------------------------------------
+
+// most common next objects after a build order, with their frequency and average time
+void DlgBrowser::_DescribeContinuations(const unsigned short *nodes, int length, CString& desc) const
+{
+	desc="";
+	int total = m_boTrie.GetPrefixCount(nodes,length,BOTrie::ALLMATCHUPS);
+	BOContinuation conts[4];
+	int count = m_boTrie.GetContinuations(nodes,length,BOTrie::ALLMATCHUPS,conts,4);
+	for(int i=0, shown=0; i<count && shown<3; i++)
+	{
+		if(conts[i].m_node==BOTrie::END) continue;
+
+		CString name, str;
+		BONode node(0,conts[i].m_node&0xFF,conts[i].m_node>>8);
+		node.ToString(name,true);
+		if(conts[i].m_time>=0)
+			str.Format("%s %d%% %d:%02d",(const char*)name,100*conts[i].m_count/total,conts[i].m_time/60,conts[i].m_time%60);
+		else
+			str.Format("%s %d%%",(const char*)name,100*conts[i].m_count/total);
+		if(!desc.IsEmpty()) desc+=", ";
+		desc+=str;
+		shown++;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+
+// node codes of a build order string (4 hex digits per node)
+int DlgBrowser::_ParseBO(const CString& bo, unsigned short *nodes, int maxNodes)
+{
+	int count = bo.GetLength()/4;
+	if(count>maxNodes) count=maxNodes;
+	const char *str = bo;
+	for(int i=0; i<count; i++)
+	{
+		char hex[5];
+		memcpy(hex,str+4*i,4);
+		hex[4]=0;
+		nodes[i] = (unsigned short)strtoul(hex,0,16);
+	}
+	return count;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+
+// index build orders of all replays (key is the replay index)
+void DlgBrowser::_BuildBOSearch()
+{
+	m_boSearch.Clear();
+	m_boSearchReps.RemoveAll();
+	m_boSearchReps.SetSize(0,m_replays.GetSize());
+	unsigned short nodes[BOSearchIndex::MAXLENGTH];
+	unsigned short times[BOSearchIndex::MAXLENGTH];
+	for(int i=0; i<m_replays.GetSize(); i++)
+	{
+		ReplayInfo *rep = (ReplayInfo *)m_replays.GetAt(i);
+		int key = m_boSearchReps.Add(rep);
+		for(int k=0; k<rep->m_playerCount; k++)
+		{
+			int count = _ParseBO(rep->m_bo[k],nodes,BOSearchIndex::MAXLENGTH);
+			if(count==0) continue;
+			bool timed = rep->m_boTimes[k].GetLength()==rep->m_bo[k].GetLength();
+			if(timed) _ParseBO(rep->m_boTimes[k],times,BOSearchIndex::MAXLENGTH);
+			m_boSearch.Add(key,nodes,timed ? times : 0,count);
+		}
+	}
+	m_boSearchDirty=false;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+
+static int _CompareMatch(const void *match1, const void *match2)
+{
+	const BOMatch *m1 = (const BOMatch *)match1;
+	const BOMatch *m2 = (const BOMatch *)match2;
+	if(m1->m_distance!=m2->m_distance) return m1->m_distance<m2->m_distance ? -1 : 1;
+	if(m1->m_timeGap!=m2->m_timeGap) return m1->m_timeGap<m2->m_timeGap ? -1 : 1;
+	return m1->m_key-m2->m_key;
+}
+
+// list the replays with the closest openings to the selected replay
+void DlgBrowser::OnFindSimilar()
+{
+	if(m_selectedReplay==0) return;
+	CWaitCursor wait;
+	if(m_boSearchDirty) _BuildBOSearch();
+
+	// search with the build order of every player of the selected replay
+	ReplayInfo *selected = m_selectedReplay;
+	int exclude=-1;
+	for(int i=0; i<m_boSearchReps.GetSize(); i++)
+		if(m_boSearchReps.GetAt(i)==selected) {exclude=i; break;}
+	BOMatch matches[ReplayInfo::MAXPLAYER*MAXSIMILAR];
+	int matchCount=0;
+	unsigned short nodes[BOSearchIndex::MAXLENGTH];
+	unsigned short times[BOSearchIndex::MAXLENGTH];
+	for(int k=0; k<selected->m_playerCount; k++)
+	{
+		int count = _ParseBO(selected->m_bo[k],nodes,BOSearchIndex::MAXLENGTH);
+		if(count==0) continue;
+		bool timed = selected->m_boTimes[k].GetLength()==selected->m_bo[k].GetLength();
+		if(timed) _ParseBO(selected->m_boTimes[k],times,BOSearchIndex::MAXLENGTH);
+		matchCount += m_boSearch.Search(nodes,timed ? times : 0,count,exclude,matches+matchCount,MAXSIMILAR);
+	}
+
+	// closest first, one row per replay (the selected replay is shown first)
+	qsort(matches,matchCount,sizeof(BOMatch),_CompareMatch);
+	CByteArray listed;
+	listed.SetSize(m_boSearchReps.GetSize());
+	m_reps.DeleteAllItems();
+	m_filterReplays.RemoveAll();
+	m_filterReplays.Add(selected);
+	for(int i=0; i<matchCount && m_filterReplays.GetSize()<=MAXSIMILAR; i++)
+	{
+		if(listed[matches[i].m_key]) continue;
+		listed[matches[i].m_key]=1;
+		m_filterReplays.Add((ReplayInfo *)m_boSearchReps.GetAt(matches[i].m_key));
+	}
+	m_reps.SetItemCountEx(m_filterReplays.GetSize(), LVSICF_NOSCROLL|LVSICF_NOINVALIDATEALL);
+
+	m_replayCount.Format("Closest openings: %d replays",m_filterReplays.GetSize()-1);
+	UpdateData(FALSE);
+}
+
+//--------------------------------------------------------------------------------------------------------------
+
 void DlgBrowser::OnToggleFilter() 
 {
 	// filter activated or deactivated, update lists
@@ -2909,6 +3364,11 @@ void DlgBrowser::OnGetdispinfoReps(NMHDR* pNMHDR, LRESULT* pResult)
 			strcpy(pItem->pszText,apm);
 			break;
 
+		case COL_ACTIVITY:
+			// player curves (see OnCustomdrawReps)
+			pItem->pszText[0]=0;
+			break;
+
 		default:
 				assert(0);
 				break;
@@ -2924,6 +3384,68 @@ void DlgBrowser::OnGetdispinfoReps(NMHDR* pNMHDR, LRESULT* pResult)
 
 //--------------------------------------------------------------------------------------------------------------
 
+// draw activity column from the stored player curves
+void DlgBrowser::OnCustomdrawReps(NMHDR* pNMHDR, LRESULT* pResult) 
+{
+	NMLVCUSTOMDRAW* pCD = (NMLVCUSTOMDRAW*)pNMHDR;
+	*pResult = CDRF_DODEFAULT;
+	switch(pCD->nmcd.dwDrawStage)
+	{
+	case CDDS_PREPAINT:
+		*pResult = CDRF_NOTIFYITEMDRAW;
+		break;
+	case CDDS_ITEMPREPAINT:
+		*pResult = CDRF_NOTIFYSUBITEMDRAW;
+		break;
+	case CDDS_ITEMPREPAINT|CDDS_SUBITEM:
+		{
+		int nItem = (int)pCD->nmcd.dwItemSpec;
+		if(pCD->iSubItem!=COL_ACTIVITY || nItem>=m_filterReplays.GetSize()) break;
+		ReplayInfo *rep = (ReplayInfo *)m_filterReplays.GetAt(nItem);
+		CRect rect;
+		m_reps.GetSubItemRect(nItem,COL_ACTIVITY,LVIR_BOUNDS,rect);
+		CDC *pDC = CDC::FromHandle(pCD->nmcd.hdc);
+		bool selected = (m_reps.GetItemState(nItem,LVIS_SELECTED)&LVIS_SELECTED)!=0;
+		pDC->FillSolidRect(&rect,selected ? ::GetSysColor(COLOR_HIGHLIGHT) : m_reps.GetBkColor());
+		_PaintSparklines(pDC,rect,rep,ReplaySparkline::S_APM);
+		*pResult = CDRF_SKIPDEFAULT;
+		}
+		break;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+
+// one curve per player, on the same scale
+void DlgBrowser::_PaintSparklines(CDC *pDC, const CRect& rect, const ReplayInfo *rep, int serie) const
+{
+	unsigned long maxval=0;
+	for(int k=0;k<rep->m_playerCount && rep->GetSparkline(k)!=0;k++)
+		maxval = max(maxval,(unsigned long)rep->GetSparkline(k)->GetMax(serie));
+	if(maxval==0 || rect.Width()<8 || rect.Height()<8) return;
+
+	int clr = serie==ReplaySparkline::S_APM ? ReplayResource::CLR_APM : 
+		serie==ReplaySparkline::S_SUPPLY ? ReplayResource::CLR_SUPPLY : ReplayResource::CLR_UNITS;
+	CRect area(rect);
+	area.DeflateRect(2,2);
+	CPoint points[ReplaySparkline::POINTS];
+	for(int k=0;k<rep->m_playerCount && rep->GetSparkline(k)!=0;k++)
+	{
+		const ReplaySparkline *spark = rep->GetSparkline(k);
+		for(int i=0;i<ReplaySparkline::POINTS;i++)
+		{
+			points[i].x = area.left + i*(area.Width()-1)/(ReplaySparkline::POINTS-1);
+			points[i].y = area.bottom-1 - (int)(spark->GetValue(serie,i)*(area.Height()-1)/maxval);
+		}
+		CPen pen(PS_SOLID,1,ReplayResource::GetColor(clr,k,rep->m_playerCount));
+		CPen *oldPen = pDC->SelectObject(&pen);
+		pDC->Polyline(points,ReplaySparkline::POINTS);
+		pDC->SelectObject(oldPen);
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+
 void DlgBrowser::OnOpenDirectory()
 {
 	if(m_selectedReplay!=0)
@@ -3021,11 +3543,13 @@ void DlgBrowser::OnMoveToBin()
 	_MemorizeSelection(selection);
 
 	// move all selected replays to bin
+	BWChartDB::BeginUpdate();
 	for(int i=0;i<selection.GetSize();i++)
 	{
 		m_selectedReplay = (ReplayInfo*)selection.GetAt(i);
 		_MoveReplayToBin();
 	}
+	BWChartDB::EndUpdate();
 
 	// update list
 	_DisplayList();
@@ -3047,11 +3571,13 @@ void DlgBrowser::OnMoveToFolder()
 	_MemorizeSelection(selection);
 
 	// move all selected replays to other folder
+	BWChartDB::BeginUpdate();
 	for(int i=0;i<selection.GetSize();i++)
 	{
 		m_selectedReplay = (ReplayInfo*)selection.GetAt(i);
 		_MoveReplayToFolder(m_lastFolder);
 	}
+	BWChartDB::EndUpdate();
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -3061,7 +3587,10 @@ void DlgBrowser::OnRenameReplays()
 	m_noRepaint=true;
 	DlgRename dlg(&m_reps,&m_filterReplays,this);
 	if(dlg.DoModal()==IDOK)
+	{
+		m_browseIndexDirty=true;
 		_DisplayList();
+	}
 	m_noRepaint=false;
 	m_reps.Invalidate();
 }
@@ -3130,6 +3659,7 @@ void DlgBrowser::_MoveReplayToFolder(const char *folder)
 		UtilDir::AddFileName(newpath,folder,m_selectedReplay->Name());
 		m_selectedReplay->m_path = newpath;
 		m_selectedReplay->Save(BWChartDB::FILE_MAIN);
+		_IndexReplay(m_selectedReplay);
 	}
 }
 
@@ -3274,6 +3804,10 @@ void DlgBrowser::OnGetdispinfoListBos(NMHDR* pNMHDR, LRESULT* pResult)
 			// content
 			strcat(pItem->pszText,pbo->m_desc);
 			break;
+		case 3:
+			// continuations
+			strcat(pItem->pszText,pbo->m_next);
+			break;
 		}
 	}
 
@@ -3327,6 +3861,7 @@ void DlgBrowser::_RemoveReplay(ReplayInfo *rep)
 	// remove replay from database
 	CString str;
 	BWChartDB::Delete(BWChartDB::FILE_MAIN,rep->Dir(str),rep->Name());
+	_AggregateReplay(rep,-1);
 
 	//remove replay from memory
 	for(int i=0;i<m_replays.GetSize();i++)
@@ -3335,6 +3870,8 @@ void DlgBrowser::_RemoveReplay(ReplayInfo *rep)
 		if(rep==replay)
 			{m_replays.RemoveAt(i); delete rep; break;}
 	}
+	m_browseIndexDirty=true;
+	m_boSearchDirty=true;
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -3380,6 +3917,7 @@ void DlgBrowser::OnCleanmissing()
 
 	// for each replay
 	int removed=0;
+	BWChartDB::BeginUpdate();
 	for(int i=0; i<m_replays.GetSize();)
 	{
 		// update progress bar
@@ -3400,6 +3938,7 @@ void DlgBrowser::OnCleanmissing()
 			// remove replay from database
 			CString str;
 			BWChartDB::Delete(BWChartDB::FILE_MAIN,rep->Dir(str),rep->Name());
+			_AggregateReplay(rep,-1);
 
 			//remove play from memory
 			m_replays.RemoveAt(i); 
@@ -3409,6 +3948,8 @@ void DlgBrowser::OnCleanmissing()
 		else
 			i++;
 	}
+	BWChartDB::EndUpdate();
+	if(removed>0) m_browseIndexDirty=m_boSearchDirty=true;
 
 	//hide progress bar
 	m_progress.ShowWindow(SW_HIDE);
@@ -3431,6 +3972,7 @@ void DlgBrowser::_BuildBOFile()
 
 	// for each replay
 	int removed=0;
+	BWChartDB::BeginUpdate();
 	for(int i=0; i<m_replays.GetSize();)
 	{
 		// update progress bar
@@ -3451,6 +3993,7 @@ void DlgBrowser::_BuildBOFile()
 			// remove replay from database
 			CString str;
 			BWChartDB::Delete(BWChartDB::FILE_MAIN,rep->Dir(str),rep->Name());
+			_AggregateReplay(rep,-1);
 
 			//remove play from memory
 			m_replays.RemoveAt(i); 
@@ -3462,8 +4005,9 @@ void DlgBrowser::_BuildBOFile()
 			// update replay's BOs
 			if(_LoadReplay(rep->m_path,rep->m_filedate,*rep))
 			{
-				// save in buildorder.txt
+				// save in buildorder.txt (and curves)
 				rep->SaveBO();
+				rep->SaveSparklines();
 
 				// for each player in the replay
 				for(int k=0; k<rep->m_playerCount; k++)
@@ -3476,7 +4020,10 @@ void DlgBrowser::_BuildBOFile()
 			i++;
 		}
 	}
+	BWChartDB::EndUpdate();
 
+	// replays were reloaded or removed
+	m_browseIndexDirty=m_boSearchDirty=true;
 	MAINWND->SetHasBOFile();
 }
 
@@ -3486,11 +4033,11 @@ void DlgBrowser::_BuildBOFile()
 int DlgBrowser::_GetBOOptions() const
 {
 	int boOptions=0;
-	if(m_boBuilding) boOptions|=BOTree::BUILDING;
-	if(m_boUnit) boOptions|=BOTree::UNIT;
-	if(m_boResearch) boOptions|=BOTree::RESEARCH;
-	if(m_boUpgrade) boOptions|=BOTree::UPGRADE;
-	if(m_boSupply) boOptions|=BOTree::DEPOTS;
+	if(m_boBuilding) boOptions|=BONodeList::BUILDING;
+	if(m_boUnit) boOptions|=BONodeList::UNIT;
+	if(m_boResearch) boOptions|=BONodeList::RESEARCH;
+	if(m_boUpgrade) boOptions|=BONodeList::UPGRADE;
+	if(m_boSupply) boOptions|=BONodeList::DEPOTS;
 	return boOptions;
 }
 
@@ -3508,18 +4055,53 @@ void DlgBrowser::_UpdateBuildOrder()
 	m_filteredBos.RemoveAll();
 	m_listBos.DeleteAllItems();
 
-	// build tree of unique build orders (with counting)
-	BOTree tree;
+	// build orders matching the filter
+	CPtrArray matching;
+	int nodeCount=0;
 	for(int i=0; i<m_bos.GetSize(); i++)
 	{
 		BuildOrder *pbo=(BuildOrder *)m_bos.GetAt(i);
 		if(_InsertBOVirtual(pbo, &filter))
-			tree.AddBO(pbo->m_bo,_GetBOOptions(),m_boMaxObj);
+		{
+			matching.Add(pbo);
+			nodeCount+=pbo->m_bo.GetCount();
+		}
+	}
+
+	// their nodes (without excluded ones) and node times
+	int options = _GetBOOptions();
+	CWordArray nodes, times;
+	nodes.SetSize(nodeCount);
+	times.SetSize(nodeCount);
+	BOTrieEntry *entries = new BOTrieEntry[matching.GetSize()+1];
+	for(int i=0, n=0; i<matching.GetSize(); i++)
+	{
+		BuildOrder *pbo=(BuildOrder *)matching.GetAt(i);
+		const CString& strtimes = pbo->m_rep->m_boTimes[pbo->m_player];
+		bool timed = strtimes.GetLength()==4*pbo->m_bo.GetCount();
+		BOTrieEntry& entry = entries[i];
+		entry.m_nodes = nodes.GetData()+n;
+		entry.m_times = timed ? times.GetData()+n : 0;
+		entry.m_length = 0;
+		entry.m_matchup = pbo->m_rep->GetMatchup();
+		for(int j=0; j<pbo->m_bo.GetCount(); j++)
+		{
+			BONode *node = pbo->m_bo.GetNode(j);
+			if(node->Exclude(options)) continue;
+			nodes[n] = node->GetADN();
+			times[n] = timed ? (WORD)strtoul(strtimes.Mid(4*j,4),0,16) : 0;
+			entry.m_length++;
+			n++;
+		}
 	}
 
-	// display build orders
+	// build trie of build orders (with counting)
+	m_boTrie.Build(entries,matching.GetSize());
+	delete []entries;
+
+	// display unique build orders (cut after max number of objects)
 	m_filteredBos.RemoveAll();
-	tree.ListUniqueBos(this);
+	m_boTrie.List(_ListTrieBO,this,BOTrie::ALLMATCHUPS,m_boMaxObj>0 ? m_boMaxObj : -1);
 	m_listBos.SetItemCountEx(m_filteredBos.GetSize(), LVSICF_NOSCROLL|LVSICF_NOINVALIDATEALL);
 
 	// compute total
@@ -11,6 +11,11 @@
 #include "replay.h"
 #include "replaydb.h"
 #include "botree.h"
+#include "botrie.h"
+#include "bosearch.h"
+#include "scanmanifest.h"
+#include "browseindex.h"
+#include "replaybitmap.h"
 #include "xlistctrl.h"
 
 // bw supposed version
@@ -118,11 +123,12 @@ public:
 	int m_count;
 	int m_percent;
 	CString m_desc;
+	CString m_next; // most common continuations
 };
 
 //------------------------------------------------------------
 
-class DlgBrowser : public CDialog, public BWChartDB, public IBOLister
+class DlgBrowser : public CDialog, public BWChartDB
 {
 // Construction
 public:
@@ -185,12 +191,13 @@ public:
 	
 	void ProcessEntry(const char * section, const char *entry, const char *data, int percentage);
 	ReplayInfo * _ProcessReplay(const char *dir, CFileFind& finder);
+	ReplayInfo * _ProcessReplay(const char *dir, const char *name, bool reparse);
 
 	// add replay in database (returns true if replay could be loaded)
 	bool AddReplay(const char *reppath, bool msg, bool display);
 
-	// IBOLister implementation
-	virtual void AddBO(BONodeList* bo, int count);
+	// add a build order to the list
+	void AddBO(BONodeList* bo, int count);
 
 // Overrides
 	// ClassWizard generated virtual function overrides
@@ -243,20 +250,39 @@ protected:
 	XObArray m_replays;
 	// filtered replays
 	CObArray m_filterReplays;
+	// sort keys and filter bitmaps of replays (rebuilt when dirty)
+	BrowseIndex m_browseIndex;
+	ReplayFilterIndex m_filterIndex;
+	CPtrArray m_indexedReplays; // replay of each row
+	bool m_browseIndexDirty;
 	// players (only one per aka)
 	XObArray m_players;
+	CMapStringToPtr m_playerNames; // lower case name -> PlayerInfo
 	// filtered players
 	CObArray m_filterPlayers;
 	// maps
 	XObArray m_maps;
+	CMapStringToPtr m_mapNames; // lower case name -> MapInfo
+	// players and maps come from the database aggregates (replays were loaded from database)
+	bool m_aggregatedLists;
 	// all players (with the original name they had in the replay)
 	mutable CStringArray m_allPlayers;
+	mutable CByteArray m_allPlayerIds; // name ids in m_allPlayers
 	// all maps
 	CStringArray m_allMaps;
+	CByteArray m_allMapIds; // name ids in m_allMaps
+	// clarified name of every map name id (empty if not computed yet)
+	CStringArray m_clarifiedMaps;
 	// all build orders
 	XObArray m_bos;
 	// filtered build orders
 	XObArray m_filteredBos;
+	// trie of filtered build orders (not cut)
+	BOTrie m_boTrie;
+	// build orders of all replays, to find similar openings (rebuilt when dirty)
+	BOSearchIndex m_boSearch;
+	CPtrArray m_boSearchReps; // replay of each key
+	bool m_boSearchDirty;
 
 	bool _LoadReplay(const char *path, const CTime& creationDate, ReplayInfo& tmpRep);
 	void _BuildFilter(DlgFilter& filter);
@@ -271,9 +297,8 @@ protected:
 	void _ClearAll();
 	ReplayInfo* _FindReplay(const char *path) const;
 	PlayerInfo* _FindPlayer(const char *name) const;
-	bool _FindAllPlayer(const char *name) const;
 	MapInfo* _FindMap(const char *name) const;
-	bool _FindAllMap(const char *name) const;
+	static bool _MarkName(CByteArray& known, int id);
 	void _MoveReplayToBin();
 	void _MoveReplayToFolder(const char *folder);
 	void _MemorizeSelection(CObArray& selection);
@@ -281,28 +306,50 @@ protected:
 
 	// build order options filter
 	int _GetBOOptions() const;
+	// list a build order of the trie
+	static void _ListTrieBO(void *context, const unsigned short *nodes, int length, int count);
+	// describe the most common continuations of a build order
+	void _DescribeContinuations(const unsigned short *nodes, int length, CString& desc) const;
+	// index build orders of all replays
+	void _BuildBOSearch();
+	// node codes of a build order string, returns number of nodes
+	static int _ParseBO(const CString& bo, unsigned short *nodes, int maxNodes);
+	// draw player curves of a replay
+	void _PaintSparklines(CDC *pDC, const CRect& rect, const ReplayInfo *rep, int serie) const;
 
 	// update player data
-	void _AddPlayer(const char *pname, ReplayInfo *rep, int k);
+	void _AddPlayer(const char *pname, const AggregateStats& stats, int sign);
 	// update map data
-	void _AddMap(const char *pname, ReplayInfo *rep, int k);
+	void _AddMap(const char *pname, const AggregateStats& stats, int sign);
+	// add (sign=1) or remove (sign=-1) replay from players and maps data
+	void _AggregateReplay(ReplayInfo *rep, int sign);
+	// build players and maps from the database aggregates
+	void _LoadAggregatedLists();
+	bool _IsRootDir(const char *dir) const;
 	// add build order
 	void _AddBuildOrder(const CString& bo, ReplayInfo *rep, int pidx);
 
 	void _Resize();
-	void _BrowseReplays(const char *dir, int& count, int &idx, bool bCount);
+	void _ScanReplays(const char *dir, const ManifestStat& dirStat, const ScanManifest& previous, ScanManifest& current, int &idx);
+	void _MoveReplayEntries(const char *oldDir, const char *oldName, const char *dir, const char *name);
 	void _InsertPlayerVirtual(PlayerInfo *rep, const DlgFilter *filter=0);
 	void _InsertMap(MapInfo *map, int idx);
 	bool _InsertBOVirtual(BuildOrder *pbo, const DlgFilter *filter);
 		 
-	ReplayInfo * _AddReplay(const ReplayInfo& tmpRep);
+	ReplayInfo * _AddReplay(const ReplayInfo& tmpRep, bool aggregate=true);
+	void _ResolveNames(ReplayInfo *rep);
+	const CString& _GetMainName(int id, bool map);
+	static const char *_GetSortName(void *context, int col, int id);
+	void _IndexReplay(ReplayInfo *rep);
+	void _BuildBrowseIndex();
 	void _UpdateCounter();
 	void _SelectedItem(int nItem);
 	void _SelectedPlayer(int nItem);
 	HWND _StartBW(ReplayInfo* selectedReplay, int version, CString& exe) ;
 	void _GetStarcraftPath(CString& path) ;
 	void _UpdateReplayVersion(ReplayInfo* selectedReplay, int version);
-	bool _InsertReplayVirtual(ReplayInfo *rep, const DlgFilter* filter=0);
+	bool _InsertReplayVirtual(ReplayInfo *rep, const DlgFilter* filter=0, bool indexed=false);
+	void _SelectReplays(const DlgFilter& filter, ReplayBitmap& selected);
 	HWND _WaitForProcess(const char *wndclassname, int timeoutS);
 
 	// remove replay from filtered list of replays
@@ -349,6 +396,7 @@ protected:
 	afx_msg void OnChangeFplayer();
 	afx_msg void OnTimer(UINT nIDEvent);
 	afx_msg void OnGetdispinfoReps(NMHDR* pNMHDR, LRESULT* pResult);
+	afx_msg void OnCustomdrawReps(NMHDR* pNMHDR, LRESULT* pResult);
 	afx_msg void OnItemchangedListplayers(NMHDR* pNMHDR, LRESULT* pResult);
 	afx_msg void OnRclickListplayers(NMHDR* pNMHDR, LRESULT* pResult);
 	afx_msg void OnMatchup();
@@ -367,6 +415,7 @@ protected:
 	afx_msg void OnAddReplayEvents();
 	afx_msg void OnAddToFavorites();
 	afx_msg void OnUpdateAkas();
+	afx_msg void OnFindSimilar();
 	afx_msg void OnOpenDirectory();
 	afx_msg void OnListReplays();
 	afx_msg void OnMoveToBin();
@@ -83,7 +83,7 @@ void DlgFavorites::ProcessEntry(const char * section, const char *entry, const c
 	ReplayInfo *rep = new ReplayInfo;
 
 	// load replay (reppath,repname,data must be in regular format)
-	CString rdata(BWChartDB::ConverFromHex(data));
+	CString rdata(data);
 	rep->ExtractInfo(section,entry,(char*)(const char*)rdata);
 
 	// trim player name
@@ -140,7 +140,7 @@ void DlgMap::ResetTime(unsigned long time)
 {
 	if(m_replay!=0 && m_replay->GetMapAnim()!=0)
 	{
-		m_replay->GetMapAnim()->Start();
+		m_replay->GetMapAnim()->Seek(time);
 		UpdateTime(time);
 	}
 }
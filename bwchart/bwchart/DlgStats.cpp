@@ -197,6 +197,7 @@ void DlgStats::_Parameters(bool bLoad)
 	PINT("main",seeHotPoints,TRUE);
 	PINT("main",seePercent,TRUE);
 	PINT("main",animationSpeed,2);
+	PINT("main",coverageSide,MAPCOVERAGE_SIDE);
 	PINT("main",hlist,120);
 	PINT("main",wlist,0);
 	PINT("main",viewHKselect,FALSE);
@@ -562,6 +563,8 @@ DlgStats::DlgStats(CWnd* pParent /*=NULL*/)
 	m_bIsAnimating=false;
 	m_animationSpeed=2;
 	m_prevAnimationSpeed=0;
+	m_cursorStateCount=0;
+	m_coverageSide=MAPCOVERAGE_SIDE;
 	m_timer=0;
 	m_mixedCount=0;
 	m_MixedPlayerIdx=0;
@@ -577,6 +580,8 @@ DlgStats::DlgStats(CWnd* pParent /*=NULL*/)
 	// load parameters
 	_Parameters(true);
 	if(m_hlist<60) m_hlist=60;
+	m_replay.SetCoverageSide(m_coverageSide);
+	m_coverageSide = m_replay.GetCoverageSide();
 
 	// scroller increments
 	m_lineDev.cx = 5;
@@ -939,8 +944,17 @@ void DlgStats::_SetTimeCursor(unsigned long value, bool bUpdateListView, bool bU
 		}
 	}
 
-	// update map
+	// update map and players state (both seek from their nearest checkpoint)
 	if(bUserControl) m_dlgmap->ResetTime(m_timeCursor);
+	_SampleCursorStates();
+
+	// hot key numbers show slots at time cursor
+	if(m_chartType==HOTKEYS || m_chartType==MIX_APMHOTKEYS)
+	{
+		CRect rectkeys(m_boardRect);
+		rectkeys.right = rectkeys.left+m_dataAreaX+8;
+		InvalidateRect(rectkeys,FALSE);
+	}
 
 	// repaint view
 	InvalidateRect(rect,FALSE);
@@ -1074,6 +1088,7 @@ void DlgStats::LoadReplay(const char *reppath, bool bClear)
 	m_timeBegin = 0;
 	m_timeCursor = 0;
 	m_timeEnd = (m_chartType==BUILDORDER) ? m_replay.GetLastBuildOrderTime() : m_replay.GetEndTime();
+	_SampleCursorStates();
 	m_scroller.SetScrollRange(0,m_timeEnd/HSCROLL_DIVIDER);
 
 	// init all pens for drawing all the charts
@@ -1320,7 +1335,7 @@ void DlgStats::_InitDrawingTools(int player, int maxplayer, int /*lineWidth*/)
 void DlgStats::_PaintHotPoint(CDC *pDC, int x, int y, const ReplayEvt *evt, COLORREF clr)
 {
 	const char *hotpoint=0;
-	const IStarcraftAction *action = evt->GetAction();
+	const IStarcraftAction *action = m_list->GetEvtAction(evt);
 	int off=8;
 
 	//if event is a hack
@@ -1480,7 +1495,7 @@ private:
 //-----------------------------------------------------------------------------------------------------------------
 
 // draw resource lines for one resource slot
-void DlgStats::_PaintResources2(CDC *pDC, int ybottom, int cx, DrawingTools *tools, ReplayResource *res, unsigned long time, CKnotArray& knot, int knotidx)
+void DlgStats::_PaintResources2(CDC *pDC, int ybottom, int cx, DrawingTools *tools, const ReplayResource *res, unsigned long time, CKnotArray& knot, int knotidx)
 {
 	static int rx[DrawingTools::maxcurve],ry[DrawingTools::maxcurve];
 	static int orx[DrawingTools::maxcurve],ory[DrawingTools::maxcurve];
@@ -1506,6 +1521,7 @@ void DlgStats::_PaintResources2(CDC *pDC, int ybottom, int cx, DrawingTools *too
 		if(j==8) continue;
 		if(j==9 && m_chartType!=MAPCOVERAGE) continue;
 		if(j==10 && (!m_seeUnits[m_chartType] || m_chartType!=MAPCOVERAGE)) continue;
+		if(j==11 && (m_chartType!=APM)) continue; // effective apm
 		 
 		// we had a previous point, move beginning of line on it
 		CPoint firstpt(rx[j],ry[j]);
@@ -1641,6 +1657,7 @@ void DlgStats::_PaintEvents(CDC *pDC, int chartType, const CRect& rect, const Re
 	m_fvinc[7] = rheight/(float)resmax.APM();
 	m_fvinc[8] = rheight/(float)(resmax.MacroAPM()*4);
 	m_fvinc[9] = m_fvinc[10] = rheight/(float)(max(resmax.MapCoverage(),resmax.MovingMapCoverage()));
+	m_fvinc[11] = rheight/(float)resmax.APM();
 	m_finc = (float)(rect.Width()-hleft-hright)/(float)(m_timeEnd - m_timeBegin);
 
 	// get drawing tools
@@ -1660,26 +1677,36 @@ void DlgStats::_PaintEvents(CDC *pDC, int chartType, const CRect& rect, const Re
 	lastHotPointX = 0;
 	lastHotPoint = 0;
 
-	// for all resource slots
+	// pick summary level matching the chart width (level 0 = every slot)
+	int level = ReplayPyramid::GetLevel(m_timeEnd-m_timeBegin, rect.Width()-hleft-hright);
+	const ReplayPyramid *pyramid = level==0 ? 0 : &m_list->GetPyramid();
+	int step = ReplayPyramid::GetSlotsPerBucket(level);
+	ReplayResource bucketres;
+
+	// for all resource slots (or buckets)
 	firstPoint=true;
 	int slotBegin =  m_list->Time2Slot(m_timeBegin);
 	int slotEnd =  m_list->Time2Slot(m_timeEnd); // m_list->GetSlotCount()
-	int slotCount = slotEnd-slotBegin;
+	slotBegin -= slotBegin%step;
+	int slotCount = (slotEnd-slotBegin+step-1)/step;
 	int divider = max(1,slotCount/gSplineCount[chartType]);
 	int knotcount = slotCount==0 ? 0 : (slotCount/divider);
 	CKnotArray *knots = knotcount==0 ? 0 : new CKnotArray(knotcount);
-	for(int slot = slotBegin; slot<slotEnd; slot++)
+	ReplayTimeline::Cursor cursor;
+	for(int slot = slotBegin; slot<slotEnd; slot+=step)
 	{
 		// get resource object
-		ReplayResource *res = m_list->GetResourceFromIdx(slot);
-		unsigned long tick = m_list->Slot2Time(slot);
+		const ReplayResource *res = &bucketres;
+		if(pyramid!=0) pyramid->GetMax(level,slot/step,bucketres);
+		else res = &m_list->ReadResource(cursor,slot);
+		unsigned long tick = max(m_timeBegin,m_list->Slot2Time(slot));
 
 		// compute event position on X
 		float fx=(float)(rect.left+hleft) + m_finc * (tick-m_timeBegin);
 		int cx = (int)fx;
 
 		// draw resource lines
-		int knotslot = min(knotcount-1,(slot-slotBegin)/divider);
+		int knotslot = min(knotcount-1,(slot-slotBegin)/step/divider);
 		_PaintResources2(pDC, rect.bottom - vbottom, cx, tools, res, tick, *knots, knotslot);
 	}
 
@@ -1735,7 +1762,7 @@ void DlgStats::_PaintEvents(CDC *pDC, int chartType, const CRect& rect, const Re
 			firstPoint=false;
 			if(m_seeMinerals && m_seeHotPoints && !evt->IsDiscarded()) 
 			{
-				int y = rect.bottom-vbottom - (int)((float)(evt->Resources().Value(0))*m_fvinc[0]);
+				int y = rect.bottom-vbottom - (int)((float)(m_list->ReadResource(cursor,m_list->Time2Slot(evt->Time())).Value(0))*m_fvinc[0]);
 				pDC->SelectObject(tools->m_penMineralS[0]);
 				_PaintHotPoint(pDC, cx, y, evt, tools->m_clr[0]);
 			}
@@ -2243,6 +2270,7 @@ void DlgStats::_PaintPlayerName(CDC *pDC, const CRect& rectpl, ReplayEvtList *li
 			if(j==5 && (!m_seeBPM || m_chartType!=APM)) continue;
 			if(j==6 && (!m_seeUPM || m_chartType!=APM)) continue;
 			if(j==7 || j==8) continue;
+			if(j==11 && m_chartType!=APM) continue;
 			pDC->FillSolidRect(&rectTxt,_GetDrawingTools(playerIdx)->m_clr[j]);
 			rectTxt.OffsetRect(rectTxt.Width()+3,0);
 		}
@@ -2474,8 +2502,10 @@ void DlgStats::_PaintHotKeys(CDC *pDC, const CRect& rectc)
 		rectText.right = rectText.left + wkey;
 		while(rectText.Width()<4) rectText.InflateRect(1,1);
 
-		// fill key rect
-		COLORREF clr = m_list->IsHotKeyUsed(i) ? clrkey : clrkeydark;
+		// fill key rect (lit if the slot holds units at time cursor)
+		const ReplayPlayerState *state = _GetCursorState(m_list);
+		bool used = state!=0 ? state->m_hotkeys[i]!=HOTKEYLOG_NOGROUP : m_list->IsHotKeyUsed(i);
+		COLORREF clr = used ? clrkey : clrkeydark;
 		//pDC->FillSolidRect(rectText,clr);
 		Gradient::Fill(pDC,rectText,clr,CHsvRgb::Darker(clr,0.70));
 		pDC->Draw3dRect(rectText,clr,CHsvRgb::Darker(clr,0.80));
@@ -2861,8 +2891,9 @@ void DlgStats::_SelectAction(int idx)
 	if(evt->IsSuspect())
 	{
 		CString origin;
-		ReplayEvtList *list = (ReplayEvtList *)evt->GetAction()->GetUserData(0);
-		list->GetSuspectEventOrigin(evt->GetAction(),origin,m_useSeconds?true:false);
+		const IStarcraftAction *action = m_replay.GetEnAction(idx);
+		ReplayEvtList *list = (ReplayEvtList *)action->GetUserData(0);
+		list->GetSuspectEventOrigin(action,origin,m_useSeconds?true:false);
 		GetDlgItem(IDC_SUSPECT_INFO)->SetWindowText(origin);
 	}
 
@@ -3876,10 +3907,59 @@ void DlgStats::OnLButtonUp(UINT nFlags, CPoint point)
 
 //-----------------------------------------------------------------------------------------------------------------
 
+void DlgStats::_SampleCursorStates()
+{
+	m_cursorStateCount=0;
+	if(!m_replay.IsDone() || m_replay.GetPlayerCount()>MAXPLAYER) return;
+	m_replay.GetPlayerStates(m_timeCursor,m_cursorStates);
+	m_cursorStateCount=m_replay.GetPlayerCount();
+}
+
+const ReplayPlayerState *DlgStats::_GetCursorState(const ReplayEvtList *list) const
+{
+	for(int i=0; i<m_cursorStateCount && i<m_replay.GetPlayerCount(); i++)
+		if(m_replay.GetEvtList(i)==list) return &m_cursorStates[i];
+	return 0;
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
 void DlgStats::_GetHotKeyDesc(ReplayEvtList *list, int slot, CString& info)
 {
 	info="";
 
+	// slot usage
+	const HotKeySlotStats& stats = list->GetHotKeyStats(slot);
+	if(stats.m_assigns+stats.m_adds+stats.m_recalls==0) return;
+	info.Format("assigns: %d, adds: %d, recalls: %d (%.1f/min), units: %d-%d (avg %d)",
+		stats.m_assigns,stats.m_adds,stats.m_recalls,list->GetHotKeyRecallRate(slot),
+		stats.m_minSize,stats.m_maxSize,stats.GetAverageSize());
+
+	// slot and selection at time cursor
+	const ReplayPlayerState *state = _GetCursorState(list);
+	if(state!=0)
+	{
+		char buffer[64];
+		info+="\r\n";
+		info+=CString("at ")+_MkTime(m_replay.QueryFile()->QueryHeader(),state->m_time,m_useSeconds?true:false)+" =>  ";
+		int group = state->m_hotkeys[slot];
+		int unitcount = group==HOTKEYLOG_NOGROUP ? 0 : list->GetHotKeyLog().GetGroupSize(group);
+		const short *units = unitcount==0 ? 0 : list->GetHotKeyLog().GetGroupUnits(group);
+		for(int uidx=0;uidx<unitcount;uidx++)
+		{
+			if(uidx>0) info+=", ";
+			m_replay.QueryFile()->QueryHeader()->MkUnitID2String(buffer, units[uidx], list->GetElemList(), state->m_time);
+			info += buffer;
+		}
+		info+="  (selection: ";
+		for(int i=0;i<state->m_selection;i++)
+		{
+			if(i>0) info+=", ";
+			info+=state->m_selectedObjects[i]==-1 ? "?" : BWrepGameData::GetObjectNameFromID(state->m_selectedObjects[i]);
+		}
+		info+=")";
+	}
+
 	// browse hotkey events
 	for(int i=0;i<(int)list->GetHKEventCount();i++)
 	{
@@ -3899,11 +3979,12 @@ void DlgStats::_GetHotKeyDesc(ReplayEvtList *list, int slot, CString& info)
 		char buffer[64];
 		strcpy(buffer,_MkTime(m_replay.QueryFile()->QueryHeader(),hkevt->m_time,m_useSeconds?true:false));
 		info+=buffer+CString(" =>  ");
-		const HotKey * hk = hkevt->GetHotKey();
-		for(int uidx=0;uidx<hk->m_unitcount;uidx++)
+		int unitcount = list->GetHotKeyLog().GetGroupSize(hkevt->m_group);
+		const short *units = list->GetHotKeyLog().GetGroupUnits(hkevt->m_group);
+		for(int uidx=0;uidx<unitcount;uidx++)
 		{
 			if(uidx>0) info+=", ";
-			m_replay.QueryFile()->QueryHeader()->MkUnitID2String(buffer, hk->m_hotkeyUnits[uidx], list->GetElemList(), hkevt->m_time);
+			m_replay.QueryFile()->QueryHeader()->MkUnitID2String(buffer, units[uidx], list->GetElemList(), hkevt->m_time);
 			info += buffer;
 		}
 	}
@@ -3911,6 +3992,37 @@ void DlgStats::_GetHotKeyDesc(ReplayEvtList *list, int slot, CString& info)
 
 //-----------------------------------------------------------------------------------------------------------------
 
+// number of actions referencing the unit that has this id at that time, and time of first and last one
+void DlgStats::_GetUnitHistoryDesc(ReplayEvtList *list, short unitID, unsigned long time, CString& info)
+{
+	int total = list->GetUnitHistory(unitID,0,0);
+	if(total==0) return;
+	ReplayUnitPosting *history = new ReplayUnitPosting[total];
+	list->GetUnitHistory(unitID,history,total);
+
+	// unit ids are reused, only keep actions on the same object
+	short objectID = list->GetObjectID(unitID,time);
+	int count=0;
+	unsigned long first=0,last=0;
+	for(int i=0;i<total;i++)
+	{
+		if(history[i].m_objectID!=objectID) continue;
+		if(count++==0) first=history[i].m_time;
+		last=history[i].m_time;
+	}
+	delete[]history;
+	if(count==0) return;
+
+	// append to description
+	const IStarcraftGame *header = m_replay.QueryFile()->QueryHeader();
+	CString str;
+	str.Format(" (%d actions, %s",count,_MkTime(header,first,m_useSeconds?true:false));
+	info+=str;
+	info+=CString(" - ")+_MkTime(header,last,m_useSeconds?true:false)+")";
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
 void DlgStats::_CheckForHotKey(ReplayEvtList *list, CPoint& point, CRect& datarect, int delta)
 {
 	CRect symRect;
@@ -3953,17 +4065,19 @@ void DlgStats::_CheckForHotKey(ReplayEvtList *list, CPoint& point, CRect& datare
 		_ComputeHotkeySymbolRect(list, hkevt, datarect, symRect);
 
 		// is mouse over this event?
-		const HotKey * hk = hkevt->GetHotKey();
-		if(symRect.PtInRect(point) && hk!=0)
+		if(symRect.PtInRect(point) && hkevt->m_group!=HOTKEYLOG_NOGROUP)
 		{
 			// build unit list as string
 			CString info;
 			char buffer[64];
-			for(int uidx=0;uidx<hk->m_unitcount;uidx++)
+			int unitcount = list->GetHotKeyLog().GetGroupSize(hkevt->m_group);
+			const short *units = list->GetHotKeyLog().GetGroupUnits(hkevt->m_group);
+			for(int uidx=0;uidx<unitcount;uidx++)
 			{
 				if(!info.IsEmpty()) info+="\r\n";
-				m_replay.QueryFile()->QueryHeader()->MkUnitID2String(buffer, hk->m_hotkeyUnits[uidx], list->GetElemList(), hkevt->m_time);
+				m_replay.QueryFile()->QueryHeader()->MkUnitID2String(buffer, units[uidx], list->GetElemList(), hkevt->m_time);
 				info += buffer;
+				_GetUnitHistoryDesc(list, units[uidx], hkevt->m_time, info);
 			}
 			// update overlay window
 			m_over->SetText(info,this,point);
@@ -154,9 +154,14 @@ protected:
 	unsigned long m_timeBegin;
 	unsigned long m_timeEnd;
 	unsigned long m_timeCursor;
+
+	// selection and hot keys of every player at the time cursor
+	ReplayPlayerState m_cursorStates[MAXPLAYER];
+	int m_cursorStateCount;
 	bool m_lockListView;
 	int m_animationSpeed; //1=realtime
 	int m_prevAnimationSpeed;
+	int m_coverageSide; // map coverage grid (cells per side)
 
 	int m_maxPlayerOnBoard;
 	int m_selectedPlayer;
@@ -266,7 +271,7 @@ protected:
 	void _PaintBackgroundLayer(CDC *pDC, const CRect& rect, const ReplayResource& resmax);
 	void _PaintForegroundLayer(CDC *pDC, const CRect& rect, const ReplayResource& resmax, int mask=255);
 	void _PaintMapName(CDC *pDC, CRect& rect);
-	void _PaintResources2(CDC *pDC, int ybottom, int cx, DrawingTools *tools, ReplayResource *res, unsigned long time, class CKnotArray& knot, int knotidx);
+	void _PaintResources2(CDC *pDC, int ybottom, int cx, DrawingTools *tools, const ReplayResource *res, unsigned long time, class CKnotArray& knot, int knotidx);
 
 	// paint a spline curve
 	void _PaintSpline(CDC *pDC, const class CKnotArray& knots, int curveidx);
@@ -276,6 +281,8 @@ protected:
 	void _Resize(int cx, int cy);
 	unsigned long _GetEventFromTime(unsigned long cursor);
 	void _SetTimeCursor(unsigned long value, bool bUpdateListView=true, bool bIgnoreAnim=true);
+	void _SampleCursorStates();
+	const ReplayPlayerState *_GetCursorState(const ReplayEvtList *list) const;
 	BOOL _OnScroll(UINT nScrollCode, UINT nPos, BOOL bDoScroll);
 	BOOL _OnScrollBy(CSize sizeScroll, BOOL bDoScroll);
 	void _AdjustWindow();
@@ -294,6 +301,7 @@ protected:
 	void _GetDataRectForPlayer(int plidx, CRect& rect, int pcount);
 	void _CheckForHotKey(ReplayEvtList *list, CPoint& point, CRect& datarect, int delta=0);
 	void _GetHotKeyDesc(ReplayEvtList *list, int slot, CString& info);
+	void _GetUnitHistoryDesc(ReplayEvtList *list, short unitID, unsigned long time, CString& info);
 	inline unsigned long _GetActionCount();
 	bool _GetFileName(const char *filter, const char *ext, const char *def, CString& file);
 	void _SelectAction(int idx);
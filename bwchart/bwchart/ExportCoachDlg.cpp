@@ -127,7 +127,7 @@ bool ExportCoachDlg::_ExportTo(const char *file)
 			if(evt->IsDiscarded()) continue;
 				   
 			// is it a build/train/upgrade/research?
-			const IStarcraftAction *action = evt->GetAction();
+			const IStarcraftAction *action = list->GetEvtAction(evt);
 			int actionID = action->GetID();
 			if(actionID==BWrepGameData::CMD_BUILD || actionID==BWrepGameData::CMD_MORPH || 
 				(m_includeUnits && (actionID==BWrepGameData::CMD_TRAIN || actionID==BWrepGameData::CMD_HATCH ||
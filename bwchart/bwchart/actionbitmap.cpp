@@ -0,0 +1,151 @@
+// actionbitmap.cpp : implementation of the ActionBitmapIndex class
+//
+
+#include "actionbitmap.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define WORDBITS 64
+
+//---------------------------------------------------------------------------------------
+
+ActionBitmapIndex::ActionBitmapIndex() : m_actionCount(0), m_bitmapCount(0), m_words(0), m_bitmaps(0),
+	m_selected(0), m_mask(0), m_ranks(0), m_count(0)
+{
+}
+
+ActionBitmapIndex::~ActionBitmapIndex()
+{
+	free(m_bitmaps);
+	free(m_selected);
+	free(m_mask);
+	free(m_ranks);
+}
+
+int ActionBitmapIndex::_PopCount(ActionBitmapWord w)
+{
+#if defined(__GNUC__)
+	return __builtin_popcountll(w);
+#else
+	// no popcnt instruction on every cpu
+	w = w - ((w>>1) & 0x5555555555555555ui64);
+	w = (w & 0x3333333333333333ui64) + ((w>>2) & 0x3333333333333333ui64);
+	w = (w + (w>>4)) & 0x0F0F0F0F0F0F0F0Fui64;
+	return (int)((w*0x0101010101010101ui64)>>56);
+#endif
+}
+
+//---------------------------------------------------------------------------------------
+
+void ActionBitmapIndex::Reset(int actionCount, int bitmapCount)
+{
+	int words = (actionCount+WORDBITS-1)/WORDBITS;
+	int blocks = (words+ACTIONBITMAP_RANKWORDS-1)/ACTIONBITMAP_RANKWORDS;
+	if(words!=m_words || bitmapCount!=m_bitmapCount)
+	{
+		free(m_bitmaps);
+		free(m_selected);
+		free(m_mask);
+		free(m_ranks);
+		m_bitmaps = (ActionBitmapWord*)malloc((bitmapCount*words+1)*sizeof(ActionBitmapWord));
+		m_selected = (ActionBitmapWord*)malloc((words+1)*sizeof(ActionBitmapWord));
+		m_mask = (ActionBitmapWord*)malloc((words+1)*sizeof(ActionBitmapWord));
+		m_ranks = (unsigned int*)malloc((blocks+1)*sizeof(unsigned int));
+	}
+	m_actionCount = actionCount;
+	m_bitmapCount = bitmapCount;
+	m_words = words;
+	memset(m_bitmaps,0,bitmapCount*words*sizeof(ActionBitmapWord));
+	memset(m_selected,0,words*sizeof(ActionBitmapWord));
+	memset(m_mask,0,words*sizeof(ActionBitmapWord));
+	memset(m_ranks,0,(blocks+1)*sizeof(unsigned int));
+	m_count = 0;
+}
+
+void ActionBitmapIndex::Set(int bitmap, int idx)
+{
+	assert(bitmap>=0 && bitmap<m_bitmapCount);
+	if(idx<0 || idx>=m_actionCount) return;
+	_Bitmap(bitmap)[idx/WORDBITS] |= (ActionBitmapWord)1<<(idx%WORDBITS);
+}
+
+bool ActionBitmapIndex::Test(int bitmap, int idx) const
+{
+	assert(bitmap>=0 && bitmap<m_bitmapCount);
+	if(idx<0 || idx>=m_actionCount) return false;
+	return (_Bitmap(bitmap)[idx/WORDBITS] & ((ActionBitmapWord)1<<(idx%WORDBITS)))!=0;
+}
+
+//---------------------------------------------------------------------------------------
+
+void ActionBitmapIndex::Select(const int *any, int anyCount, const int *mask, int maskCount)
+{
+	int i,w;
+
+	// mask
+	memset(m_mask,0,m_words*sizeof(ActionBitmapWord));
+	for(i=0; i<maskCount; i++)
+	{
+		const ActionBitmapWord *bits = _Bitmap(mask[i]);
+		for(w=0; w<m_words; w++) m_mask[w] |= bits[w];
+	}
+
+	// union of selected bitmaps
+	memset(m_selected,0,m_words*sizeof(ActionBitmapWord));
+	for(i=0; i<anyCount; i++)
+	{
+		const ActionBitmapWord *bits = _Bitmap(any[i]);
+		for(w=0; w<m_words; w++) m_selected[w] |= bits[w];
+	}
+
+	// intersection and ranks
+	m_count=0;
+	for(w=0; w<m_words; w++)
+	{
+		if(w%ACTIONBITMAP_RANKWORDS==0) m_ranks[w/ACTIONBITMAP_RANKWORDS]=m_count;
+		m_selected[w] &= m_mask[w];
+		m_count += _PopCount(m_selected[w]);
+	}
+	m_ranks[(m_words+ACTIONBITMAP_RANKWORDS-1)/ACTIONBITMAP_RANKWORDS]=m_count;
+}
+
+int ActionBitmapIndex::GetAt(int rank) const
+{
+	if(rank<0 || rank>=m_count) return -1;
+
+	// last block starting at or before rank
+	int low=0, high=(m_words+ACTIONBITMAP_RANKWORDS-1)/ACTIONBITMAP_RANKWORDS-1;
+	while(low<high)
+	{
+		int mid = (low+high+1)/2;
+		if(m_ranks[mid]<=(unsigned int)rank) low=mid;
+		else high=mid-1;
+	}
+
+	// word containing it
+	rank -= m_ranks[low];
+	int w = low*ACTIONBITMAP_RANKWORDS;
+	for(;;w++)
+	{
+		int count = _PopCount(m_selected[w]);
+		if(rank<count) break;
+		rank-=count;
+	}
+
+	// bit in word
+	ActionBitmapWord bits = m_selected[w];
+	for(int k=0; k<rank; k++) bits &= bits-1;
+	int bit=0;
+	while((bits&1)==0) {bits>>=1; bit++;}
+	return w*WORDBITS+bit;
+}
+
+int ActionBitmapIndex::CountInMask(int bitmap) const
+{
+	assert(bitmap>=0 && bitmap<m_bitmapCount);
+	const ActionBitmapWord *bits = _Bitmap(bitmap);
+	int count=0;
+	for(int w=0; w<m_words; w++) count += _PopCount(bits[w]&m_mask[w]);
+	return count;
+}
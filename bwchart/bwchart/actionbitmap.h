@@ -0,0 +1,72 @@
+// actionbitmap.h : interface of the ActionBitmapIndex class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ACTIONBITMAP_H
+#define __ACTIONBITMAP_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+//--------------------------------------------------------------------------------------
+
+#ifdef _WIN32
+typedef unsigned __int64 ActionBitmapWord;
+#else
+typedef unsigned long long ActionBitmapWord;
+#endif
+
+#define ACTIONBITMAP_RANKWORDS 8 // words per rank block (512 actions)
+
+// Bitmaps over action indices (one per action category, player...).
+//
+// A selection is the union of some bitmaps intersected with the union of some others,
+// computed a word at a time. The selected actions get a rank directory (number of
+// selected actions before each block of words) so the nth selected action is found
+// with a binary search and a few popcounts, without building a list.
+//
+class ActionBitmapIndex
+{
+public:
+	ActionBitmapIndex();
+	~ActionBitmapIndex();
+
+	// clear all bitmaps for actionCount actions
+	void Reset(int actionCount, int bitmapCount);
+	int GetActionCount() const {return m_actionCount;}
+	int GetBitmapCount() const {return m_bitmapCount;}
+
+	// set/test action in a bitmap
+	void Set(int bitmap, int idx);
+	bool Test(int bitmap, int idx) const;
+
+	// select actions in (any of bitmaps in any) and (any of bitmaps in mask)
+	void Select(const int *any, int anyCount, const int *mask, int maskCount);
+
+	// number of selected actions
+	int GetCount() const {return m_count;}
+
+	// index of nth selected action (-1 if none)
+	int GetAt(int rank) const;
+
+	// number of actions in a bitmap and in the mask of last selection
+	int CountInMask(int bitmap) const;
+
+private:
+	int m_actionCount;
+	int m_bitmapCount;
+	int m_words; // words per bitmap
+	ActionBitmapWord *m_bitmaps;
+
+	// last selection, its mask and rank directory
+	ActionBitmapWord *m_selected;
+	ActionBitmapWord *m_mask;
+	unsigned int *m_ranks;
+	int m_count;
+
+	ActionBitmapWord *_Bitmap(int bitmap) const {return m_bitmaps+bitmap*m_words;}
+	static int _PopCount(ActionBitmapWord w);
+};
+
+#endif
@@ -0,0 +1,199 @@
+// aggregates.cpp : implementation of the ReplayAggregates class
+//
+
+#include "aggregates.h"
+#include "replaystore.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define KEY_SOURCECOUNT "#"
+#define MAXKEYLEN 1024
+
+static char _Fold(char c) {return c>='A' && c<='Z' ? c-'A'+'a' : c;}
+
+//---------------------------------------------------------------------------------------
+
+ReplayAggregates::ReplayAggregates() : m_store(0), m_rows(0), m_count(0), m_size(0), m_sourceCount(-1),
+	m_updateDepth(0), m_index(512)
+{
+}
+
+ReplayAggregates::~ReplayAggregates()
+{
+	_Free();
+}
+
+void ReplayAggregates::_Free()
+{
+	for(int i=0; i<m_count; i++) free(m_rows[i].m_key);
+	free(m_rows);
+	m_rows=0;
+	m_count=m_size=0;
+	m_index.Clear();
+	m_sourceCount=-1;
+}
+
+//---------------------------------------------------------------------------------------
+
+// names compare like store keys (ASCII case is ignored)
+bool ReplayAggregates::_Equal(const char *key1, int len1, const char *key2, int len2)
+{
+	if(len1!=len2) return false;
+	for(int i=0; i<len1; i++) if(_Fold(key1[i])!=_Fold(key2[i])) return false;
+	return true;
+}
+
+int ReplayAggregates::_MakeKey(char *key, int size, int kind, const char *dir, const char *name)
+{
+	int lendir = (int)strlen(dir);
+	int lenname = (int)strlen(name);
+	if(2+lendir+lenname>size) return 0;
+	key[0] = kind==KIND_MAP ? KEY_MAP : KEY_PLAYER;
+	memcpy(key+1,dir,lendir);
+	key[1+lendir]=0;
+	memcpy(key+2+lendir,name,lenname);
+	return 2+lendir+lenname;
+}
+
+//---------------------------------------------------------------------------------------
+
+int ReplayAggregates::_Find(const char *key, int keyLen) const
+{
+	unsigned long hash = HashIndex::HashNoCase(key,keyLen);
+	for(int pos=m_index.First(hash); pos>=0; pos=m_index.Next(pos,hash))
+	{
+		const Row& row = m_rows[m_index.GetID(pos)];
+		if(_Equal(row.m_key,row.m_keyLen,key,keyLen)) return m_index.GetID(pos);
+	}
+	return -1;
+}
+
+int ReplayAggregates::_Insert(const char *key, int keyLen)
+{
+	if(m_count==m_size)
+	{
+		m_size = m_size==0 ? 256 : 2*m_size;
+		m_rows = (Row*)realloc(m_rows,m_size*sizeof(Row));
+	}
+	Row& row = m_rows[m_count++];
+	row.m_key = (char*)malloc(keyLen+1);
+	memcpy(row.m_key,key,keyLen);
+	row.m_key[keyLen]=0;
+	row.m_keyLen = keyLen;
+	row.m_nameOff = (int)strlen(row.m_key)+1;
+	row.m_dirty = false;
+	memset(&row.m_stats,0,sizeof(row.m_stats));
+	m_index.Add(HashIndex::HashNoCase(key,keyLen),m_count-1);
+	return m_count-1;
+}
+
+//---------------------------------------------------------------------------------------
+
+void ReplayAggregates::_LoadRecord(void *context, const char *key, int keyLen, const char *value, int valLen, int /*percentage*/)
+{
+	ReplayAggregates *agg = (ReplayAggregates *)context;
+
+	// number of replay records
+	if(keyLen==1 && key[0]==KEY_SOURCECOUNT[0])
+	{
+		if(valLen==sizeof(int)) memcpy(&agg->m_sourceCount,value,sizeof(int));
+		return;
+	}
+
+	// stats of a player or a map (records of another size are ignored)
+	if(keyLen<2 || (key[0]!=KEY_PLAYER && key[0]!=KEY_MAP) || memchr(key,0,keyLen)==0) return;
+	if(valLen!=sizeof(AggregateStats)) return;
+	int r = agg->_Find(key,keyLen);
+	if(r<0) r = agg->_Insert(key,keyLen);
+	memcpy(&agg->m_rows[r].m_stats,value,sizeof(AggregateStats));
+}
+
+void ReplayAggregates::Load(ReplayStore *store)
+{
+	_Free();
+	m_store = store;
+	if(m_store!=0) m_store->Enumerate(_LoadRecord,this);
+}
+
+void ReplayAggregates::Clear()
+{
+	if(m_store!=0)
+	{
+		for(int i=0; i<m_count; i++)
+			if(m_rows[i].m_stats.m_games>0 || m_rows[i].m_dirty) m_store->Delete(m_rows[i].m_key,m_rows[i].m_keyLen);
+		m_store->Delete(KEY_SOURCECOUNT,1);
+	}
+	_Free();
+}
+
+void ReplayAggregates::SetSourceCount(int count)
+{
+	m_sourceCount = count;
+	if(m_store!=0) m_store->Put(KEY_SOURCECOUNT,1,(const char *)&count,sizeof(int));
+}
+
+//---------------------------------------------------------------------------------------
+
+void ReplayAggregates::BeginUpdate()
+{
+	if(m_updateDepth++==0) SetSourceCount(-1);
+}
+
+void ReplayAggregates::EndUpdate(int sourceCount)
+{
+	assert(m_updateDepth>0);
+	if(--m_updateDepth>0) return;
+	_Flush();
+	SetSourceCount(sourceCount);
+}
+
+// write changed rows
+void ReplayAggregates::_Flush()
+{
+	for(int i=0; i<m_count; i++)
+	{
+		Row& row = m_rows[i];
+		if(!row.m_dirty) continue;
+		row.m_dirty = false;
+		if(m_store==0) continue;
+		if(row.m_stats.m_games>0) m_store->Put(row.m_key,row.m_keyLen,(const char *)&row.m_stats,sizeof(row.m_stats));
+		else m_store->Delete(row.m_key,row.m_keyLen);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+
+void ReplayAggregates::Add(int kind, const char *dir, const char *name, const AggregateStats& stats, int sign)
+{
+	assert(sign==1 || sign==-1);
+	char key[MAXKEYLEN];
+	int keyLen = _MakeKey(key,sizeof(key),kind,dir,name);
+	if(keyLen==0) return;
+
+	// find or create row
+	int r = _Find(key,keyLen);
+	if(r<0) r = _Insert(key,keyLen);
+	AggregateStats& dst = m_rows[r].m_stats;
+
+	// update stats
+	dst.m_games += sign*stats.m_games;
+	dst.m_gamesAsT += sign*stats.m_gamesAsT;
+	dst.m_gamesAsZ += sign*stats.m_gamesAsZ;
+	dst.m_gamesAsP += sign*stats.m_gamesAsP;
+	dst.m_apm += sign*stats.m_apm;
+	dst.m_apmAsT += sign*stats.m_apmAsT;
+	dst.m_apmAsZ += sign*stats.m_apmAsZ;
+	dst.m_apmAsP += sign*stats.m_apmAsP;
+	dst.m_duration += sign*stats.m_duration;
+	for(int i=0; i<4; i++) dst.m_raceDist[i] += sign*stats.m_raceDist[i];
+	dst.m_apmDev += sign*stats.m_apmDev;
+	dst.m_apmCount += sign*stats.m_apmCount;
+
+	// last replay is gone
+	if(dst.m_games<=0) memset(&dst,0,sizeof(dst));
+
+	// written at the end of the update
+	m_rows[r].m_dirty = true;
+	if(m_updateDepth==0) _Flush();
+}
@@ -0,0 +1,109 @@
+// aggregates.h : interface of the ReplayAggregates class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __AGGREGATES_H
+#define __AGGREGATES_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include "hashindex.h"
+
+class ReplayStore;
+
+//--------------------------------------------------------------------------------------
+
+// what one replay adds to a player or a map
+struct AggregateStats
+{
+	int m_games;
+	int m_gamesAsT;
+	int m_gamesAsZ;
+	int m_gamesAsP;
+	int m_apm;
+	int m_apmAsT;
+	int m_apmAsZ;
+	int m_apmAsP;
+	int m_duration; // in seconds
+	int m_raceDist[4];
+	int m_apmDev;
+	int m_apmCount;
+};
+
+// Player and map statistics of the replay database, by directory and raw name (before
+// akas are applied, so an aka change doesnt need the replays).
+//
+// Every replay written to or removed from the database adds or subtracts its stats
+// here, and the changed rows are written to a store at the end of each update, so the
+// statistics can be read back at startup without reading the replays. The number of
+// replay records the statistics match is stored too, it is -1 while an update is in
+// progress so an interrupted update is detected.
+//
+class ReplayAggregates
+{
+public:
+	enum {KIND_PLAYER, KIND_MAP};
+
+	ReplayAggregates();
+	~ReplayAggregates();
+
+	// read aggregates from store, they are written there from now on
+	void Load(ReplayStore *store);
+	bool IsLoaded() const {return m_store!=0;}
+
+	// remove all aggregates (from store too)
+	void Clear();
+
+	// updates can be nested, changes are written when the outermost one ends
+	void BeginUpdate();
+	void EndUpdate(int sourceCount);
+
+	// add (sign=1) or subtract (sign=-1) replay stats for a player or a map
+	void Add(int kind, const char *dir, const char *name, const AggregateStats& stats, int sign);
+
+	// aggregates (stats with 0 games are left over by removed replays)
+	int GetCount() const {return m_count;}
+	int GetKind(int idx) const {return m_rows[idx].m_key[0]==KEY_MAP ? KIND_MAP : KIND_PLAYER;}
+	const char *GetDir(int idx) const {return m_rows[idx].m_key+1;}
+	const char *GetName(int idx) const {return m_rows[idx].m_key+m_rows[idx].m_nameOff;}
+	const AggregateStats& GetStats(int idx) const {return m_rows[idx].m_stats;}
+
+	// number of replay records the aggregates were computed from (-1 if unknown)
+	int GetSourceCount() const {return m_sourceCount;}
+	void SetSourceCount(int count);
+
+private:
+	enum {KEY_PLAYER='P', KEY_MAP='M'};
+
+	// key is kind, directory, a zero, then name (as in store)
+	struct Row
+	{
+		char *m_key;
+		int m_keyLen;
+		int m_nameOff;
+		bool m_dirty; // not written to store yet
+		AggregateStats m_stats;
+	};
+
+	ReplayStore *m_store;
+	Row *m_rows;
+	int m_count;
+	int m_size;
+	int m_sourceCount;
+	int m_updateDepth;
+
+	// rows by key
+	HashIndex m_index;
+
+	void _Free();
+	int _Find(const char *key, int keyLen) const;
+	int _Insert(const char *key, int keyLen);
+	void _Flush();
+	static void _LoadRecord(void *context, const char *key, int keyLen, const char *value, int valLen, int percentage);
+	static int _MakeKey(char *key, int size, int kind, const char *dir, const char *name);
+	static bool _Equal(const char *key1, int len1, const char *key2, int len2);
+};
+
+#endif
@@ -28,17 +28,24 @@ void Aka::Save(int nfile)
 
 //------------------------------------------------------------
 
-static unsigned long _ComputeHashCode(const char *name)
+// name -> aka (first aka with that name wins)
+void AkaList::_AddName(Aka *player, const char *name)
 {
-	unsigned int sum=0;
-	int len = min(4,(int)strlen(name));
-	for(int i=0;i<len;i++)
+	int id = NameTable::Shared().Intern(name);
+	if(id>=m_akaOfName.GetSize()) m_akaOfName.SetSize(id+1,1024);
+	if(m_akaOfName.GetAt(id)==0) m_akaOfName.SetAt(id,player);
+}
+
+// rebuild name -> aka table from all players
+void AkaList::_BuildNameTable()
+{
+	m_akaOfName.RemoveAll();
+	for(int i=0;i<GetPlayerCount();i++)
 	{
-		char c = name[i];
-		if(c!=' ') 
-			sum+=tolower((unsigned char)c)*i;
+		Aka *player = GetPlayer(i);
+		for(int j=0;j<player->GetAkaCount();j++)
+			_AddName(player, player->GetAka(j));
 	}
-	return sum%MAXHASH;
 }
 
 //------------------------------------------------------------
@@ -49,12 +56,9 @@ void AkaList::AddPlayer(Aka *player)
 	// add player in main list
 	m_akas.Add(player);
 
-	// update hash table with every name
+	// update name table with every name
 	for(int i=0;i<player->GetAkaCount();i++)
-	{
-		AkaElement *elem = &m_hash[_ComputeHashCode(player->GetAka(i))];
-		elem->AddElem(player, player->GetAka(i));
-	}
+		_AddName(player, player->GetAka(i));
 }
 
 //------------------------------------------------------------
@@ -65,9 +69,8 @@ void AkaList::AddAka(Aka *player, const char *newaka)
 	// add aka into player's aka list
 	if(!player->AddAka(newaka)) return;
 
-	// update hash table
-	AkaElement *elem = &m_hash[_ComputeHashCode(newaka)];
-	elem->AddElem(player, newaka);
+	// update name table
+	_AddName(player, newaka);
 }
 
 
@@ -105,13 +108,9 @@ void AkaList::RemovePlayer(Aka *player)
 		// remove from file
 		BWChartDB::Delete(m_nfile,player->MainName(),"akas");
 
-		// remove from hash table
-		for(int i=0;i<player->GetAkaCount();i++)
-		{
-			AkaElement *elem = &m_hash[_ComputeHashCode(player->GetAka(i))];
-			elem->RemoveElem(player,player->GetAka(i));
-			//assert(GetAkaFromName(player->GetAka(i))==0);
-		}
+		// remove from name table (another player may have the same names)
+		_BuildNameTable();
+
 		// delete player
 		delete player;
 	}
@@ -133,8 +132,7 @@ const Aka* AkaList::GetAkaFromName(const char *name) const
 {
 //	ASSERT(strcmp(name,"GG1-ElkY")!=0);
 
-	const AkaElement *elem = &m_hash[_ComputeHashCode(name)];
-	const Aka *aka = elem->Find(name);
+	const Aka *aka = GetAkaFromId(NameTable::Shared().Find(name));
 
 	/*
 	if(aka==0)
@@ -165,7 +163,7 @@ void AkaList::ProcessEntry(const char * section, const char *entry, const char *
 
 	// add akas
 	char buffer[2048];
-	strcpy(buffer,BWChartDB::ConverFromHex(data));
+	strcpy(buffer,data);
 	char *p=strtok(buffer,",");
 	while(p!=0)
 	{
@@ -185,9 +183,8 @@ void AkaList::Load()
 	// clear current list
 	m_akas.RemoveAll();
 
-	// clear hash table
-	for(int i=0;i<MAXHASH;i++)
-		m_hash[i].DeleteElem();
+	// clear name table
+	m_akaOfName.RemoveAll();
 
 	// load list from file
 	BWChartDB::LoadFile(m_nfile);
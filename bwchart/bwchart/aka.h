@@ -3,10 +3,9 @@
 
 #include "bwdb.h"
 #include "memblock.h"
+#include "names.h"
 #include <assert.h>
 
-#define MAXHASH 256
-
 //------------------------------------------------------------
 
 class Aka : public CObject
@@ -24,6 +23,7 @@ public:
 		m_akas.Copy(src.m_akas);
 	}
 	const char *MainName() const {return m_mainName;}
+	const CString& GetMainName() const {return m_mainName;}
 	void Clear() {m_akas.RemoveAll();}
 	bool AddAka(const char *name);
 	int GetAkaCount() const {return m_akas.GetSize();}
@@ -33,73 +33,20 @@ public:
 
 //------------------------------------------------------------
 
-class AkaElement
-{
-private:
-	CString m_name;
-	Aka *m_pAka;
-	AkaElement *m_pNext;
-public:
-	AkaElement() : m_pAka(0), m_pNext(0) {}
-	~AkaElement() {if(m_pNext) delete m_pNext;}
-	void Clear() {m_pAka=0, m_pNext=0;}
-
-	void AddElem(Aka *aka, const char *name)
-	{
-		if(m_pAka==0) {m_pAka=aka; m_name=name; return;}
-		if(m_pNext==0) m_pNext=new AkaElement();
-		m_pNext->AddElem(aka,name);
-	}
-	void RemoveElem(Aka *player, const char *name)
-	{
-		if(m_name.CompareNoCase(name)==0 && player==m_pAka)
-		{
-			if(m_pNext==0) {m_pAka=0; m_name=""; return;}
-			m_pAka = m_pNext->m_pAka;
-			m_name = m_pNext->m_name;
-			AkaElement *oldNext = m_pNext;
-			m_pNext = m_pNext->m_pNext;
-			oldNext->m_pNext=0;
-			delete oldNext;
-			return;
-		}
-		else if(m_pNext!=0)
-		{
-			m_pNext->RemoveElem(player,name);
-			return;
-		}
-		assert(0);
-	}
-	void DeleteElem()
-	{
-		if(m_pNext!=0) m_pNext->DeleteElem();
-		m_pAka=0;
-		m_pNext=0;
-	}
-	Aka* Find(const char *name) const
-	{
-		if(m_name.CompareNoCase(name)==0) return m_pAka;
-		if(m_pNext!=0) return m_pNext->Find(name);
-		return 0;
-	}
-};
-
-//------------------------------------------------------------
-
 class AkaList : public BWChartDB
 {
 private:
 	// akas list
 	XObArray m_akas;
 
-	// hash-table
-	AkaElement m_hash[MAXHASH];
+	// aka of every name id of the NameTable (0 if none)
+	CPtrArray m_akaOfName;
 
 	// data file
 	int m_nfile;
 
 public:
-	AkaList(int nfile) : m_nfile(nfile) {for(int i=0;i<MAXHASH;i++) m_hash[i].Clear();}
+	AkaList(int nfile) : m_nfile(nfile) {}
 
 	// get player count
 	int GetPlayerCount() const {return m_akas.GetSize();}
@@ -125,6 +72,12 @@ public:
 	// get aka from any name
 	const Aka* GetAkaFromName(const char *name) const;
 
+	// get aka from a name id of the NameTable
+	const Aka* GetAkaFromId(int nameId) const 
+	{
+		return nameId>=0 && nameId<m_akaOfName.GetSize() ? (const Aka *)m_akaOfName.GetAt(nameId) : 0;
+	}
+
 	// load list
 	void Load();
 	void ProcessEntry(const char * section, const char *entry, const char *data, int percentage);
@@ -134,6 +87,10 @@ public:
 
 	// fill a combo with akalist content
 	void FillCombo(CComboBox *combo, const char *regentry, const char *name=0);
+
+private:
+	void _AddName(Aka *player, const char *name);
+	void _BuildNameTable();
 };
 
 #endif
@@ -0,0 +1,211 @@
+// arena.cpp : implementation of the Arena class
+//
+
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+//---------------------------------------------------------------------------------------
+
+Arena::Arena(size_t chunkSize, Arena *parent) :
+	m_owner(parent==0 ? this : parent->m_owner), m_chunkSize(chunkSize), m_chunks(0), m_reserved(0),
+	m_lock(0), m_cur(0), m_end(0)
+{
+	// only the owner of the chunks needs a lock
+	if(m_owner!=this) return;
+#ifdef _WIN32
+	m_lock = malloc(sizeof(CRITICAL_SECTION));
+	InitializeCriticalSection((CRITICAL_SECTION*)m_lock);
+#else
+	m_lock = malloc(sizeof(pthread_mutex_t));
+	pthread_mutex_init((pthread_mutex_t*)m_lock,0);
+#endif
+}
+
+Arena::~Arena()
+{
+	if(m_owner!=this) return;
+	Reset();
+#ifdef _WIN32
+	DeleteCriticalSection((CRITICAL_SECTION*)m_lock);
+#else
+	pthread_mutex_destroy((pthread_mutex_t*)m_lock);
+#endif
+	free(m_lock);
+}
+
+//---------------------------------------------------------------------------------------
+
+void Arena::_Lock()
+{
+#ifdef _WIN32
+	EnterCriticalSection((CRITICAL_SECTION*)m_lock);
+#else
+	pthread_mutex_lock((pthread_mutex_t*)m_lock);
+#endif
+}
+
+void Arena::_Unlock()
+{
+#ifdef _WIN32
+	LeaveCriticalSection((CRITICAL_SECTION*)m_lock);
+#else
+	pthread_mutex_unlock((pthread_mutex_t*)m_lock);
+#endif
+}
+
+//---------------------------------------------------------------------------------------
+
+Arena::Chunk *Arena::_NewChunk(size_t size)
+{
+	Chunk *chunk = (Chunk*)malloc(_HeaderSize()+size);
+	if(chunk==0) return 0;
+	chunk->m_size = size;
+
+	// link chunk at the head of the list
+	_Lock();
+	chunk->m_prev = 0;
+	chunk->m_next = m_chunks;
+	if(m_chunks!=0) m_chunks->m_prev = chunk;
+	m_chunks = chunk;
+	m_reserved += size;
+	_Unlock();
+	return chunk;
+}
+
+Arena::Chunk *Arena::_ResizeChunk(Chunk *chunk, size_t size)
+{
+	_Lock();
+	Chunk *newchunk = (Chunk*)realloc(chunk,_HeaderSize()+size);
+	if(newchunk!=0)
+	{
+		// chunk may have moved, fix links
+		if(newchunk->m_prev!=0) newchunk->m_prev->m_next = newchunk; else m_chunks = newchunk;
+		if(newchunk->m_next!=0) newchunk->m_next->m_prev = newchunk;
+		m_reserved += size;
+		m_reserved -= newchunk->m_size;
+		newchunk->m_size = size;
+	}
+	_Unlock();
+	return newchunk;
+}
+
+void Arena::_FreeChunk(Chunk *chunk)
+{
+	_Lock();
+	if(chunk->m_prev!=0) chunk->m_prev->m_next = chunk->m_next; else m_chunks = chunk->m_next;
+	if(chunk->m_next!=0) chunk->m_next->m_prev = chunk->m_prev;
+	m_reserved -= chunk->m_size;
+	_Unlock();
+	free(chunk);
+}
+
+//---------------------------------------------------------------------------------------
+
+void *Arena::Alloc(size_t size)
+{
+	size = _Align(size);
+
+	// large blocks get their own chunk, so they can be resized in place
+	if(_IsLarge(size))
+	{
+		Chunk *chunk = m_owner->_NewChunk(size);
+		return chunk==0 ? 0 : _Data(chunk);
+	}
+
+	// if we dont have enough space in current chunk
+	if(m_cur==0 || m_cur+size>m_end)
+	{
+		// start a new one (what is left in the current one is lost)
+		Chunk *chunk = m_owner->_NewChunk(m_chunkSize);
+		if(chunk==0) return 0;
+		m_cur = _Data(chunk);
+		m_end = m_cur+m_chunkSize;
+	}
+
+	// bump
+	void *ptr = m_cur;
+	m_cur += size;
+	return ptr;
+}
+
+//---------------------------------------------------------------------------------------
+
+void *Arena::Realloc(void *ptr, size_t oldSize, size_t newSize)
+{
+	if(ptr==0) return Alloc(newSize);
+	oldSize = _Align(oldSize);
+	newSize = _Align(newSize);
+
+	// block has its own chunk
+	if(_IsLarge(oldSize))
+	{
+		if(_IsLarge(newSize))
+		{
+			Chunk *chunk = m_owner->_ResizeChunk(_ChunkFromData(ptr),newSize);
+			return chunk==0 ? 0 : _Data(chunk);
+		}
+		void *newptr = Alloc(newSize);
+		if(newptr!=0)
+		{
+			memcpy(newptr,ptr,newSize);
+			m_owner->_FreeChunk(_ChunkFromData(ptr));
+		}
+		return newptr;
+	}
+
+	// last block allocated in current chunk: resize it in place
+	if((char*)ptr+oldSize==m_cur && !_IsLarge(newSize) && (char*)ptr+newSize<=m_end)
+	{
+		m_cur = (char*)ptr+newSize;
+		return ptr;
+	}
+
+	// otherwise copy it (old block is released with the arena)
+	void *newptr = Alloc(newSize);
+	if(newptr!=0) memcpy(newptr,ptr,oldSize<newSize ? oldSize : newSize);
+	return newptr;
+}
+
+//---------------------------------------------------------------------------------------
+
+void Arena::Free(void *ptr, size_t size)
+{
+	if(ptr==0) return;
+	size = _Align(size);
+
+	// block has its own chunk
+	if(_IsLarge(size)) {m_owner->_FreeChunk(_ChunkFromData(ptr)); return;}
+
+	// last block allocated in current chunk
+	if((char*)ptr+size==m_cur) m_cur = (char*)ptr;
+}
+
+//---------------------------------------------------------------------------------------
+
+void Arena::Reset()
+{
+	m_cur = m_end = 0;
+
+	// local arena: chunks belong to the parent
+	if(m_owner!=this) return;
+
+	_Lock();
+	Chunk *chunk = m_chunks;
+	while(chunk!=0)
+	{
+		Chunk *next = chunk->m_next;
+		free(chunk);
+		chunk = next;
+	}
+	m_chunks = 0;
+	m_reserved = 0;
+	_Unlock();
+}
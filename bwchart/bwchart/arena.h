@@ -0,0 +1,81 @@
+// arena.h : interface of the Arena class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stddef.h>
+
+//--------------------------------------------------------------------------------------
+
+// Bump allocator. Nothing is freed individually, all memory is released at once
+// with Reset or when the arena is destroyed.
+//
+// An arena created with a parent is a local arena: it takes its chunks from the
+// parent (under lock) but allocates without any locking, so each worker thread
+// can use its own. Local arenas own nothing, resetting the parent releases
+// everything they allocated.
+//
+class Arena
+{
+public:
+	Arena(size_t chunkSize=65536, Arena *parent=0);
+	~Arena();
+
+	// allocate memory (8 bytes aligned)
+	void *Alloc(size_t size);
+
+	// resize a block returned by Alloc or Realloc
+	void *Realloc(void *ptr, size_t oldSize, size_t newSize);
+
+	// release a block early when possible (large blocks and the last block allocated),
+	// otherwise it is released with the arena
+	void Free(void *ptr, size_t size);
+
+	// release everything allocated in that arena (and in its local arenas)
+	void Reset();
+
+	// bytes reserved by the arena
+	size_t GetReserved() const {return m_reserved;}
+
+private:
+	struct Chunk
+	{
+		Chunk *m_next;
+		Chunk *m_prev;
+		size_t m_size;
+	};
+
+	// owner of the chunks (this or parent)
+	Arena *m_owner;
+	size_t m_chunkSize;
+
+	// chunks owned by this arena
+	Chunk *m_chunks;
+	size_t m_reserved;
+	void *m_lock;
+
+	// current chunk for bump allocation
+	char *m_cur;
+	char *m_end;
+
+	bool _IsLarge(size_t size) const {return size>m_chunkSize/4;}
+	static size_t _Align(size_t size) {return (size+7)&~(size_t)7;}
+	static size_t _HeaderSize() {return (sizeof(Chunk)+15)&~(size_t)15;}
+	static char *_Data(Chunk *chunk) {return (char*)chunk+_HeaderSize();}
+	static Chunk *_ChunkFromData(void *ptr) {return (Chunk*)((char*)ptr-_HeaderSize());}
+
+	// chunk management (owner only, locked)
+	Chunk *_NewChunk(size_t size);
+	Chunk *_ResizeChunk(Chunk *chunk, size_t size);
+	void _FreeChunk(Chunk *chunk);
+	void _Lock();
+	void _Unlock();
+};
+
+#endif
@@ -0,0 +1,343 @@
+// bosearch.cpp : implementation of the BOSearchIndex class
+//
+
+#include "bosearch.h"
+#include "ingest.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
+
+// smallest number of build orders worth a thread of their own
+#define SEARCHMIN 4096
+#define MAXTHREADS 64
+
+//---------------------------------------------------------------------------------------
+
+BOSearchIndex::BOSearchIndex() : m_entries(0), m_count(0), m_size(0),
+	m_nodes(0), m_times(0), m_nodeCount(0), m_nodeSize(0),
+	m_grams(0), m_gramCount(0), m_gramSize(0), m_symbols(0), m_symbolCount(0)
+{
+}
+
+BOSearchIndex::~BOSearchIndex()
+{
+	Clear();
+}
+
+void BOSearchIndex::Clear()
+{
+	free(m_entries);
+	m_entries=0;
+	m_count=m_size=0;
+	free(m_nodes);
+	free(m_times);
+	m_nodes=m_times=0;
+	m_nodeCount=m_nodeSize=0;
+	free(m_grams);
+	m_grams=0;
+	m_gramCount=m_gramSize=0;
+	free(m_symbols);
+	m_symbols=0;
+	m_symbolCount=0;
+}
+
+//---------------------------------------------------------------------------------------
+
+// sorted 2-grams of a symbol sequence, returns their count
+int BOSearchIndex::_MakeGrams(const unsigned short *nodes, int length, unsigned int *grams)
+{
+	int count=0;
+	for(int i=0; i+Q<=length; i++)
+	{
+		unsigned int gram = ((unsigned int)nodes[i]<<16)|nodes[i+1];
+		int j=count++;
+		for(; j>0 && grams[j-1]>gram; j--) grams[j]=grams[j-1];
+		grams[j]=gram;
+	}
+	return count;
+}
+
+int BOSearchIndex::Add(int key, const unsigned short *nodes, const unsigned short *times, int length)
+{
+	int i;
+	if(length>MAXLENGTH) length=MAXLENGTH;
+
+	// make room
+	if(m_count==m_size)
+	{
+		m_size = m_size==0 ? 1024 : 2*m_size;
+		m_entries = (Entry*)realloc(m_entries,m_size*sizeof(Entry));
+	}
+	if(m_nodeCount+length>m_nodeSize)
+	{
+		m_nodeSize = 2*m_nodeSize+MAXLENGTH*64;
+		m_nodes = (unsigned short*)realloc(m_nodes,m_nodeSize*sizeof(unsigned short));
+		m_times = (unsigned short*)realloc(m_times,m_nodeSize*sizeof(unsigned short));
+	}
+	if(m_gramCount+length>m_gramSize)
+	{
+		m_gramSize = 2*m_gramSize+MAXLENGTH*64;
+		m_grams = (unsigned int*)realloc(m_grams,m_gramSize*sizeof(unsigned int));
+	}
+	if(m_symbols==0)
+	{
+		m_symbols = (unsigned short*)malloc(65536*sizeof(unsigned short));
+		for(i=0; i<65536; i++) m_symbols[i]=NOSYMBOL;
+	}
+
+	// nodes as symbols
+	Entry& entry = m_entries[m_count++];
+	entry.m_key = key;
+	entry.m_offset = m_nodeCount;
+	entry.m_length = (short)length;
+	entry.m_timed = times!=0;
+	for(i=0; i<length; i++)
+	{
+		if(m_symbols[nodes[i]]==NOSYMBOL) m_symbols[nodes[i]] = (unsigned short)m_symbolCount++;
+		m_nodes[m_nodeCount+i] = m_symbols[nodes[i]];
+		m_times[m_nodeCount+i] = times!=0 ? times[i] : 0;
+	}
+	m_nodeCount+=length;
+
+	// 2-grams
+	entry.m_grams = m_gramCount;
+	entry.m_gramCount = (short)_MakeGrams(m_nodes+entry.m_offset,length,m_grams+m_gramCount);
+	m_gramCount+=entry.m_gramCount;
+
+	return m_count-1;
+}
+
+//---------------------------------------------------------------------------------------
+
+// edit distance between pattern (as bits for each symbol) and text
+int BOSearchIndex::_Distance(const BOSearchWord *peq, int m, const unsigned short *text, int n)
+{
+	if(m==0) return n;
+
+	BOSearchWord pv = ~(BOSearchWord)0;
+	BOSearchWord mv = 0;
+	BOSearchWord last = (BOSearchWord)1<<(m-1);
+	int score = m;
+	for(int j=0; j<n; j++)
+	{
+		BOSearchWord eq = peq[text[j]];
+		BOSearchWord xv = eq|mv;
+		BOSearchWord xh = (((eq&pv)+pv)^pv)|eq;
+		BOSearchWord ph = mv|~(xh|pv);
+		BOSearchWord mh = pv&xh;
+		if(ph&last) score++;
+		else if(mh&last) score--;
+		// first row grows by one with every text node
+		ph = (ph<<1)|1;
+		mh <<= 1;
+		pv = mh|~(xv|ph);
+		mv = ph&xv;
+	}
+	return score;
+}
+
+// lower bound of the distance from the 2-grams both build orders have
+int BOSearchIndex::_Bound(const Query& query, const Entry& entry) const
+{
+	// shared 2-grams (counting repeated ones)
+	const unsigned int *grams = m_grams+entry.m_grams;
+	int shared=0;
+	for(int i=0, j=0; i<query.m_gramCount && j<entry.m_gramCount;)
+	{
+		if(query.m_grams[i]<grams[j]) i++;
+		else if(query.m_grams[i]>grams[j]) j++;
+		else {shared++; i++; j++;}
+	}
+
+	// an edit removes Q 2-grams at most
+	int longest = query.m_length>entry.m_length ? query.m_length : entry.m_length;
+	int missing = longest-Q+1-shared;
+	int bound = missing>0 ? (missing+Q-1)/Q : 0;
+	int diff = query.m_length>entry.m_length ? query.m_length-entry.m_length : entry.m_length-query.m_length;
+	return bound>diff ? bound : diff;
+}
+
+unsigned int BOSearchIndex::_TimeGap(const Query& query, const Entry& entry) const
+{
+	if(!query.m_timed || !entry.m_timed) return 0xFFFFFFFF;
+	unsigned int gap=0;
+	const unsigned short *nodes = m_nodes+entry.m_offset;
+	const unsigned short *times = m_times+entry.m_offset;
+	for(int i=0; i<query.m_length && i<entry.m_length; i++)
+	{
+		if(nodes[i]!=query.m_nodes[i]) continue;
+		gap += times[i]>query.m_times[i] ? times[i]-query.m_times[i] : query.m_times[i]-times[i];
+	}
+	return gap;
+}
+
+//---------------------------------------------------------------------------------------
+
+bool BOSearchIndex::_Better(const BOMatch& m1, const BOMatch& m2)
+{
+	if(m1.m_distance!=m2.m_distance) return m1.m_distance<m2.m_distance;
+	if(m1.m_timeGap!=m2.m_timeGap) return m1.m_timeGap<m2.m_timeGap;
+	if(m1.m_key!=m2.m_key) return m1.m_key<m2.m_key;
+	return m1.m_entry<m2.m_entry;
+}
+
+// keep a match if it is among the best ones (one per key)
+void BOSearchIndex::_Keep(BOMatch *matches, int& count, int maxMatches, const BOMatch& match)
+{
+	int i;
+
+	// key already there
+	for(i=0; i<count; i++)
+	{
+		if(matches[i].m_key!=match.m_key) continue;
+		if(!_Better(match,matches[i])) return;
+		memmove(matches+i,matches+i+1,(count-i-1)*sizeof(BOMatch));
+		count--;
+		break;
+	}
+
+	// insert in order
+	int pos=count;
+	while(pos>0 && _Better(match,matches[pos-1])) pos--;
+	if(pos>=maxMatches) return;
+	if(count<maxMatches) count++;
+	memmove(matches+pos+1,matches+pos,(count-1-pos)*sizeof(BOMatch));
+	matches[pos]=match;
+}
+
+void BOSearchIndex::_Search(Job& job) const
+{
+	int i;
+	const Query& query = *job.m_query;
+	int count = job.m_end-job.m_start;
+	job.m_matchCount=0;
+	if(count<=0) return;
+
+	// bounds, and build orders sorted by bound (counting sort)
+	int *bounds = (int*)malloc(count*sizeof(int));
+	int *order = (int*)malloc(count*sizeof(int));
+	int starts[MAXLENGTH+2];
+	memset(starts,0,sizeof(starts));
+	for(i=0; i<count; i++)
+	{
+		const Entry& entry = m_entries[job.m_start+i];
+		bounds[i] = entry.m_key==query.m_excludeKey ? -1 : _Bound(query,entry);
+		if(bounds[i]>=0) starts[bounds[i]+1]++;
+	}
+	for(i=1; i<=MAXLENGTH+1; i++) starts[i]+=starts[i-1];
+	int candidates = starts[MAXLENGTH+1];
+	for(i=0; i<count; i++) if(bounds[i]>=0) order[starts[bounds[i]]++] = i;
+
+	// compute distances, lowest bound first
+	for(i=0; i<candidates; i++)
+	{
+		const Entry& entry = m_entries[job.m_start+order[i]];
+		int bound = bounds[order[i]];
+		if(job.m_matchCount==query.m_maxMatches && bound>job.m_matches[job.m_matchCount-1].m_distance) break;
+
+		BOMatch match;
+		match.m_key = entry.m_key;
+		match.m_entry = job.m_start+order[i];
+		match.m_distance = _Distance(query.m_peq,query.m_length,m_nodes+entry.m_offset,entry.m_length);
+		match.m_timeGap = _TimeGap(query,entry);
+		_Keep(job.m_matches,job.m_matchCount,query.m_maxMatches,match);
+	}
+
+	free(order);
+	free(bounds);
+}
+
+#ifdef _WIN32
+unsigned __stdcall BOSearchIndex::_SearchThread(void *param)
+#else
+void *BOSearchIndex::_SearchThread(void *param)
+#endif
+{
+	Job *job = (Job *)param;
+	job->m_index->_Search(*job);
+	return 0;
+}
+
+int BOSearchIndex::Search(const unsigned short *nodes, const unsigned short *times, int length, int excludeKey,
+	BOMatch *matches, int maxMatches, int threads) const
+{
+	int i;
+	if(m_count==0 || maxMatches<=0) return 0;
+	if(length>MAXLENGTH) length=MAXLENGTH;
+
+	// searched build order as symbols (unknown nodes match nothing)
+	Query query;
+	query.m_length = length;
+	query.m_timed = times!=0;
+	query.m_excludeKey = excludeKey;
+	query.m_maxMatches = maxMatches;
+	query.m_peq = (BOSearchWord*)calloc(m_symbolCount+1,sizeof(BOSearchWord));
+	for(i=0; i<length; i++)
+	{
+		query.m_nodes[i] = m_symbols[nodes[i]];
+		query.m_times[i] = times!=0 ? times[i] : 0;
+		if(query.m_nodes[i]!=NOSYMBOL) query.m_peq[query.m_nodes[i]] |= (BOSearchWord)1<<i;
+	}
+	query.m_gramCount = _MakeGrams(query.m_nodes,length,query.m_grams);
+
+	// split build orders between threads (keys are not split)
+	if(threads<=0) threads = IngestPipeline::GetProcessorCount();
+	if(threads>m_count/SEARCHMIN) threads = m_count/SEARCHMIN;
+	if(threads>MAXTHREADS) threads = MAXTHREADS;
+	if(threads<1) threads = 1;
+	Job jobs[MAXTHREADS];
+	for(i=0; i<threads; i++)
+	{
+		jobs[i].m_index = this;
+		jobs[i].m_query = &query;
+		jobs[i].m_start = i==0 ? 0 : jobs[i-1].m_end;
+		jobs[i].m_end = (int)((double)m_count*(i+1)/threads);
+		while(jobs[i].m_end>jobs[i].m_start && jobs[i].m_end<m_count && m_entries[jobs[i].m_end].m_key==m_entries[jobs[i].m_end-1].m_key)
+			jobs[i].m_end++;
+		if(jobs[i].m_end<jobs[i].m_start) jobs[i].m_end = jobs[i].m_start;
+		jobs[i].m_matches = (BOMatch*)malloc(maxMatches*sizeof(BOMatch));
+		jobs[i].m_matchCount = 0;
+	}
+
+	// run them (a job whose thread cant be started runs here)
+	if(threads==1) _Search(jobs[0]);
+	else
+	{
+#ifdef _WIN32
+		HANDLE handles[MAXTHREADS];
+		for(i=0; i<threads; i++) handles[i] = (HANDLE)_beginthreadex(0,0,_SearchThread,&jobs[i],0,0);
+		for(i=0; i<threads; i++)
+		{
+			if(handles[i]==0) {_Search(jobs[i]); continue;}
+			WaitForSingleObject(handles[i],INFINITE);
+			CloseHandle(handles[i]);
+		}
+#else
+		pthread_t handles[MAXTHREADS];
+		bool started[MAXTHREADS];
+		for(i=0; i<threads; i++) started[i] = pthread_create(&handles[i],0,_SearchThread,&jobs[i])==0;
+		for(i=0; i<threads; i++)
+		{
+			if(!started[i]) _Search(jobs[i]);
+			else pthread_join(handles[i],0);
+		}
+#endif
+	}
+
+	// best matches of all threads (keys dont span threads)
+	int count=0;
+	for(i=0; i<threads; i++)
+	{
+		for(int j=0; j<jobs[i].m_matchCount; j++) _Keep(matches,count,maxMatches,jobs[i].m_matches[j]);
+		free(jobs[i].m_matches);
+	}
+	free(query.m_peq);
+	return count;
+}
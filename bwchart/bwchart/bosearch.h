@@ -0,0 +1,132 @@
+// bosearch.h : interface of the BOSearchIndex class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __BOSEARCH_H
+#define __BOSEARCH_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+//--------------------------------------------------------------------------------------
+
+#ifdef _WIN32
+typedef unsigned __int64 BOSearchWord;
+#else
+typedef unsigned long long BOSearchWord;
+#endif
+
+// a build order close to the one searched
+struct BOMatch
+{
+	int m_key; // key of the build order (a replay)
+	int m_entry; // build order index
+	int m_distance; // nodes to insert, remove or replace
+	unsigned int m_timeGap; // sum of time differences of nodes at the same place (in seconds)
+};
+
+// Build orders as sequences of node codes with their times, to find the ones closest
+// to a given build order.
+//
+// Closeness is the edit distance of node sequences, computed with Myers' bit-parallel
+// algorithm on one 64-bit word (build orders are cut after 64 nodes). Build orders at
+// the same distance are ordered by the time gap of their nodes at the same place.
+// The number of 2-grams two build orders share gives a lower bound of their distance:
+// build orders are tried from the lowest bound up, and the search stops when the bound
+// is above the distance of the last match kept.
+//
+// A key gets one match at most (its closest build order), and build orders of a key
+// must be added one after the other. Search splits build orders between threads.
+//
+class BOSearchIndex
+{
+public:
+	enum {MAXLENGTH=64, Q=2};
+
+	BOSearchIndex();
+	~BOSearchIndex();
+
+	void Clear();
+
+	// add a build order (times in seconds, or 0 if unknown), returns its index
+	int Add(int key, const unsigned short *nodes, const unsigned short *times, int length);
+
+	int GetCount() const {return m_count;}
+	int GetKey(int entry) const {return m_entries[entry].m_key;}
+
+	// closest build orders to a build order, closest first (one per key, excluding
+	// excludeKey), returns number of matches (threads=0 for one per processor)
+	int Search(const unsigned short *nodes, const unsigned short *times, int length, int excludeKey,
+		BOMatch *matches, int maxMatches, int threads=0) const;
+
+private:
+	struct Entry
+	{
+		int m_key;
+		int m_offset; // in m_nodes & m_times
+		int m_grams; // in m_grams
+		short m_length;
+		short m_gramCount;
+		bool m_timed;
+	};
+
+	// build order searched
+	struct Query
+	{
+		unsigned short m_nodes[MAXLENGTH]; // symbols
+		unsigned short m_times[MAXLENGTH];
+		bool m_timed;
+		int m_length;
+		unsigned int m_grams[MAXLENGTH];
+		int m_gramCount;
+		BOSearchWord *m_peq; // pattern bits of every symbol
+		int m_excludeKey;
+		int m_maxMatches;
+	};
+
+	// share of a search thread
+	struct Job
+	{
+		const BOSearchIndex *m_index;
+		const Query *m_query;
+		int m_start, m_end;
+		BOMatch *m_matches;
+		int m_matchCount;
+	};
+
+	Entry *m_entries;
+	int m_count;
+	int m_size;
+
+	// build order nodes as symbols (numbered in order of appearance), and times
+	unsigned short *m_nodes;
+	unsigned short *m_times;
+	int m_nodeCount;
+	int m_nodeSize;
+
+	// sorted 2-grams of build orders
+	unsigned int *m_grams;
+	int m_gramCount;
+	int m_gramSize;
+
+	// symbol of every node code (NOSYMBOL if not seen)
+	enum {NOSYMBOL=0xFFFF};
+	unsigned short *m_symbols;
+	int m_symbolCount;
+
+	void _Search(Job& job) const;
+	int _Bound(const Query& query, const Entry& entry) const;
+	unsigned int _TimeGap(const Query& query, const Entry& entry) const;
+	static int _MakeGrams(const unsigned short *nodes, int length, unsigned int *grams);
+	static int _Distance(const BOSearchWord *peq, int m, const unsigned short *text, int n);
+	static bool _Better(const BOMatch& m1, const BOMatch& m2);
+	static void _Keep(BOMatch *matches, int& count, int maxMatches, const BOMatch& match);
+#ifdef _WIN32
+	static unsigned __stdcall _SearchThread(void *param);
+#else
+	static void *_SearchThread(void *param);
+#endif
+};
+
+#endif
@@ -7,63 +7,9 @@
 static char THIS_FILE[] = __FILE__;
 #endif
 
-BONode * BONode::FindChild(const BONode& node, bool add) 
-{
-	// find existing node
-	for(int i=0;i< GetChildrenCount();i++)
-	{
-		BONode *child = GetChild(i);
-		if(*child == node) 
-		{
-			if(child->GetType()==TERMINATOR)
-				child->IncRef(); 
-			return child;
-		}
-	}
-
-	// if not found and we must add it
-	if(add)
-	{
-		// create new node
-		BONode *newchild = new BONode(this,node.GetContent(),node.GetType());
-		m_children.Add(newchild);
-		return newchild;
-	}
-	return 0;
-}
-
-void BONode::GoDown(IBOLister *lister, BONodeList* bo)
-{
-	// for each node at current level
-	for(int i=0;i<GetChildrenCount();i++)
-	{
-		BONode *child = GetChild(i);
-		
-		// if child is a leaf
-		if(child->IsLeaf()) 
-		{
-			// it should be a terminator too
-			assert(child->GetType()==TERMINATOR);
-			// register another unique bo
-			lister->AddBO(bo,child->GetCount());
-		}
-		else 
-		{
-			// add node in BO
-			bo->AddNode(child);
-			// go down one level
-			child->GoDown(lister,bo);
-			// remove node from BO
-			bo->RemoveLastNode();
-		}
-	}
-}
-
-
 // get object name
 const char *BONode::GetName() const 
 {
-	assert(m_type!=TERMINATOR);
 	return (m_type==BLD || m_type==UNIT) ? BWrepGameData::GetObjectNameFromID(m_content):
 		   m_type==RES ? BWrepGameData::GetResearchNameFromID(m_content):
 			             BWrepGameData::GetUpgradeNameFromID(m_content);
@@ -71,7 +17,6 @@ const char *BONode::GetName() const
 
 void BONode::ToString(CString& str, bool readable) const
 {
-	assert(m_type!=TERMINATOR);
 	if(!readable)
 	{
 		str.Format("%04X",GetADN());
@@ -94,7 +39,6 @@ void BONode::FromString(const CString& str)
 	sscanf((const char*)str,"%x",&val);
 	m_content = val & 0x00FF;
 	m_type = ((val & 0xFF00)>>8);
-	m_count = 1;
 	assert(GetName()!=0);
 }
 
@@ -104,11 +48,11 @@ bool BONode::Exclude(int options) const
 	if(options==-1) return false;
 
 	// shall we skip it?
-	if((options&BOTree::BUILDING)==0 && GetType()==BONode::BLD) return true;
-	if((options&BOTree::UNIT)==0 && GetType()==BONode::UNIT) return true;
-	if((options&BOTree::RESEARCH)==0 && GetType()==BONode::RES) return true;
-	if((options&BOTree::UPGRADE)==0 && GetType()==BONode::UPG) return true;
-	if((options&BOTree::DEPOTS)==0) 
+	if((options&BONodeList::BUILDING)==0 && GetType()==BONode::BLD) return true;
+	if((options&BONodeList::UNIT)==0 && GetType()==BONode::UNIT) return true;
+	if((options&BONodeList::RESEARCH)==0 && GetType()==BONode::RES) return true;
+	if((options&BONodeList::UPGRADE)==0 && GetType()==BONode::UPG) return true;
+	if((options&BONodeList::DEPOTS)==0) 
 	{
 		if(	(GetType()==BONode::BLD && GetContent() == BWrepGameData::OBJ_SUPPLYDEPOT) ||
 			(GetType()==BONode::BLD && GetContent() == BWrepGameData::OBJ_PYLON) ||
@@ -165,54 +109,3 @@ BONodeList& BONodeList::operator = (const BONodeList& src)
 }
 
 //------------------------------------------------------------------------
-
-// add a build order to the tree
-void BOTree::AddBO(const BONodeList& bo, int options, int maxnode)
-{
-	// for each node in the BO
-	BONode *parent =&m_root;
-	for(int i=0,j=0;i<bo.GetCount();i++)
-	{
-		// get node
-		BONode *node =bo.GetNode(i);
-
-		// shall we skip it?
-		if(node->Exclude(options)) continue;
-
-		// find it or add it the children list at the current level
-		parent = parent->FindChild(*node, true);
-		if(maxnode>0 && ++j==maxnode) break;
-	}
-
-	// add terminating node
-	BONode term(0,0,BONode::TERMINATOR);
-	parent->FindChild(term, true);
-
-#ifndef NDEBUG
-	#if 0
-	ListUniqueBos(this);
-	OutputDebugString("-----------------------\r\n");
-	#endif
-#endif
-}
-
-//------------------------------------------------------------------------
-
-void BOTree::ListUniqueBos(IBOLister *lister)
-{
-	BONodeList bo;
-	m_root.GoDown(lister, &bo);
-}
-
-// for debugging
-void BOTree::AddBO(BONodeList* bo, int count)
-{
-	CString str;
-	bo->ToString(str,true);
-	CString str2;
-	str2.Format("%d %s\r\n",count,(const char*)str);
-	OutputDebugString(str2);
-}
-
-//------------------------------------------------------------------------
-
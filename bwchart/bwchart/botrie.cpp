@@ -0,0 +1,673 @@
+// botrie.cpp : implementation of the BOTrie class
+//
+
+#include "botrie.h"
+#include "ingest.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
+
+// smallest number of build orders worth a shard of their own
+#define SHARDMIN 2048
+#define MAXTHREADS 64
+
+//---------------------------------------------------------------------------------------
+
+// atomic increment (returns new value)
+static long _Increment(volatile long *dest)
+{
+#ifdef _WIN32
+	return InterlockedIncrement(dest);
+#else
+	return __sync_add_and_fetch(dest,1);
+#endif
+}
+
+//---------------------------------------------------------------------------------------
+
+BOTrie::BOTrie() : m_maxLength(0)
+{
+	memset(&m_trie,0,sizeof(m_trie));
+}
+
+BOTrie::~BOTrie()
+{
+	_FreeOutput(m_trie);
+}
+
+void BOTrie::Clear()
+{
+	_FreeOutput(m_trie);
+	m_maxLength=0;
+}
+
+//---------------------------------------------------------------------------------------
+
+int BOTrie::_AddNodes(Output& out, int count)
+{
+	if(out.m_nodeCount+count>out.m_nodeSize)
+	{
+		out.m_nodeSize = out.m_nodeSize==0 ? 1024 : 2*out.m_nodeSize;
+		if(out.m_nodeSize<out.m_nodeCount+count) out.m_nodeSize=out.m_nodeCount+count;
+		out.m_nodes = (Node*)realloc(out.m_nodes,out.m_nodeSize*sizeof(Node));
+	}
+	memset(out.m_nodes+out.m_nodeCount,0,count*sizeof(Node));
+	out.m_nodeCount+=count;
+	return out.m_nodeCount-count;
+}
+
+int BOTrie::_AddLabels(Output& out, int count)
+{
+	if(out.m_labelCount+count>out.m_labelSize)
+	{
+		out.m_labelSize = out.m_labelSize==0 ? 4096 : 2*out.m_labelSize;
+		if(out.m_labelSize<out.m_labelCount+count) out.m_labelSize=out.m_labelCount+count;
+		out.m_labels = (unsigned short*)realloc(out.m_labels,out.m_labelSize*sizeof(unsigned short));
+		out.m_timeSums = (unsigned int*)realloc(out.m_timeSums,out.m_labelSize*sizeof(unsigned int));
+	}
+	out.m_labelCount+=count;
+	return out.m_labelCount-count;
+}
+
+void BOTrie::_FreeOutput(Output& out)
+{
+	free(out.m_nodes);
+	free(out.m_labels);
+	free(out.m_timeSums);
+	memset(&out,0,sizeof(out));
+}
+
+//---------------------------------------------------------------------------------------
+
+// add a child to a shard node, at position pos in its sorted children
+int BOTrie::_AddShardChild(Shard& shard, int parent, int pos, unsigned short key)
+{
+	// new node
+	if(shard.m_nodeCount==shard.m_nodeSize)
+	{
+		shard.m_nodeSize*=2;
+		shard.m_nodes = (ShardNode*)realloc(shard.m_nodes,shard.m_nodeSize*sizeof(ShardNode));
+	}
+	int child = shard.m_nodeCount++;
+	memset(&shard.m_nodes[child],0,sizeof(ShardNode));
+	shard.m_nodes[child].m_key = key;
+
+	// children are moved to the end of the pool when they dont fit anymore
+	ShardNode& p = shard.m_nodes[parent];
+	if(p.m_childCount==p.m_childSize)
+	{
+		int size = p.m_childSize==0 ? 1 : 2*p.m_childSize;
+		if(shard.m_poolUsed+size>shard.m_poolSize)
+		{
+			shard.m_poolSize = 2*shard.m_poolSize+size;
+			shard.m_pool = (int*)realloc(shard.m_pool,shard.m_poolSize*sizeof(int));
+		}
+		memcpy(shard.m_pool+shard.m_poolUsed,shard.m_pool+p.m_children,p.m_childCount*sizeof(int));
+		p.m_children = shard.m_poolUsed;
+		p.m_childSize = size;
+		shard.m_poolUsed += size;
+	}
+	int *children = shard.m_pool+p.m_children;
+	memmove(children+pos+1,children+pos,(p.m_childCount-pos)*sizeof(int));
+	children[pos]=child;
+	p.m_childCount++;
+	return child;
+}
+
+void BOTrie::_InsertShard(Shard& shard, const BOTrieEntry& entry)
+{
+	if(entry.m_matchup<0 || entry.m_matchup>=MAXMATCHUPS) {assert(0); return;}
+
+	int node = entry.m_matchup;
+	shard.m_nodes[node].m_count++;
+	for(int i=0; i<entry.m_length; i++)
+	{
+		// find child (children are sorted)
+		unsigned short key = entry.m_nodes[i];
+		const ShardNode& parent = shard.m_nodes[node];
+		const int *children = shard.m_pool+parent.m_children;
+		int lo=0, hi=parent.m_childCount;
+		while(lo<hi)
+		{
+			int mid=(lo+hi)/2;
+			if(shard.m_nodes[children[mid]].m_key<key) lo=mid+1; else hi=mid;
+		}
+		int child = lo<parent.m_childCount && shard.m_nodes[children[lo]].m_key==key ? children[lo] : _AddShardChild(shard,node,lo,key);
+
+		// count build order
+		ShardNode& c = shard.m_nodes[child];
+		c.m_count++;
+		if(entry.m_times!=0) {c.m_timed++; c.m_timeSum+=entry.m_times[i];}
+		node = child;
+	}
+	shard.m_nodes[node].m_ends++;
+}
+
+void BOTrie::_FreeShard(Shard& shard)
+{
+	free(shard.m_nodes);
+	free(shard.m_pool);
+	memset(&shard,0,sizeof(shard));
+}
+
+//---------------------------------------------------------------------------------------
+
+int BOTrie::_CompareRef(const void *ref1, const void *ref2)
+{
+	const ShardRef *r1 = (const ShardRef *)ref1;
+	const ShardRef *r2 = (const ShardRef *)ref2;
+	if(r1->m_key!=r2->m_key) return r1->m_key<r2->m_key ? -1 : 1;
+	return r1->m_shard-r2->m_shard;
+}
+
+// children of a set of shard nodes, sorted by first node
+int BOTrie::_Children(const Shard *shards, const ShardRef *refs, int count, ShardRef **children)
+{
+	int i,j,total=0;
+	for(i=0; i<count; i++) total += shards[refs[i].m_shard].m_nodes[refs[i].m_node].m_childCount;
+	*children = (ShardRef*)malloc((total>0 ? total : 1)*sizeof(ShardRef));
+
+	int n=0;
+	for(i=0; i<count; i++)
+	{
+		const Shard& shard = shards[refs[i].m_shard];
+		const ShardNode& node = shard.m_nodes[refs[i].m_node];
+		for(j=0; j<node.m_childCount; j++)
+		{
+			ShardRef& child = (*children)[n++];
+			child.m_node = shard.m_pool[node.m_children+j];
+			child.m_key = shard.m_nodes[child.m_node].m_key;
+			child.m_shard = refs[i].m_shard;
+		}
+	}
+	if(count>1) qsort(*children,total,sizeof(ShardRef),_CompareRef);
+	return total;
+}
+
+// merge shard nodes with the same first node into the radix trie node at slot
+void BOTrie::_MergeNode(Output& out, const Shard *shards, ShardRef *refs, int count, int slot)
+{
+	Node node;
+	memset(&node,0,sizeof(node));
+	node.m_key = refs[0].m_key;
+	node.m_label = out.m_labelCount;
+
+	// follow nodes while there is a single branch
+	ShardRef *chain=0;
+	ShardRef single;
+	ShardRef *children;
+	int childCount;
+	for(;;)
+	{
+		int i,total=0,ends=0,timed=0;
+		unsigned int timeSum=0;
+		for(i=0; i<count; i++)
+		{
+			const ShardNode& n = shards[refs[i].m_shard].m_nodes[refs[i].m_node];
+			total+=n.m_count;
+			ends+=n.m_ends;
+			timed+=n.m_timed;
+			timeSum+=n.m_timeSum;
+		}
+		if(node.m_labelLength==0) {node.m_count=total; node.m_timed=timed;}
+		int label = _AddLabels(out,1);
+		out.m_labels[label] = refs[0].m_key;
+		out.m_timeSums[label] = timeSum;
+		node.m_labelLength++;
+		node.m_ends = ends;
+		bool full = node.m_labelLength==0xFFFF;
+
+		// a node of one shard with one child (the tail of most build orders)
+		const Shard& shard = shards[refs[0].m_shard];
+		const ShardNode& n = shard.m_nodes[refs[0].m_node];
+		if(count==1 && ends==0 && n.m_childCount==1 && !full)
+		{
+			single.m_shard = refs[0].m_shard;
+			single.m_node = shard.m_pool[n.m_children];
+			single.m_key = shard.m_nodes[single.m_node].m_key;
+			free(chain);
+			chain=0;
+			refs=&single;
+			continue;
+		}
+
+		childCount = _Children(shards,refs,count,&children);
+		bool branch = childCount==0 || children[0].m_key!=children[childCount-1].m_key;
+		if(ends>0 || branch || full) break;
+		free(chain);
+		chain = refs = children;
+		count = childCount;
+	}
+	free(chain);
+
+	// one child per first node
+	int i,groups=0;
+	for(i=0; i<childCount; i++) if(i==0 || children[i].m_key!=children[i-1].m_key) groups++;
+	if(groups>0) node.m_first = _AddNodes(out,groups);
+	node.m_childCount = groups;
+	out.m_nodes[slot] = node;
+
+	// merge children
+	for(int g=0, start=0; start<childCount; g++)
+	{
+		int end=start+1;
+		while(end<childCount && children[end].m_key==children[start].m_key) end++;
+		_MergeNode(out,shards,children+start,end-start,node.m_first+g);
+		start=end;
+	}
+	free(children);
+}
+
+//---------------------------------------------------------------------------------------
+
+void BOTrie::_Fill(Job& job)
+{
+	// matchup roots
+	Shard& shard = job.m_shards[job.m_thread];
+	shard.m_nodeSize = 1024;
+	shard.m_nodes = (ShardNode*)calloc(shard.m_nodeSize,sizeof(ShardNode));
+	shard.m_nodeCount = MAXMATCHUPS;
+
+	// insert our share of build orders
+	for(int i=job.m_entryStart; i<job.m_entryEnd; i++)
+		_InsertShard(shard,job.m_entries[i]);
+}
+
+void BOTrie::_Merge(Job& job)
+{
+	Output& out = job.m_output;
+	for(;;)
+	{
+		// next subtrie
+		int t = (int)_Increment(job.m_nextTask)-1;
+		if(t>=job.m_taskCount) break;
+		Task& task = job.m_tasks[t];
+
+		// merge it in our output, its root first
+		task.m_thread = job.m_thread;
+		task.m_nodeStart = _AddNodes(out,1);
+		task.m_labelStart = out.m_labelCount;
+		_MergeNode(out,job.m_shards,task.m_refs,task.m_refCount,task.m_nodeStart);
+		task.m_nodeEnd = out.m_nodeCount;
+		task.m_labelEnd = out.m_labelCount;
+	}
+}
+
+// copy a merged subtrie in the final trie
+void BOTrie::_Copy(const Output& src, const Task& task)
+{
+	// labels
+	int label = _AddLabels(m_trie,task.m_labelEnd-task.m_labelStart);
+	memcpy(m_trie.m_labels+label,src.m_labels+task.m_labelStart,(task.m_labelEnd-task.m_labelStart)*sizeof(unsigned short));
+	memcpy(m_trie.m_timeSums+label,src.m_timeSums+task.m_labelStart,(task.m_labelEnd-task.m_labelStart)*sizeof(unsigned int));
+	int labelDelta = label-task.m_labelStart;
+
+	// root goes to its slot, the other nodes at the end
+	int first = _AddNodes(m_trie,task.m_nodeEnd-task.m_nodeStart-1);
+	int nodeDelta = first-(task.m_nodeStart+1);
+	for(int i=task.m_nodeStart; i<task.m_nodeEnd; i++)
+	{
+		Node node = src.m_nodes[i];
+		node.m_label += labelDelta;
+		if(node.m_childCount>0) node.m_first += nodeDelta;
+		m_trie.m_nodes[i==task.m_nodeStart ? task.m_slot : i+nodeDelta] = node;
+	}
+}
+
+#ifdef _WIN32
+unsigned __stdcall BOTrie::_JobThread(void *param)
+#else
+void *BOTrie::_JobThread(void *param)
+#endif
+{
+	Job *job = (Job *)param;
+	if(job->m_merge) job->m_owner->_Merge(*job);
+	else job->m_owner->_Fill(*job);
+	return 0;
+}
+
+// run jobs, one thread each (a job whose thread cant be started runs here)
+void BOTrie::_RunJobs(Job *jobs, int threadCount)
+{
+	int i;
+	if(threadCount==1) {_JobThread(&jobs[0]); return;}
+
+#ifdef _WIN32
+	HANDLE threads[MAXTHREADS];
+	for(i=0; i<threadCount; i++) threads[i] = (HANDLE)_beginthreadex(0,0,_JobThread,&jobs[i],0,0);
+	for(i=0; i<threadCount; i++)
+	{
+		if(threads[i]==0) {_JobThread(&jobs[i]); continue;}
+		WaitForSingleObject(threads[i],INFINITE);
+		CloseHandle(threads[i]);
+	}
+#else
+	pthread_t threads[MAXTHREADS];
+	bool started[MAXTHREADS];
+	for(i=0; i<threadCount; i++) started[i] = pthread_create(&threads[i],0,_JobThread,&jobs[i])==0;
+	for(i=0; i<threadCount; i++)
+	{
+		if(!started[i]) _JobThread(&jobs[i]);
+		else pthread_join(threads[i],0);
+	}
+#endif
+}
+
+int BOTrie::_CompareTask(const void *task1, const void *task2)
+{
+	// biggest first
+	return ((const Task *)task2)->m_count-((const Task *)task1)->m_count;
+}
+
+void BOTrie::Build(const BOTrieEntry *entries, int count, int threads)
+{
+	int i,mu;
+	Clear();
+	for(i=0; i<count; i++) if(entries[i].m_length>m_maxLength) m_maxLength=entries[i].m_length;
+
+	// one shard per thread, unless shards would be too small
+	if(threads<=0) threads = IngestPipeline::GetProcessorCount();
+	if(threads>count/SHARDMIN) threads = count/SHARDMIN;
+	if(threads>MAXTHREADS) threads = MAXTHREADS;
+	if(threads<1) threads = 1;
+
+	// fill shards
+	Shard *shards = (Shard*)calloc(threads,sizeof(Shard));
+	Job *jobs = (Job*)calloc(threads,sizeof(Job));
+	volatile long nextTask=0;
+	for(i=0; i<threads; i++)
+	{
+		jobs[i].m_owner = this;
+		jobs[i].m_thread = i;
+		jobs[i].m_merge = false;
+		jobs[i].m_entries = entries;
+		jobs[i].m_entryStart = (int)((double)count*i/threads);
+		jobs[i].m_entryEnd = (int)((double)count*(i+1)/threads);
+		jobs[i].m_shards = shards;
+		jobs[i].m_nextTask = &nextTask;
+	}
+	_RunJobs(jobs,threads);
+
+	// matchup roots, and one task per first node of a matchup
+	Task *tasks=0;
+	int taskCount=0, taskSize=0;
+	ShardRef roots[MAXTHREADS];
+	_AddNodes(m_trie,MAXMATCHUPS);
+	for(mu=0; mu<MAXMATCHUPS; mu++)
+	{
+		for(i=0; i<threads; i++)
+		{
+			roots[i].m_key = 0;
+			roots[i].m_shard = (short)i;
+			roots[i].m_node = mu;
+			m_trie.m_nodes[mu].m_count += shards[i].m_nodes[mu].m_count;
+			m_trie.m_nodes[mu].m_ends += shards[i].m_nodes[mu].m_ends;
+		}
+
+		// children of the root are next to each other
+		ShardRef *children;
+		int childCount = _Children(shards,roots,threads,&children);
+		m_trie.m_nodes[mu].m_first = m_trie.m_nodeCount;
+		for(int start=0; start<childCount;)
+		{
+			int end=start+1;
+			while(end<childCount && children[end].m_key==children[start].m_key) end++;
+			if(taskCount==taskSize)
+			{
+				taskSize = taskSize==0 ? 256 : 2*taskSize;
+				tasks = (Task*)realloc(tasks,taskSize*sizeof(Task));
+			}
+			Task& task = tasks[taskCount++];
+			memset(&task,0,sizeof(task));
+			task.m_refCount = end-start;
+			task.m_refs = (ShardRef*)malloc(task.m_refCount*sizeof(ShardRef));
+			memcpy(task.m_refs,children+start,task.m_refCount*sizeof(ShardRef));
+			for(i=start; i<end; i++) task.m_count += shards[children[i].m_shard].m_nodes[children[i].m_node].m_count;
+			task.m_slot = _AddNodes(m_trie,1);
+			m_trie.m_nodes[mu].m_childCount++;
+			start=end;
+		}
+		free(children);
+	}
+
+	// merge shards
+	if(taskCount>1) qsort(tasks,taskCount,sizeof(Task),_CompareTask);
+	for(i=0; i<threads; i++) jobs[i].m_merge = true;
+	for(i=0; i<threads; i++) jobs[i].m_tasks = tasks;
+	for(i=0; i<threads; i++) jobs[i].m_taskCount = taskCount;
+	_RunJobs(jobs,threads>taskCount ? (taskCount>0 ? taskCount : 1) : threads);
+
+	// gather merged subtries
+	for(i=0; i<taskCount; i++)
+	{
+		_Copy(jobs[tasks[i].m_thread].m_output,tasks[i]);
+		free(tasks[i].m_refs);
+	}
+	free(tasks);
+	for(i=0; i<threads; i++) _FreeOutput(jobs[i].m_output);
+	for(i=0; i<threads; i++) _FreeShard(shards[i]);
+	free(jobs);
+	free(shards);
+}
+
+//---------------------------------------------------------------------------------------
+
+// cursors at the roots of a matchup (or all of them)
+int BOTrie::_Start(int matchup, Cursor *cursors) const
+{
+	int count=0;
+	if(m_trie.m_nodeCount==0) return 0;
+	for(int mu=0; mu<MAXMATCHUPS; mu++)
+	{
+		if(matchup!=ALLMATCHUPS && mu!=matchup) continue;
+		if(m_trie.m_nodes[mu].m_count==0) continue;
+		cursors[count].m_node = mu;
+		cursors[count].m_pos = 0;
+		count++;
+	}
+	return count;
+}
+
+int BOTrie::_FindChild(const Node& parent, unsigned short key) const
+{
+	int lo=parent.m_first, hi=parent.m_first+parent.m_childCount;
+	while(lo<hi)
+	{
+		int mid=(lo+hi)/2;
+		if(m_trie.m_nodes[mid].m_key<key) lo=mid+1; else hi=mid;
+	}
+	return lo<parent.m_first+parent.m_childCount && m_trie.m_nodes[lo].m_key==key ? lo : -1;
+}
+
+// move cursors one node down (cursors that cant are removed), returns new count
+int BOTrie::_Advance(Cursor *cursors, int count, unsigned short node) const
+{
+	int n=0;
+	for(int i=0; i<count; i++)
+	{
+		Cursor c = cursors[i];
+		const Node& current = m_trie.m_nodes[c.m_node];
+		if(c.m_pos<current.m_labelLength)
+		{
+			if(m_trie.m_labels[current.m_label+c.m_pos]!=node) continue;
+			c.m_pos++;
+		}
+		else
+		{
+			c.m_node = _FindChild(current,node);
+			if(c.m_node<0) continue;
+			c.m_pos = 1;
+		}
+		cursors[n++] = c;
+	}
+	return n;
+}
+
+int BOTrie::_CompareStep(const void *step1, const void *step2)
+{
+	const Step *s1 = (const Step *)step1;
+	const Step *s2 = (const Step *)step2;
+	return s1->m_node==s2->m_node ? 0 : (s1->m_node<s2->m_node ? -1 : 1);
+}
+
+// every next node from a set of cursors, sorted by node
+int BOTrie::_Steps(const Cursor *cursors, int count, Step **steps) const
+{
+	int i,j,total=0;
+	for(i=0; i<count; i++)
+	{
+		const Node& current = m_trie.m_nodes[cursors[i].m_node];
+		total += cursors[i].m_pos<current.m_labelLength ? 1 : current.m_childCount+1;
+	}
+	*steps = (Step*)malloc((total>0 ? total : 1)*sizeof(Step));
+
+	int n=0;
+	for(i=0; i<count; i++)
+	{
+		const Node& current = m_trie.m_nodes[cursors[i].m_node];
+		if(cursors[i].m_pos<current.m_labelLength)
+		{
+			// inside label
+			Step& step = (*steps)[n++];
+			step.m_node = m_trie.m_labels[current.m_label+cursors[i].m_pos];
+			step.m_count = current.m_count;
+			step.m_timeSum = m_trie.m_timeSums[current.m_label+cursors[i].m_pos];
+			step.m_timed = current.m_timed;
+			step.m_next.m_node = cursors[i].m_node;
+			step.m_next.m_pos = cursors[i].m_pos+1;
+			continue;
+		}
+
+		// children
+		for(j=0; j<current.m_childCount; j++)
+		{
+			const Node& child = m_trie.m_nodes[current.m_first+j];
+			Step& step = (*steps)[n++];
+			step.m_node = child.m_key;
+			step.m_count = child.m_count;
+			step.m_timeSum = m_trie.m_timeSums[child.m_label];
+			step.m_timed = child.m_timed;
+			step.m_next.m_node = current.m_first+j;
+			step.m_next.m_pos = 1;
+		}
+
+		// build orders ending here
+		if(current.m_ends>0)
+		{
+			Step& step = (*steps)[n++];
+			memset(&step,0,sizeof(step));
+			step.m_node = END;
+			step.m_count = current.m_ends;
+		}
+	}
+	if(count>1) qsort(*steps,n,sizeof(Step),_CompareStep);
+	return n;
+}
+
+//---------------------------------------------------------------------------------------
+
+int BOTrie::GetPrefixCount(const unsigned short *prefix, int length, int matchup) const
+{
+	Cursor cursors[MAXMATCHUPS];
+	int count = _Start(matchup,cursors);
+	for(int i=0; i<length && count>0; i++) count = _Advance(cursors,count,prefix[i]);
+
+	int total=0;
+	for(int i=0; i<count; i++) total += m_trie.m_nodes[cursors[i].m_node].m_count;
+	return total;
+}
+
+int BOTrie::GetContinuations(const unsigned short *prefix, int length, int matchup, BOContinuation *results, int maxResults) const
+{
+	// go down the prefix
+	Cursor cursors[MAXMATCHUPS];
+	int count = _Start(matchup,cursors);
+	for(int i=0; i<length && count>0; i++) count = _Advance(cursors,count,prefix[i]);
+
+	// next nodes
+	Step *steps;
+	int n = _Steps(cursors,count,&steps);
+	int r=0;
+	for(int i=0; i<n;)
+	{
+		// add up matchups
+		BOContinuation cont;
+		cont.m_node = steps[i].m_node;
+		cont.m_count = 0;
+		unsigned int timeSum=0;
+		int timed=0;
+		for(; i<n && steps[i].m_node==cont.m_node; i++)
+		{
+			cont.m_count += steps[i].m_count;
+			timeSum += steps[i].m_timeSum;
+			timed += steps[i].m_timed;
+		}
+		cont.m_time = timed>0 ? (int)(timeSum/timed) : -1;
+
+		// keep the most common ones
+		int pos=r;
+		while(pos>0 && results[pos-1].m_count<cont.m_count) pos--;
+		if(pos>=maxResults) continue;
+		if(r<maxResults) r++;
+		memmove(results+pos+1,results+pos,(r-1-pos)*sizeof(BOContinuation));
+		results[pos] = cont;
+	}
+	free(steps);
+	return r;
+}
+
+//---------------------------------------------------------------------------------------
+
+void BOTrie::_List(Lister lister, void *context, Cursor *cursors, int count, unsigned short *path, int depth, int maxLength) const
+{
+	int i;
+	if(count==0) return;
+
+	// cut here
+	if(depth==maxLength)
+	{
+		int total=0;
+		for(i=0; i<count; i++) total += m_trie.m_nodes[cursors[i].m_node].m_count;
+		lister(context,path,depth,total);
+		return;
+	}
+
+	// for each next node
+	Step *steps;
+	int n = _Steps(cursors,count,&steps);
+	for(i=0; i<n;)
+	{
+		unsigned short node = steps[i].m_node;
+		Cursor next[MAXMATCHUPS];
+		int nextCount=0, total=0;
+		for(; i<n && steps[i].m_node==node; i++)
+		{
+			next[nextCount++] = steps[i].m_next;
+			total += steps[i].m_count;
+		}
+
+		if(node==END) lister(context,path,depth,total);
+		else
+		{
+			path[depth] = node;
+			_List(lister,context,next,nextCount,path,depth+1,maxLength);
+		}
+	}
+	free(steps);
+}
+
+void BOTrie::List(Lister lister, void *context, int matchup, int maxLength) const
+{
+	Cursor cursors[MAXMATCHUPS];
+	int count = _Start(matchup,cursors);
+	unsigned short *path = (unsigned short*)malloc((m_maxLength>0 ? m_maxLength : 1)*sizeof(unsigned short));
+	_List(lister,context,cursors,count,path,0,maxLength);
+	free(path);
+}
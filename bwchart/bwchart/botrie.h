@@ -0,0 +1,201 @@
+// botrie.h : interface of the BOTrie class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __BOTRIE_H
+#define __BOTRIE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+//--------------------------------------------------------------------------------------
+
+// a build order to add to the trie
+struct BOTrieEntry
+{
+	const unsigned short *m_nodes; // node codes (see BONode::GetADN)
+	const unsigned short *m_times; // time of every node in seconds (0 if unknown)
+	int m_length;
+	int m_matchup; // 0 to BOTrie::MAXMATCHUPS-1
+};
+
+// what comes after a prefix
+struct BOContinuation
+{
+	unsigned short m_node; // node code, BOTrie::END when build orders stop there
+	int m_count;
+	int m_time; // average time in seconds (-1 if unknown)
+};
+
+// Build orders of a set of replays, by matchup, as a radix trie: a chain of nodes
+// that only one branch goes through is kept in one trie node, and the children of
+// a trie node are stored next to each other, sorted by their first build order node.
+// Every position keeps the number of build orders going through it and the sum of
+// their times.
+//
+// Build splits the build orders in shards, fills one plain trie per shard in
+// parallel, then merges the shards into the radix trie, one thread per first node
+// of a matchup.
+//
+class BOTrie
+{
+public:
+	enum {MAXMATCHUPS=8, ALLMATCHUPS=-1, END=0xFFFF};
+
+	BOTrie();
+	~BOTrie();
+
+	void Clear();
+
+	// build from a set of build orders (threads=0 for one per processor)
+	void Build(const BOTrieEntry *entries, int count, int threads=0);
+
+	// number of trie nodes
+	int GetNodeCount() const {return m_trie.m_nodeCount;}
+
+	// number of build orders starting with prefix (for a matchup or all of them)
+	int GetPrefixCount(const unsigned short *prefix, int length, int matchup) const;
+
+	// the most common continuations of a prefix, most common first, returns number of results
+	int GetContinuations(const unsigned short *prefix, int length, int matchup, BOContinuation *results, int maxResults) const;
+
+	// list distinct build orders with their count, build orders longer than maxLength
+	// are cut and counted together
+	typedef void (*Lister)(void *context, const unsigned short *nodes, int length, int count);
+	void List(Lister lister, void *context, int matchup, int maxLength=-1) const;
+
+private:
+	// radix trie node (nodes 0 to MAXMATCHUPS-1 are the matchup roots, with an empty label)
+	struct Node
+	{
+		unsigned short m_key; // first node of label
+		unsigned short m_labelLength;
+		int m_label; // offset in m_labels & m_timeSums
+		int m_first; // first child
+		int m_childCount;
+		int m_count; // build orders going through the node
+		int m_ends; // build orders ending at the end of the label
+		int m_timed; // build orders with times going through the node
+	};
+
+	// growing radix trie (the merge of one thread)
+	struct Output
+	{
+		Node *m_nodes;
+		int m_nodeCount;
+		int m_nodeSize;
+		unsigned short *m_labels;
+		unsigned int *m_timeSums;
+		int m_labelCount;
+		int m_labelSize;
+	};
+
+	// plain trie of a shard (nodes 0 to MAXMATCHUPS-1 are the matchup roots)
+	struct ShardNode
+	{
+		unsigned short m_key;
+		int m_count;
+		int m_ends;
+		int m_timed;
+		unsigned int m_timeSum;
+		int m_children; // offset of child indices in pool
+		int m_childCount;
+		int m_childSize;
+	};
+	struct Shard
+	{
+		ShardNode *m_nodes;
+		int m_nodeCount;
+		int m_nodeSize;
+		int *m_pool;
+		int m_poolUsed;
+		int m_poolSize;
+	};
+
+	// a node of a shard
+	struct ShardRef
+	{
+		unsigned short m_key;
+		short m_shard;
+		int m_node;
+	};
+
+	// subtrie to merge (children of a matchup root with the same first node)
+	struct Task
+	{
+		ShardRef *m_refs;
+		int m_refCount;
+		int m_count;
+		int m_slot; // node in the final trie
+		int m_thread;
+		int m_nodeStart, m_nodeEnd; // in the output of the thread
+		int m_labelStart, m_labelEnd;
+	};
+
+	// state shared by build threads
+	struct Job
+	{
+		BOTrie *m_owner;
+		int m_thread;
+		bool m_merge; // fill shards or merge them
+		const BOTrieEntry *m_entries;
+		int m_entryStart, m_entryEnd;
+		Shard *m_shards;
+		Task *m_tasks;
+		int m_taskCount;
+		volatile long *m_nextTask;
+		Output m_output;
+	};
+
+	// position in the trie (m_pos is the number of label nodes already matched)
+	struct Cursor
+	{
+		int m_node;
+		int m_pos;
+	};
+
+	// next node from a cursor
+	struct Step
+	{
+		unsigned short m_node;
+		int m_count;
+		unsigned int m_timeSum;
+		int m_timed;
+		Cursor m_next;
+	};
+
+	Output m_trie;
+	int m_maxLength; // longest build order
+
+	// queries
+	int _Start(int matchup, Cursor *cursors) const;
+	int _FindChild(const Node& parent, unsigned short key) const;
+	int _Advance(Cursor *cursors, int count, unsigned short node) const;
+	int _Steps(const Cursor *cursors, int count, Step **steps) const;
+	void _List(Lister lister, void *context, Cursor *cursors, int count, unsigned short *path, int depth, int maxLength) const;
+
+	// build
+	void _RunJobs(Job *jobs, int threadCount);
+	void _Fill(Job& job);
+	void _Merge(Job& job);
+	void _Copy(const Output& src, const Task& task);
+	static void _InsertShard(Shard& shard, const BOTrieEntry& entry);
+	static int _AddShardChild(Shard& shard, int parent, int pos, unsigned short key);
+	static void _FreeShard(Shard& shard);
+	static int _Children(const Shard *shards, const ShardRef *refs, int count, ShardRef **children);
+	static void _MergeNode(Output& out, const Shard *shards, ShardRef *refs, int count, int slot);
+	static int _AddNodes(Output& out, int count);
+	static int _AddLabels(Output& out, int count);
+	static void _FreeOutput(Output& out);
+	static int _CompareRef(const void *ref1, const void *ref2);
+	static int _CompareStep(const void *step1, const void *step2);
+	static int _CompareTask(const void *task1, const void *task2);
+#ifdef _WIN32
+	static unsigned __stdcall _JobThread(void *param);
+#else
+	static void *_JobThread(void *param);
+#endif
+};
+
+#endif
@@ -0,0 +1,399 @@
+// browseindex.cpp : implementation of the BrowseIndex class
+//
+
+#include "browseindex.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// radix sort is done with 8 bits digits, on several threads for sets bigger than this
+#define RADIX_BUCKETS 256
+#define RADIX_PARALLEL 65536
+#define RADIX_MAXTHREADS 16
+
+//---------------------------------------------------------------------------------------
+
+// one chunk of the set to sort, for one pass
+struct RadixJob
+{
+	const unsigned int *m_keys;
+	const int *m_rows;
+	unsigned int *m_keysOut;
+	int *m_rowsOut;
+	int m_begin;
+	int m_end;
+	int m_shift;
+	int m_counts[RADIX_BUCKETS]; // histogram, then output offsets
+};
+
+static void _Histogram(RadixJob *job)
+{
+	memset(job->m_counts,0,sizeof(job->m_counts));
+	for(int i=job->m_begin;i<job->m_end;i++)
+		job->m_counts[(job->m_keys[i]>>job->m_shift)&(RADIX_BUCKETS-1)]++;
+}
+
+static void _Scatter(RadixJob *job)
+{
+	for(int i=job->m_begin;i<job->m_end;i++)
+	{
+		int pos = job->m_counts[(job->m_keys[i]>>job->m_shift)&(RADIX_BUCKETS-1)]++;
+		job->m_keysOut[pos] = job->m_keys[i];
+		job->m_rowsOut[pos] = job->m_rows[i];
+	}
+}
+
+typedef void (*RadixFn)(RadixJob *job);
+
+struct RadixThread
+{
+	RadixJob *m_job;
+	RadixFn m_fn;
+};
+
+#ifdef _WIN32
+static unsigned __stdcall _RadixThread(void *param)
+#else
+static void *_RadixThread(void *param)
+#endif
+{
+	RadixThread *thread = (RadixThread*)param;
+	thread->m_fn(thread->m_job);
+	return 0;
+}
+
+// run fn on every job, first job on the calling thread
+static void _RunJobs(RadixJob *jobs, int count, RadixFn fn)
+{
+	int i;
+	RadixThread params[RADIX_MAXTHREADS];
+#ifdef _WIN32
+	HANDLE threads[RADIX_MAXTHREADS];
+#else
+	pthread_t threads[RADIX_MAXTHREADS];
+	bool started[RADIX_MAXTHREADS];
+#endif
+
+	for(i=1;i<count;i++)
+	{
+		params[i].m_job = &jobs[i];
+		params[i].m_fn = fn;
+#ifdef _WIN32
+		threads[i] = (HANDLE)_beginthreadex(0,0,_RadixThread,&params[i],0,0);
+		if(threads[i]==0) fn(&jobs[i]);
+#else
+		started[i] = pthread_create(&threads[i],0,_RadixThread,&params[i])==0;
+		if(!started[i]) fn(&jobs[i]);
+#endif
+	}
+
+	fn(&jobs[0]);
+
+	for(i=1;i<count;i++)
+	{
+#ifdef _WIN32
+		if(threads[i]==0) continue;
+		WaitForSingleObject(threads[i],INFINITE);
+		CloseHandle(threads[i]);
+#else
+		if(started[i]) pthread_join(threads[i],0);
+#endif
+	}
+}
+
+static int _ThreadCount(int count)
+{
+	if(count<RADIX_PARALLEL) return 1;
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	int cpus = (int)info.dwNumberOfProcessors;
+#else
+	int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	int threads = count/(RADIX_PARALLEL/2);
+	if(threads>cpus) threads=cpus;
+	if(threads>RADIX_MAXTHREADS) threads=RADIX_MAXTHREADS;
+	return threads<1 ? 1 : threads;
+}
+
+static int _CompareNoCase(const char *s1, const char *s2)
+{
+	for(;;s1++,s2++)
+	{
+		int c1 = (unsigned char)*s1;
+		int c2 = (unsigned char)*s2;
+		if(c1>='A' && c1<='Z') c1+='a'-'A';
+		if(c2>='A' && c2<='Z') c2+='a'-'A';
+		if(c1!=c2 || c1==0) return c1-c2;
+	}
+}
+
+// string ids are sorted with qsort
+static const char *gpPool;
+static const int *gpStrings;
+static const char **gpNames;
+
+static int _CompareStrings(const void *id1, const void *id2)
+{
+	return _CompareNoCase(gpPool+gpStrings[*(const int*)id1],gpPool+gpStrings[*(const int*)id2]);
+}
+
+static int _CompareNames(const void *id1, const void *id2)
+{
+	return _CompareNoCase(gpNames[*(const int*)id1],gpNames[*(const int*)id2]);
+}
+
+//---------------------------------------------------------------------------------------
+
+BrowseIndex::BrowseIndex(int columnCount) : m_columnCount(columnCount), m_rowCount(0), m_rowSize(0),
+	m_pool(0), m_poolUsed(0), m_poolSize(0), m_strings(0), m_ranks(0), m_stringCount(0), m_stringSize(0),
+	m_ranksValid(false), m_index(1024), m_nameFn(0), m_nameContext(0)
+{
+	m_types = (char*)malloc(columnCount);
+	memset(m_types,COL_INT,columnCount);
+	m_columns = (unsigned int**)malloc(columnCount*sizeof(unsigned int*));
+	memset(m_columns,0,columnCount*sizeof(unsigned int*));
+	m_nameRanks = (unsigned int**)malloc(columnCount*sizeof(unsigned int*));
+	memset(m_nameRanks,0,columnCount*sizeof(unsigned int*));
+	m_nameRankCount = (int*)malloc(columnCount*sizeof(int));
+	memset(m_nameRankCount,0,columnCount*sizeof(int));
+	m_nameCount = (int*)malloc(columnCount*sizeof(int));
+	memset(m_nameCount,0,columnCount*sizeof(int));
+}
+
+BrowseIndex::~BrowseIndex()
+{
+	Clear();
+	free(m_types);
+	free(m_columns);
+	free(m_nameRanks);
+	free(m_nameRankCount);
+	free(m_nameCount);
+}
+
+void BrowseIndex::Clear()
+{
+	for(int col=0;col<m_columnCount;col++) {free(m_columns[col]); m_columns[col]=0;}
+	m_rowCount=m_rowSize=0;
+
+	free(m_pool);
+	free(m_strings);
+	free(m_ranks);
+	m_index.Clear();
+	m_pool=0; m_strings=0; m_ranks=0;
+	m_poolUsed=m_poolSize=m_stringCount=m_stringSize=0;
+	m_ranksValid=false;
+	memset(m_nameCount,0,m_columnCount*sizeof(int));
+	InvalidateNames();
+}
+
+void BrowseIndex::InvalidateNames()
+{
+	for(int col=0;col<m_columnCount;col++) {free(m_nameRanks[col]); m_nameRanks[col]=0;}
+	memset(m_nameRankCount,0,m_columnCount*sizeof(int));
+}
+
+void BrowseIndex::SetColumnType(int col, int type)
+{
+	assert(col>=0 && col<m_columnCount);
+	assert(m_rowCount==0);
+	m_types[col]=(char)type;
+}
+
+int BrowseIndex::AddRow()
+{
+	if(m_rowCount==m_rowSize)
+	{
+		m_rowSize = m_rowSize==0 ? 1024 : m_rowSize*2;
+		for(int col=0;col<m_columnCount;col++)
+			m_columns[col] = (unsigned int*)realloc(m_columns[col],m_rowSize*sizeof(unsigned int));
+	}
+	for(int col=0;col<m_columnCount;col++) m_columns[col][m_rowCount]=0;
+	if(m_stringCount==0) _Intern("");
+	return m_rowCount++;
+}
+
+// signed values are stored with their sign bit flipped, so they sort as unsigned
+void BrowseIndex::SetInt(int row, int col, int value)
+{
+	assert(row>=0 && row<m_rowCount && m_types[col]==COL_INT);
+	m_columns[col][row] = (unsigned int)value^0x80000000;
+}
+
+void BrowseIndex::SetString(int row, int col, const char *str)
+{
+	assert(row>=0 && row<m_rowCount && m_types[col]==COL_STRING);
+	m_columns[col][row] = (unsigned int)_Intern(str==0 ? "" : str);
+}
+
+// ids are stored plus one, 0 is no name
+void BrowseIndex::SetName(int row, int col, int id)
+{
+	assert(row>=0 && row<m_rowCount && m_types[col]==COL_NAME);
+	m_columns[col][row] = (unsigned int)(id<0 ? 0 : id+1);
+	if(id>=m_nameCount[col]) m_nameCount[col]=id+1;
+}
+
+//---------------------------------------------------------------------------------------
+
+int BrowseIndex::_Intern(const char *str)
+{
+	// known string?
+	int len = (int)strlen(str)+1;
+	unsigned long hash = HashIndex::Hash(str,len-1);
+	for(int pos=m_index.First(hash); pos>=0; pos=m_index.Next(pos,hash))
+		if(strcmp(m_pool+m_strings[m_index.GetID(pos)],str)==0) return m_index.GetID(pos);
+
+	// add it to pool
+	if(m_poolUsed+len>m_poolSize)
+	{
+		while(m_poolUsed+len>m_poolSize) m_poolSize = m_poolSize==0 ? 16384 : m_poolSize*2;
+		m_pool = (char*)realloc(m_pool,m_poolSize);
+	}
+	if(m_stringCount==m_stringSize)
+	{
+		m_stringSize = m_stringSize==0 ? 1024 : m_stringSize*2;
+		m_strings = (int*)realloc(m_strings,m_stringSize*sizeof(int));
+	}
+	memcpy(m_pool+m_poolUsed,str,len);
+	m_strings[m_stringCount]=m_poolUsed;
+	m_poolUsed+=len;
+	m_index.Add(hash,m_stringCount);
+	m_ranksValid=false;
+	return m_stringCount++;
+}
+
+// rank of every string in case insensitive order (equal strings get the same rank)
+void BrowseIndex::_BuildRanks()
+{
+	int *ids = (int*)malloc(m_stringCount*sizeof(int));
+	for(int i=0;i<m_stringCount;i++) ids[i]=i;
+	gpPool = m_pool;
+	gpStrings = m_strings;
+	qsort(ids,m_stringCount,sizeof(int),_CompareStrings);
+
+	free(m_ranks);
+	m_ranks = (unsigned int*)malloc(m_stringCount*sizeof(unsigned int));
+	unsigned int rank=0;
+	for(int i=0;i<m_stringCount;i++)
+	{
+		if(i>0 && _CompareNoCase(m_pool+m_strings[ids[i-1]],m_pool+m_strings[ids[i]])!=0) rank++;
+		m_ranks[ids[i]]=rank;
+	}
+	free(ids);
+	m_ranksValid=true;
+}
+
+// rank of every name id of a column, same order as strings
+void BrowseIndex::_BuildNameRanks(int col)
+{
+	assert(m_nameFn!=0);
+	int count = m_nameCount[col]+1;
+	const char **names = (const char **)malloc(count*sizeof(const char *));
+	int *ids = (int*)malloc(count*sizeof(int));
+	names[0]="";
+	for(int i=0;i<count;i++)
+	{
+		if(i>0) names[i] = m_nameFn(m_nameContext,col,i-1);
+		if(names[i]==0) names[i]="";
+		ids[i]=i;
+	}
+	gpNames = names;
+	qsort(ids,count,sizeof(int),_CompareNames);
+
+	free(m_nameRanks[col]);
+	m_nameRanks[col] = (unsigned int*)malloc(count*sizeof(unsigned int));
+	unsigned int rank=0;
+	for(int i=0;i<count;i++)
+	{
+		if(i>0 && _CompareNoCase(names[ids[i-1]],names[ids[i]])!=0) rank++;
+		m_nameRanks[col][ids[i]]=rank;
+	}
+	m_nameRankCount[col]=count;
+	free(ids);
+	free(names);
+}
+
+//---------------------------------------------------------------------------------------
+
+void BrowseIndex::Sort(int col, bool ascending, int *rows, int count)
+{
+	int i,c;
+	assert(col>=0 && col<m_columnCount);
+	if(count<2) return;
+
+	// get keys (inverted for descending order, so ties still keep their order)
+	const unsigned int *column = m_columns[col];
+	if(m_types[col]==COL_STRING && !m_ranksValid) _BuildRanks();
+	if(m_types[col]==COL_NAME && m_nameRankCount[col]<m_nameCount[col]+1) _BuildNameRanks(col);
+	unsigned int *keys = (unsigned int*)malloc(2*count*sizeof(unsigned int));
+	int *tmprows = (int*)malloc(count*sizeof(int));
+	unsigned int mask = ascending ? 0 : 0xFFFFFFFF;
+	for(i=0;i<count;i++)
+	{
+		assert(rows[i]>=0 && rows[i]<m_rowCount);
+		unsigned int key = column[rows[i]];
+		if(m_types[col]==COL_STRING) key = m_ranks[key];
+		else if(m_types[col]==COL_NAME) key = m_nameRanks[col][key];
+		keys[i] = key^mask;
+	}
+
+	// split set in chunks
+	int threads = _ThreadCount(count);
+	RadixJob jobs[RADIX_MAXTHREADS];
+	int chunk = (count+threads-1)/threads;
+
+	// least significant digit first, each pass is stable
+	unsigned int *srcKeys=keys, *dstKeys=keys+count;
+	int *srcRows=rows, *dstRows=tmprows;
+	for(int shift=0;shift<32;shift+=8)
+	{
+		for(c=0;c<threads;c++)
+		{
+			jobs[c].m_keys=srcKeys; jobs[c].m_rows=srcRows;
+			jobs[c].m_keysOut=dstKeys; jobs[c].m_rowsOut=dstRows;
+			jobs[c].m_begin = c*chunk;
+			jobs[c].m_end = c*chunk+chunk<count ? c*chunk+chunk : count;
+			jobs[c].m_shift = shift;
+		}
+		_RunJobs(jobs,threads,_Histogram);
+
+		// skip pass when all keys have the same digit
+		int b;
+		for(b=0;b<RADIX_BUCKETS;b++)
+		{
+			int total=0;
+			for(c=0;c<threads;c++) total+=jobs[c].m_counts[b];
+			if(total==count) break;
+			if(total!=0) {b=RADIX_BUCKETS; break;}
+		}
+		if(b<RADIX_BUCKETS) continue;
+
+		// output offsets: by digit, then by chunk
+		int offset=0;
+		for(b=0;b<RADIX_BUCKETS;b++)
+			for(c=0;c<threads;c++)
+			{
+				int n = jobs[c].m_counts[b];
+				jobs[c].m_counts[b]=offset;
+				offset+=n;
+			}
+		_RunJobs(jobs,threads,_Scatter);
+
+		unsigned int *tmpk=srcKeys; srcKeys=dstKeys; dstKeys=tmpk;
+		int *tmpr=srcRows; srcRows=dstRows; dstRows=tmpr;
+	}
+
+	if(srcRows!=rows) memcpy(rows,srcRows,count*sizeof(int));
+	free(tmprows);
+	free(keys);
+}
@@ -0,0 +1,96 @@
+// browseindex.h : interface of the BrowseIndex class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __BROWSEINDEX_H
+#define __BROWSEINDEX_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include "hashindex.h"
+
+// name of an id of a name column, as it's sorted
+typedef const char *(*BrowseNameFn)(void *context, int col, int id);
+
+//--------------------------------------------------------------------------------------
+
+// Columnar table of sort keys for the replay browser.
+//
+// Every row has one 32 bits key per column. Integer columns keep the value itself,
+// string columns keep the id of the interned string, name columns keep the id of a
+// name of the caller (the player and map name ids of the application name table), and
+// the ids are turned into ranks (strings in case insensitive order) when the column is
+// sorted. Sorting a set
+// of rows is a stable radix sort on the keys, spread over several threads for large
+// sets.
+//
+class BrowseIndex
+{
+public:
+	enum {COL_INT, COL_STRING, COL_NAME};
+
+	BrowseIndex(int columnCount);
+	~BrowseIndex();
+
+	// remove all rows, strings and name ranks (column types and name source are kept)
+	void Clear();
+
+	// column type (COL_INT by default)
+	void SetColumnType(int col, int type);
+
+	// names of the ids of name columns (call InvalidateNames when they change)
+	void SetNameSource(BrowseNameFn fn, void *context) {m_nameFn=fn; m_nameContext=context; InvalidateNames();}
+	void InvalidateNames();
+
+	// add a row, returns its index
+	int AddRow();
+	int GetRowCount() const {return m_rowCount;}
+
+	// set cell value
+	void SetInt(int row, int col, int value);
+	void SetString(int row, int col, const char *str);
+	void SetName(int row, int col, int id);
+
+	// sort rows on a column (ties keep their order)
+	void Sort(int col, bool ascending, int *rows, int count);
+
+	// interned strings
+	int GetStringCount() const {return m_stringCount;}
+	const char *GetString(int id) const {return m_pool+m_strings[id];}
+
+private:
+	int m_columnCount;
+	char *m_types;
+	unsigned int **m_columns;
+	int m_rowCount;
+	int m_rowSize;
+
+	// string pool, offsets and case insensitive ranks
+	char *m_pool;
+	int m_poolUsed;
+	int m_poolSize;
+	int *m_strings;
+	unsigned int *m_ranks;
+	int m_stringCount;
+	int m_stringSize;
+	bool m_ranksValid;
+
+	// strings by value
+	HashIndex m_index;
+
+	// name source, and case insensitive ranks of the name ids of every column
+	// (rank 0 for no name, ids above the ranked ones need new ranks)
+	BrowseNameFn m_nameFn;
+	void *m_nameContext;
+	unsigned int **m_nameRanks;
+	int *m_nameRankCount;
+	int *m_nameCount;
+
+	int _Intern(const char *str);
+	void _BuildRanks();
+	void _BuildNameRanks(int col);
+};
+
+#endif
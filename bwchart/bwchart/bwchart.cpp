@@ -194,9 +194,6 @@ int CBwchartApp::_CommandLineMode()
 
 int CBwchartApp::ExitInstance() 
 {
-	DESTROY_LOCAL_HEAP(BWElement);
-	DESTROY_LOCAL_HEAP(ReplayEvt);
-
 	CWinApp::ExitInstance();
 	return m_exitCode;
 }
@@ -3,6 +3,10 @@
 #include"resource.h"
 #include"DlgBWChart.h"
 #include"dirutil.h"
+#include"mapcache.h"
+#include"replaystore.h"
+#include"aggregates.h"
+#include"replaydb.h"
 #include<io.h>
 
 #ifdef _DEBUG
@@ -12,6 +16,9 @@ static char THIS_FILE[] = __FILE__;
 #endif
 
 bool BWChartDB::m_useMyDocuments = true;
+MapAssetCache BWChartDB::m_mapCache;
+ReplayAggregates BWChartDB::m_aggregates;
+static ReplayStore _stores[BWChartDB::__FILEMAX];
 
 char *BWChartDB::m_buffer=0;
 int BWChartDB::m_bufferSize=0;
@@ -39,10 +46,14 @@ const char * BWChartDB::ConverToHex(const char *str)
 	_GetBuffer((lenstr+1)*2);
 
 	// convert chars to Hex values
-	m_buffer[0]=0;
+	static const char digits[]="0123456789ABCDEF";
 	for(int i=0;i<lenstr; i++)
-		sprintf(&m_buffer[strlen(m_buffer)],"%02X",(unsigned char)str[i]);
-	
+	{
+		m_buffer[2*i] = digits[((unsigned char)str[i])>>4];
+		m_buffer[2*i+1] = digits[((unsigned char)str[i])&15];
+	}
+	m_buffer[2*lenstr]=0;
+
 	return m_buffer;
 }
 
@@ -142,12 +153,16 @@ void BWChartDB::_BuildUserDataFileName(CString& rpath, const char *file)
 const char *BWChartDB::GetDatabaseFileName(CString& path, int file)
 {
 	char *files[]={
-		"replays.txt",
-		"favorites.txt",
-		"comments.txt",
+		"replays.db",
+		"favorites.db",
+		"comments.db",
 		"akas.txt",
 		"mapakas.txt",
-		"buildorders.txt"
+		"buildorders.db",
+		"mapcache.bin",
+		"manifest.bin",
+		"aggregates.db",
+		"sparklines.db"
 	};
 	// build rep list file name
 	_BuildUserDataFileName(path,files[file]);
@@ -175,6 +190,16 @@ static void CreateDefaultAka(const char *filename, UINT resID)
 // if file doesnt exist, create it with version number in it
 static void _WriteVersion(int nfile)
 {
+	// store: add version entry if it's missing
+	ReplayStore *store = BWChartDB::GetStore(nfile);
+	if(store!=0)
+	{
+		char buffer[64];
+		BWChartDB::ReadEntry(nfile,TAG_VERSION,"ver",buffer,sizeof(buffer));
+		if(buffer[0]==0) BWChartDB::WriteEntry(nfile,TAG_VERSION,"ver",NVERSION);
+		return;
+	}
+
 	// if file doesnt exist
 	CString repFile;
 	if(_access(BWChartDB::GetDatabaseFileName(repFile, nfile),0)!=0)
@@ -195,6 +220,15 @@ static void _ReadVersion(int nfile, CString& version)
 	CString repFile;
 	version="";
 
+	// store
+	if(BWChartDB::GetStore(nfile)!=0)
+	{
+		char buffer[64];
+		BWChartDB::ReadEntry(nfile,TAG_VERSION,"ver",buffer,sizeof(buffer));
+		version=buffer;
+		return;
+	}
+
 	// if file exists
 	if(_access(BWChartDB::GetDatabaseFileName(repFile, nfile),0)==0)
 	{
@@ -215,6 +249,262 @@ static void _DeleteFile(const char *path)
 
 //-----------------------------------------------------------------------------------------------------------------
 
+ReplayStore *BWChartDB::GetStore(int nfile)
+{
+	if(nfile==FILE_MAIN || nfile==FILE_FAVORITES || nfile==FILE_COMMENTS || nfile==FILE_BOS || nfile==FILE_AGGREGATES || nfile==FILE_SPARKS) return &_stores[nfile];
+	return 0;
+}
+
+// key is section (without ending slash), a zero, then entry
+int BWChartDB::_MakeKey(char *key, int size, const char *section, const char *entry)
+{
+	int lensec = (int)strlen(section);
+	if(lensec>0 && section[lensec-1]=='\\') lensec--;
+	int lenent = (int)strlen(entry);
+	if(lensec+1+lenent>size) return 0;
+	memcpy(key,section,lensec);
+	key[lensec]=0;
+	memcpy(key+lensec+1,entry,lenent);
+	return lensec+1+lenent;
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
+// delete a database file (store is emptied)
+void BWChartDB::_DeleteDatabaseFile(int nfile)
+{
+	CString path;
+	GetDatabaseFileName(path, nfile);
+	ReplayStore *store = GetStore(nfile);
+	if(store==0) {_DeleteFile(path); return;}
+
+	// store is mapped in memory, close it first
+	char logPath[MAX_PATH+8];
+	store->Close();
+	_DeleteFile(path);
+	_DeleteFile(ReplayStore::GetLogFileName(logPath,sizeof(logPath),path));
+	store->Open(path);
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
+// section/entry/data as they are in INI file (section/entry in HEX)
+typedef void (*IniEntryCallback)(void *context, const char *section, const char *entry, const char *data, int percentage);
+
+static bool _ParseIniFile(const char *path, IniEntryCallback fn, void *context)
+{
+	FILE *fp=fopen(path,"rb");
+	if(fp==0) return false;
+
+	// get file size
+	fseek(fp,0,SEEK_END);
+	unsigned long fsize=(unsigned long)ftell(fp);
+	fseek(fp,0,SEEK_SET);
+
+	// read line by line
+	char line[2408];
+	char reppath[512];
+	char repname[512];
+	reppath[0]=0;
+	repname[0]=0;
+	unsigned long sizeRead=0;
+	while(fgets(line,sizeof(line),fp)!=0)
+	{
+		// update size read
+		sizeRead+=strlen(line);
+		unsigned long percentage = (100UL*sizeRead)/fsize;
+
+		// remove end of line
+		char *text=strtok(line,"\r\n");
+		if(text==0) continue;
+
+		// skip blanks
+		while(*text==' ') text++;
+
+		// comment?
+		if(text[0]==';' || text[0]==0) continue;
+
+		// if it is a section
+		if(text[0]=='[')
+		{
+			text++;
+			char *p=strrchr(text,']');
+			if(p!=0)
+			{
+				*p=0; 
+				if(strcmp(text,TAG_VERSION)!=0)
+				{
+					strcpy(reppath,BWChartDB::ConverFromHex(text));
+					continue;
+				}
+			}
+			reppath[0]=0;
+		}
+		else
+		{
+			// must be an entry, extract entry name
+			char *p=strtok(text,"=");
+			if(p==0) continue;
+			strcpy(repname,BWChartDB::ConverFromHex(p));
+			char *data=p+strlen(p)+1;
+			// process entry
+			if(reppath[0]!=0 && data) fn(context, reppath, repname, data, (int)percentage);
+		}
+	}
+
+	//close file
+	fclose(fp);
+	return true;
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
+static void _ImportEntry(void *context, const char *section, const char *entry, const char *data, int /*percentage*/)
+{
+	int nfile = *(int*)context;
+	// bos were not converted to HEX
+	BWChartDB::WriteEntry(nfile,section,entry,nfile==BWChartDB::FILE_BOS ? data : BWChartDB::ConverFromHex(data));
+}
+
+// copy INI file from previous versions into its store
+void BWChartDB::_ImportIniFile(int nfile)
+{
+	char *files[]={
+		"replays.txt",
+		"favorites.txt",
+		"comments.txt",
+		"",
+		"",
+		"buildorders.txt",
+		"",
+		"",
+		"",
+		""
+	};
+	if(files[nfile][0]==0) return;
+
+	// only if store doesnt exist yet
+	CString path;
+	char logPath[MAX_PATH+8];
+	GetDatabaseFileName(path, nfile);
+	if(_access(path,0)==0 || _access(ReplayStore::GetLogFileName(logPath,sizeof(logPath),path),0)==0) return;
+
+	// and there is an INI file that wasnt imported yet
+	CString iniFile;
+	_BuildUserDataFileName(iniFile,files[nfile]);
+	if(_access(iniFile,0)!=0 || _access(iniFile+".bak",0)==0) return;
+
+	// copy version and entries
+	char buffer[64];
+	::GetPrivateProfileString(TAG_VERSION,"ver","",buffer,sizeof(buffer),iniFile);
+	if(buffer[0]!=0) WriteEntry(nfile,TAG_VERSION,"ver",buffer);
+	_ParseIniFile(iniFile,_ImportEntry,&nfile);
+
+	// retire INI file once it's in the store (so clearing the database doesnt bring it back)
+	if(GetStore(nfile)->Compact()) ::MoveFileEx(iniFile,iniFile+".bak",MOVEFILE_REPLACE_EXISTING);
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
+void BWChartDB::_OpenStores()
+{
+	CString path;
+	for(int i=0;i<__FILEMAX;i++)
+	{
+		ReplayStore *store = GetStore(i);
+		if(store==0) continue;
+		store->Open(GetDatabaseFileName(path, i));
+		_ImportIniFile(i);
+	}
+}
+
+void BWChartDB::_CloseStores()
+{
+	for(int i=0;i<__FILEMAX;i++)
+		if(GetStore(i)!=0) GetStore(i)->Close();
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
+// add main file record to player and map aggregates (context is the sign: 1 to add, -1 to subtract)
+void BWChartDB::_AggregateRecord(void *context, const char *key, int keyLen, const char *value, int valLen, int /*percentage*/)
+{
+	// split key, skip version
+	const char *entry = (const char *)memchr(key,0,keyLen);
+	if(entry==0 || strcmp(key,TAG_VERSION)==0) return;
+	entry++;
+	CString strEntry(entry,keyLen-(int)(entry-key));
+	CString data(value,valLen);
+
+	// same replays as the ones the browser loads
+	ReplayInfo rep;
+	rep.ExtractInfo(key,strEntry,(char*)(const char*)data,false);
+	if(rep.m_playerCount<=0) return;
+
+	// players and map
+	int sign = context!=0 ? *(int*)context : 1;
+	AggregateStats stats;
+	for(int k=0; k<rep.m_playerCount; k++)
+	{
+		rep.m_player[k].TrimRight();
+		rep.GetPlayerStats(k,stats);
+		m_aggregates.Add(ReplayAggregates::KIND_PLAYER,key,rep.m_player[k],stats,sign);
+	}
+	rep.m_map.TrimRight();
+	rep.GetMapStats(stats);
+	m_aggregates.Add(ReplayAggregates::KIND_MAP,key,rep.m_map,stats,sign);
+}
+
+// main file record is about to change (before) or has changed
+void BWChartDB::_UpdateAggregates(const char *key, int keyLen, bool before)
+{
+	if(!m_aggregates.IsLoaded()) return;
+
+	// aggregates dont match main file until the change is done
+	ReplayStore *store = GetStore(FILE_MAIN);
+	if(before) BeginUpdate();
+
+	// subtract old record or add new one (read it again if it doesnt fit)
+	char buffer[4096];
+	char *record = buffer;
+	int valLen = store->Read(key,keyLen,buffer,sizeof(buffer));
+	if(valLen>=(int)sizeof(buffer))
+	{
+		record = (char*)malloc(valLen+1);
+		valLen = record==0 ? -1 : store->Read(key,keyLen,record,valLen+1);
+	}
+	int sign = before ? -1 : 1;
+	if(valLen>=0) _AggregateRecord(&sign,key,keyLen,record,valLen,0);
+	if(record!=buffer) free(record);
+
+	if(!before) EndUpdate();
+}
+
+// batch aggregates writes of several main file changes
+void BWChartDB::BeginUpdate()
+{
+	if(m_aggregates.IsLoaded()) m_aggregates.BeginUpdate();
+}
+
+void BWChartDB::EndUpdate()
+{
+	if(m_aggregates.IsLoaded()) m_aggregates.EndUpdate(GetStore(FILE_MAIN)->GetRecordCount());
+}
+
+// read aggregates, compute them again from main file if they dont match it
+void BWChartDB::_LoadAggregates()
+{
+	m_aggregates.Load(GetStore(FILE_AGGREGATES));
+	ReplayStore *store = GetStore(FILE_MAIN);
+	if(m_aggregates.GetSourceCount()==store->GetRecordCount()) return;
+	m_aggregates.Clear();
+	m_aggregates.BeginUpdate();
+	store->Enumerate(_AggregateRecord,0);
+	m_aggregates.EndUpdate(store->GetRecordCount());
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
 void BWChartDB::_MoveReplayFile(int nfile, bool tobwchart)
 {	
 	CString fileFrom;
@@ -232,6 +522,14 @@ void BWChartDB::_MoveReplayFile(int nfile, bool tobwchart)
 	// move file
 	MoveFile(fileFrom,fileTo);
 
+	// and its log
+	if(GetStore(nfile)!=0)
+	{
+		char logFrom[MAX_PATH+8];
+		char logTo[MAX_PATH+8];
+		MoveFile(ReplayStore::GetLogFileName(logFrom,sizeof(logFrom),fileFrom),ReplayStore::GetLogFileName(logTo,sizeof(logTo),fileTo));
+	}
+
 	// restore flag
 	m_useMyDocuments = mydoc;
 }
@@ -243,9 +541,15 @@ void BWChartDB::UpdateDatabaseDir(bool mydoc)
 {	
 	if(m_useMyDocuments==mydoc) return;
 
+	// map cache and stores are mapped in memory, close them while moving files
+	m_mapCache.Close();
+	_CloseStores();
 	m_useMyDocuments=mydoc;
 	for(int i=0;i<__FILEMAX;i++)
 		_MoveReplayFile(i,!m_useMyDocuments);
+	CString path;
+	m_mapCache.Open(GetDatabaseFileName(path, FILE_MAPCACHE));
+	_OpenStores();
 }
 
 //-----------------------------------------------------------------------------------------------------------------
@@ -254,10 +558,12 @@ bool BWChartDB::ClearDatabase()
 {
 	if(AfxMessageBox(IDS_DELETEALL,MB_YESNO)==IDNO) return false;
 
-	CString file;
-	_DeleteFile(GetDatabaseFileName(file, FILE_MAIN));
-	_DeleteFile(GetDatabaseFileName(file, FILE_FAVORITES));
-	_DeleteFile(GetDatabaseFileName(file, FILE_BOS));
+	_DeleteDatabaseFile(FILE_MAIN);
+	_DeleteDatabaseFile(FILE_FAVORITES);
+	_DeleteDatabaseFile(FILE_BOS);
+	_DeleteDatabaseFile(FILE_MANIFEST);
+	_DeleteDatabaseFile(FILE_AGGREGATES);
+	_DeleteDatabaseFile(FILE_SPARKS);
 	InitInstance(m_useMyDocuments);
 	return true;
 }
@@ -270,25 +576,28 @@ bool BWChartDB::InitInstance(bool useMyDocuments)
 	// where is the database
 	m_useMyDocuments = useMyDocuments;
 
+	// open stores (importing old INI files if needed)
+	_OpenStores();
+
 	// read version from main file
 	CString version;
 	_ReadVersion(FILE_MAIN, version);
 
 	// if it's missing, it's an old file, so delete it
 	if(version.IsEmpty()) 
-		_DeleteFile(GetDatabaseFileName(version, FILE_MAIN));
+		_DeleteDatabaseFile(FILE_MAIN);
 
 	// if it's an old version, delete it
 	version.MakeUpper();
 	if(version.Compare("1.01H")<0) 
 	{
 		AfxMessageBox(IDS_FORMATCHG,MB_OK|MB_ICONINFORMATION);
-		_DeleteFile(GetDatabaseFileName(version, FILE_MAIN));
-		_DeleteFile(GetDatabaseFileName(version, FILE_FAVORITES));
+		_DeleteDatabaseFile(FILE_MAIN);
+		_DeleteDatabaseFile(FILE_FAVORITES);
 	}
 
 	// do we have a BO file?
-	bool boExist=(_access(GetDatabaseFileName(version, FILE_BOS),0)==0);
+	bool boExist=GetStore(FILE_BOS)->GetSnapshotCount()+GetStore(FILE_BOS)->GetLogCount()>0;
 
 	_WriteVersion(FILE_MAIN);
 	_WriteVersion(FILE_FAVORITES);
@@ -296,6 +605,13 @@ bool BWChartDB::InitInstance(bool useMyDocuments)
 	_WriteVersion(FILE_AKAS);
 	_WriteVersion(FILE_MAPAKAS);
 	_WriteVersion(FILE_BOS);
+	_WriteVersion(FILE_SPARKS);
+
+	// player and map statistics
+	_LoadAggregates();
+
+	// open map cache
+	m_mapCache.Open(GetDatabaseFileName(version, FILE_MAPCACHE));
 	return boExist;
 }
 
@@ -303,6 +619,8 @@ bool BWChartDB::InitInstance(bool useMyDocuments)
 
 void BWChartDB::ExitInstance()
 {
+	m_mapCache.Close();
+	_CloseStores();
 	if(m_buffer!=0) free(m_buffer);
 }
 
@@ -313,6 +631,13 @@ void BWChartDB::ExitInstance()
 
 void BWChartDB::WriteEntry(int nfile, const char *section, const char *entry, const char *data, bool convertToHex)
 {
+	// store: data is kept as is
+	if(GetStore(nfile)!=0)
+	{
+		WriteData(nfile,section,entry,data,(int)strlen(data));
+		return;
+	}
+
 	CString repFile(section);
 	if(section[strlen(section)-1]=='\\') repFile=repFile.Left(repFile.GetLength()-1);
 
@@ -332,9 +657,40 @@ void BWChartDB::WriteEntry(int nfile, const char *section, const char *entry, co
 
 //-----------------------------------------------------------------------------------------------------------------
 
+void BWChartDB::WriteData(int nfile, const char *section, const char *entry, const char *data, int size)
+{
+	ReplayStore *store = GetStore(nfile);
+	char key[2*MAX_PATH];
+	int keyLen = _MakeKey(key,sizeof(key),section,entry);
+	if(store==0 || keyLen==0) return;
+	if(nfile==FILE_MAIN) _UpdateAggregates(key,keyLen,true);
+	store->Put(key,keyLen,data,size);
+	if(nfile==FILE_MAIN) _UpdateAggregates(key,keyLen,false);
+}
+
+int BWChartDB::ReadData(int nfile, const char *section, const char *entry, char *buffer, int bufsize)
+{
+	ReplayStore *store = GetStore(nfile);
+	buffer[0]=0;
+	char key[2*MAX_PATH];
+	int keyLen = _MakeKey(key,sizeof(key),section,entry);
+	return store!=0 && keyLen>0 ? store->Read(key,keyLen,buffer,bufsize) : -1;
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
 // section/entry already in HEX format
 void BWChartDB::ReadEntryBis(int nfile, const char *section, const char *entry, char *buffer, int bufsize)
 {
+	// store: convert section/entry back to regular format
+	if(GetStore(nfile)!=0)
+	{
+		CString sectionReg(ConverFromHex(section));
+		CString entryReg(ConverFromHex(entry));
+		ReadEntry(nfile,sectionReg,entryReg,buffer,bufsize);
+		return;
+	}
+
 	CString sectionNoSlash(section);
 	if(section[strlen(section)-1]=='\\') sectionNoSlash=sectionNoSlash.Left(sectionNoSlash.GetLength()-1);
 	buffer[0]=0;
@@ -347,8 +703,19 @@ void BWChartDB::ReadEntryBis(int nfile, const char *section, const char *entry,
 // section/entry in regular format
 void BWChartDB::ReadEntry(int nfile, const char *section, const char *entry, char *buffer, int bufsize, bool convertFromHex)
 {
-	CString repFile(section);
 	buffer[0]=0;
+
+	// store: data is kept as is
+	ReplayStore *store = GetStore(nfile);
+	if(store!=0)
+	{
+		char key[2*MAX_PATH];
+		int keyLen = _MakeKey(key,sizeof(key),section,entry);
+		if(keyLen>0) store->Read(key,keyLen,buffer,bufsize);
+		return;
+	}
+
+	CString repFile(section);
 	if(section[strlen(section)-1]=='\\') repFile=repFile.Left(repFile.GetLength()-1);
 	CString cvnSec = ConverToHex(repFile);
 	CString cvnEnt = ConverToHex(entry);
@@ -361,6 +728,18 @@ void BWChartDB::ReadEntry(int nfile, const char *section, const char *entry, cha
 
 void BWChartDB::Delete(int nfile, const char *section, const char *entry)
 {
+	ReplayStore *store = GetStore(nfile);
+	if(store!=0)
+	{
+		char key[2*MAX_PATH];
+		int keyLen = _MakeKey(key,sizeof(key),section,entry);
+		if(keyLen==0) return;
+		if(nfile==FILE_MAIN) _UpdateAggregates(key,keyLen,true);
+		store->Delete(key,keyLen);
+		if(nfile==FILE_MAIN) _UpdateAggregates(key,keyLen,false);
+		return;
+	}
+
 	CString repFile(section);
 	if(section[strlen(section)-1]=='\\') repFile=repFile.Left(repFile.GetLength()-1);
 	CString cnvDir = ConverToHex(repFile);
@@ -371,77 +750,41 @@ void BWChartDB::Delete(int nfile, const char *section, const char *entry)
 
 //--------------------------------------------------------------------------------------------------------------
 
+// store record -> ProcessEntry
+void BWChartDB::_ProcessRecord(void *context, const char *key, int keyLen, const char *value, int valLen, int percentage)
+{
+	// split key, skip version
+	const char *entry = (const char *)memchr(key,0,keyLen);
+	if(entry==0 || strcmp(key,TAG_VERSION)==0) return;
+	entry++;
+	CString strEntry(entry,keyLen-(int)(entry-key));
+	CString data(value,valLen);
+	((BWChartDB*)context)->ProcessEntry(key, strEntry, data, percentage);
+}
+
+static void _ProcessIniEntry(void *context, const char *section, const char *entry, const char *data, int percentage)
+{
+	((BWChartDB*)context)->ProcessEntry(section, entry, BWChartDB::ConverFromHex(data), percentage);
+}
+
 // load file
 bool BWChartDB::LoadFile(int nfile)
 {
+	// store
+	ReplayStore *store = GetStore(nfile);
+	if(store!=0)
+	{
+		store->Enumerate(_ProcessRecord,this);
+		return true;
+	}
+
 	// make file writable for future modifications
 	CString repFile;
 	BWChartDB::GetDatabaseFileName(repFile, nfile);
 	UtilDir::MakeFileWritable(repFile);
 
-	// get section list
-	FILE *fp=fopen(repFile,"rb");
-	if(fp==0) return false;
-
-	// get file size
-	fseek(fp,0,SEEK_END);
-	unsigned long fsize=(unsigned long)ftell(fp);
-	fseek(fp,0,SEEK_SET);
-
-	// read line by line
-	char line[2408];
-	char reppath[512];
-	char repname[512];
-	reppath[0]=0;
-	repname[0]=0;
-	unsigned long sizeRead=0;
-	while(fgets(line,sizeof(line),fp)!=0)
-	{
-		// update size read
-		sizeRead+=strlen(line);
-		unsigned long percentage = (100UL*sizeRead)/fsize;
-
-		// remove end of line
-		char *text=strtok(line,"\r\n");
-		if(text==0) continue;
-
-		// skip blanks
-		while(*text==' ') text++;
-
-		// comment?
-		if(text[0]==';' || text[0]==0) continue;
-
-		// if it is a section
-		if(text[0]=='[')
-		{
-			text++;
-			char *p=strrchr(text,']');
-			if(p!=0)
-			{
-				*p=0; 
-				if(strcmp(text,TAG_VERSION)!=0)
-				{
-					strcpy(reppath,BWChartDB::ConverFromHex(text));
-					continue;
-				}
-			}
-			reppath[0]=0;
-		}
-		else
-		{
-			// must be an entry, extract entry name
-			char *p=strtok(text,"=");
-			if(p==0) continue;
-			strcpy(repname,BWChartDB::ConverFromHex(p));
-			char *data=p+strlen(p)+1;
-			// process entry
-			if(reppath[0]!=0 && data) ProcessEntry(reppath, repname, data, (int)percentage);
-		}
-	}
-
-	//close file
-	fclose(fp);
-	return true;
+	// read all entries
+	return _ParseIniFile(repFile,_ProcessIniEntry,this);
 }
 
 //-----------------------------------------------------------------------------------------------------------------
@@ -6,6 +6,10 @@ extern char * _ConverFromHex(const char *str);
 
 #define TAG_VERSION "__VERSION_"
 
+class MapAssetCache;
+class ReplayStore;
+class ReplayAggregates;
+
 //------------------------------------------------------------
 
 class BWChartDB
@@ -13,8 +17,19 @@ class BWChartDB
 private:
 	static void _BuildUserDataFileName(CString& rpath, const char *file);
 	static void _MoveReplayFile(int nfile, bool tobwchart);
+	static void _DeleteDatabaseFile(int nfile);
+	static void _ImportIniFile(int nfile);
+	static void _OpenStores();
+	static void _CloseStores();
+	static int _MakeKey(char *key, int size, const char *section, const char *entry);
+	static void _ProcessRecord(void *context, const char *key, int keyLen, const char *value, int valLen, int percentage);
+	static void _AggregateRecord(void *context, const char *key, int keyLen, const char *value, int valLen, int percentage);
+	static void _UpdateAggregates(const char *key, int keyLen, bool before);
+	static void _LoadAggregates();
 
 	static bool m_useMyDocuments;
+	static MapAssetCache m_mapCache;
+	static ReplayAggregates m_aggregates;
 	static char *m_buffer;
 	static int m_bufferSize;
 	static char *_GetBuffer(int size);
@@ -25,8 +40,8 @@ public:
 	// removed all unwanted signs in a map name to make it more readable
 	static const char *ClarifyMapName(CString& map, const char *mapname);
 
-	// get database file name
-	enum {FILE_MAIN, FILE_FAVORITES, FILE_COMMENTS, FILE_AKAS, FILE_MAPAKAS,FILE_BOS,__FILEMAX};
+	// get database file name (replays, favorites, comments, bos, aggregates and sparklines are kept in a ReplayStore, others are INI files)
+	enum {FILE_MAIN, FILE_FAVORITES, FILE_COMMENTS, FILE_AKAS, FILE_MAPAKAS,FILE_BOS,FILE_MAPCACHE,FILE_MANIFEST,FILE_AGGREGATES,FILE_SPARKS,__FILEMAX};
  	static const char *GetDatabaseFileName(CString& path, int file);
 
 	// init/exit instance
@@ -34,6 +49,19 @@ public:
 	static void ExitInstance();
 	static bool ClearDatabase();
 
+	// store for a database file (0 if it's an INI file)
+	static ReplayStore *GetStore(int nfile);
+
+	// map assets shared by all replays on the same map
+	static MapAssetCache *GetMapCache() {return &m_mapCache;}
+
+	// player and map statistics of the replays in main file (kept up to date by WriteEntry/Delete)
+	static const ReplayAggregates *GetAggregates() {return &m_aggregates;}
+
+	// aggregates of several main file changes are written once, at the end of the update
+	static void BeginUpdate();
+	static void EndUpdate();
+
 	static const char * ConverToHex(const char *str);
 	static char * ConverFromHex(const char *str);
 
@@ -46,10 +74,15 @@ public:
 	// section/entry in regular format, buffer returned in regular format
 	static void ReadEntry(int file, const char *section, const char *entry, char *buffer, int bufsize, bool convertFromHex=true);
 
+	// binary data of a store file entry (section/entry in regular format), ReadData
+	// returns the data size (-1 if not found) and truncates data to bufsize
+	static void WriteData(int file, const char *section, const char *entry, const char *data, int size);
+	static int ReadData(int file, const char *section, const char *entry, char *buffer, int bufsize);
+
 	// remove entry (section/entry/data in regular format)
 	static void Delete(int nfile, const char *section, const char *entry);
 
-	// load file
+	// load file (ProcessEntry gets section/entry/data in regular format)
 	bool LoadFile(int nfile);
 	virtual void ProcessEntry(const char * /*section*/, const char * /*entry*/, const char * /*data*/, int /*percentage*/) {}
 
@@ -2,9 +2,7 @@
 #include "bwmap.h"
 #include "hsvrgb.h"
 #include "replay.h"
-
-#define MAXCLR 230
-#define LOWCLR 60
+#include "mapframe.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -12,23 +10,8 @@
 static char THIS_FILE[] = __FILE__;
 #endif
 
-// player colors
-COLORREF gPlayerColors[]=
-{
-	RGB(LOWCLR,MAXCLR,LOWCLR),
-	RGB(LOWCLR,LOWCLR,MAXCLR),
-	RGB(MAXCLR,LOWCLR,LOWCLR),
-	RGB(MAXCLR,MAXCLR,0),
-	RGB(MAXCLR,0,MAXCLR),
-	RGB(0,MAXCLR,MAXCLR),
-	RGB(MAXCLR,MAXCLR/2,0),
-	RGB(MAXCLR,0,MAXCLR/2),
-	RGB(MAXCLR/2,0,MAXCLR),
-	RGB(MAXCLR,MAXCLR/2,MAXCLR/2),
-	RGB(MAXCLR/2,MAXCLR/2,MAXCLR),
-	RGB(MAXCLR,MAXCLR/2,MAXCLR)
-};
-#define MAXCOLORS (sizeof(gPlayerColors)/sizeof(gPlayerColors[0]))
+// player colors (shared with the headless renderer)
+#define MAXCOLORS MAPFRAME_MAXCOLORS
 
 MapElem MapElem::gEmpty(MAPEMPTY,MAPEMPTY);
 
@@ -55,7 +38,8 @@ static void _InitBitmapInfo(BITMAPINFO& info, int nWidth, int nHeight, int nBitC
 // get player color
 COLORREF ReplayMap::GetPlayerColor(int idx)
 {
-	return gPlayerColors[idx];
+	const unsigned char *rgb = gMapFramePlayerColors[idx];
+	return RGB(rgb[0],rgb[1],rgb[2]);
 }
 
 //--------------------------------------------------------------------------------
@@ -86,7 +70,7 @@ COLORREF ReplayMap::_GetColor(int i, int j, int options)	const
 	else if(val->m_playerid!=MAPEMPTY)
 	{
 		// use player color
-		clr = gPlayerColors[val->m_playerid%MAXCOLORS];
+		clr = GetPlayerColor(val->m_playerid%MAXCOLORS);
 
 		// if hilight is on
 		if(val->m_buildingid>0)
@@ -185,24 +169,170 @@ void ReplayMapAnimated::Start()
 	// compute action peaks and reset all counters
 	_ComputePeaks();
 
-	// reset actions
-	m_animidx=0;
-	m_animidx2=0;
-	m_animidx3=0;
-	for(int i=0; i<(int)m_actions.GetCount(); i++)
+	// actions may have changed, rebuild checkpoints on seek
+	_ClearCheckpoints();
+
+	// reset all actions
+	m_touched[0]=(int)m_actions.GetCount();
+	m_touched[1]=(int)m_moves.GetCount();
+	m_touched[2]=(int)m_units.GetCount();
+	Seek(0);
+}
+
+//--------------------------------------------------------------------------------
+
+void ReplayMapAnimated::_ResetActions(MemoryBlock& block, int first, int last)
+{
+	for(int i=first; i<last; i++)
 	{
-		ReplayMapAction *act = (ReplayMapAction*)m_actions.GetPtr(i*sizeof(ReplayMapAction));
+		ReplayMapAction *act = (ReplayMapAction*)block.GetPtr(i*sizeof(ReplayMapAction));
 		act->Reset();
 	}
-	for(int i=0; i<(int)m_moves.GetCount(); i++)
+}
+
+//--------------------------------------------------------------------------------
+
+// move animation to any time
+void ReplayMapAnimated::Seek(unsigned long time)
+{
+	// checkpoints only contain actions of enabled players
+	unsigned long players = _GetEnabledPlayers();
+	if(m_checkpointMaps==0 || players!=m_checkpointPlayers) _BuildCheckpoints(players);
+
+	// nearest checkpoint before the oldest action still highlighted at that time
+	unsigned long fade = (MAXHILIGHT/min(BUILD_CONSUMERATE,MOVE_CONSUMERATE))*m_frameTicks;
+	int idx = (int)((time>fade ? time-fade : 0)/m_checkpointInterval);
+	if(idx>=(int)m_checkpoints.GetCount()) idx=(int)m_checkpoints.GetCount()-1;
+	const ReplayMapCheckpoint *chk = (const ReplayMapCheckpoint*)m_checkpoints.GetPtr(idx*sizeof(ReplayMapCheckpoint));
+
+	// restore surface and counters
+	MapSurface::Restore(m_checkpointMaps+idx*m_width*m_height);
+	m_maphi.Clear(0);
+	memcpy(m_buildingCount,chk->m_buildingCount,sizeof(m_buildingCount));
+	memcpy(m_moveCount,chk->m_moveCount,sizeof(m_moveCount));
+	memcpy(m_unitCount,chk->m_unitCount,sizeof(m_unitCount));
+
+	// actions after checkpoint will be animated again
+	m_animidx=chk->m_animidx[0];
+	m_animidx2=chk->m_animidx[1];
+	m_animidx3=chk->m_animidx[2];
+	_ResetActions(m_actions,m_animidx,m_touched[0]);
+	_ResetActions(m_moves,m_animidx2,m_touched[1]);
+	_ResetActions(m_units,m_animidx3,m_touched[2]);
+	memcpy(m_touched,chk->m_animidx,sizeof(m_touched));
+
+	// consume highlight of actions between checkpoint and time
+	_RestoreHighlights(m_actions,m_animidx,m_touched[0],time,BUILD_CONSUMERATE,m_buildingCount);
+	_RestoreHighlights(m_moves,m_animidx2,m_touched[1],time,MOVE_CONSUMERATE,m_moveCount);
+	_RestoreHighlights(m_units,m_animidx3,m_touched[2],time,MOVE_CONSUMERATE,m_unitCount);
+	m_lastTime=time;
+}
+
+//--------------------------------------------------------------------------------
+
+// an action drawn every frame since its time lost one rate per frame,
+// and was counted on its first frame
+void ReplayMapAnimated::_RestoreHighlights(MemoryBlock& block, int first, int& touched, unsigned long time, int rate, int *count)
+{
+	for(int i=first; i<(int)block.GetCount(); i++)
 	{
-		ReplayMapAction *act = (ReplayMapAction*)m_moves.GetPtr(i*sizeof(ReplayMapAction));
-		act->Reset();
+		ReplayMapAction *act = (ReplayMapAction*)block.GetPtr(i*sizeof(ReplayMapAction));
+		if(act->GetTime()>time) break;
+		if(!_IsEnabled(act)) continue;
+		int frames = (int)((time-act->GetTime())/m_frameTicks);
+		if(frames==0) continue;
+		act->Consume(min(frames,MAXHILIGHT/rate)*rate);
+		if(act->GetPlayerID()<MAXPLAYERS) count[act->GetPlayerID()]++;
+		touched=i+1;
 	}
-	for(int i=0; i<(int)m_units.GetCount(); i++)
+}
+
+//--------------------------------------------------------------------------------
+
+unsigned long ReplayMapAnimated::_GetEnabledPlayers() const
+{
+	unsigned long players=0;
+	for(int i=0; i<m_replay->GetPlayerCount(); i++)
 	{
-		ReplayMapAction *act = (ReplayMapAction*)m_units.GetPtr(i*sizeof(ReplayMapAction));
-		act->Reset();
+		const ReplayEvtList *list = m_replay->GetEvtList(i);
+		if(list->IsEnabled() && list->GetPlayerID()<32) players|=1<<list->GetPlayerID();
+	}
+	return players;
+}
+
+bool ReplayMapAnimated::_IsEnabled(const ReplayMapAction *act) const
+{
+	if(!ISVALIDPLAYERID(act->GetPlayerID())) return true;
+	const ReplayEvtList * list = m_replay->GetEvtListFromPlayerID(act->GetPlayerID());
+	return list->IsEnabled();
+}
+
+void ReplayMapAnimated::_ClearCheckpoints()
+{
+	delete[]m_checkpointMaps;
+	m_checkpointMaps=0;
+	m_checkpoints.Clear();
+}
+
+//--------------------------------------------------------------------------------
+
+// snapshot map state every m_checkpointInterval ticks, as if all actions
+// before the checkpoint were over
+void ReplayMapAnimated::_BuildCheckpoints(unsigned long players)
+{
+	_ClearCheckpoints();
+	m_checkpointPlayers = players;
+
+	// end of animation
+	unsigned long end=0;
+	if(m_actions.GetCount()>0) end=max(end,((ReplayMapAction*)m_actions.GetPtr((m_actions.GetCount()-1)*sizeof(ReplayMapAction)))->GetTime());
+	if(m_moves.GetCount()>0) end=max(end,((ReplayMapAction*)m_moves.GetPtr((m_moves.GetCount()-1)*sizeof(ReplayMapAction)))->GetTime());
+	if(m_units.GetCount()>0) end=max(end,((ReplayMapAction*)m_units.GetPtr((m_units.GetCount()-1)*sizeof(ReplayMapAction)))->GetTime());
+
+	// keep checkpoint count (and memory) bounded on long games
+	m_checkpointInterval = max((unsigned long)MAPCHECKPOINT_TICKS,end/MAXMAPCHECKPOINTS+1);
+	int count = (int)(end/m_checkpointInterval)+1;
+	m_checkpointMaps = new MapElem[count*m_width*m_height];
+
+	ReplayMapCheckpoint chk;
+	memset(&chk,0,sizeof(chk));
+	MapSurface::Clear(MAPEMPTY);
+	int i=0,j=0,k=0;
+	for(int c=0; c<count; c++)
+	{
+		chk.m_time = c*m_checkpointInterval;
+
+		// buildings
+		for(; i<(int)m_actions.GetCount(); i++)
+		{
+			const ReplayMapAction *act = (const ReplayMapAction*)m_actions.GetPtr(i*sizeof(ReplayMapAction));
+			if(act->GetTime()>=chk.m_time) break;
+			if(!_IsEnabled(act)) continue;
+			SetBuilding(act->GetX(),act->GetY(),act->GetWidth(),act->GetHeight(),MapElem(0,act->GetPlayerID()));
+			if(act->GetPlayerID()<MAXPLAYERS) chk.m_buildingCount[act->GetPlayerID()]++;
+		}
+
+		// moves
+		for(; j<(int)m_moves.GetCount(); j++)
+		{
+			const ReplayMapAction *act = (const ReplayMapAction*)m_moves.GetPtr(j*sizeof(ReplayMapAction));
+			if(act->GetTime()>=chk.m_time) break;
+			if(_IsEnabled(act) && act->GetPlayerID()<MAXPLAYERS) chk.m_moveCount[act->GetPlayerID()]++;
+		}
+
+		// train units
+		for(; k<(int)m_units.GetCount(); k++)
+		{
+			const ReplayMapAction *act = (const ReplayMapAction*)m_units.GetPtr(k*sizeof(ReplayMapAction));
+			if(act->GetTime()>=chk.m_time) break;
+			if(_IsEnabled(act) && act->GetPlayerID()<MAXPLAYERS) chk.m_unitCount[act->GetPlayerID()]++;
+		}
+
+		chk.m_animidx[0]=i;
+		chk.m_animidx[1]=j;
+		chk.m_animidx[2]=k;
+		m_checkpoints.Add(&chk,sizeof(chk));
+		MapSurface::Save(m_checkpointMaps+c*m_width*m_height);
 	}
 }
 
@@ -265,6 +395,10 @@ void ReplayMapAnimated::_ComputePeaks()
 // build map at specific time
 HBITMAP ReplayMapAnimated::BuildMap(unsigned long time, int options)
 {
+	// ticks per frame, for seeking (ignore jumps)
+	if(time>m_lastTime && time-m_lastTime<MAPCHECKPOINT_TICKS) m_frameTicks=time-m_lastTime;
+	m_lastTime=time;
+
 	// update build actions
 	for(int i=m_animidx; i<(int)m_actions.GetCount(); i++)
 	{
@@ -287,6 +421,7 @@ HBITMAP ReplayMapAnimated::BuildMap(unsigned long time, int options)
 		// action hilight is over?
 		if(act->Highlight()==0) m_animidx=i;
 		else act->Consume(BUILD_CONSUMERATE);
+		if(i>=m_touched[0]) m_touched[0]=i+1;
 
 		// update buidling count
 		if(act->Highlight()==MAXHILIGHT-BUILD_CONSUMERATE && act->GetPlayerID()<MAXPLAYERS)
@@ -311,6 +446,7 @@ HBITMAP ReplayMapAnimated::BuildMap(unsigned long time, int options)
 		if(act->GetTime()>time) break;
 
 		// action hilight is over?
+		if(i>=m_touched[1]) m_touched[1]=i+1;
 		if(act->Highlight()==0) m_animidx2=i;
 		else 
 		{
@@ -343,6 +479,7 @@ HBITMAP ReplayMapAnimated::BuildMap(unsigned long time, int options)
 		if(act->GetTime()>time) break;
 
 		// action hilight is over?
+		if(i>=m_touched[2]) m_touched[2]=i+1;
 		if(act->Highlight()==0) m_animidx3=i;
 		else 
 		{
@@ -362,6 +499,31 @@ HBITMAP ReplayMapAnimated::BuildMap(unsigned long time, int options)
 
 //--------------------------------------------------------------------------------
 
+// feed headless renderer with tileset and actions of enabled players
+// (start locations and resources are build actions at time 0)
+void ReplayMapAnimated::InitRenderer(MapFrameRenderer& renderer, const MapAssetRecord& assets) const
+{
+	assert(renderer.GetWidth()==m_width && renderer.GetHeight()==m_height);
+	assert(MAPMINERAL==MAPFRAME_MINERAL && MAXHILIGHT==MAPFRAME_MAXHILIGHT && BUILD_CONSUMERATE==MAPFRAME_CONSUMERATE);
+
+	// tiles
+	renderer.SetTiles(assets);
+
+	// actions
+	const MemoryBlock *blocks[3] = {&m_actions,&m_moves,&m_units};
+	const int kinds[3] = {MapFrameRenderer::BUILD,MapFrameRenderer::MOVE,MapFrameRenderer::UNIT};
+	for(int k=0; k<3; k++)
+		for(int i=0; i<(int)blocks[k]->GetCount(); i++)
+		{
+			const ReplayMapAction *act = (const ReplayMapAction*)blocks[k]->GetPtr(i*sizeof(ReplayMapAction));
+			if(!_IsEnabled(act)) continue;
+			renderer.AddAction(kinds[k],act->GetX(),act->GetY(),act->GetWidth(),act->GetHeight(),act->GetPlayerID(),act->GetTime());
+		}
+	renderer.Restart();
+}
+
+//--------------------------------------------------------------------------------
+
 int _compare( const void *arg1, const void *arg2 )
 {
 	ReplayMapAction *act1 = (ReplayMapAction*)arg1;
@@ -5,6 +5,8 @@
 #include <assert.h>
 
 class Replay;
+class MapFrameRenderer;
+class MapAssetRecord;
 
 //---------------------------------------------------------------------------------------------------
 
@@ -16,6 +18,9 @@ class Replay;
 #define BUILD_CONSUMERATE	5
 #define MOVE_CONSUMERATE	5
 #define ISVALIDPLAYERID(pid) ((unsigned char)pid<MAPMINERAL)
+#define MAPCHECKPOINT_TICKS	1440
+#define MAXMAPCHECKPOINTS	24
+#define MAPDEFAULT_FRAMETICKS	6 // x2 animation at 8 frames per second
 
 //------=---------------------------------------------------------------------------------------------
 
@@ -51,6 +56,10 @@ public:
 	// clear map
 	void Clear(int val) {memset(m_map,val,m_width*m_height*sizeof(MapElem));}
 
+	// save/restore whole surface (buffer must hold GetWidth()*GetHeight() elements)
+	void Save(MapElem *dst) const {memcpy(dst,m_map,m_width*m_height*sizeof(MapElem));}
+	void Restore(const MapElem *src) {memcpy(m_map,src,m_width*m_height*sizeof(MapElem));}
+
 	// set square
 	void SetSquare(int x, int y, const MapElem& val) {if(_IsValid(x,y)) m_map[MAPACCESS(x,y)]=val;}
 
@@ -64,35 +73,6 @@ public:
 		}
 	}
 
-	// sum square content
-	void Sum(MapElem& sum, unsigned __int64& unit) const
-	{
-		assert(m_width*m_height<=64); 
-		unit=0;
-		unsigned __int64 mask=1;
-		for(int i=0;i<m_width*m_height;i++)
-		{
-			// count how many squares are "lighted"
-			MapElem& elem = m_map[i];
-			if(elem.m_buildingid>0) sum.m_buildingid++;
-			if(elem.m_playerid>0) 
-			{
-				sum.m_playerid++; unit|=mask;
-			}
-			mask<<=1;
-		}
-	}
-
-	// clear content for units only
-	void ClearUnit() const
-	{
-		for(int i=0;i<m_width*m_height;i++)
-		{
-			MapElem& elem = m_map[i];
-			elem.m_playerid=0;
-		}
-	}
-
 	// return square at position
 	MapElem* GetSquare(int x, int y) const {return _IsValid(x,y) ? &m_map[MAPACCESS(x,y)] : &MapElem::gEmpty;}
 
@@ -145,6 +125,7 @@ public:
 
 	// associated tile map (if any)
 	MapSurface* GetTileSet() {return &m_tileset;}
+	const MapSurface* GetTileSet() const {return &m_tileset;}
 
 	// get player color
 	static COLORREF GetPlayerColor(int idx);
@@ -181,6 +162,38 @@ public:
 
 //------------------------------------------------------------------------------------------------------------
 
+// map action recorded by a player during analysis, merged later in replay action order
+class ReplayMapPending
+{
+public:
+	enum {BUILD,MOVE,UNIT};
+	ReplayMapPending(int seq, int kind, const ReplayMapAction& act) : m_seq(seq), m_kind(kind), m_act(act) {}
+
+	// index of the replay action that produced it
+	int m_seq;
+	int m_kind;
+	ReplayMapAction m_act;
+};
+
+//------------------------------------------------------------------------------------------------------------
+
+// state of the animation before a given time
+class ReplayMapCheckpoint
+{
+public:
+	unsigned long m_time;
+
+	// index of first action at or after m_time (build, move, train)
+	int m_animidx[3];
+
+	// counts per player
+	int m_buildingCount[MAXPLAYERS];
+	int m_moveCount[MAXPLAYERS];
+	int m_unitCount[MAXPLAYERS];
+};
+
+//------------------------------------------------------------------------------------------------------------
+
 class ReplayMapAnimated : public ReplayMap
 {
 private:
@@ -211,17 +224,45 @@ private:
 	int m_unitCount[MAXPLAYERS];
 	int m_peakUnitCount;
 
+	// checkpoints for seeking (one surface per checkpoint in m_checkpointMaps)
+	MemoryBlock m_checkpoints; // block with all ReplayMapCheckpoint
+	MapElem *m_checkpointMaps;
+	unsigned long m_checkpointInterval;
+	unsigned long m_checkpointPlayers; // enabled players when checkpoints were built
+
+	// one past the last action visited by BuildMap since last seek (build, move, train)
+	int m_touched[3];
+
+	// highlight decays per frame, remember how many ticks a frame lasts
+	unsigned long m_lastTime;
+	unsigned long m_frameTicks;
+
 	// compute all peaks
 	void _ComputePeaks();
 
+	// checkpoints
+	unsigned long _GetEnabledPlayers() const;
+	bool _IsEnabled(const ReplayMapAction *act) const;
+	void _BuildCheckpoints(unsigned long players);
+	void _ClearCheckpoints();
+	static void _ResetActions(MemoryBlock& block, int first, int last);
+	void _RestoreHighlights(MemoryBlock& block, int first, int& touched, unsigned long time, int rate, int *count);
+
 public:
 	ReplayMapAnimated(Replay *replay, int w, int h) : ReplayMap(w,h), m_replay(replay), 
-		m_animidx(0), m_animidx2(0), m_animidx3(0) {m_useUnits=true;}
-	~ReplayMapAnimated() {}
+		m_animidx(0), m_animidx2(0), m_animidx3(0), m_checkpointMaps(0), m_checkpointInterval(0), 
+		m_checkpointPlayers(0), m_lastTime(0), m_frameTicks(MAPDEFAULT_FRAMETICKS) 
+		{m_useUnits=true; memset(m_touched,0,sizeof(m_touched));}
+	~ReplayMapAnimated() {_ClearCheckpoints();}
 
 	// start animation
 	void Start();
 
+	// move animation to any time (forward or backward), next BuildMap only
+	// replays actions between the nearest checkpoint and that time, with
+	// the highlight they would have after a normal animation
+	void Seek(unsigned long time);
+
 	// add build action
 	void AddBuild(const ReplayMapAction *act) {m_actions.Add(act,sizeof(ReplayMapAction));}
 
@@ -231,9 +272,20 @@ public:
 	// add train unit action
 	void AddUnit(const ReplayMapAction *act) {m_units.Add(act,sizeof(ReplayMapAction));}
 
+	// add action recorded by a player
+	void AddPending(const ReplayMapPending *pending)
+	{
+		if(pending->m_kind==ReplayMapPending::BUILD) AddBuild(&pending->m_act);
+		else if(pending->m_kind==ReplayMapPending::MOVE) AddMove(&pending->m_act);
+		else AddUnit(&pending->m_act);
+	}
+
 	// build map at specific time
 	HBITMAP BuildMap(unsigned long time, int options=BUILDINGS_ON|MINERALS_ON);
 
+	// feed headless renderer (same frames as BuildMap, without GDI), tiles come from the map assets
+	void InitRenderer(MapFrameRenderer& renderer, const MapAssetRecord& assets) const;
+
 	// sort actions according to time
 	void Sort();
 
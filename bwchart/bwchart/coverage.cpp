@@ -0,0 +1,155 @@
+// coverage.cpp : implementation of the CoverageGrid class
+//
+
+#include "coverage.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+//---------------------------------------------------------------------------------------
+
+// number of bits set in a word
+static inline int _Popcount(CoverageWord w)
+{
+#ifdef __GNUC__
+	return __builtin_popcountll(w);
+#else
+	// no cpu check for the popcnt instruction, count bits in parallel
+	w = w - ((w>>1) & 0x5555555555555555ui64);
+	w = (w & 0x3333333333333333ui64) + ((w>>2) & 0x3333333333333333ui64);
+	w = (w + (w>>4)) & 0x0F0F0F0F0F0F0F0Fui64;
+	return (int)((w*0x0101010101010101ui64)>>56);
+#endif
+}
+
+//---------------------------------------------------------------------------------------
+
+CoverageGrid::CoverageGrid(int side, int mapWidth, int mapHeight, int slotCount) :
+	m_side(side), m_mapWidth(mapWidth), m_mapHeight(mapHeight), m_currentCount(0),
+	m_slotCount(slotCount), m_cells(0), m_cellsUsed(0), m_cellsSize(0)
+{
+	assert(side>0 && side<=COVERAGE_MAXSIDE);
+	m_words = (GetCellCount()+63)/64;
+	m_buildings = (CoverageWord*)calloc(m_words,sizeof(CoverageWord));
+	m_current = (CoverageWord*)calloc(m_words,sizeof(CoverageWord));
+	m_currentCells = (unsigned short*)malloc(GetCellCount()*sizeof(unsigned short));
+	m_slotFirst = (unsigned long*)calloc(slotCount,sizeof(unsigned long));
+	m_slotCells = (unsigned short*)calloc(slotCount,sizeof(unsigned short));
+}
+
+CoverageGrid::~CoverageGrid()
+{
+	free(m_buildings);
+	free(m_current);
+	free(m_currentCells);
+	free(m_slotFirst);
+	free(m_slotCells);
+	if(m_cells!=0) free(m_cells);
+}
+
+//---------------------------------------------------------------------------------------
+
+// cell index for a map position (-1 if outside map)
+int CoverageGrid::_Cell(int x, int y) const
+{
+	if(x<0 || y<0 || x>=m_mapWidth || y>=m_mapHeight) return -1;
+	return (y*m_side/m_mapHeight)*m_side + x*m_side/m_mapWidth;
+}
+
+// set bit, return true if it was not set
+bool CoverageGrid::_TestAndSet(CoverageWord *bits, int cell)
+{
+	CoverageWord mask = (CoverageWord)1<<(cell&63);
+	if((bits[cell>>6]&mask)!=0) return false;
+	bits[cell>>6] |= mask;
+	return true;
+}
+
+int CoverageGrid::_Count(const CoverageWord *bits) const
+{
+	int count=0;
+	for(int i=0;i<m_words;i++) count+=_Popcount(bits[i]);
+	return count;
+}
+
+//---------------------------------------------------------------------------------------
+
+void CoverageGrid::AddBuilding(int x, int y)
+{
+	int cell = _Cell(x,y);
+	if(cell>=0) _TestAndSet(m_buildings,cell);
+}
+
+void CoverageGrid::AddUnit(int x, int y)
+{
+	int cell = _Cell(x,y);
+	if(cell>=0 && _TestAndSet(m_current,cell)) 
+		m_currentCells[m_currentCount++]=(unsigned short)cell;
+}
+
+//---------------------------------------------------------------------------------------
+
+void CoverageGrid::EndSlots(int first, int last)
+{
+	if(last>m_slotCount) last=m_slotCount;
+
+	// store cells of current slot
+	if(m_currentCount>0 && first<last)
+	{
+		if(m_cellsUsed+m_currentCount>m_cellsSize)
+		{
+			m_cellsSize = (m_cellsSize+m_currentCount)*2;
+			m_cells = (unsigned short*)realloc(m_cells,m_cellsSize*sizeof(unsigned short));
+		}
+		memcpy(m_cells+m_cellsUsed,m_currentCells,m_currentCount*sizeof(unsigned short));
+	}
+
+	// all slots in range share them
+	for(int i=first;i<last;i++)
+	{
+		m_slotFirst[i]=m_cellsUsed;
+		m_slotCells[i]=(unsigned short)m_currentCount;
+	}
+	if(first<last) m_cellsUsed+=m_currentCount;
+
+	// clear current slot
+	for(int i=0;i<m_currentCount;i++)
+		m_current[m_currentCells[i]>>6] &= ~((CoverageWord)1<<(m_currentCells[i]&63));
+	m_currentCount=0;
+}
+
+//---------------------------------------------------------------------------------------
+
+// add (inc=1) or remove (inc=-1) cells of a slot in the window
+void CoverageGrid::_Slide(int slot, int inc, unsigned short *counters, int& active) const
+{
+	const unsigned short *cell = m_cells+m_slotFirst[slot];
+	for(int i=0;i<m_slotCells[slot];i++,cell++)
+	{
+		if(inc>0) {if(counters[*cell]++==0) active++;}
+		else {if(--counters[*cell]==0) active--;}
+	}
+}
+
+void CoverageGrid::ComputeMovingCoverage(int slotCount, int delta, unsigned short *coverage) const
+{
+	memset(coverage,0,slotCount*sizeof(unsigned short));
+	if(delta<0) return;
+	if(slotCount>m_slotCount) slotCount=m_slotCount;
+
+	// number of slots in window for each cell
+	unsigned short *counters = (unsigned short*)calloc(GetCellCount(),sizeof(unsigned short));
+	int active=0;
+	int last=-1;
+	for(int slot=0;slot<slotCount;slot++)
+	{
+		// slots entering the window
+		int end = slot+delta<slotCount-1 ? slot+delta : slotCount-1;
+		while(last<end) _Slide(++last,1,counters,active);
+
+		// slot leaving the window
+		if(slot-delta-1>=0) _Slide(slot-delta-1,-1,counters,active);
+		coverage[slot]=(unsigned short)active;
+	}
+	free(counters);
+}
@@ -0,0 +1,81 @@
+// coverage.h : interface of the CoverageGrid class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __COVERAGE_H
+#define __COVERAGE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+//--------------------------------------------------------------------------------------
+
+#define COVERAGE_MAXSIDE 64 // cells
+
+#ifdef _WIN32
+typedef unsigned __int64 CoverageWord;
+#else
+typedef unsigned long long CoverageWord;
+#endif
+
+// Map coverage of a player on a grid of side x side cells.
+//
+// Buildings are kept in a bitset (cells with at least one building). Unit activity 
+// (moves, attacks) is recorded per resource slot as a list of distinct cells, so 
+// moving coverage on a window of slots is computed with per cell counters: a slot 
+// entering or leaving the window only touches its own cells.
+//
+class CoverageGrid
+{
+public:
+	CoverageGrid(int side, int mapWidth, int mapHeight, int slotCount);
+	~CoverageGrid();
+
+	// grid size
+	int GetSide() const {return m_side;}
+	int GetCellCount() const {return m_side*m_side;}
+
+	// record activity at map position (in tiles)
+	void AddBuilding(int x, int y);
+	void AddUnit(int x, int y);
+
+	// store unit activity recorded since last call for slots [first,last[, and start a new slot
+	void EndSlots(int first, int last);
+
+	// number of cells with buildings / with unit activity since last EndSlots
+	int GetBuildingCoverage() const {return _Count(m_buildings);}
+	int GetUnitCoverage() const {return _Count(m_current);}
+
+	// number of cells with unit activity in slots [slot-delta,slot+delta] for all slots in [0,slotCount[
+	void ComputeMovingCoverage(int slotCount, int delta, unsigned short *coverage) const;
+
+private:
+	int m_side;
+	int m_mapWidth;
+	int m_mapHeight;
+	int m_words; // words per bitset
+
+	// bitsets
+	CoverageWord *m_buildings;
+	CoverageWord *m_current;
+
+	// cells with unit activity in current slot
+	unsigned short *m_currentCells;
+	int m_currentCount;
+
+	// cells with unit activity for all slots
+	int m_slotCount;
+	unsigned long *m_slotFirst; // first cell in m_cells
+	unsigned short *m_slotCells; // number of cells
+	unsigned short *m_cells;
+	unsigned long m_cellsUsed;
+	unsigned long m_cellsSize;
+
+	int _Cell(int x, int y) const;
+	static bool _TestAndSet(CoverageWord *bits, int cell);
+	int _Count(const CoverageWord *bits) const;
+	void _Slide(int slot, int inc, unsigned short *counters, int& active) const;
+};
+
+#endif
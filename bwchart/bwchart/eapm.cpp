@@ -0,0 +1,236 @@
+// eapm.cpp : implementation of the EAPMClassifier class
+//
+
+#include "eapm.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// hot key command (first parameter of the command)
+enum {HOT_ASSIGN, HOT_SELECT, HOT_ADD};
+
+// time limits (ticks, same as the checks bwchart used to do on its event lists)
+#define REPEAT_TICKS 10
+#define RESELECT_TICKS 8
+#define CANCEL_TICKS 20
+#define SIMILAR_TICKS 10
+#define UPGRADE_TICKS 15
+#define BUILD_TICKS 714 // 30 seconds
+
+//---------------------------------------------------------------------------------------
+
+EAPMClassifier::EAPMClassifier(unsigned long bucketTicks) : m_bucketTicks(bucketTicks>0 ? bucketTicks : 1),
+	m_actions(0), m_effective(0), m_bucketSize(0)
+{
+	Reset();
+}
+
+EAPMClassifier::~EAPMClassifier()
+{
+	free(m_actions);
+	free(m_effective);
+}
+
+// keep series buffers
+void EAPMClassifier::Reset()
+{
+	m_seq=0;
+	memset(m_commands,0,sizeof(m_commands));
+	m_commandCount=0;
+	memset(m_builds,0,sizeof(m_builds));
+	m_buildCount=0;
+	m_selTime=0;
+	m_selSeq=-1;
+	m_selBucket=0;
+	m_selection=0;
+	memset(m_hotkeys,0,sizeof(m_hotkeys));
+	m_similar=0;
+	m_queueTime=0;
+	m_bucketCount=0;
+	m_totalActions=0;
+	m_totalEffective=0;
+}
+
+unsigned long EAPMClassifier::_Hash(unsigned long hash, const unsigned char *data, int size)
+{
+	for(int i=0; i<size; i++) hash = (hash^data[i])*16777619UL;
+	return hash&0xFFFFFFFFUL;
+}
+
+//---------------------------------------------------------------------------------------
+
+void EAPMClassifier::_Count(int bucket, int actions, int effective)
+{
+	if(bucket>=m_bucketSize)
+	{
+		int size = m_bucketSize==0 ? 256 : m_bucketSize;
+		while(size<=bucket) size*=2;
+		m_actions = (unsigned short*)realloc(m_actions,size*sizeof(unsigned short));
+		m_effective = (unsigned short*)realloc(m_effective,size*sizeof(unsigned short));
+		m_bucketSize = size;
+	}
+	if(bucket>=m_bucketCount)
+	{
+		memset(m_actions+m_bucketCount,0,(bucket+1-m_bucketCount)*sizeof(unsigned short));
+		memset(m_effective+m_bucketCount,0,(bucket+1-m_bucketCount)*sizeof(unsigned short));
+		m_bucketCount = bucket+1;
+	}
+	m_actions[bucket] += actions;
+	m_effective[bucket] += effective;
+	m_totalActions += actions;
+	m_totalEffective += effective;
+}
+
+int EAPMClassifier::Classify(const Command& cmd, int *revoked)
+{
+	if(revoked!=0) *revoked=-1;
+	int reason = _Classify(cmd,revoked);
+	_Count((int)(cmd.m_time/m_bucketTicks),1,reason==EFFECTIVE ? 1 : 0);
+	m_seq++;
+	return reason;
+}
+
+int EAPMClassifier::_Classify(const Command& cmd, int *revoked)
+{
+	unsigned long time = cmd.m_time;
+	unsigned char idByte = (unsigned char)cmd.m_id;
+	unsigned long key = _Hash(_Hash(2166136261UL,&idByte,1),cmd.m_params,cmd.m_size);
+
+	// previous command
+	const Past *prev = m_commandCount==0 ? 0 : &m_commands[(m_commandCount-1)%EAPM_HISTORY];
+	Past& cur = m_commands[m_commandCount%EAPM_HISTORY];
+	m_commandCount++;
+	cur.m_time = time;
+	cur.m_key = key;
+	cur.m_kind = cmd.m_kind;
+	cur.m_id = cmd.m_id;
+	cur.m_object = cmd.m_object;
+
+	// not a game command
+	if(cmd.m_kind==K_NOTGAME) return R_NOTGAME;
+
+	// selection changes
+	bool isSelection = cmd.m_kind==K_SELECT || cmd.m_kind==K_SHIFTSELECT || cmd.m_kind==K_SHIFTDESELECT;
+	if(cmd.m_kind==K_HOTKEY && cmd.m_size>=2)
+	{
+		// no such slot, the game does nothing
+		int slot = cmd.m_params[1];
+		if(slot>=EAPM_MAXSLOT) return R_INVALID;
+		if(cmd.m_params[0]==HOT_SELECT)
+		{
+			// recall of what is already selected
+			isSelection=true;
+			if(m_hotkeys[slot]==m_selection && m_selSeq<0 && prev!=0) return R_REPEAT;
+			m_selection = m_hotkeys[slot];
+		}
+		else
+		{
+			// assigning the same units again
+			unsigned long group = cmd.m_params[0]==HOT_ASSIGN ? m_selection :
+				_Hash(m_hotkeys[slot],(const unsigned char*)&m_selection,sizeof(m_selection));
+			if(cmd.m_params[0]==HOT_ASSIGN && m_hotkeys[slot]==group) return R_HOTKEY;
+			m_hotkeys[slot] = group;
+			return EFFECTIVE;
+		}
+	}
+	if(isSelection)
+	{
+		// previous selection replaced before anything was done with it
+		int reason=EFFECTIVE;
+		if(m_selSeq>=0 && time-m_selTime<=RESELECT_TICKS)
+		{
+			if(revoked!=0) *revoked = m_selSeq;
+			_Count(m_selBucket,0,-1);
+		}
+		else if(prev!=0 && prev->m_key==key && time-prev->m_time<=REPEAT_TICKS)
+			reason=R_REPEAT;
+		if(cmd.m_kind!=K_HOTKEY)
+			m_selection = cmd.m_kind==K_SELECT ? _Hash(2166136261UL,cmd.m_params,cmd.m_size) :
+				_Hash(m_selection,cmd.m_params,cmd.m_size);
+		if(reason==EFFECTIVE)
+		{
+			m_selTime = time;
+			m_selSeq = m_seq;
+			m_selBucket = (int)(time/m_bucketTicks);
+			if(cmd.m_kind==K_SELECT || cmd.m_kind==K_HOTKEY) m_similar = 0;
+		}
+		return reason;
+	}
+
+	// any other command uses the selection
+	m_selSeq = -1;
+
+	// caller knows it did nothing
+	if(cmd.m_invalid) return R_INVALID;
+
+	// same command again right away (queueing the same unit is handled below)
+	if(cmd.m_kind!=K_TRAIN && prev!=0 && prev->m_key==key && time-prev->m_time<=REPEAT_TICKS) return R_REPEAT;
+
+	bool same = prev!=0 && prev->m_kind==cmd.m_kind && prev->m_id==cmd.m_id && prev->m_object==cmd.m_object;
+	switch(cmd.m_kind)
+	{
+		case K_TRAIN:
+		{
+			// too many similar units queued for the selection (more tolerated as game goes on)
+			if(same && time-prev->m_time<=SIMILAR_TICKS) m_similar++;
+			m_queueTime = time;
+			int limit = time<2000 ? 3 : time<4000 ? 4 : 5;
+			return m_similar>=limit ? R_QUEUE : EFFECTIVE;
+		}
+		case K_CANCEL:
+			// cancel right after queueing
+			return m_queueTime!=0 && time-m_queueTime<=CANCEL_TICKS ? R_CANCEL : EFFECTIVE;
+		case K_TECH:
+			// same research or upgrade again
+			return same && time-prev->m_time<=UPGRADE_TICKS ? R_UPGRADE : EFFECTIVE;
+		case K_BUILD:
+		case K_MORPH:
+			m_queueTime = time;
+			_Rebuild(cmd,revoked);
+			return EFFECTIVE;
+	}
+
+	return EFFECTIVE;
+}
+
+// building placed or morphed again (earlier one is the failed one)
+void EAPMClassifier::_Rebuild(const Command& cmd, int *revoked)
+{
+	unsigned long time = cmd.m_time;
+	unsigned long limit = cmd.m_kind==K_BUILD ? BUILD_TICKS : time<4000 ? 170 : time<7000 ? 120 : 40;
+	int first = m_buildCount>EAPM_HISTORY ? m_buildCount-EAPM_HISTORY : 0;
+	for(int i=m_buildCount-1; i>=first; i--)
+	{
+		Build& old = m_builds[i%EAPM_HISTORY];
+		if(time-old.m_time>limit) break;
+		if(old.m_seq<0 || old.m_kind!=cmd.m_kind || old.m_object!=cmd.m_object) continue;
+		if(cmd.m_kind==K_BUILD && (abs(old.m_x-cmd.m_x)>=cmd.m_width || abs(old.m_y-cmd.m_y)>=cmd.m_height)) continue;
+		if(revoked!=0) *revoked = old.m_seq;
+		_Count((int)(old.m_time/m_bucketTicks),0,-1);
+		old.m_seq = -1;
+		break;
+	}
+
+	Build& build = m_builds[m_buildCount%EAPM_HISTORY];
+	build.m_time = time;
+	build.m_kind = cmd.m_kind;
+	build.m_object = cmd.m_object;
+	build.m_x = cmd.m_x;
+	build.m_y = cmd.m_y;
+	build.m_seq = m_seq;
+	m_buildCount++;
+}
+
+//---------------------------------------------------------------------------------------
+
+int EAPMClassifier::GetAPM(int bucket, int window, unsigned long ticksPerMinute, bool effective) const
+{
+	if(window<=0) return 0;
+	int first = bucket-window+1;
+	if(first<0) first=0;
+	int count=0;
+	for(int i=first; i<=bucket; i++)
+		count += effective ? GetEffectiveActions(i) : GetActions(i);
+	unsigned long ticks = (unsigned long)(bucket-first+1)*m_bucketTicks;
+	return (int)((double)count*ticksPerMinute/(double)ticks);
+}
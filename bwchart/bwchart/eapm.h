@@ -0,0 +1,138 @@
+// eapm.h : interface of the EAPMClassifier class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __EAPM_H
+#define __EAPM_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+//--------------------------------------------------------------------------------------
+
+#define EAPM_HISTORY 8 // commands and builds remembered (ring buffers)
+#define EAPM_MAXSLOT 10 // hot key slots
+
+// Streaming classifier for the effective actions of one player.
+//
+// Commands are fed one at a time in time order and labeled effective or not. The caller
+// maps its command ids to kinds and decodes the object of train, build and tech commands,
+// so the classifier only sees the replay format and no game data. All state is fixed size:
+// the last commands and builds in ring buffers, selection and hot key fingerprints, and a
+// few counters. A command can also make an earlier one ineffective (a selection replaced
+// right away, a building placed again), Classify reports it so the caller can relabel it.
+//
+// Actions and effective actions are counted per bucket of ticks.
+//
+class EAPMClassifier
+{
+public:
+	// command kinds
+	enum {K_OTHER,K_SELECT,K_SHIFTSELECT,K_SHIFTDESELECT,K_HOTKEY,K_TRAIN,K_BUILD,K_MORPH,K_TECH,K_CANCEL,K_NOTGAME};
+
+	// why a command is not effective (R_RESELECT and R_BUILD are for revoked commands)
+	enum {EFFECTIVE,R_REPEAT,R_RESELECT,R_CANCEL,R_QUEUE,R_UPGRADE,R_BUILD,R_HOTKEY,R_NOTGAME,R_INVALID};
+
+	// a command as the classifier sees it
+	class Command
+	{
+	public:
+		Command(unsigned long time, int kind, int id, const void *params, int size) : m_time(time), m_kind(kind), m_id(id),
+			m_params((const unsigned char *)params), m_size(size), m_object(-1), m_x(0), m_y(0), m_width(0), m_height(0), m_invalid(false) {}
+
+		unsigned long m_time;
+		int m_kind;
+		int m_id; // command id (same id and parameters right away is a repeat)
+		const unsigned char *m_params; // raw parameters, as stored in the replay
+		int m_size;
+		int m_object; // unit trained, building built or morphed, tech researched (-1 if none)
+		int m_x, m_y; // build position
+		int m_width, m_height; // building size (same unit as position)
+		bool m_invalid; // caller knows the command did nothing (not effective)
+	};
+
+	EAPMClassifier(unsigned long bucketTicks);
+	~EAPMClassifier();
+
+	// forget everything
+	void Reset();
+
+	// classify command, returns EFFECTIVE or a reason. If an earlier command becomes
+	// ineffective (replaced selection or build), *revoked is set to its sequence number
+	// (else -1). Sequence numbers count the classified commands from 0.
+	int Classify(const Command& cmd, int *revoked=0);
+
+	// time series
+	int GetBucketCount() const {return m_bucketCount;}
+	unsigned long GetBucketTicks() const {return m_bucketTicks;}
+	int GetActions(int bucket) const {return bucket<0 || bucket>=m_bucketCount ? 0 : m_actions[bucket];}
+	int GetEffectiveActions(int bucket) const {return bucket<0 || bucket>=m_bucketCount ? 0 : m_effective[bucket];}
+
+	// total counts
+	int GetTotalActions() const {return m_totalActions;}
+	int GetTotalEffectiveActions() const {return m_totalEffective;}
+
+	// actions per minute on a window of buckets ending at bucket (ticksPerMinute is 1428 at fastest speed)
+	int GetAPM(int bucket, int window, unsigned long ticksPerMinute, bool effective) const;
+
+private:
+	struct Past
+	{
+		unsigned long m_time;
+		unsigned long m_key; // command and parameters fingerprint
+		int m_kind;
+		int m_id;
+		int m_object;
+	};
+
+	struct Build
+	{
+		unsigned long m_time;
+		int m_kind;
+		int m_object;
+		int m_x, m_y;
+		int m_seq; // -1 once revoked
+	};
+
+	unsigned long m_bucketTicks;
+	int m_seq; // commands so far
+
+	// last commands (ring)
+	Past m_commands[EAPM_HISTORY];
+	int m_commandCount;
+
+	// last effective builds and morphs (ring)
+	Build m_builds[EAPM_HISTORY];
+	int m_buildCount;
+
+	// last selection change, if no command followed it yet
+	unsigned long m_selTime;
+	int m_selSeq; // -1 if none
+	int m_selBucket;
+
+	// selection and hot key fingerprints
+	unsigned long m_selection;
+	unsigned long m_hotkeys[EAPM_MAXSLOT];
+
+	// similar units queued since selection
+	int m_similar;
+
+	// last train, morph or build (for cancels)
+	unsigned long m_queueTime;
+
+	// counts per bucket
+	unsigned short *m_actions;
+	unsigned short *m_effective;
+	int m_bucketCount;
+	int m_bucketSize;
+	int m_totalActions;
+	int m_totalEffective;
+
+	int _Classify(const Command& cmd, int *revoked);
+	void _Rebuild(const Command& cmd, int *revoked);
+	void _Count(int bucket, int actions, int effective);
+	static unsigned long _Hash(unsigned long hash, const unsigned char *data, int size);
+};
+
+#endif
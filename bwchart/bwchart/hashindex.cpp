@@ -0,0 +1,88 @@
+// hashindex.cpp : implementation of the HashIndex class
+//
+
+#include "hashindex.h"
+#include <stdlib.h>
+#include <assert.h>
+
+#define FNV_PRIME 16777619UL
+
+//---------------------------------------------------------------------------------------
+
+HashIndex::HashIndex(int minBuckets) : m_buckets(0), m_bucketCount(0), m_count(0), m_minBuckets(minBuckets)
+{
+	// bucket count must stay a power of 2
+	assert(minBuckets>0 && (minBuckets&(minBuckets-1))==0);
+}
+
+HashIndex::~HashIndex()
+{
+	free(m_buckets);
+}
+
+void HashIndex::Clear()
+{
+	free(m_buckets);
+	m_buckets=0;
+	m_bucketCount=0;
+	m_count=0;
+}
+
+//---------------------------------------------------------------------------------------
+
+unsigned long HashIndex::Hash(const void *data, int size, unsigned long hash)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	for(int i=0; i<size; i++) hash = ((hash^p[i])*FNV_PRIME)&0xFFFFFFFFUL;
+	return hash;
+}
+
+unsigned long HashIndex::HashNoCase(const char *str, int size, unsigned long hash)
+{
+	for(int i=0; size<0 ? str[i]!=0 : i<size; i++)
+	{
+		unsigned char c = (unsigned char)str[i];
+		if(c>='A' && c<='Z') c = c-'A'+'a';
+		hash = ((hash^c)*FNV_PRIME)&0xFFFFFFFFUL;
+	}
+	return hash;
+}
+
+//---------------------------------------------------------------------------------------
+
+int HashIndex::_Probe(unsigned long b, unsigned long hash) const
+{
+	for(; m_buckets[b].m_id!=-1; b=(b+1)&(m_bucketCount-1))
+		if(m_buckets[b].m_hash==hash) return (int)b;
+	return -1;
+}
+
+void HashIndex::_Rehash(int bucketCount)
+{
+	Bucket *old = m_buckets;
+	int oldCount = m_bucketCount;
+	m_buckets = (Bucket*)malloc(bucketCount*sizeof(Bucket));
+	m_bucketCount = bucketCount;
+	for(int i=0; i<bucketCount; i++) m_buckets[i].m_id=-1;
+	for(int i=0; i<oldCount; i++)
+	{
+		if(old[i].m_id==-1) continue;
+		unsigned long b = old[i].m_hash&(bucketCount-1);
+		while(m_buckets[b].m_id!=-1) b=(b+1)&(bucketCount-1);
+		m_buckets[b]=old[i];
+	}
+	free(old);
+}
+
+void HashIndex::Add(unsigned long hash, int id)
+{
+	assert(id>=0);
+
+	// keep table half empty
+	m_count++;
+	if(2*m_count>m_bucketCount) _Rehash(m_bucketCount==0 ? m_minBuckets : 2*m_bucketCount);
+	unsigned long b = hash&(m_bucketCount-1);
+	while(m_buckets[b].m_id!=-1) b=(b+1)&(m_bucketCount-1);
+	m_buckets[b].m_hash = hash;
+	m_buckets[b].m_id = id;
+}
@@ -0,0 +1,70 @@
+// hashindex.h : interface of the HashIndex class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __HASHINDEX_H
+#define __HASHINDEX_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#define HASH_SEED 2166136261UL
+
+//--------------------------------------------------------------------------------------
+
+// Open addressing hash table of ids (names, records, unit groups...).
+//
+// The table only keeps the ids with the hash of their key: the owner keeps the keys
+// and compares them while walking the ids stored with the same hash, so the table
+// can grow without calling the owner back.
+//
+//	for(int pos=index.First(hash); pos>=0; pos=index.Next(pos,hash))
+//		if(_Equal(index.GetID(pos),key)) return index.GetID(pos);
+//
+class HashIndex
+{
+public:
+	HashIndex(int minBuckets=64);
+	~HashIndex();
+
+	// remove all ids
+	void Clear();
+
+	// walk the ids stored with a hash (-1 at the end)
+	int First(unsigned long hash) const {return m_bucketCount==0 ? -1 : _Probe(hash&(m_bucketCount-1),hash);}
+	int Next(int pos, unsigned long hash) const {return _Probe((pos+1)&(m_bucketCount-1),hash);}
+	int GetID(int pos) const {return m_buckets[pos].m_id;}
+
+	// add an id (>=0, the caller checked its key isnt in the table yet)
+	void Add(unsigned long hash, int id);
+
+	// number of ids
+	int GetCount() const {return m_count;}
+
+	// memory used by the table
+	unsigned long GetSize() const {return m_bucketCount*sizeof(Bucket);}
+
+	// 32 bits FNV-1a of a buffer (pass a previous hash to chain buffers)
+	static unsigned long Hash(const void *data, int size, unsigned long hash=HASH_SEED);
+
+	// same with ASCII case ignored (size -1 for a zero terminated string)
+	static unsigned long HashNoCase(const char *str, int size=-1, unsigned long hash=HASH_SEED);
+
+private:
+	struct Bucket
+	{
+		unsigned long m_hash;
+		int m_id; // -1 for empty buckets
+	};
+
+	Bucket *m_buckets;
+	int m_bucketCount;
+	int m_count;
+	int m_minBuckets;
+
+	int _Probe(unsigned long b, unsigned long hash) const;
+	void _Rehash(int bucketCount);
+};
+
+#endif
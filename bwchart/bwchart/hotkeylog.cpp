@@ -0,0 +1,102 @@
+// hotkeylog.cpp : implementation of the HotKeyLog class
+//
+
+#include "hotkeylog.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+//---------------------------------------------------------------------------------------
+
+HotKeyLog::HotKeyLog() : m_events(0), m_count(0), m_size(0), m_pool(0), m_poolUsed(0), m_poolSize(0)
+{
+	Clear();
+}
+
+HotKeyLog::~HotKeyLog()
+{
+	Clear();
+}
+
+void HotKeyLog::Clear()
+{
+	free(m_events);
+	m_events=0;
+	m_count=m_size=0;
+	free(m_pool);
+	m_pool=0;
+	m_poolUsed=m_poolSize=0;
+	m_index.Clear();
+	memset(m_stats,0,sizeof(m_stats));
+}
+
+unsigned long HotKeyLog::GetSize() const
+{
+	return m_size*sizeof(HotKeyEvent) + m_poolSize*sizeof(short) + m_index.GetSize();
+}
+
+//---------------------------------------------------------------------------------------
+
+unsigned long HotKeyLog::_Hash(const short *units, int count)
+{
+	return HashIndex::Hash(units,count*sizeof(short),HashIndex::Hash(&count,sizeof(count)));
+}
+
+int HotKeyLog::AddGroup(const short *units, int count)
+{
+	assert(count>=0);
+
+	// identical group already stored?
+	unsigned long hash = _Hash(units,count);
+	for(int pos=m_index.First(hash); pos>=0; pos=m_index.Next(pos,hash))
+	{
+		int group = m_index.GetID(pos);
+		if(m_pool[group]==count && (count==0 || memcmp(m_pool+group+1,units,count*sizeof(short))==0)) return group;
+	}
+
+	// append it to the pool
+	if(m_poolUsed+count+1>m_poolSize)
+	{
+		m_poolSize = m_poolSize==0 ? 1024 : 2*m_poolSize;
+		while(m_poolUsed+count+1>m_poolSize) m_poolSize*=2;
+		m_pool = (short*)realloc(m_pool,m_poolSize*sizeof(short));
+	}
+	int group = m_poolUsed;
+	m_pool[group] = (short)count;
+	if(count>0) memcpy(m_pool+group+1,units,count*sizeof(short));
+	m_poolUsed += count+1;
+	m_index.Add(hash,group);
+	return group;
+}
+
+//---------------------------------------------------------------------------------------
+
+void HotKeyLog::Add(unsigned long time, int slot, int type, int group)
+{
+	assert(slot>=0 && slot<HOTKEYLOG_MAXSLOT);
+	if(m_count==m_size)
+	{
+		m_size = m_size==0 ? 256 : 2*m_size;
+		m_events = (HotKeyEvent*)realloc(m_events,m_size*sizeof(HotKeyEvent));
+	}
+	HotKeyEvent& evt = m_events[m_count++];
+	evt.m_time = (unsigned int)time;
+	evt.m_slot = (unsigned char)slot;
+	evt.m_type = (unsigned char)type;
+	evt.m_group = group;
+
+	// update slot statistics
+	HotKeySlotStats& stats = m_stats[slot];
+	if(stats.m_assigns+stats.m_adds+stats.m_recalls==0) stats.m_firstTime=time;
+	stats.m_lastTime=time;
+	if(type==HotKeyEvent::SELECT)
+	{
+		stats.m_recalls++;
+		return;
+	}
+	if(type==HotKeyEvent::ASSIGN) stats.m_assigns++; else stats.m_adds++;
+	int size = GetGroupSize(group);
+	if(stats.m_assigns+stats.m_adds==1 || size<stats.m_minSize) stats.m_minSize=size;
+	if(size>stats.m_maxSize) stats.m_maxSize=size;
+	stats.m_sizeSum+=size;
+}
@@ -0,0 +1,107 @@
+// hotkeylog.h : interface of the HotKeyLog class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __HOTKEYLOG_H
+#define __HOTKEYLOG_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include "hashindex.h"
+
+//--------------------------------------------------------------------------------------
+
+#define HOTKEYLOG_MAXSLOT 16
+#define HOTKEYLOG_NOGROUP -1
+
+// hot key event
+class HotKeyEvent
+{
+public:
+	enum {ASSIGN,SELECT,ADD};
+	unsigned int m_time; // tick
+	unsigned char m_slot;
+	unsigned char m_type;
+	int m_group; // units in hot key (offset in log pool, HOTKEYLOG_NOGROUP if none)
+};
+
+// statistics for a hot key slot
+class HotKeySlotStats
+{
+public:
+	int m_assigns;
+	int m_adds;
+	int m_recalls;
+
+	// group sizes after each assign or add
+	int m_minSize;
+	int m_maxSize;
+	int m_sizeSum;
+
+	// first and last event
+	unsigned long m_firstTime;
+	unsigned long m_lastTime;
+
+	int GetAverageSize() const {return m_assigns+m_adds==0 ? 0 : m_sizeSum/(m_assigns+m_adds);}
+};
+
+// Hot key events of a player.
+//
+// Unit groups are stored once in a pool of unit ids (identical groups are shared), and
+// events only keep the offset of their group. Slot statistics are updated as events
+// are added.
+//
+class HotKeyLog
+{
+public:
+	HotKeyLog();
+	~HotKeyLog();
+
+	// release everything
+	void Clear();
+
+	// store a group of units (or find the identical one), returns its offset
+	int AddGroup(const short *units, int count);
+
+	// add event
+	void Add(unsigned long time, int slot, int type, int group);
+
+	// events
+	int GetCount() const {return m_count;}
+	const HotKeyEvent *GetEvent(int idx) const {return &m_events[idx];}
+
+	// units in a group
+	int GetGroupSize(int group) const {return group==HOTKEYLOG_NOGROUP ? 0 : m_pool[group];}
+	const short *GetGroupUnits(int group) const {return group==HOTKEYLOG_NOGROUP ? 0 : m_pool+group+1;}
+
+	// number of distinct groups
+	int GetGroupCount() const {return m_index.GetCount();}
+
+	// statistics for a slot
+	const HotKeySlotStats& GetSlotStats(int slot) const {return m_stats[slot];}
+
+	// memory used (bytes)
+	unsigned long GetSize() const;
+
+private:
+	// events
+	HotKeyEvent *m_events;
+	int m_count;
+	int m_size;
+
+	// unit groups (unit count followed by unit ids)
+	short *m_pool;
+	int m_poolUsed;
+	int m_poolSize;
+
+	// groups by units (offsets in pool)
+	HashIndex m_index;
+
+	HotKeySlotStats m_stats[HOTKEYLOG_MAXSLOT];
+
+	static unsigned long _Hash(const short *units, int count);
+};
+
+#endif
@@ -0,0 +1,463 @@
+// ingest.cpp : implementation of the IngestPipeline class
+//
+
+#include "ingest.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#define PATHSEP '\\'
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PATHSEP '/'
+#endif
+
+//---------------------------------------------------------------------------------------
+
+// atomic operations (full barrier)
+static long _CompareExchange(volatile long *dest, long exchange, long comparand)
+{
+#ifdef _WIN32
+	return InterlockedCompareExchange(dest,exchange,comparand);
+#else
+	return __sync_val_compare_and_swap(dest,comparand,exchange);
+#endif
+}
+
+static long _Increment(volatile long *dest)
+{
+#ifdef _WIN32
+	return InterlockedIncrement(dest);
+#else
+	return __sync_add_and_fetch(dest,1);
+#endif
+}
+
+static long _Decrement(volatile long *dest)
+{
+#ifdef _WIN32
+	return InterlockedDecrement(dest);
+#else
+	return __sync_sub_and_fetch(dest,1);
+#endif
+}
+
+static long _Load(volatile long *src)
+{
+#ifdef _WIN32
+	return InterlockedCompareExchange(src,0,0);
+#else
+	return __atomic_load_n(src,__ATOMIC_SEQ_CST);
+#endif
+}
+
+static void _Store(volatile long *dest, long value)
+{
+#ifdef _WIN32
+	InterlockedExchange(dest,value);
+#else
+	__atomic_store_n(dest,value,__ATOMIC_SEQ_CST);
+#endif
+}
+
+// difference between two positions (counters wrap around)
+static long _Distance(long seq, long pos)
+{
+	return (long)((unsigned long)seq-(unsigned long)pos);
+}
+
+//---------------------------------------------------------------------------------------
+
+IngestQueue::IngestQueue(int size) : m_tail(0), m_head(0)
+{
+	unsigned long count=2;
+	while(count<(unsigned long)size) count<<=1;
+	m_mask = count-1;
+	m_cells = (Cell*)malloc(count*sizeof(Cell));
+	for(unsigned long i=0;i<count;i++) {m_cells[i].m_seq=(long)i; m_cells[i].m_data=0;}
+}
+
+IngestQueue::~IngestQueue()
+{
+	free(m_cells);
+}
+
+bool IngestQueue::Push(void *data)
+{
+	Cell *cell;
+	long pos = _Load(&m_tail);
+	for(;;)
+	{
+		// cell is free for this position when its sequence number is the position
+		cell = &m_cells[(unsigned long)pos&m_mask];
+		long dif = _Distance(_Load(&cell->m_seq),pos);
+		if(dif==0)
+		{
+			long prev = _CompareExchange(&m_tail,(long)((unsigned long)pos+1),pos);
+			if(prev==pos) break;
+			pos = prev;
+		}
+		else if(dif<0) return false; // cell still holds the value from the previous round
+		else pos = _Load(&m_tail);
+	}
+
+	cell->m_data = data;
+	_Store(&cell->m_seq,(long)((unsigned long)pos+1));
+	return true;
+}
+
+bool IngestQueue::Pop(void **data)
+{
+	Cell *cell;
+	long pos = _Load(&m_head);
+	for(;;)
+	{
+		// cell holds a value for this position when its sequence number is the position+1
+		cell = &m_cells[(unsigned long)pos&m_mask];
+		long dif = _Distance(_Load(&cell->m_seq),(long)((unsigned long)pos+1));
+		if(dif==0)
+		{
+			long prev = _CompareExchange(&m_head,(long)((unsigned long)pos+1),pos);
+			if(prev==pos) break;
+			pos = prev;
+		}
+		else if(dif<0) return false; // not written yet
+		else pos = _Load(&m_head);
+	}
+
+	*data = cell->m_data;
+	_Store(&cell->m_seq,(long)((unsigned long)pos+m_mask+1));
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+
+IngestPipeline::IngestPipeline(IngestHandler *handler, int workers, int queueSize, int batchSize) :
+	m_handler(handler), m_parsers(0), m_workerCount(workers), m_batchSize(batchSize),
+	m_files(queueSize), m_records(queueSize), m_root(0), m_recursive(false),
+	m_abort(0), m_walking(0), m_activeWorkers(0), m_writing(0),
+	m_fileCount(0), m_parsedCount(0), m_failedCount(0), m_writtenCount(0), m_nextWorker(0)
+{
+	if(m_workerCount<=0) m_workerCount = GetProcessorCount();
+	if(m_batchSize<=0) m_batchSize = 1;
+}
+
+IngestPipeline::~IngestPipeline()
+{
+	assert(m_parsers==0);
+}
+
+int IngestPipeline::GetProcessorCount()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	int count = (int)info.dwNumberOfProcessors;
+#else
+	int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return count<1 ? 1 : count;
+}
+
+bool IngestPipeline::HasExtension(const char *path, const char *ext)
+{
+	size_t len = strlen(path);
+	size_t extlen = strlen(ext);
+	if(len<extlen) return false;
+	path += len-extlen;
+	for(size_t i=0;i<extlen;i++)
+	{
+		char c1 = path[i]>='A' && path[i]<='Z' ? path[i]-'A'+'a' : path[i];
+		char c2 = ext[i]>='A' && ext[i]<='Z' ? ext[i]-'A'+'a' : ext[i];
+		if(c1!=c2) return false;
+	}
+	return true;
+}
+
+void IngestPipeline::FreeRecord(IngestRecord *record)
+{
+	free(record->m_path);
+	free(record->m_data);
+	free(record->m_extra);
+	free(record);
+}
+
+void IngestPipeline::_Yield()
+{
+#ifdef _WIN32
+	Sleep(0);
+#else
+	sched_yield();
+#endif
+}
+
+// backpressure: wait until next stage made room (false if aborted, or if the next stage has no thread left)
+bool IngestPipeline::_PushWait(IngestQueue& queue, void *data, volatile long *consumers)
+{
+	int spin=0;
+	while(!queue.Push(data))
+	{
+		if(m_abort || _Load(consumers)==0) return false;
+		if(++spin<64) _Yield();
+		else
+		{
+#ifdef _WIN32
+			Sleep(1);
+#else
+			usleep(1000);
+#endif
+		}
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+
+// walker stage (false to stop walking)
+bool IngestPipeline::_Walk(const char *dir)
+{
+	bool walking=true;
+	size_t dirlen = strlen(dir);
+	char *path;
+
+#ifdef _WIN32
+	char *pattern = (char*)malloc(dirlen+3);
+	strcpy(pattern,dir);
+	strcpy(pattern+dirlen,"\\*");
+	WIN32_FIND_DATAA data;
+	HANDLE hfind = FindFirstFileA(pattern,&data);
+	free(pattern);
+	if(hfind==INVALID_HANDLE_VALUE) return true;
+	do
+	{
+		const char *name = data.cFileName;
+		bool isDirectory = (data.dwFileAttributes&FILE_ATTRIBUTE_DIRECTORY)!=0;
+
+		// junctions and directory links are not followed (they can loop)
+		if(isDirectory && (data.dwFileAttributes&FILE_ATTRIBUTE_REPARSE_POINT)!=0) continue;
+#else
+	DIR *hdir = opendir(dir);
+	if(hdir==0) return true;
+	struct dirent *entry;
+	while((entry=readdir(hdir))!=0)
+	{
+		const char *name = entry->d_name;
+#endif
+		if(strcmp(name,".")==0 || strcmp(name,"..")==0) continue;
+		if(m_abort) {walking=false; break;}
+
+		// full path
+		size_t namelen = strlen(name);
+		path = (char*)malloc(dirlen+namelen+2);
+		memcpy(path,dir,dirlen);
+		path[dirlen]=PATHSEP;
+		memcpy(path+dirlen+1,name,namelen+1);
+
+#ifndef _WIN32
+		// links to files are followed, links to directories are not (they can loop)
+		struct stat st;
+		if(lstat(path,&st)!=0 || (S_ISLNK(st.st_mode) && (stat(path,&st)!=0 || S_ISDIR(st.st_mode)))) {free(path); continue;}
+		bool isDirectory = S_ISDIR(st.st_mode);
+#endif
+
+		if(!m_handler->Accept(path,isDirectory))
+			free(path);
+		else if(isDirectory)
+		{
+			if(m_recursive) walking = _Walk(path);
+			free(path);
+			if(!walking) break;
+		}
+		else
+		{
+			// queue file for workers (they own the path from now on)
+			_Increment(&m_fileCount);
+			if(!_PushWait(m_files,path,&m_activeWorkers)) {free(path); walking=false; break;}
+		}
+#ifdef _WIN32
+	}
+	while(FindNextFileA(hfind,&data));
+	FindClose(hfind);
+#else
+	}
+	closedir(hdir);
+#endif
+	return walking;
+}
+
+// worker stage
+void IngestPipeline::_Worker(IngestParser *parser)
+{
+	void *data;
+	while(!m_abort)
+	{
+		if(!m_files.Pop(&data))
+		{
+			// walker is done and queue is empty, we're done too
+			if(_Load(&m_walking)==0) {if(!m_files.Pop(&data)) break;}
+			else {_Yield(); continue;}
+		}
+
+		// parse file
+		IngestRecord *record = (IngestRecord*)malloc(sizeof(IngestRecord));
+		record->m_path = (char*)data;
+		record->m_data = 0;
+		record->m_size = 0;
+		record->m_extra = 0;
+		record->m_extraSize = 0;
+		record->m_status = parser->Parse(record->m_path,record);
+		_Increment(record->m_status==0 ? &m_parsedCount : &m_failedCount);
+
+		// queue it for writer
+		if(!_PushWait(m_records,record,&m_writing)) {FreeRecord(record); break;}
+	}
+
+	_Decrement(&m_activeWorkers);
+}
+
+// writer stage
+void IngestPipeline::_Writer()
+{
+	IngestRecord **batch = (IngestRecord**)malloc(m_batchSize*sizeof(IngestRecord*));
+	int count=0;
+	void *data;
+	for(;;)
+	{
+		// workers count is read before the queue: once it is 0, an empty queue stays empty
+		bool done = _Load(&m_activeWorkers)==0;
+		bool got = m_records.Pop(&data);
+		if(got) batch[count++] = (IngestRecord*)data;
+
+		// write batch when its full, or when we'd have to wait for the next record
+		if(count>0 && (count==m_batchSize || !got))
+		{
+			if(!m_abort)
+			{
+				m_handler->Write(batch,count);
+				m_writtenCount += count;
+			}
+			for(int i=0;i<count;i++) FreeRecord(batch[i]);
+			count=0;
+		}
+
+		if(!got)
+		{
+			if(done) break;
+			_Yield();
+		}
+	}
+	free(batch);
+	_Store(&m_writing,0);
+}
+
+#ifdef _WIN32
+unsigned __stdcall IngestPipeline::_WalkerThread(void *param)
+#else
+void *IngestPipeline::_WalkerThread(void *param)
+#endif
+{
+	IngestPipeline *pipeline = (IngestPipeline*)param;
+	pipeline->_Walk(pipeline->m_root);
+	_Store(&pipeline->m_walking,0);
+	return 0;
+}
+
+#ifdef _WIN32
+unsigned __stdcall IngestPipeline::_WorkerThread(void *param)
+#else
+void *IngestPipeline::_WorkerThread(void *param)
+#endif
+{
+	IngestPipeline *pipeline = (IngestPipeline*)param;
+	long idx = _Increment(&pipeline->m_nextWorker)-1;
+	pipeline->_Worker(pipeline->m_parsers[idx]);
+	return 0;
+}
+
+#ifdef _WIN32
+unsigned __stdcall IngestPipeline::_WriterThread(void *param)
+#else
+void *IngestPipeline::_WriterThread(void *param)
+#endif
+{
+	IngestPipeline *pipeline = (IngestPipeline*)param;
+	pipeline->_Writer();
+	return 0;
+}
+
+//---------------------------------------------------------------------------------------
+
+int IngestPipeline::Run(const char *root, bool recursive)
+{
+	int i;
+	assert(m_parsers==0);
+
+	m_root = root;
+	m_recursive = recursive;
+	m_abort = 0;
+	m_walking = 1;
+	m_activeWorkers = m_workerCount;
+	m_writing = 1;
+	m_nextWorker = 0;
+	m_fileCount = m_parsedCount = m_failedCount = m_writtenCount = 0;
+
+	// one parser per worker
+	m_parsers = (IngestParser**)malloc(m_workerCount*sizeof(IngestParser*));
+	for(i=0;i<m_workerCount;i++) m_parsers[i] = m_handler->CreateParser();
+
+	// start stages (a stage that cant be started is considered done)
+	int threadCount = m_workerCount+2;
+#ifdef _WIN32
+	HANDLE *threads = (HANDLE*)malloc(threadCount*sizeof(HANDLE));
+	threads[0] = (HANDLE)_beginthreadex(0,0,_WalkerThread,this,0,0);
+	if(threads[0]==0) m_walking=0;
+	for(i=0;i<m_workerCount;i++)
+	{
+		threads[i+1] = (HANDLE)_beginthreadex(0,0,_WorkerThread,this,0,0);
+		if(threads[i+1]==0) _Decrement(&m_activeWorkers);
+	}
+	threads[threadCount-1] = (HANDLE)_beginthreadex(0,0,_WriterThread,this,0,0);
+	if(threads[threadCount-1]==0) {m_writing=0; Abort();}
+
+	// wait for all of them (not WaitForMultipleObjects, we may have more than 64 threads)
+	for(i=0;i<threadCount;i++)
+	{
+		if(threads[i]==0) continue;
+		WaitForSingleObject(threads[i],INFINITE);
+		CloseHandle(threads[i]);
+	}
+#else
+	pthread_t *threads = (pthread_t*)malloc(threadCount*sizeof(pthread_t));
+	bool *started = (bool*)malloc(threadCount*sizeof(bool));
+	started[0] = pthread_create(&threads[0],0,_WalkerThread,this)==0;
+	if(!started[0]) m_walking=0;
+	for(i=0;i<m_workerCount;i++)
+	{
+		started[i+1] = pthread_create(&threads[i+1],0,_WorkerThread,this)==0;
+		if(!started[i+1]) _Decrement(&m_activeWorkers);
+	}
+	started[threadCount-1] = pthread_create(&threads[threadCount-1],0,_WriterThread,this)==0;
+	if(!started[threadCount-1]) {m_writing=0; Abort();}
+	for(i=0;i<threadCount;i++) if(started[i]) pthread_join(threads[i],0);
+	free(started);
+#endif
+	free(threads);
+
+	// files left in queues if aborted
+	void *data;
+	while(m_files.Pop(&data)) free(data);
+	while(m_records.Pop(&data)) FreeRecord((IngestRecord*)data);
+
+	for(i=0;i<m_workerCount;i++) delete m_parsers[i];
+	free(m_parsers);
+	m_parsers=0;
+
+	return m_writtenCount;
+}
@@ -0,0 +1,162 @@
+// ingest.h : interface of the IngestPipeline class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __INGEST_H
+#define __INGEST_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+//--------------------------------------------------------------------------------------
+
+// Bounded queue of pointers for several producers and consumers.
+//
+// Every cell has a sequence number telling whether it can be written or read for a
+// given position, producers and consumers reserve a position with a compare and swap
+// on the tail or head counter, so no thread ever waits for a lock.
+//
+class IngestQueue
+{
+public:
+	// size is rounded up to a power of 2
+	IngestQueue(int size);
+	~IngestQueue();
+
+	// false if queue is full (Push) or empty (Pop)
+	bool Push(void *data);
+	bool Pop(void **data);
+
+private:
+	struct Cell
+	{
+		volatile long m_seq;
+		void *m_data;
+	};
+
+	Cell *m_cells;
+	unsigned long m_mask;
+	volatile long m_tail;
+	char m_pad[64]; // keep producers and consumers counters on different cache lines
+	volatile long m_head;
+};
+
+//--------------------------------------------------------------------------------------
+
+// a parsed file on its way to the writer
+class IngestRecord
+{
+public:
+	char *m_path;
+	int m_status; // 0 if parsed ok, parser error otherwise
+	char *m_data; // parser output (malloc'ed)
+	int m_size;
+	char *m_extra; // second output for another store (malloc'ed, 0 if none)
+	int m_extraSize;
+};
+
+// parses files, one instance per worker thread
+class IngestParser
+{
+public:
+	virtual ~IngestParser() {}
+
+	// fill record data and extra data (malloc'ed), returns 0 or an error code
+	virtual int Parse(const char *path, IngestRecord *record) = 0;
+};
+
+// what the pipeline does with the files
+class IngestHandler
+{
+public:
+	virtual ~IngestHandler() {}
+
+	// called by the walker for every file and sub directory
+	virtual bool Accept(const char *path, bool isDirectory) = 0;
+
+	// called once per worker before the pipeline starts
+	virtual IngestParser *CreateParser() = 0;
+
+	// called by the writer thread only, with records in batches
+	virtual void Write(IngestRecord **records, int count) = 0;
+};
+
+// Replay ingestion: a thread walks the directories and queues the file names, worker
+// threads (one parser each) parse them and queue the results, and a single writer
+// thread hands them to the handler in batches. Queues are bounded, a stage that gets
+// ahead waits for the next one.
+//
+// The pipeline serves the headless ingestion (scr-benchmark -i), the browser dialog keeps
+// its incremental scan: it only parses new or modified replays, with the MFC Replay class.
+//
+class IngestPipeline
+{
+public:
+	// workers=0 for one worker per processor
+	IngestPipeline(IngestHandler *handler, int workers=0, int queueSize=1024, int batchSize=256);
+	~IngestPipeline();
+
+	// process directory (and sub directories if recursive), returns number of records written
+	int Run(const char *root, bool recursive);
+
+	// stop pipeline (can be called from any thread or from the handler)
+	void Abort() {m_abort=1;}
+	bool IsAborted() const {return m_abort!=0;}
+
+	// progress (can be read while Run is in progress)
+	int GetWorkerCount() const {return m_workerCount;}
+	int GetFileCount() const {return m_fileCount;}
+	int GetParsedCount() const {return m_parsedCount;}
+	int GetFailedCount() const {return m_failedCount;}
+	int GetWrittenCount() const {return m_writtenCount;}
+
+	// helpers
+	static int GetProcessorCount();
+	static bool HasExtension(const char *path, const char *ext);
+	static void FreeRecord(IngestRecord *record);
+
+private:
+	IngestHandler *m_handler;
+	IngestParser **m_parsers;
+	int m_workerCount;
+	int m_batchSize;
+
+	IngestQueue m_files;
+	IngestQueue m_records;
+
+	const char *m_root;
+	bool m_recursive;
+
+	// stage states
+	volatile long m_abort;
+	volatile long m_walking;
+	volatile long m_activeWorkers;
+	volatile long m_writing;
+
+	// counters
+	volatile long m_fileCount;
+	volatile long m_parsedCount;
+	volatile long m_failedCount;
+	volatile long m_writtenCount;
+	volatile long m_nextWorker;
+
+	bool _Walk(const char *dir);
+	void _Worker(IngestParser *parser);
+	void _Writer();
+
+	bool _PushWait(IngestQueue& queue, void *data, volatile long *consumers);
+
+	static void _Yield();
+#ifdef _WIN32
+	static unsigned __stdcall _WalkerThread(void *param);
+	static unsigned __stdcall _WorkerThread(void *param);
+	static unsigned __stdcall _WriterThread(void *param);
+#else
+	static void *_WalkerThread(void *param);
+	static void *_WorkerThread(void *param);
+	static void *_WriterThread(void *param);
+#endif
+};
+
+#endif
@@ -0,0 +1,337 @@
+// mapcache.cpp : implementation of the MapAssetCache class
+//
+
+#include "mapcache.h"
+#include "unitsize.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define MAPASSET_MAGIC 0x414D5742 // "BWMA"
+
+// unit of the map UNIT section (position in pixels)
+struct MapSectionUnit
+{
+	unsigned char u1[4];
+	unsigned short x;
+	unsigned short y;
+	unsigned short unitid;
+	unsigned char u2[6];
+	unsigned char playerid;
+	unsigned char u3[19];
+};
+
+// unit ids of the UNIT section
+enum {UNIT_MINERAL1=176, UNIT_MINERAL2=177, UNIT_MINERAL3=178, UNIT_GEYSER=188, UNIT_STARTLOCATION=214};
+#define UNIT_COMMANDCENTER 106
+
+//---------------------------------------------------------------------------------------
+
+static size_t _RecordSize(int width, int height, bool hasTiles, int unitCount)
+{
+	size_t size = sizeof(MapAssetRecord) + (hasTiles ? 2*width*height : 0) + unitCount*sizeof(MapAssetUnit);
+	return (size+7)&~(size_t)7;
+}
+
+MapAssetRecord *MapAssetRecord::Create(MapAssetHash hash, int width, int height, const unsigned char *tiles,
+	const MapAssetUnit *units, int unitCount)
+{
+	size_t size = _RecordSize(width,height,tiles!=0,unitCount);
+	MapAssetRecord *record = (MapAssetRecord *)calloc(1,size);
+	if(record==0) return 0;
+	record->m_magic = MAPASSET_MAGIC;
+	record->m_size = (unsigned int)size;
+	record->m_hash = hash;
+	record->m_width = (unsigned short)width;
+	record->m_height = (unsigned short)height;
+	record->m_unitCount = (unsigned short)unitCount;
+	record->m_hasTiles = tiles!=0 ? 1 : 0;
+	if(tiles!=0) memcpy((unsigned char*)(record+1),tiles,2*width*height);
+	memcpy((void*)record->GetUnits(),units,unitCount*sizeof(MapAssetUnit));
+	return record;
+}
+
+MapAssetRecord *MapAssetRecord::Extract(MapAssetHash hash, int width, int height, const unsigned char *tiles,
+	unsigned long tileSize, const unsigned char *units, unsigned long unitSize)
+{
+	assert(sizeof(MapSectionUnit)==36);
+
+	// tiles (2 bytes per square)
+	unsigned char *squares=0;
+	unsigned long mapsize = (unsigned long)width*height;
+	if(tiles!=0 && tileSize>0 && mapsize>0)
+	{
+		squares = (unsigned char *)calloc(2*mapsize,1);
+		if(tileSize==mapsize)
+			for(unsigned long i=0;i<mapsize;i++) squares[2*i]=tiles[i];
+		else
+			memcpy(squares,tiles,tileSize<2*mapsize ? tileSize : 2*mapsize);
+	}
+
+	// start locations get the size of the main buildings (the same for all races)
+	int mainWidth,mainHeight;
+	GetBuildingSize(UNIT_COMMANDCENTER,&mainWidth,&mainHeight);
+
+	// start locations and resources
+	int count = units==0 ? 0 : (int)(unitSize/sizeof(MapSectionUnit));
+	MapAssetUnit *assets = (MapAssetUnit *)calloc(count+1,sizeof(MapAssetUnit));
+	int assetCount=0;
+	for(int i=0;i<count;i++)
+	{
+		MapSectionUnit desc;
+		memcpy(&desc,units+i*sizeof(MapSectionUnit),sizeof(desc));
+		MapAssetUnit& unit = assets[assetCount];
+		if(desc.unitid==UNIT_STARTLOCATION)
+		{
+			unit.m_kind = MapAssetUnit::STARTLOCATION;
+			unit.m_playerid = desc.playerid;
+			unit.m_width = (unsigned char)mainWidth;
+			unit.m_height = (unsigned char)mainHeight;
+		}
+		else if(desc.unitid==UNIT_MINERAL1 || desc.unitid==UNIT_MINERAL2 || desc.unitid==UNIT_MINERAL3 || desc.unitid==UNIT_GEYSER)
+		{
+			unit.m_kind = MapAssetUnit::RESOURCE;
+			unit.m_width = desc.unitid==UNIT_GEYSER ? 4 : 2;
+			unit.m_height = desc.unitid==UNIT_GEYSER ? 2 : 1;
+		}
+		else continue;
+		unit.m_x = desc.x/32;
+		unit.m_y = desc.y/32;
+		assetCount++;
+	}
+
+	MapAssetRecord *record = Create(hash,width,height,squares,assets,assetCount);
+	free(assets);
+	free(squares);
+	return record;
+}
+
+//---------------------------------------------------------------------------------------
+
+#ifdef _WIN32
+#define FNV_OFFSET 14695981039346656037ui64
+#define FNV_PRIME 1099511628211ui64
+#else
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+#endif
+
+MapAssetHasher::MapAssetHasher(unsigned long unpackedSize) : m_hash(FNV_OFFSET)
+{
+	for(int i=0; i<4; i++) {m_hash^=(unsigned char)(unpackedSize>>(8*i)); m_hash*=FNV_PRIME;}
+}
+
+void MapAssetHasher::Add(const void *packed, size_t size)
+{
+	const unsigned char *p = (const unsigned char *)packed;
+	for(size_t i=0; i<size; i++) {m_hash^=p[i]; m_hash*=FNV_PRIME;}
+}
+
+//---------------------------------------------------------------------------------------
+
+MapAssetCache::MapAssetCache() : m_path(0), m_file(0), m_mapping(0), m_view(0), m_viewSize(0), m_validSize(0),
+	m_index(0), m_count(0), m_size(0), m_added(0), m_addedCount(0)
+{
+#ifdef _WIN32
+	m_lock = malloc(sizeof(CRITICAL_SECTION));
+	InitializeCriticalSection((CRITICAL_SECTION*)m_lock);
+#else
+	m_lock = malloc(sizeof(pthread_mutex_t));
+	pthread_mutex_init((pthread_mutex_t*)m_lock,0);
+#endif
+}
+
+MapAssetCache::~MapAssetCache()
+{
+	Close();
+#ifdef _WIN32
+	DeleteCriticalSection((CRITICAL_SECTION*)m_lock);
+#else
+	pthread_mutex_destroy((pthread_mutex_t*)m_lock);
+#endif
+	free(m_lock);
+}
+
+void MapAssetCache::_Lock() const
+{
+#ifdef _WIN32
+	EnterCriticalSection((CRITICAL_SECTION*)m_lock);
+#else
+	pthread_mutex_lock((pthread_mutex_t*)m_lock);
+#endif
+}
+
+void MapAssetCache::_Unlock() const
+{
+#ifdef _WIN32
+	LeaveCriticalSection((CRITICAL_SECTION*)m_lock);
+#else
+	pthread_mutex_unlock((pthread_mutex_t*)m_lock);
+#endif
+}
+
+//---------------------------------------------------------------------------------------
+
+bool MapAssetCache::Open(const char *path)
+{
+	Close();
+	_Lock();
+	m_path = (char*)malloc(strlen(path)+1);
+	strcpy(m_path,path);
+
+	// map existing file (if any)
+	bool ok=true;
+#ifdef _WIN32
+	HANDLE hFile = ::CreateFileA(path,GENERIC_READ,FILE_SHARE_READ|FILE_SHARE_WRITE,0,OPEN_EXISTING,0,0);
+	if(hFile!=INVALID_HANDLE_VALUE)
+	{
+		m_file = hFile;
+		m_viewSize = ::GetFileSize(hFile,0);
+		if(m_viewSize>0) m_mapping = ::CreateFileMappingA(hFile,0,PAGE_READONLY,0,0,0);
+		if(m_mapping!=0) m_view = (const char*)::MapViewOfFile(m_mapping,FILE_MAP_READ,0,0,0);
+		ok = m_viewSize==0 || m_view!=0;
+	}
+#else
+	int fd = open(path,O_RDONLY);
+	struct stat st;
+	if(fd>=0 && fstat(fd,&st)==0 && st.st_size>0)
+	{
+		void *view = mmap(0,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+		if(view!=MAP_FAILED) {m_view = (const char*)view; m_viewSize = st.st_size;}
+		else ok=false;
+	}
+	if(fd>=0) close(fd);
+#endif
+	if(m_view==0) m_viewSize=0;
+
+	// index all valid records
+	size_t off=0;
+	while(off+sizeof(MapAssetRecord)<=m_viewSize)
+	{
+		const MapAssetRecord *record = (const MapAssetRecord *)(m_view+off);
+		if(record->m_magic!=MAPASSET_MAGIC || off+record->m_size>m_viewSize) break;
+		if(record->m_size!=_RecordSize(record->m_width,record->m_height,record->m_hasTiles!=0,record->m_unitCount)) break;
+		if(_Find(record->m_hash)<0) _Insert(record);
+		off+=record->m_size;
+	}
+
+	// anything after last valid record will be overwritten
+	m_validSize=off;
+	_Unlock();
+	return ok;
+}
+
+void MapAssetCache::Close()
+{
+	_Lock();
+#ifdef _WIN32
+	if(m_view!=0) ::UnmapViewOfFile(m_view);
+	if(m_mapping!=0) ::CloseHandle(m_mapping);
+	if(m_file!=0) ::CloseHandle(m_file);
+#else
+	if(m_view!=0) munmap((void*)m_view,m_viewSize);
+#endif
+	m_view=0;
+	m_mapping=0;
+	m_file=0;
+	m_viewSize=0;
+	m_validSize=0;
+
+	for(int i=0; i<m_addedCount; i++) free(m_added[i]);
+	free(m_added);
+	m_added=0;
+	m_addedCount=0;
+
+	free(m_index);
+	m_index=0;
+	m_count=m_size=0;
+
+	free(m_path);
+	m_path=0;
+	_Unlock();
+}
+
+//---------------------------------------------------------------------------------------
+
+// index of entry with that hash, or -(insertion point)-1
+int MapAssetCache::_Find(MapAssetHash hash) const
+{
+	int low=0, high=m_count-1;
+	while(low<=high)
+	{
+		int mid = (low+high)/2;
+		if(m_index[mid].m_hash<hash) low=mid+1;
+		else if(m_index[mid].m_hash>hash) high=mid-1;
+		else return mid;
+	}
+	return -low-1;
+}
+
+void MapAssetCache::_Insert(const MapAssetRecord *record)
+{
+	int pos = -_Find(record->m_hash)-1;
+	assert(pos>=0);
+	if(m_count==m_size)
+	{
+		m_size = m_size==0 ? 64 : 2*m_size;
+		m_index = (Entry*)realloc(m_index,m_size*sizeof(Entry));
+	}
+	memmove(&m_index[pos+1],&m_index[pos],(m_count-pos)*sizeof(Entry));
+	m_index[pos].m_hash = record->m_hash;
+	m_index[pos].m_record = record;
+	m_count++;
+}
+
+//---------------------------------------------------------------------------------------
+
+const MapAssetRecord *MapAssetCache::Find(MapAssetHash hash) const
+{
+	_Lock();
+	int idx = _Find(hash);
+	const MapAssetRecord *record = idx<0 ? 0 : m_index[idx].m_record;
+	_Unlock();
+	return record;
+}
+
+const MapAssetRecord *MapAssetCache::Add(const MapAssetRecord *record)
+{
+	_Lock();
+
+	// another thread may have added it
+	int idx = _Find(record->m_hash);
+	if(idx>=0) {const MapAssetRecord *found = m_index[idx].m_record; _Unlock(); return found;}
+
+	// keep a copy
+	MapAssetRecord *copy = (MapAssetRecord *)malloc(record->m_size);
+	memcpy(copy,record,record->m_size);
+	m_added = (MapAssetRecord **)realloc(m_added,(m_addedCount+1)*sizeof(MapAssetRecord *));
+	m_added[m_addedCount++] = copy;
+	_Insert(copy);
+
+	// append it to cache file
+	if(m_path!=0)
+	{
+		FILE *fp = fopen(m_path,"r+b");
+		if(fp==0) fp = fopen(m_path,"wb");
+		if(fp!=0)
+		{
+			if(fseek(fp,(long)m_validSize,SEEK_SET)==0 && fwrite(copy,copy->m_size,1,fp)==1)
+				m_validSize+=copy->m_size;
+			fclose(fp);
+		}
+	}
+
+	_Unlock();
+	return copy;
+}
@@ -0,0 +1,140 @@
+// mapcache.h : interface of the MapAssetCache class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __MAPCACHE_H
+#define __MAPCACHE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stddef.h>
+
+//--------------------------------------------------------------------------------------
+
+#ifdef _WIN32
+typedef unsigned __int64 MapAssetHash;
+#else
+typedef unsigned long long MapAssetHash;
+#endif
+
+// unit from the map UNIT section (positions and sizes in map squares)
+class MapAssetUnit
+{
+public:
+	enum {STARTLOCATION,RESOURCE};
+	unsigned char m_kind;
+	unsigned char m_playerid;
+	unsigned char m_width;
+	unsigned char m_height;
+	unsigned short m_x;
+	unsigned short m_y;
+};
+
+// assets derived from a map section: tileset (also used as the minimap raster),
+// start locations and resources, in the order of the UNIT section.
+// Records are stored as is in the cache file, so they have no pointer.
+class MapAssetRecord
+{
+public:
+	unsigned int m_magic;
+	unsigned int m_size; // whole record size (multiple of 8)
+	MapAssetHash m_hash;
+	unsigned short m_width;
+	unsigned short m_height;
+	unsigned short m_unitCount;
+	unsigned short m_hasTiles;
+
+	// tile squares (2 bytes per square) if m_hasTiles, followed by all units
+	const unsigned char *GetTiles() const {return m_hasTiles ? (const unsigned char*)(this+1) : 0;}
+	const MapAssetUnit *GetUnits() const
+		{return (const MapAssetUnit*)((const unsigned char*)(this+1)+(m_hasTiles ? 2*m_width*m_height : 0));}
+
+	// allocate a record (release it with free)
+	static MapAssetRecord *Create(MapAssetHash hash, int width, int height, const unsigned char *tiles,
+		const MapAssetUnit *units, int unitCount);
+
+	// extract a record from the map sections (release it with free): tiles of the MTXM section
+	// (2 bytes per square, a shorter one only sets the first squares) or of the old tile
+	// section (1 byte per square), and start locations and resources of the UNIT section.
+	// Either section can be 0.
+	static MapAssetRecord *Extract(MapAssetHash hash, int width, int height, const unsigned char *tiles,
+		unsigned long tileSize, const unsigned char *units, unsigned long unitSize);
+};
+
+// Hash of a packed map section (same as the bwrep map hash): FNV-1a of the unpacked size
+// (4 bytes, little endian), then of the packed data, which can be added in several parts.
+// A hash is never 0.
+//
+class MapAssetHasher
+{
+public:
+	MapAssetHasher(unsigned long unpackedSize);
+
+	// add packed data
+	void Add(const void *packed, size_t size);
+
+	MapAssetHash GetHash() const {return m_hash==0 ? 1 : m_hash;}
+
+private:
+	MapAssetHash m_hash;
+};
+
+// Cache of map assets keyed by map hash.
+//
+// The cache file is a sequence of records, it is mapped in memory when opened and
+// new records are appended to it. Records read from the file are used in place.
+//
+class MapAssetCache
+{
+public:
+	MapAssetCache();
+	~MapAssetCache();
+
+	// open cache file (created on first Add if it doesnt exist), false if it cant be mapped
+	bool Open(const char *path);
+	void Close();
+
+	// find assets for a map (0 if none)
+	const MapAssetRecord *Find(MapAssetHash hash) const;
+
+	// add assets (record is copied), returns stored record
+	const MapAssetRecord *Add(const MapAssetRecord *record);
+
+	// number of maps in cache
+	int GetCount() const {return m_count;}
+
+private:
+	struct Entry
+	{
+		MapAssetHash m_hash;
+		const MapAssetRecord *m_record;
+	};
+
+	// cache file and its mapping
+	char *m_path;
+	void *m_file;
+	void *m_mapping;
+	const char *m_view;
+	size_t m_viewSize;
+	size_t m_validSize; // end of last valid record
+
+	// index sorted by hash
+	Entry *m_index;
+	int m_count;
+	int m_size;
+
+	// records added since Open
+	MapAssetRecord **m_added;
+	int m_addedCount;
+
+	void *m_lock;
+
+	int _Find(MapAssetHash hash) const;
+	void _Insert(const MapAssetRecord *record);
+	void _Lock() const;
+	void _Unlock() const;
+};
+
+#endif
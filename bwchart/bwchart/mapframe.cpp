@@ -0,0 +1,393 @@
+// mapframe.cpp : implementation of the MapFrameRenderer class
+//
+
+#include "mapframe.h"
+#include "mapcache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#include <emmintrin.h>
+#define MAPFRAME_SSE2
+#endif
+
+#define MAXCLR 230
+#define LOWCLR 60
+
+// player colors
+const unsigned char gMapFramePlayerColors[MAPFRAME_MAXCOLORS][3]=
+{
+	{LOWCLR,MAXCLR,LOWCLR},
+	{LOWCLR,LOWCLR,MAXCLR},
+	{MAXCLR,LOWCLR,LOWCLR},
+	{MAXCLR,MAXCLR,0},
+	{MAXCLR,0,MAXCLR},
+	{0,MAXCLR,MAXCLR},
+	{MAXCLR,MAXCLR/2,0},
+	{MAXCLR,0,MAXCLR/2},
+	{MAXCLR/2,0,MAXCLR},
+	{MAXCLR,MAXCLR/2,MAXCLR/2},
+	{MAXCLR/2,MAXCLR/2,MAXCLR},
+	{MAXCLR,MAXCLR/2,MAXCLR}
+};
+
+//---------------------------------------------------------------------------------------
+
+// same conversions as CHsvRgb (hue in degrees, saturation and value in [0,1])
+static void _Rgb2Hsv(const unsigned char *rgb, int *h, double *s, double *v)
+{
+	double r=rgb[0]/255.0, g=rgb[1]/255.0, b=rgb[2]/255.0;
+	double rgbmin = r<g ? (r<b ? r : b) : (g<b ? g : b);
+	double rgbmax = r>g ? (r>b ? r : b) : (g>b ? g : b);
+	double ht=0.0, st=0.0;
+	if(rgbmax>0.0) st = (rgbmax-rgbmin)/rgbmax;
+	if(st>0.0)
+	{
+		double rc = (rgbmax-r)/(rgbmax-rgbmin);
+		double gc = (rgbmax-g)/(rgbmax-rgbmin);
+		double bc = (rgbmax-b)/(rgbmax-rgbmin);
+		if(r==rgbmax) ht = bc-gc;
+		else if(g==rgbmax) ht = 2+rc-bc;
+		else if(b==rgbmax) ht = 4+gc-rc;
+		ht = ht*60.0;
+		if(ht<0.0) ht += 360.0;
+	}
+	double dh = ht/360.0;
+	*h = (int)(dh*360.0);
+	*s = st;
+	*v = rgbmax;
+}
+
+static void _Hsv2Rgb(int h, double s, double v, unsigned char *rgb)
+{
+	if(s>1.0) s=1.0;
+	if(v>1.0) v=1.0;
+	if(s<0.0) s=0.0;
+	if(v<0.0) v=0.0;
+
+	double r=v, g=v, b=v;
+	double dh=(double)(h%360)/360.0;
+	if(s>0.0)
+	{
+		if(dh>=1.0) dh=0.0;
+		dh = 6.0*dh;
+		int i = (int)dh;
+		double f = dh-(double)i;
+		double p = v*(1-s);
+		double q = v*(1-(s*f));
+		double t = v*(1-(s*(1-f)));
+		switch(i)
+		{
+			case 0: r=v; g=t; b=p; break;
+			case 1: r=q; g=v; b=p; break;
+			case 2: r=p; g=v; b=t; break;
+			case 3: r=p; g=q; b=v; break;
+			case 4: r=t; g=p; b=v; break;
+			case 5: r=v; g=p; b=q; break;
+		}
+	}
+	rgb[0] = (unsigned char)floor(r*255);
+	rgb[1] = (unsigned char)floor(g*255);
+	rgb[2] = (unsigned char)floor(b*255);
+}
+
+//---------------------------------------------------------------------------------------
+
+MapFrameRenderer::MapFrameRenderer(int width, int height) :
+	m_width(width), m_height(height), m_dirtyCount(0), m_lastMoveCount(0), m_options(-1), m_fullRepaint(true)
+{
+	int count = width*height;
+	m_tiles = (unsigned char*)malloc(count);
+	m_buildings = (unsigned char*)malloc(2*count);
+	m_moves = (unsigned char*)malloc(2*count);
+	m_dirty = (int*)malloc(count*sizeof(int));
+	m_isDirty = (unsigned char*)calloc(count,1);
+	m_lastMoves = (int*)malloc(count*sizeof(int));
+	m_frame = (unsigned char*)calloc(count,4);
+	memset(m_tiles,MAPFRAME_EMPTY,count);
+	memset(&m_build,0,sizeof(m_build));
+	memset(&m_move,0,sizeof(m_move));
+	_InitPalette();
+	Restart();
+}
+
+MapFrameRenderer::~MapFrameRenderer()
+{
+	_FreeList(m_build);
+	_FreeList(m_move);
+	free(m_tiles);
+	free(m_buildings);
+	free(m_moves);
+	free(m_dirty);
+	free(m_isDirty);
+	free(m_lastMoves);
+	free(m_frame);
+}
+
+void MapFrameRenderer::_FreeList(ActionList& list)
+{
+	free(list.m_actions);
+	free(list.m_active);
+	free(list.m_hilight);
+	memset(&list,0,sizeof(list));
+}
+
+//---------------------------------------------------------------------------------------
+
+// colors for all highlight levels, as computed by ReplayMap::_GetColor
+void MapFrameRenderer::_InitPalette()
+{
+	for(int c=0; c<MAPFRAME_MAXCOLORS; c++)
+	{
+		int h; double s,v;
+		_Rgb2Hsv(gMapFramePlayerColors[c],&h,&s,&v);
+		for(int k=0; k<2; k++)
+		{
+			memcpy(m_palette[k][c][0],gMapFramePlayerColors[c],3);
+			m_palette[k][c][0][3]=255;
+			for(int hl=1; hl<=MAPFRAME_MAXHILIGHT; hl++)
+			{
+				double ratio = (double)hl/(double)MAPFRAME_MAXHILIGHT;
+				_Hsv2Rgb(h,1.0-0.8*ratio,k==0 ? 1.0 : 0.2+0.8*ratio,m_palette[k][c][hl]);
+				m_palette[k][c][hl][3]=255;
+			}
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+
+void MapFrameRenderer::SetTile(int x, int y, unsigned char tile)
+{
+	if(x<0 || x>=m_width || y<0 || y>=m_height) return;
+	m_tiles[x+y*m_width]=tile;
+	m_fullRepaint=true;
+}
+
+void MapFrameRenderer::SetTiles(const MapAssetRecord& assets)
+{
+	assert(assets.m_width==m_width && assets.m_height==m_height);
+	const unsigned char *tiles = assets.GetTiles();
+	if(tiles==0) return;
+	for(int j=0;j<m_height;j++)
+		for(int i=0;i<m_width;i++)
+			SetTile(i,j,tiles[2*(i+j*m_width)]);
+}
+
+void MapFrameRenderer::AddMapUnits(const MapAssetRecord& assets, const int *playerids, int count)
+{
+	const MapAssetUnit *units = assets.GetUnits();
+	for(int i=0;i<assets.m_unitCount;i++)
+	{
+		const MapAssetUnit& unit = units[i];
+		int playerid = MAPFRAME_MINERAL;
+		if(unit.m_kind==MapAssetUnit::STARTLOCATION)
+		{
+			if(unit.m_playerid>=count || playerids[unit.m_playerid]<0) continue;
+			playerid = playerids[unit.m_playerid];
+		}
+		AddAction(BUILD,unit.m_x,unit.m_y,unit.m_width,unit.m_height,playerid,0);
+	}
+}
+
+void MapFrameRenderer::AddAction(int kind, int x, int y, int w, int h, int playerid, unsigned long time)
+{
+	if(kind==UNIT) return;
+	ActionList& list = kind==BUILD ? m_build : m_move;
+	assert(list.m_count==0 || list.m_actions[list.m_count-1].m_time<=time);
+
+	// grow list (active set can hold all actions)
+	if(list.m_count==list.m_size)
+	{
+		list.m_size = list.m_size==0 ? 256 : 2*list.m_size;
+		list.m_actions = (Action*)realloc(list.m_actions,list.m_size*sizeof(Action));
+		list.m_active = (int*)realloc(list.m_active,list.m_size*sizeof(int));
+		list.m_hilight = (unsigned char*)realloc(list.m_hilight,list.m_size);
+	}
+
+	Action& act = list.m_actions[list.m_count++];
+	act.m_x = (unsigned char)x;
+	act.m_y = (unsigned char)y;
+	act.m_width = (unsigned char)w;
+	act.m_height = (unsigned char)h;
+	act.m_playerid = (unsigned char)playerid;
+	act.m_time = time;
+}
+
+//---------------------------------------------------------------------------------------
+
+void MapFrameRenderer::Restart()
+{
+	memset(m_buildings,MAPFRAME_EMPTY,2*m_width*m_height);
+	memset(m_moves,0,2*m_width*m_height);
+	m_build.m_next = m_build.m_activeCount = 0;
+	m_move.m_next = m_move.m_activeCount = 0;
+	m_lastMoveCount = 0;
+	m_fullRepaint = true;
+}
+
+//---------------------------------------------------------------------------------------
+
+inline void MapFrameRenderer::_MarkDirty(int idx)
+{
+	if(m_isDirty[idx]) return;
+	m_isDirty[idx]=1;
+	m_dirty[m_dirtyCount++]=idx;
+}
+
+// add actions started before time to active set
+void MapFrameRenderer::_Start(ActionList& list, unsigned long time)
+{
+	while(list.m_next<list.m_count && list.m_actions[list.m_next].m_time<=time)
+	{
+		list.m_active[list.m_activeCount] = list.m_next++;
+		list.m_hilight[list.m_activeCount] = MAPFRAME_MAXHILIGHT;
+		list.m_activeCount++;
+	}
+}
+
+// decay all highlights (saturated at 0)
+void MapFrameRenderer::_Decay(unsigned char *hilight, int count)
+{
+	int i=0;
+#ifdef MAPFRAME_SSE2
+	const __m128i rate = _mm_set1_epi8(MAPFRAME_CONSUMERATE);
+	for(; i+16<=count; i+=16)
+	{
+		__m128i hl = _mm_loadu_si128((const __m128i*)(hilight+i));
+		_mm_storeu_si128((__m128i*)(hilight+i),_mm_subs_epu8(hl,rate));
+	}
+#endif
+	for(; i<count; i++)
+		hilight[i] = hilight[i]>MAPFRAME_CONSUMERATE ? (unsigned char)(hilight[i]-MAPFRAME_CONSUMERATE) : 0;
+}
+
+//---------------------------------------------------------------------------------------
+
+void MapFrameRenderer::_ColorSquare(int idx)
+{
+	static const unsigned char mineral[4]={0,255,255,255};
+	const unsigned char *val = m_buildings+2*idx;
+	const unsigned char *clr = 0;
+
+	// if we have unit at that position, draw unit instead of building
+	bool bIsMove = m_moves[2*idx]>0;
+	if(bIsMove) val = m_moves+2*idx;
+
+	if(val[1]==MAPFRAME_MINERAL)
+	{
+		if((m_options&MINERALS_ON)!=0) clr=mineral;
+	}
+	else if(val[1]!=MAPFRAME_EMPTY)
+	{
+		int c = val[1]%MAPFRAME_MAXCOLORS;
+		if(val[0]>0) clr = m_palette[bIsMove || (m_options&BUILDINGS_ON)==0 ? 1 : 0][c][val[0]];
+		else if((m_options&BUILDINGS_ON)!=0 && !bIsMove) clr = m_palette[0][c][0];
+	}
+
+	unsigned char *pix = m_frame+4*idx;
+	if(clr!=0) {memcpy(pix,clr,4); return;}
+
+	// display tile in shades of gray
+	unsigned char tile = m_tiles[idx];
+	unsigned char gray = tile!=MAPFRAME_EMPTY ? tile/2 : 0;
+	pix[0]=pix[1]=pix[2]=gray;
+	pix[3]=255;
+}
+
+//---------------------------------------------------------------------------------------
+
+const unsigned char *MapFrameRenderer::Render(unsigned long time, int options)
+{
+	if(options!=m_options) {m_options=options; m_fullRepaint=true;}
+
+	// erase moves of previous frame
+	for(int i=0; i<m_lastMoveCount; i++)
+	{
+		m_moves[2*m_lastMoves[i]]=0;
+		_MarkDirty(m_lastMoves[i]);
+	}
+	m_lastMoveCount=0;
+
+	// new actions
+	_Start(m_build,time);
+	_Start(m_move,time);
+
+	// draw active buildings, the ones drawn with highlight 0 are over
+	int kept=0;
+	for(int k=0; k<m_build.m_activeCount; k++)
+	{
+		const Action& act = m_build.m_actions[m_build.m_active[k]];
+		unsigned char hl = m_build.m_hilight[k];
+		for(int j=act.m_y; j<act.m_y+act.m_height && j<m_height; j++)
+			for(int i=act.m_x; i<act.m_x+act.m_width && i<m_width; i++)
+			{
+				int idx = i+j*m_width;
+				m_buildings[2*idx] = hl;
+				m_buildings[2*idx+1] = act.m_playerid;
+				_MarkDirty(idx);
+			}
+		if(hl==0) continue;
+		m_build.m_active[kept] = m_build.m_active[k];
+		m_build.m_hilight[kept] = hl;
+		kept++;
+	}
+	m_build.m_activeCount = kept;
+	_Decay(m_build.m_hilight,m_build.m_activeCount);
+
+	// draw active moves
+	for(int k=0; k<m_move.m_activeCount; k++)
+	{
+		const Action& act = m_move.m_actions[m_move.m_active[k]];
+		if(act.m_x>=m_width || act.m_y>=m_height) continue;
+		int idx = act.m_x+act.m_y*m_width;
+		if(m_moves[2*idx]==0) m_lastMoves[m_lastMoveCount++]=idx;
+		m_moves[2*idx] = m_move.m_hilight[k];
+		m_moves[2*idx+1] = act.m_playerid;
+		_MarkDirty(idx);
+	}
+	_Decay(m_move.m_hilight,m_move.m_activeCount);
+
+	// moves with highlight 0 are over
+	kept=0;
+	for(int k=0; k<m_move.m_activeCount; k++)
+	{
+		if(m_move.m_hilight[k]==0) continue;
+		m_move.m_active[kept] = m_move.m_active[k];
+		m_move.m_hilight[kept] = m_move.m_hilight[k];
+		kept++;
+	}
+	m_move.m_activeCount = kept;
+
+	// recolor squares
+	if(m_fullRepaint)
+	{
+		for(int idx=0; idx<m_width*m_height; idx++) _ColorSquare(idx);
+		m_fullRepaint=false;
+	}
+	else
+	{
+		for(int i=0; i<m_dirtyCount; i++) _ColorSquare(m_dirty[i]);
+	}
+	for(int i=0; i<m_dirtyCount; i++) m_isDirty[m_dirty[i]]=0;
+	m_dirtyCount=0;
+
+	return m_frame;
+}
+
+//---------------------------------------------------------------------------------------
+
+bool MapFrameRenderer::WritePPM(const char *path) const
+{
+	FILE *fp = fopen(path,"wb");
+	if(fp==0) return false;
+	fprintf(fp,"P6\n%d %d\n255\n",m_width,m_height);
+	const unsigned char *pix = m_frame;
+	for(int i=0; i<m_width*m_height; i++, pix+=4) fwrite(pix,1,3,fp);
+	bool ok = ferror(fp)==0;
+	fclose(fp);
+	return ok;
+}
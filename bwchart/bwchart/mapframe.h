@@ -0,0 +1,133 @@
+// mapframe.h : interface of the MapFrameRenderer class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __MAPFRAME_H
+#define __MAPFRAME_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+//--------------------------------------------------------------------------------------
+
+class MapAssetRecord;
+
+#define MAPFRAME_MAXCOLORS 12
+#define MAPFRAME_EMPTY 0xFF
+#define MAPFRAME_MINERAL 0xFE
+#define MAPFRAME_MAXHILIGHT 200
+#define MAPFRAME_CONSUMERATE 5
+
+// player colors (r,g,b), shared with the animated map
+extern const unsigned char gMapFramePlayerColors[MAPFRAME_MAXCOLORS][3];
+
+// Headless renderer for the animated map, produces RGBA frames (4 bytes per map square)
+// with the same colors as ReplayMapAnimated::BuildMap, without GDI.
+//
+// Only actions whose highlight is still decaying are kept in the active set. The
+// highlights are decayed all at once with saturated byte subtractions, and only the
+// squares touched since the previous frame are recolored (colors for every player and
+// highlight level are computed once).
+//
+// Frames must be requested with increasing times, Restart goes back to the beginning.
+//
+class MapFrameRenderer
+{
+public:
+	// action kinds (same as ReplayMapPending)
+	enum {BUILD,MOVE,UNIT};
+
+	// options for frames (same as ReplayMap)
+	enum {BUILDINGS_ON=1,MINERALS_ON=2};
+
+	MapFrameRenderer(int width, int height);
+	~MapFrameRenderer();
+
+	// map size
+	int GetWidth() const {return m_width;}
+	int GetHeight() const {return m_height;}
+
+	// set tile (shade of gray) at position, MAPFRAME_EMPTY if none
+	void SetTile(int x, int y, unsigned char tile);
+
+	// set all tiles from the map assets (same size as the renderer)
+	void SetTiles(const MapAssetRecord& assets);
+
+	// add start locations and resources of the map assets at time 0. playerids gives the
+	// player of the start location of each map player (count of them, -1 if nobody is there)
+	void AddMapUnits(const MapAssetRecord& assets, const int *playerids, int count);
+
+	// add action, actions of each kind must be added in time order
+	// (train actions dont change the map and are ignored)
+	void AddAction(int kind, int x, int y, int w, int h, int playerid, unsigned long time);
+
+	// compute frame at time, returns width*height RGBA pixels (top-bottom)
+	const unsigned char *Render(unsigned long time, int options=BUILDINGS_ON|MINERALS_ON);
+	const unsigned char *GetFrame() const {return m_frame;}
+
+	// go back to beginning of animation
+	void Restart();
+
+	// write last frame as binary PPM (P6)
+	bool WritePPM(const char *path) const;
+
+private:
+	struct Action
+	{
+		unsigned char m_x;
+		unsigned char m_y;
+		unsigned char m_width;
+		unsigned char m_height;
+		unsigned char m_playerid;
+		unsigned long m_time;
+	};
+
+	// list of actions with the active ones (index in list and highlight, in action order)
+	struct ActionList
+	{
+		Action *m_actions;
+		int m_count;
+		int m_size;
+		int m_next; // first action not started yet
+		int *m_active;
+		unsigned char *m_hilight;
+		int m_activeCount;
+	};
+
+	int m_width;
+	int m_height;
+
+	// square layers: tiles, buildings (highlight, player id), moves (highlight, player id)
+	unsigned char *m_tiles;
+	unsigned char *m_buildings;
+	unsigned char *m_moves;
+
+	// squares to recolor, and squares with a move in last frame
+	int *m_dirty;
+	int m_dirtyCount;
+	unsigned char *m_isDirty;
+	int *m_lastMoves;
+	int m_lastMoveCount;
+
+	// actions
+	ActionList m_build;
+	ActionList m_move;
+
+	// colors for each player color and highlight (v=1 and v decreasing with highlight)
+	unsigned char m_palette[2][MAPFRAME_MAXCOLORS][MAPFRAME_MAXHILIGHT+1][4];
+
+	// current frame
+	unsigned char *m_frame;
+	int m_options;
+	bool m_fullRepaint;
+
+	void _InitPalette();
+	void _MarkDirty(int idx);
+	void _Start(ActionList& list, unsigned long time);
+	void _ColorSquare(int idx);
+	static void _Decay(unsigned char *hilight, int count);
+	static void _FreeList(ActionList& list);
+};
+
+#endif
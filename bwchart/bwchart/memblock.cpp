@@ -1,14 +1,8 @@
 // memoryBlock.cpp : implementation of the MemoryBlock class
 //
 
-#include "stdafx.h"
 #include "memblock.h"
-
-#ifdef _DEBUG
-#define new DEBUG_NEW
-#undef THIS_FILE
-static char THIS_FILE[] = __FILE__;
-#endif
+#include <string.h>
 
 //---------------------------------------------------------------------------------------
 
@@ -20,8 +14,8 @@ unsigned long MemoryBlock::Add(const void *pData, unsigned long size, bool bInve
 	if(m_pData==0)
 	{
 		// allocate initial block
-		m_Size = max(m_Resize,size);
-		m_pData = (char*)Alloc(m_Size);
+		m_Size = m_Resize>size ? m_Resize : size;
+		m_pData = (char*)_Alloc(m_Size);
 		if(m_pData == 0) return INVALID_PTR;
 	}
 	else
@@ -30,9 +24,10 @@ unsigned long MemoryBlock::Add(const void *pData, unsigned long size, bool bInve
 		if(m_Used+size > m_Size)
 		{
 			// resize block
-			m_Size = max(m_Size+m_Resize,m_Used+size);
-			m_pData = (char*)Realloc(m_pData, m_Size);
+			unsigned long newSize = m_Size+m_Resize>m_Used+size ? m_Size+m_Resize : m_Used+size;
+			m_pData = (char*)_Realloc(m_pData, newSize);
 			if(m_pData == 0) return INVALID_PTR;
+			m_Size = newSize;
 		}
 	}
 	// offset is at the end of current data
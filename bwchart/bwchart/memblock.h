@@ -9,22 +9,31 @@
 #pragma once
 #endif // _MSC_VER > 1000
 
-#include "heapperclass.h"
+#include "arena.h"
+#include <stdlib.h>
 
 //--------------------------------------------------------------------------------------
 
 #define INVALID_PTR 0xFFFFFFFF
 
-class MemoryBlock : public CHeapPerInstance {
+// growing block of data, allocated from an arena (if any) or from the C heap
+class MemoryBlock {
 public:
-	MemoryBlock(unsigned long res=65536) : m_pData(0), m_Size(0), m_Used(0), m_Resize(res), m_Count(0) {}
-	~MemoryBlock() {if(m_pData) Free(m_pData);}
+	MemoryBlock(unsigned long res=65536, Arena *arena=0) : m_arena(arena), m_pData(0), m_Size(0), m_Used(0), m_Resize(res), m_Count(0) {}
+	~MemoryBlock() {if(m_pData) _Free(m_pData);}
 	unsigned long Add(const void *pData, unsigned long size, bool bInvert=false);
 	void *GetPtr(unsigned long off) const {return m_pData+off;}
-	void Clear() {if(m_pData) Free(m_pData); m_pData=0;m_Size=0, m_Used=0; m_Count=0;}
+	void Clear() {if(m_pData) _Free(m_pData); m_pData=0;m_Size=0, m_Used=0; m_Count=0;}
 	unsigned long GetCount() const {return m_Count;}
+	unsigned long GetUsed() const {return m_Used;}
 	void RemoveAt(unsigned long off, unsigned long size, unsigned long count=1);
 private:
+	// arena memory is only released with the arena
+	void *_Alloc(unsigned long size) {return m_arena!=0 ? m_arena->Alloc(size) : malloc(size);}
+	void *_Realloc(void *ptr, unsigned long size) {return m_arena!=0 ? m_arena->Realloc(ptr,m_Size,size) : realloc(ptr,size);}
+	void _Free(void *ptr) {if(m_arena==0) free(ptr);}
+
+	Arena *m_arena;
 	char *m_pData;
 	unsigned long m_Size;
 	unsigned long m_Used;
@@ -34,10 +43,15 @@ private:
 
 //--------------------------------------------------------------------------------------
 
+#ifdef __AFX_H__
+
+// array that owns its objects (MFC only)
 class XObArray : public CObArray {
 public:
 	~XObArray() {RemoveAll();}
 	void RemoveAll() {for(int i=0; i<GetSize(); i++) delete GetAt(i); CObArray::RemoveAll();}
 };
 
+#endif
+
 #endif 
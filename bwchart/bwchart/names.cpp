@@ -0,0 +1,50 @@
+// names.cpp : implementation of the NameTable class
+//
+
+#include "stdafx.h"
+#include "names.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+//---------------------------------------------------------------------------------------
+
+NameTable::NameTable() : m_index(1024)
+{
+}
+
+NameTable::~NameTable()
+{
+	for(int i=0; i<m_names.GetSize(); i++) delete (CString *)m_names.GetAt(i);
+}
+
+NameTable& NameTable::Shared()
+{
+	static NameTable names;
+	return names;
+}
+
+//---------------------------------------------------------------------------------------
+
+// case is ignored (like CString::CompareNoCase)
+int NameTable::Find(const char *name) const
+{
+	unsigned long hash = HashIndex::HashNoCase(name);
+	for(int pos=m_index.First(hash); pos>=0; pos=m_index.Next(pos,hash))
+		if(GetName(m_index.GetID(pos)).CompareNoCase(name)==0) return m_index.GetID(pos);
+	return -1;
+}
+
+int NameTable::Intern(const char *name)
+{
+	int id = Find(name);
+	if(id>=0) return id;
+
+	// new name
+	id = m_names.Add(new CString(name));
+	m_index.Add(HashIndex::HashNoCase(name),id);
+	return id;
+}
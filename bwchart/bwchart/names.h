@@ -0,0 +1,48 @@
+// names.h : interface of the NameTable class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __NAMES_H
+#define __NAMES_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include "hashindex.h"
+
+//--------------------------------------------------------------------------------------
+
+// Player and map names of the whole application.
+//
+// Every name is kept once and gets an id, names that only differ by case get the same
+// id (the first spelling seen is kept). Replays keep the ids and share the kept strings
+// (CString copies only add a reference), and akas are found by id.
+//
+class NameTable
+{
+public:
+	NameTable();
+	~NameTable();
+
+	// id of a name (added if it's new)
+	int Intern(const char *name);
+
+	// id of a name, -1 if it's unknown
+	int Find(const char *name) const;
+
+	// name of an id
+	int GetCount() const {return m_names.GetSize();}
+	const CString& GetName(int id) const {return *(const CString *)m_names.GetAt(id);}
+
+	// table shared by browser and akas
+	static NameTable& Shared();
+
+private:
+	CPtrArray m_names;
+
+	// ids by name
+	HashIndex m_index;
+};
+
+#endif
@@ -3,6 +3,9 @@
 #include "hsvrgb.h"
 #include "progressdlg.h"
 #include "botree.h"
+#include "bwdb.h"
+#include "mapcache.h"
+#include "unitsize.h"
 #include <assert.h>
 #include <math.h>
 
@@ -26,12 +29,6 @@ static int gTimeWindowMap[Replay::__APM_MAX]={120,90,60,30,15};
 
 #define MOVE_SCALE 32
 
-// side of square for map coverage
-#define MAPCOVERAGE_SIDE 8
-
-IMPLEMENT_LOCAL_HEAP(ReplayEvt)
-IMPLEMENT_LOCAL_HEAP(BWElement)
-
 //------------------------------------------------------------------------------------------------------------
 
 // pre-defined colors for each resource
@@ -58,7 +55,9 @@ COLORREF ReplayResource::m_gColors[__CLR_MAX]=
 	// map coverage
 	DEF_CLR_MAPCOVERAGE,
 	// moving map coverage
-	DEF_CLR_MMCOVERAGE
+	DEF_CLR_MMCOVERAGE,
+	// effective actions per minute
+	DEF_CLR_EAPM
 };
 
 // pre-defined line sizefor each resource
@@ -85,7 +84,9 @@ int ReplayResource::m_gLineSize[__CLR_MAX]=
 	// map coverage
 	DEF_LSIZE_MAPCOVERAGE,
 	// moving map coverage
-	DEF_LSIZE_MMCOVERAGE
+	DEF_LSIZE_MMCOVERAGE,
+	// effective actions per minute
+	DEF_LSIZE_EAPM
 };
 
 //-----------------------------------------------------------------------------------------------------------------
@@ -121,9 +122,9 @@ void ReplayResource::UpdateMax(const ReplayResource& res, bool updateAPM)
 	if(updateAPM && res.m_legalActionPerMinute>m_legalActionPerMinute) m_legalActionPerMinute=res.m_legalActionPerMinute;
 	if(res.m_buildPerMinute>m_buildPerMinute) m_buildPerMinute=res.m_buildPerMinute;
 	if(res.m_unitPerMinute>m_unitPerMinute) m_unitPerMinute=res.m_unitPerMinute;
-	if(res.m_mapCoverageUnit>m_mapCoverageUnit) m_mapCoverageUnit=res.m_mapCoverageUnit;
 	if(res.m_mapCoverageBuild>m_mapCoverageBuild) m_mapCoverageBuild=res.m_mapCoverageBuild;
 	if(res.m_mapMovingMapCoverage>m_mapMovingMapCoverage) m_mapMovingMapCoverage = res.m_mapMovingMapCoverage;
+	if(res.m_effectiveActionPerMinute>m_effectiveActionPerMinute) m_effectiveActionPerMinute=res.m_effectiveActionPerMinute;
 }
 
 //------------------------------------------------------------------------------------------------------------
@@ -168,10 +169,10 @@ void ReplayResource::UpdateResourceBuild(int unitID)
 
 //------------------------------------------------------------------------------------------------------------
 
-int ReplayResource::_FindTech(const char *parameters)
+int ReplayResource::_FindTech(const char *name)
 {
 	char buffer[255];
-	strcpy(buffer,parameters);
+	strcpy(buffer,name);
 
 	char *p=strchr(buffer,'(');
 	if(p!=0)
@@ -188,12 +189,60 @@ int ReplayResource::_FindTech(const char *parameters)
 		if(_stricmp(p,gAllTechs[i].technic)==0) 
 			return i;
 	}
-	OutputDebugString("unknown upgrade\r\n"); ASSERT(0);
 	return -1;
 }
 
 //------------------------------------------------------------------------------------------------------------
 
+// technic index for every research id (non terran & terran) and every upgrade id
+#define MAXTECHID 64
+static int gResearchTech[2][MAXTECHID];
+static int gUpgradeTech[MAXTECHID];
+
+void ReplayResource::InitTechs()
+{
+	static bool bNeedInit=true;
+	if(!bNeedInit) return;
+
+	assert(BWrepGameData::g_ResearchSize<=MAXTECHID && BWrepGameData::g_UpgradesSize<=MAXTECHID);
+	for(int i=0;i<MAXTECHID;i++) {gResearchTech[0][i]=gResearchTech[1][i]=gUpgradeTech[i]=-1;}
+
+	// research
+	for(int i=0;i<BWrepGameData::g_ResearchSize;i++)
+	{
+		const char *name = BWrepGameData::g_Research[i];
+		gResearchTech[0][i]=_FindTech(name);
+
+		// some terran upgrades come with a protoss research id
+		if(strcmp(name,"Hallucination")==0) name="Ghost Sight";
+		else if(strcmp(name,"Recall")==0) name="Moebius Reactor";
+		else if(strcmp(name,"Stasis Field")==0) name="Wraith Energy";
+		gResearchTech[1][i]=_FindTech(name);
+	}
+
+	// upgrades
+	for(int i=0;i<BWrepGameData::g_UpgradesSize;i++)
+		gUpgradeTech[i]=_FindTech(BWrepGameData::g_Upgrades[i]);
+
+	bNeedInit=false;
+}
+
+int ReplayResource::GetResearchTech(int researchID, bool terran)
+{
+	int techID = researchID>=0 && researchID<MAXTECHID ? gResearchTech[terran?1:0][researchID] : -1;
+	if(techID<0) {OutputDebugString("unknown upgrade\r\n"); ASSERT(0);}
+	return techID;
+}
+
+int ReplayResource::GetUpgradeTech(int upgradeID)
+{
+	int techID = upgradeID>=0 && upgradeID<MAXTECHID ? gUpgradeTech[upgradeID] : -1;
+	if(techID<0) {OutputDebugString("unknown upgrade\r\n"); ASSERT(0);}
+	return techID;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
 void ReplayResource::UpdateResourceUpgrade(int techID)
 {
 	assert(techID>=0 && techID<MAXTECHNIC());
@@ -224,6 +273,337 @@ COLORREF ReplayResource::GetColor(int i, int player, int maxplayer)
 
 //------------------------------------------------------------------------------------------------------------
 
+// write one byte in stream (or just count it if out is null)
+static inline void _PutByte(unsigned char *out, unsigned long& off, unsigned char val)
+{
+	if(out!=0) out[off]=val;
+	off++;
+}
+
+// write unsigned value on as few bytes as possible (7 bits per byte)
+static void _PutVarint(unsigned char *out, unsigned long& off, unsigned long val)
+{
+	while(val>=0x80) {_PutByte(out,off,(unsigned char)(val|0x80)); val>>=7;}
+	_PutByte(out,off,(unsigned char)val);
+}
+
+static unsigned long _GetVarint(const unsigned char *in, unsigned long& off)
+{
+	unsigned long val=0;
+	for(int shift=0;;shift+=7)
+	{
+		unsigned char b = in[off++];
+		val |= (unsigned long)(b&0x7F)<<shift;
+		if((b&0x80)==0) break;
+	}
+	return val;
+}
+
+// write signed delta (small negative values stay small)
+static void _PutDelta(unsigned char *out, unsigned long& off, long delta)
+{
+	_PutVarint(out,off,delta<0 ? ((unsigned long)(-(delta+1))<<1)|1 : (unsigned long)delta<<1);
+}
+
+static long _GetDelta(const unsigned char *in, unsigned long& off)
+{
+	unsigned long val = _GetVarint(in,off);
+	return (val&1)!=0 ? -(long)(val>>1)-1 : (long)(val>>1);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void ReplayTimeline::Clear()
+{
+	if(m_stream!=0) free(m_stream);
+	if(m_checkpoints!=0) free(m_checkpoints);
+	if(m_columns!=0) free(m_columns);
+	m_stream=0; m_streamSize=0;
+	m_checkpoints=0;
+	m_columns=0; m_columnsSize=0;
+	m_count=0;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned long ReplayTimeline::GetSize() const
+{
+	int cpcount = (m_count+TIMELINE_CHECKPOINT-1)/TIMELINE_CHECKPOINT;
+	return sizeof(*this)+m_streamSize+m_columnsSize+cpcount*sizeof(Checkpoint);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned short ReplayTimeline::_GetSerie(const ReplayResource& res, int serie)
+{
+	switch(serie)
+	{
+	case S_APM: return res.m_actionPerMinute;
+	case S_BPM: return res.m_buildPerMinute;
+	case S_UPM: return res.m_unitPerMinute;
+	case S_LEGALAPM: return res.m_legalActionPerMinute;
+	case S_MICROAPM: return res.m_microAPM;
+	case S_MACROAPM: return res.m_macroAPM;
+	case S_MMCOVERAGE: return res.m_mapMovingMapCoverage;
+	case S_EAPM: return res.m_effectiveActionPerMinute;
+	}
+	return 0;
+}
+
+void ReplayTimeline::_SetSerie(ReplayResource& res, int serie, unsigned short val)
+{
+	switch(serie)
+	{
+	case S_APM: res.m_actionPerMinute=val; break;
+	case S_BPM: res.m_buildPerMinute=val; break;
+	case S_UPM: res.m_unitPerMinute=val; break;
+	case S_LEGALAPM: res.m_legalActionPerMinute=val; break;
+	case S_MICROAPM: res.m_microAPM=val; break;
+	case S_MACROAPM: res.m_macroAPM=val; break;
+	case S_MMCOVERAGE: res.m_mapMovingMapCoverage=val; break;
+	case S_EAPM: res.m_effectiveActionPerMinute=val; break;
+	}
+}
+
+unsigned short ReplayTimeline::_GetColumn(int serie, int slot) const
+{
+	serie = m_columnAlias[serie];
+	const unsigned char *col = m_columns+m_columnOffset[serie];
+	if(m_columnWidth[serie]==1) return col[slot];
+	return (unsigned short)(col[2*slot] | (col[2*slot+1]<<8));
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+// encode counters stream (returns its size, nothing is written if out is null)
+unsigned long ReplayTimeline::_Encode(const ReplayResource *slots, int count, unsigned char *out)
+{
+	unsigned long off=0;
+	ReplayResource prev;
+	for(int i=0;i<count;i++)
+	{
+		const ReplayResource& res = slots[i];
+
+		// checkpoint
+		if(out!=0 && i%TIMELINE_CHECKPOINT==0)
+		{
+			Checkpoint& chk = m_checkpoints[i/TIMELINE_CHECKPOINT];
+			chk.m_offset = off;
+			chk.m_minerals = prev.m_minerals;
+			chk.m_gaz = prev.m_gaz;
+			chk.m_supply = prev.m_supply;
+			chk.m_units = prev.m_units;
+			chk.m_coverage = prev.m_mapCoverageBuild;
+		}
+
+		// what is in that slot
+		unsigned char flags=0;
+		unsigned char actions=0;
+		for(int k=0;k<ReplayResource::__A_MAX;k++) if(res.m_actionCount[k]!=0) actions|=(1<<k);
+		if(res.m_minerals!=prev.m_minerals) flags|=F_MINERALS;
+		if(res.m_gaz!=prev.m_gaz) flags|=F_GAZ;
+		if(res.m_supply!=prev.m_supply) flags|=F_SUPPLY;
+		if(res.m_units!=prev.m_units) flags|=F_UNITS;
+		if(actions!=0) flags|=F_ACTIONS;
+		if(res.m_mapCoverageBuild!=prev.m_mapCoverageBuild) flags|=F_COVERAGE;
+
+		// write it
+		_PutByte(out,off,flags);
+		if(flags&F_MINERALS) _PutDelta(out,off,(long)(res.m_minerals-prev.m_minerals));
+		if(flags&F_GAZ) _PutDelta(out,off,(long)(res.m_gaz-prev.m_gaz));
+		if(flags&F_SUPPLY) _PutDelta(out,off,(long)res.m_supply-(long)prev.m_supply);
+		if(flags&F_UNITS) _PutDelta(out,off,(long)res.m_units-(long)prev.m_units);
+		if(flags&F_ACTIONS) 
+		{
+			_PutByte(out,off,actions);
+			for(int k=0;k<ReplayResource::__A_MAX;k++) if(res.m_actionCount[k]!=0) _PutVarint(out,off,res.m_actionCount[k]);
+		}
+		if(flags&F_COVERAGE) _PutDelta(out,off,(long)res.m_mapCoverageBuild-(long)prev.m_mapCoverageBuild);
+		prev = res;
+	}
+	return off;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+// decode next slot in cursor
+void ReplayTimeline::_Decode(Cursor& cursor) const
+{
+	ReplayResource& res = cursor.m_res;
+	unsigned long& off = cursor.m_offset;
+
+	unsigned char flags = m_stream[off++];
+	if(flags&F_MINERALS) res.m_minerals += _GetDelta(m_stream,off);
+	if(flags&F_GAZ) res.m_gaz += _GetDelta(m_stream,off);
+	if(flags&F_SUPPLY) res.m_supply = (unsigned short)(res.m_supply+_GetDelta(m_stream,off));
+	if(flags&F_UNITS) res.m_units = (unsigned short)(res.m_units+_GetDelta(m_stream,off));
+	memset(res.m_actionCount,0,sizeof(res.m_actionCount));
+	if(flags&F_ACTIONS) 
+	{
+		unsigned char actions = m_stream[off++];
+		for(int k=0;k<ReplayResource::__A_MAX;k++) 
+			if(actions&(1<<k)) res.m_actionCount[k] = (unsigned short)_GetVarint(m_stream,off);
+	}
+	if(flags&F_COVERAGE) res.m_mapCoverageBuild = (unsigned short)(res.m_mapCoverageBuild+_GetDelta(m_stream,off));
+	res.m_initDone = true;
+	cursor.m_slot++;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void ReplayTimeline::Build(const ReplayResource *slots, int count)
+{
+	Clear();
+	m_count = count;
+	if(count==0) return;
+
+	// counters stream: first pass for size, second pass to write it
+	m_checkpoints = (Checkpoint*)malloc(sizeof(Checkpoint)*((count+TIMELINE_CHECKPOINT-1)/TIMELINE_CHECKPOINT));
+	m_streamSize = _Encode(slots,count,0);
+	m_stream = (unsigned char*)malloc(m_streamSize);
+	_Encode(slots,count,m_stream);
+
+	// activity measurement columns
+	int i,k;
+	for(i=0;i<__S_MAX;i++)
+	{
+		// same values as a previous column?
+		m_columnAlias[i]=(unsigned char)i;
+		for(int j=0;j<i && m_columnAlias[i]==i;j++)
+		{
+			if(m_columnAlias[j]!=j) continue;
+			for(k=0;k<count && _GetSerie(slots[k],i)==_GetSerie(slots[k],j);k++);
+			if(k==count) m_columnAlias[i]=(unsigned char)j;
+		}
+		if(m_columnAlias[i]!=i) continue;
+
+		// 1 byte per slot when possible
+		unsigned short maxval=0;
+		for(k=0;k<count;k++) maxval=max(maxval,_GetSerie(slots[k],i));
+		m_columnWidth[i] = maxval<256 ? 1 : 2;
+		m_columnOffset[i] = m_columnsSize;
+		m_columnsSize += m_columnWidth[i]*count;
+	}
+	m_columns = (unsigned char*)malloc(m_columnsSize);
+	for(i=0;i<__S_MAX;i++)
+	{
+		if(m_columnAlias[i]!=i) continue;
+		unsigned char *col = m_columns+m_columnOffset[i];
+		for(k=0;k<count;k++)
+		{
+			unsigned short val = _GetSerie(slots[k],i);
+			if(m_columnWidth[i]==1) col[k]=(unsigned char)val;
+			else {col[2*k]=(unsigned char)val; col[2*k+1]=(unsigned char)(val>>8);}
+		}
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+const ReplayResource& ReplayTimeline::Seek(Cursor& cursor, int slot) const
+{
+	// out of timeline
+	if(slot<0 || slot>=m_count)
+	{
+		cursor.m_slot=-1; cursor.m_offset=0; cursor.m_res.Clear();
+		return cursor.m_res;
+	}
+
+	// restart from checkpoint unless cursor is already between checkpoint and slot
+	int first = slot-slot%TIMELINE_CHECKPOINT;
+	if(cursor.m_slot>slot || cursor.m_slot<first-1)
+	{
+		const Checkpoint& chk = m_checkpoints[slot/TIMELINE_CHECKPOINT];
+		cursor.m_res.Clear();
+		cursor.m_res.m_minerals = chk.m_minerals;
+		cursor.m_res.m_gaz = chk.m_gaz;
+		cursor.m_res.m_supply = chk.m_supply;
+		cursor.m_res.m_units = chk.m_units;
+		cursor.m_res.m_mapCoverageBuild = chk.m_coverage;
+		cursor.m_offset = chk.m_offset;
+		cursor.m_slot = first-1;
+	}
+
+	// decode up to slot
+	while(cursor.m_slot<slot) _Decode(cursor);
+
+	// activity measurement
+	for(int i=0;i<__S_MAX;i++) _SetSerie(cursor.m_res,i,_GetColumn(i,slot));
+	return cursor.m_res;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void ReplayTimeline::Expand(ReplayResource *slots) const
+{
+	Cursor cursor;
+	for(int i=0;i<m_count;i++)
+		slots[i] = Seek(cursor,i);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void ReplayPyramid::Clear()
+{
+	for(int level=1;level<PYRAMID_LEVELS;level++)
+	{
+		if(m_buckets[level]!=0) free(m_buckets[level]);
+		m_buckets[level]=0;
+	}
+	m_count=0;
+}
+
+void ReplayPyramid::Init(int slotCount)
+{
+	Clear();
+	m_count=slotCount;
+	for(int level=1;level<PYRAMID_LEVELS;level++)
+		m_buckets[level] = (Bucket*)malloc(sizeof(Bucket)*ReplayResource::__CLR_MAX*GetBucketCount(level));
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void ReplayPyramid::Add(int slot, const ReplayResource& res)
+{
+	for(int level=1;level<PYRAMID_LEVELS;level++)
+	{
+		// first slot of bucket resets it
+		Bucket *bucket = &m_buckets[level][(slot/GetSlotsPerBucket(level))*ReplayResource::__CLR_MAX];
+		bool first = slot%GetSlotsPerBucket(level)==0;
+		for(int i=0;i<ReplayResource::__CLR_MAX;i++,bucket++)
+		{
+			unsigned long val = res.Value(i);
+			if(first) {bucket->m_min=bucket->m_max=bucket->m_sum=val; continue;}
+			if(val<bucket->m_min) bucket->m_min=val;
+			if(val>bucket->m_max) bucket->m_max=val;
+			bucket->m_sum+=val;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+int ReplayPyramid::GetLevel(unsigned long ticks, int pixels)
+{
+	// coarsest level that still has a bucket every PYRAMID_PIXELS pixels
+	int level=0;
+	while(level+1<PYRAMID_LEVELS && (ticks/GetTicksPerBucket(level+1))*PYRAMID_PIXELS>=(unsigned long)pixels) level++;
+	return level;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void ReplayPyramid::GetMax(int level, int bucket, ReplayResource& res) const
+{
+	res.Clear();
+	for(int i=0;i<ReplayResource::__CLR_MAX;i++)
+		res.SetValue(i,GetBucket(level,bucket,i).m_max);
+	res.SetLegalAPM(res.APM());
+	res.SetInitDone();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
 COLORREF ReplayEvt::GetColor() const
 {
 	return ReplayEvtType::GetTypeColor(IdxAction(m_type.m_cmd,m_type.m_subcmd));
@@ -233,25 +613,28 @@ COLORREF ReplayEvt::GetColor() const
 
 //ctor
 ReplayEvtList::ReplayEvtList(Replay *replay, ReplayMapAnimated *mapAnim, const char *playername, int id, int race) : 
-	m_race(race), m_bEnabled(false), m_similarUnits(0),	m_discardedActions(0), m_eventsBegin(0),
-		m_playerid(id), m_mapAnim(mapAnim), m_events(sizeof(ReplayEvt)*500), m_apmDev(0), m_bHasAcademy(false),
-	m_currentSelection(0), m_replay(replay), m_elems_(replay), m_bHasFleetBeacon(false), m_bHasReaver(false), 
+	m_race(race), m_bEnabled(false), m_discardedActions(0), m_eapm(RES_INTERVAL_TICK), m_eventsBegin(0),
+		m_playerid(id), m_mapAnim(mapAnim), m_events(sizeof(ReplayEvt)*500,&m_arena), m_apmDev(0), m_bHasAcademy(false),
+	m_currentSelection(0), m_replay(replay), m_arena(65536,replay->GetArena()), m_elems_(replay,&m_arena),
+	m_bHasFleetBeacon(false), m_bHasReaver(false), 
 	m_bHasCarrier(false), m_startX(0), m_startY(0), m_hasCovertOps(false), 	m_lastActionID(0),	
-	m_lastSelection(0), m_mapSurface(0), m_mapDividerX(0), m_mapDividerY(0), m_currentSlot(-1)
+	m_lastSelection(0), m_coverage(0), m_currentSlot(-1),
+	m_queued(sizeof(int)*4096,&m_arena), m_currentAction(0), m_pendingMap(sizeof(ReplayMapPending)*1024,&m_arena),
+	m_selchanges(16384,&m_arena), m_checkpoints(sizeof(ReplayPlayerCheckpoint)*32,&m_arena), m_loggedSelection(0)
 
 {
 	strcpy(m_playername,playername);
 
 	// unit distribution
-	m_objects = new unsigned long[MAXUNIT];
+	m_objects = (unsigned long*)m_arena.Alloc(sizeof(unsigned long)*MAXUNIT);
 	memset(m_objects,0,sizeof(unsigned long)*MAXUNIT);
 	memset(m_peak,0,sizeof(m_peak));
 	memset(m_total,0,sizeof(m_total));
 
 	// upgrade distribution
-	m_upgrades = new unsigned long[MAXTECHNIC()];
+	m_upgrades = (unsigned long*)m_arena.Alloc(sizeof(unsigned long)*MAXTECHNIC());
 	memset(m_upgrades,0,sizeof(unsigned long)*MAXTECHNIC());
-	m_upgradesCount = new unsigned long[MAXTECHNIC()];
+	m_upgradesCount = (unsigned long*)m_arena.Alloc(sizeof(unsigned long)*MAXTECHNIC());
 	memset(m_upgradesCount,0,sizeof(unsigned long)*MAXTECHNIC());
 
 	// type distribution
@@ -261,6 +644,9 @@ ReplayEvtList::ReplayEvtList(Replay *replay, ReplayMapAnimated *mapAnim, const c
 	// hotkeys
 	memset(m_hotkey,0,sizeof(m_hotkey));
 	memset(m_hotkeyIsUsed,0,sizeof(m_hotkeyIsUsed));
+	for(int i=0;i<MAXHOTKEY;i++) m_lastHotKey[i]=m_lastAssign[i]=HOTKEYLOG_NOGROUP;
+	memset(m_loggedUnits,0,sizeof(m_loggedUnits));
+	assert(MAXHOTKEY==ReplayPlayerState::MAXHOTKEY && MAXHOTKEY<=HOTKEYLOG_MAXSLOT);
 
 	// activity measurement
 	m_bpmAcc=0;
@@ -268,42 +654,23 @@ ReplayEvtList::ReplayEvtList(Replay *replay, ReplayMapAnimated *mapAnim, const c
 	m_upmAcc=0;
 	m_upmSpeed=0;
 
-	// allocate resources array 
-	int resize = 1+replay->GetGameLength()/RES_INTERVAL_TICK;
-	m_resources = new ReplayResource[resize];
-	memset(m_resources,0,sizeof(ReplayResource)*resize);
+	// allocate working resources array (released when the timeline is built)
+	m_resCount = 1+replay->GetGameLength()/RES_INTERVAL_TICK;
+	m_resources = (ReplayResource*)m_arena.Alloc(sizeof(ReplayResource)*m_resCount);
+	memset(m_resources,0,sizeof(ReplayResource)*m_resCount);
 
-	// allocate map surface
+	// allocate map coverage grid
 	if(mapAnim!=0)
-	{
-		m_mapDividerX = mapAnim->GetWidth()/MAPCOVERAGE_SIDE;
-		m_mapDividerY = mapAnim->GetHeight()/MAPCOVERAGE_SIDE;
-		m_mapSurface = new MapSurface(mapAnim->GetWidth()/m_mapDividerX,mapAnim->GetHeight()/m_mapDividerY);
-	}
+		m_coverage = new CoverageGrid(replay->GetCoverageSide(),mapAnim->GetWidth(),mapAnim->GetHeight(),m_resCount);
 }
 
 //dtor
 ReplayEvtList::~ReplayEvtList() 
 {
-	// delete map surface
-	delete m_mapSurface;
-
-	// delete hotkeys
-	const HotKey *hk=0;
-	for(int i=0; i<(int)GetHKEventCount();i++)
-	{
-		const HotKeyEvent *hkevt = GetHKEvent(i);
-		if(hkevt->m_type!=HotKeyEvent::SELECT) 
-			delete (HotKey*)hkevt->GetHotKey();
-	}
+	// delete map coverage grid
+	delete m_coverage;
 
-	delete[] m_objects; 
-	m_objects=0;
-	delete[] m_upgrades; 
-	m_upgrades=0;
-	delete[] m_upgradesCount; 
-	m_upgradesCount=0;
-	delete[]m_resources;
+	// events, hotkeys, elements and working resources are released with the replay arena
 }
 
 //-----------------------------------------------------------------------------------------------------------------
@@ -312,9 +679,9 @@ ReplayEvtList::~ReplayEvtList()
 void ReplayEvtList::_Complete(ReplayEvt *evt, int currentSelection)
 {
 	// get action id
-	const IStarcraftAction *action = evt->GetAction();
-	int actionID = action->GetID();
+	int actionID = evt->ActionID();
 	bool bIsValidEvent = !evt->IsDiscarded();
+	ReplayResource *res = GetResource(evt->Time());
 
 	// if it's a valid event check its type
 	int type=ReplayResource::A_OTHER;
@@ -332,16 +699,16 @@ void ReplayEvtList::_Complete(ReplayEvt *evt, int currentSelection)
 				if(m_lastActionID==BWrepGameData::CMD_SELECT && m_lastSelection==1)
 				{
 					//so fix this
-					evt->pResources()->AddAction(ReplayResource::A_MICRO,false);
-					evt->pResources()->RemoveAction(ReplayResource::A_MACRO,false);
+					res->AddAction(ReplayResource::A_MICRO,false);
+					res->RemoveAction(ReplayResource::A_MACRO,false);
 				}
 				// update micro
-				evt->pResources()->AddAction(ReplayResource::A_MICRO,false);
+				res->AddAction(ReplayResource::A_MICRO,false);
 			}
 			else
 			{
 				// count set rally and clear rally as macro
-				evt->pResources()->AddAction(ReplayResource::A_MACRO,false);
+				res->AddAction(ReplayResource::A_MACRO,false);
 			}
 			break;
 		case BWrepGameData::CMD_MOVE :
@@ -353,7 +720,7 @@ void ReplayEvtList::_Complete(ReplayEvt *evt, int currentSelection)
 				if((element=GetElemList()->FindElement(m_selectedUnits[0]))!=0)
 				{
 					// if unit is cc, nexus or hatchery, this is in fact a SET RALLY action
-					short objID = element->ObjectID(action->GetTime());
+					short objID = element->ObjectID(evt->Time());
 					if(objID==BWrepGameData::OBJ_COMMANDCENTER || objID==BWrepGameData::OBJ_NEXUS || objID==BWrepGameData::OBJ_HATCHERY)
 					{
 						evt->GetTypePtr()->m_cmd = BWrepGameData::CMD_ATTACK; 
@@ -384,59 +751,59 @@ void ReplayEvtList::_Complete(ReplayEvt *evt, int currentSelection)
 			if(m_lastActionID==BWrepGameData::CMD_SELECT && m_lastSelection==1)
 			{
 				//so fix this
-				evt->pResources()->AddAction(ReplayResource::A_MICRO,false);
-				evt->pResources()->RemoveAction(ReplayResource::A_MACRO,false);
+				res->AddAction(ReplayResource::A_MICRO,false);
+				res->RemoveAction(ReplayResource::A_MACRO,false);
 			}
 			// update micro apm
-			evt->pResources()->AddAction(ReplayResource::A_MICRO,false);
+			res->AddAction(ReplayResource::A_MICRO,false);
 			break;
 		case BWrepGameData::CMD_SELECT:
 			// select more than one unit is considered micro
 			if(currentSelection>1)
-				evt->pResources()->AddAction(ReplayResource::A_MICRO,false);
+				res->AddAction(ReplayResource::A_MICRO,false);
 			else
-				evt->pResources()->AddAction(ReplayResource::A_MACRO,false);
+				res->AddAction(ReplayResource::A_MACRO,false);
 			break;
 		// used for BPM
 		case BWrepGameData::CMD_BUILD:
 		case BWrepGameData::CMD_MORPH:
 			// update macro apm
 			type=ReplayResource::A_BUILD;
-			evt->pResources()->AddAction(ReplayResource::A_MACRO,false);
+			res->AddAction(ReplayResource::A_MACRO,false);
 			break;
 		case BWrepGameData::CMD_HATCH:
 			// if last action was a select with >1 unit, it was counted as micro
 			if(m_lastActionID==BWrepGameData::CMD_SELECT && m_lastSelection>1)
 			{
 				//so fix this
-				evt->pResources()->AddAction(ReplayResource::A_MACRO,false);
-				evt->pResources()->RemoveAction(ReplayResource::A_MICRO,false);
+				res->AddAction(ReplayResource::A_MACRO,false);
+				res->RemoveAction(ReplayResource::A_MICRO,false);
 			}
 			type=ReplayResource::A_TRAIN;
-			evt->pResources()->AddAction(ReplayResource::A_MACRO,false);
+			res->AddAction(ReplayResource::A_MACRO,false);
 			break;
 		// used for UPM
 		case BWrepGameData::CMD_TRAIN:
 		case BWrepGameData::CMD_MERGEDARKARCHON:
 		case BWrepGameData::CMD_MERGEARCHON:
 			type=ReplayResource::A_TRAIN;
-			evt->pResources()->AddAction(ReplayResource::A_MACRO,false);
+			res->AddAction(ReplayResource::A_MACRO,false);
 			break;
 		case BWrepGameData::CMD_HOTKEY:
 			type=ReplayResource::A_HOTKEY;
 			if(currentSelection>1)
-				evt->pResources()->AddAction(ReplayResource::A_MICRO,false);
+				res->AddAction(ReplayResource::A_MICRO,false);
 			else
-				evt->pResources()->AddAction(ReplayResource::A_MACRO,false);
+				res->AddAction(ReplayResource::A_MACRO,false);
 			break;
 		case BWrepGameData::CMD_CANCELTRAIN:
 		case BWrepGameData::CMD_RESEARCH:
 		case BWrepGameData::CMD_UPGRADE:
 			// update macro apm
-			evt->pResources()->AddAction(ReplayResource::A_MACRO,false);
+			res->AddAction(ReplayResource::A_MACRO,false);
 			break;
 		default:
-			evt->pResources()->AddAction(ReplayResource::A_MICRO,false);
+			res->AddAction(ReplayResource::A_MICRO,false);
 			break;
 		}
 	}
@@ -445,7 +812,7 @@ void ReplayEvtList::_Complete(ReplayEvt *evt, int currentSelection)
 	m_lastSelection = currentSelection;
 
 	// count action in resources
-	evt->pResources()->AddAction(type);
+	res->AddAction(type);
 }
 
 //------------------------------------------------------------------------------------------------------------
@@ -508,7 +875,8 @@ void ReplayEvtList::AssignHotKey(int slot, unsigned long time)
 		m_hotkey[slot].m_hotkeyUnits[i]=m_selectedUnits[i];
 
 	// add hot key event
-	m_hkevents.Add(&HotKeyEvent(time, slot, new HotKey(m_hotkey[slot]),HotKeyEvent::ASSIGN),sizeof(HotKeyEvent));
+	m_lastHotKey[slot] = m_lastAssign[slot] = m_hklog.AddGroup(m_hotkey[slot].m_hotkeyUnits,m_hotkey[slot].m_unitcount);
+	m_hklog.Add(time, slot, HotKeyEvent::ASSIGN, m_lastHotKey[slot]);
 }
 
 //------------------------------------------------------------------------------------------------------------
@@ -537,7 +905,8 @@ void ReplayEvtList::AddHotKey(int slot, unsigned long time)
 	}
 
 	// add hot key event
-	m_hkevents.Add(&HotKeyEvent(time, slot, new HotKey(m_hotkey[slot]),HotKeyEvent::ADD),sizeof(HotKeyEvent));
+	m_lastHotKey[slot] = m_hklog.AddGroup(m_hotkey[slot].m_hotkeyUnits,m_hotkey[slot].m_unitcount);
+	m_hklog.Add(time, slot, HotKeyEvent::ADD, m_lastHotKey[slot]);
 }
 
 //------------------------------------------------------------------------------------------------------------
@@ -567,21 +936,165 @@ void ReplayEvtList::SelectHotKey(int slot, unsigned long time)
 	for(int i=0;i<m_currentSelection;i++)
 		m_selectedUnits[i]=m_hotkey[slot].m_hotkeyUnits[i];
 
-	// find lastest assignment
-	const HotKey *hk=0;
-	for(int i=(int)GetHKEventCount()-1; i>=0 ;i--)
+	// add hot key event (with units of lastest assignment)
+	m_hklog.Add(time, slot, HotKeyEvent::SELECT, m_lastAssign[slot]);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+// checkpoint c holds the state after all actions up to c*PLAYERSTATE_CHECKPOINT_TICKS
+void ReplayEvtList::_AddCheckpoints(unsigned long time)
+{
+	while(m_checkpoints.GetCount()*PLAYERSTATE_CHECKPOINT_TICKS < time)
+	{
+		ReplayPlayerCheckpoint chk;
+		chk.m_state.m_time = m_checkpoints.GetCount()*PLAYERSTATE_CHECKPOINT_TICKS;
+		chk.m_state.m_selection = m_loggedSelection;
+		memcpy(chk.m_state.m_selectedUnits,m_loggedUnits,sizeof(m_loggedUnits));
+		memcpy(chk.m_state.m_hotkeys,m_lastHotKey,sizeof(m_lastHotKey));
+		chk.m_hkevent = m_hklog.GetCount();
+		chk.m_selchange = m_selchanges.GetUsed();
+		m_checkpoints.Add(&chk,sizeof(chk));
+	}
+}
+
+// selection log record: time (4 bytes), unit count (2 bytes), unit ids (2 bytes each)
+void ReplayEvtList::_LogSelection(unsigned long time)
+{
+	// same selection as last logged one?
+	if(m_currentSelection==m_loggedSelection && memcmp(m_selectedUnits,m_loggedUnits,m_currentSelection*sizeof(short))==0) 
+		return;
+
+	m_loggedSelection = m_currentSelection;
+	memcpy(m_loggedUnits,m_selectedUnits,sizeof(m_loggedUnits));
+
+	char rec[6+MAXSELECTION*sizeof(short)];
+	unsigned int rectime = (unsigned int)time;
+	short count = (short)m_currentSelection;
+	memcpy(rec,&rectime,4);
+	memcpy(rec+4,&count,2);
+	memcpy(rec+6,m_selectedUnits,count*sizeof(short));
+	m_selchanges.Add(rec,6+count*sizeof(short));
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+// restore nearest checkpoint and replay only hot key events and selection changes after it
+void ReplayEvtList::GetPlayerState(unsigned long time, ReplayPlayerState& state) const
+{
+	unsigned long hkevent=0;
+	unsigned long selchange=0;
+	state = ReplayPlayerState();
+	if(m_checkpoints.GetCount()>0)
+	{
+		unsigned long idx = min(time/PLAYERSTATE_CHECKPOINT_TICKS,m_checkpoints.GetCount()-1);
+		const ReplayPlayerCheckpoint *chk = (const ReplayPlayerCheckpoint *)m_checkpoints.GetPtr(idx*sizeof(ReplayPlayerCheckpoint));
+		state = chk->m_state;
+		hkevent = chk->m_hkevent;
+		selchange = chk->m_selchange;
+	}
+	state.m_time = time;
+
+	// hot keys
+	for(unsigned long i=hkevent; i<GetHKEventCount(); i++)
 	{
 		const HotKeyEvent *hkevt = GetHKEvent(i);
-		if(hkevt->m_type==HotKeyEvent::ASSIGN && hkevt->m_slot==slot) 
-			{hk=hkevt->GetHotKey();break;}
+		if(hkevt->m_time>time) break;
+		if(hkevt->m_type!=HotKeyEvent::SELECT) state.m_hotkeys[hkevt->m_slot]=hkevt->m_group;
 	}
 
-	// add hot key event
-	m_hkevents.Add(&HotKeyEvent(time, slot,(HotKey *)hk,HotKeyEvent::SELECT),sizeof(HotKeyEvent));
+	// selection
+	while(selchange<m_selchanges.GetUsed())
+	{
+		const char *rec = (const char *)m_selchanges.GetPtr(selchange);
+		unsigned int rectime;
+		short count;
+		memcpy(&rectime,rec,4);
+		if(rectime>time) break;
+		memcpy(&count,rec+4,2);
+		state.m_selection = count;
+		memcpy(state.m_selectedUnits,rec+6,count*sizeof(short));
+		selchange += 6+count*sizeof(short);
+	}
+
+	// unit ids are reused, resolve identities at that time
+	for(int i=0; i<state.m_selection; i++)
+		state.m_selectedObjects[i] = GetObjectID(state.m_selectedUnits[i],time);
 }
 
 //------------------------------------------------------------------------------------------------------------
 
+// record units referenced by an action (once selection is updated)
+void ReplayEvtList::_PostUnits(const IStarcraftAction *action)
+{
+	int i;
+	int actionID = action->GetID();
+	if(actionID==BWrepGameData::CMD_SELECT || actionID==BWrepGameData::CMD_SHIFTSELECT || 
+		actionID==BWrepGameData::CMD_SHIFTDESELECT || actionID==BWrepGameData::CMD_DESELECTAUTO)
+	{
+		const BWrepActionSelect::Params *p = (const BWrepActionSelect::Params *)action->GetParamStruct();
+		for(i=0;i<p->m_unitCount;i++)
+			m_postings.Add(p->m_unitid[i],m_currentAction,UnitPostings::SELECT);
+		return;
+	}
+	else if(actionID==BWrepGameData::CMD_HOTKEY)
+	{
+		// selected units were recalled or put in the hot key
+		const BWrepActionHotKey::Params *p = (const BWrepActionHotKey::Params *)action->GetParamStruct();
+		int role = p->m_type==BWrepGameData::HOT_SELECT ? UnitPostings::SELECT : UnitPostings::HOTKEY;
+		for(i=0;i<m_currentSelection;i++)
+			m_postings.Add(m_selectedUnits[i],m_currentAction,role);
+		return;
+	}
+	else if(actionID==BWrepGameData::CMD_MINIMAPPING || actionID==BWrepGameData::CMD_MESSAGE || 
+		actionID==BWrepGameData::CMD_LEAVEGAME || actionID==BWrepGameData::CMD_VISION || actionID==BWrepGameData::CMD_ALLY)
+	{
+		// not a unit command
+		return;
+	}
+	else if(actionID==BWrepGameData::CMD_MOVE || actionID==BWrepGameData::CMD_ATTACK)
+	{
+		// targeted unit (same offset for move and attack)
+		const BWrepActionMove::Params *p = (const BWrepActionMove::Params *)action->GetParamStruct();
+		if(p->m_unitid!=0 && p->m_unitid!=0xFFFF) 
+			m_postings.Add(p->m_unitid,m_currentAction,UnitPostings::TARGET);
+	}
+
+	// command given to selected units
+	for(i=0;i<m_currentSelection;i++)
+		m_postings.Add(m_selectedUnits[i],m_currentAction,UnitPostings::ORDER);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+// decode postings of a unit and get its identity at the time of each action
+int ReplayEvtList::GetUnitHistory(short unitID, ReplayUnitPosting *postings, int maxPostings) const
+{
+	const IStarcraftActionList *actions = m_replay->QueryFile()->QueryActions();
+	UnitPostings::Cursor cursor;
+	if(!m_postings.Find(unitID,cursor)) return 0;
+
+	int count=0, actionIdx, role;
+	while(count<maxPostings && m_postings.Next(cursor,actionIdx,role))
+	{
+		ReplayUnitPosting& posting = postings[count++];
+		posting.m_actionIdx = actionIdx;
+		posting.m_role = role;
+		posting.m_time = actions->GetAction(actionIdx)->GetTime();
+		posting.m_objectID = GetObjectID(unitID,posting.m_time);
+	}
+	return m_postings.GetCount(unitID);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+// recalls per minute of game for a hot key slot
+double ReplayEvtList::GetHotKeyRecallRate(int slot) const
+{
+	int sec = m_replay->QueryFile()->QueryHeader()->Tick2Sec(m_replay->GetEndTime());
+	return sec<=0 ? 0.0 : (double)GetHotKeyStats(slot).m_recalls*60.0/(double)sec;
+}
+
 void ReplayEvtList::AddUnit(int idx, unsigned long time) 
 {
 	assert(idx>=0 && idx<MAXUNIT);
@@ -590,7 +1103,7 @@ void ReplayEvtList::AddUnit(int idx, unsigned long time)
 	if(m_objects[idx]>m_peak[DIST_UNIT]) m_peak[DIST_UNIT]=m_objects[idx];
 
 	if(m_mapAnim!=0) 
-		m_mapAnim->AddUnit(&ReplayMapAction(0,0,0,0,m_playerid,time));
+		_AddMapAction(ReplayMapPending::UNIT,ReplayMapAction(0,0,0,0,m_playerid,time));
 }
 
 void ReplayEvtList::AddEvtType(int idx, bool eventValidForAPM) 
@@ -632,17 +1145,24 @@ void ReplayEvtList::_AddBuilding(int idx, int x, int y, unsigned long time)
 	
 	if(x>=0 && y>=0 && m_mapAnim!=0) 
 	{
-		int w=gAllUnits[idx].width;
-		int h=gAllUnits[idx].height;
+		int w,h;
+		GetBuildingSize(idx,&w,&h);
 		//if(m_map) m_map->SetBuilding(x,y,w,h,MapElem(idx,m_playerid));
 		if(m_mapAnim) 
 		{
-			m_mapSurface->IncSquare(x/m_mapDividerX,y/m_mapDividerY,MapElem(1,0));
-			m_mapAnim->AddBuild(&ReplayMapAction(x,y,w,h,m_playerid,time));
+			m_coverage->AddBuilding(x,y);
+			_AddMapAction(ReplayMapPending::BUILD,ReplayMapAction(x,y,w,h,m_playerid,time));
 		}
 	}
 }
 
+// record map action, it will be merged in replay map once all players are processed
+void ReplayEvtList::_AddMapAction(int kind, const ReplayMapAction& act)
+{
+	ReplayMapPending pending(m_currentAction,kind,act);
+	m_pendingMap.Add(&pending,sizeof(pending));
+}
+
 const char *ReplayEvtList::GetUnitName(int idx) const 
 {
 	assert(idx>=0 && idx<BWrepGameData::g_ObjectsSize);
@@ -693,7 +1213,6 @@ bool ReplayEvtList::_UpdateSelection(const BWrepActionSelect::Params *p, unsigne
 bool ReplayEvtList::_HandleSelection(const IStarcraftAction *action)
 {
 	int actionID = action->GetID();
- 	bool bNewSelection=false;
 	bool suspicious=false;
 
 	// adjust selection
@@ -702,7 +1221,6 @@ bool ReplayEvtList::_HandleSelection(const IStarcraftAction *action)
 		// set new selection
 		const BWrepActionSelect::Params *p = (const BWrepActionSelect::Params *)action->GetParamStruct();
 		m_currentSelection=0;
-		bNewSelection=true;
 
 		// add units in elements list
 		suspicious = _UpdateSelection(p, action->GetTime());
@@ -734,10 +1252,7 @@ bool ReplayEvtList::_HandleSelection(const IStarcraftAction *action)
 		else if(p->m_type==BWrepGameData::HOT_ADD) 
 			AddHotKey(p->m_slot,action->GetTime());
 		else if(p->m_type==BWrepGameData::HOT_SELECT) 
-		{
 			SelectHotKey(p->m_slot,action->GetTime());
-			bNewSelection=true;
-		}
 	}
 	else if(actionID==BWrepGameData::CMD_ATTACK)
 	{
@@ -746,8 +1261,8 @@ bool ReplayEvtList::_HandleSelection(const IStarcraftAction *action)
 		{
 			int x= p->m_pos1/MOVE_SCALE;
 			int y= p->m_pos2/MOVE_SCALE;
-			m_mapSurface->IncSquare(x/m_mapDividerX,y/m_mapDividerY,MapElem(0,1));
-			m_mapAnim->AddMove(&ReplayMapAction(x,y,1,1,m_playerid,action->GetTime()));
+			m_coverage->AddUnit(x,y);
+			_AddMapAction(ReplayMapPending::MOVE,ReplayMapAction(x,y,1,1,m_playerid,action->GetTime()));
 		}
 	}
 	else if(actionID==BWrepGameData::CMD_MOVE)
@@ -757,8 +1272,8 @@ bool ReplayEvtList::_HandleSelection(const IStarcraftAction *action)
 		{
 			int x= p->m_pos1/MOVE_SCALE;
 			int y= p->m_pos2/MOVE_SCALE;
-			m_mapSurface->IncSquare(x/m_mapDividerX,y/m_mapDividerY,MapElem(0,1));
-			m_mapAnim->AddMove(&ReplayMapAction(x,y,1,1,m_playerid,action->GetTime()));
+			m_coverage->AddUnit(x,y);
+			_AddMapAction(ReplayMapPending::MOVE,ReplayMapAction(x,y,1,1,m_playerid,action->GetTime()));
 		}
 
 		// initial move on mineral patch of first workers?
@@ -776,9 +1291,6 @@ bool ReplayEvtList::_HandleSelection(const IStarcraftAction *action)
 		}
 	}
 	
-	// if a new element is selected, reset list of similar events
-	if(bNewSelection) ResetSimilar();
-
 	// returns true is move is suspect (hacking)
 	return suspicious;
 }
@@ -1198,11 +1710,8 @@ void ReplayEvtList::_IdentifyCommand(int cmdID, int subcmd, unsigned long time)
 
 //------------------------------------------------------------------------------------------------------------
 
-void ReplayEvtList::_AdjustData(const IStarcraftAction *action, int& actionID, int &objectID, const char * &parameters, int& subcmd )
+void ReplayEvtList::_AdjustData(const IStarcraftAction *action, int& actionID, int &objectID, int& subcmd )
 {
-	static char tmpParam[255];
-	const char *realParameters = action->GetParameters(GetElemList());
-
 	// adjust action data
 	if(actionID == BWrepGameData::CMD_BUILD) 
 	{
@@ -1215,7 +1724,6 @@ void ReplayEvtList::_AdjustData(const IStarcraftAction *action, int& actionID, i
 	}
 	else if(actionID == BWrepGameData::CMD_ARM) 
 	{
-		parameters="Interceptor/Scarab"; 
 		actionID=BWrepGameData::CMD_TRAIN; 
 		if(!m_bHasFleetBeacon)
 			objectID=BWrepGameData::OBJ_SCARAB;
@@ -1227,13 +1735,11 @@ void ReplayEvtList::_AdjustData(const IStarcraftAction *action, int& actionID, i
 	else if(actionID == BWrepGameData::CMD_MERGEARCHON) 
 	{
 		//actionID=BWrepGameData::CMD_TRAIN; 
-		parameters="Archon"; 
 		objectID=BWrepGameData::OBJ_ARCHON;
 	}
 	else if(actionID == BWrepGameData::CMD_MERGEDARKARCHON) 
 	{
 		//actionID=BWrepGameData::CMD_TRAIN; 
-		parameters="Dark Archon";
 		objectID=BWrepGameData::OBJ_DARKARCHON;
 	}
 	else if(actionID == BWrepGameData::CMD_MORPH) 
@@ -1266,11 +1772,6 @@ void ReplayEvtList::_AdjustData(const IStarcraftAction *action, int& actionID, i
 	}
 	else if(actionID == BWrepGameData::CMD_ATTACK) 
 	{
-		// remove action at the end
-		strcpy(tmpParam,realParameters);
-		char *p=strrchr(tmpParam,',');
-		if(p!=0) {*p=0; parameters=tmpParam;}
-		if(tmpParam[strlen(tmpParam)-1]==',') tmpParam[strlen(tmpParam)-1]=0;
 		const BWrepActionAttack::Params *pa = (const BWrepActionAttack::Params *)action->GetParamStruct();
 		subcmd = pa->m_type;
 	}
@@ -1299,18 +1800,10 @@ void ReplayEvtList::_AdjustData(const IStarcraftAction *action, int& actionID, i
 		if(p->m_unitCount==0) actionID = BWrepGameData::CMD_DESELECTAUTO;
 	}
 	
+	// terran research ids are remapped in ReplayResource::GetResearchTech
 	if(m_race==IStarcraftPlayer::RACE_TERRAN)
 	{
 		if(actionID == BWrepGameData::CMD_ATTACK && subcmd==BWrepGameData::ATT_RECALL) {subcmd=BWrepGameData::ATT_IRRADIATE;}
-		else if(strcmp(realParameters,"Hallucination")==0) {parameters="Ghost Sight";}
-		else if(strcmp(realParameters,"Recall")==0) {parameters="Moebius Reactor";}
-		else if(strcmp(realParameters,"Stasis Field")==0) {parameters="Wraith Energy";}
-	}
-	else if(m_race==IStarcraftPlayer::RACE_PROTOSS)
-	{
-		if(strcmp(realParameters,"Wraith Energy")==0) {parameters="Stasis Field";}
-		else if(strcmp(realParameters,"Ghost Sight")==0) {parameters="Hallucination";}
-		else if(strcmp(realParameters,"Moebius Reactor")==0) {parameters="Recall";}
 	}
 
 	// try to identify unit from command
@@ -1436,137 +1929,77 @@ void ReplayBuildOrder::RemoveBuildOrder(int actionID, unsigned long time, int ob
 
 void ReplayEvtList::_Discard(ReplayEvt *evt)
 {
+	if(evt->IsDiscarded()) return;
 	evt->Discard();
 	m_discardedActions++;
 }
 
 //------------------------------------------------------------------------------------------------------------
 
-bool ReplayEvtList::_IsValidBuildEvent(ReplayEvt *evt, ReplayEvt *prevEvt, int buildingID)
-{
-	// get previous event
-	bool bValidEvent=true;
-	int eventCount = GetEventCount();
-	assert(prevEvt!=0);
-
-	// decide time limit
-	unsigned long timeLimit = evt->Time()<4000 ? 170 : evt->Time()<7000 ? 120 : 40;
-
-	if(evt->ActionID()==BWrepGameData::CMD_MORPH)
-	{
-		// is it the same event than the previous one?
-		while(prevEvt!=0 && (evt->Time()-prevEvt->Time()<=timeLimit))
-		{
-			// do we have the same building during the time limit?
-			if(prevEvt->Type()==evt->Type() && prevEvt->UnitIdx()==buildingID)
-			{
-				bValidEvent=false;
-				break;
-			}
-
-			eventCount--;
-			prevEvt = eventCount==0 ? 0 : GetEvent(eventCount-1);
-		}
-	}
-
-	// do we have a build event at same x,y position on the map?
-	else if(evt->ActionID()==BWrepGameData::CMD_BUILD)
-	{
-		const BWrepActionBuild::Params *p = (const BWrepActionBuild::Params *)evt->GetAction()->GetParamStruct();
-		int x=p->m_pos1; int y=p->m_pos2;
-		timeLimit = m_replay->QueryFile()->QueryHeader()->Sec2Tick(30);
-		while(bValidEvent && prevEvt!=0 && (evt->Time()-prevEvt->Time()<=timeLimit))
-		{
-			// do we have the same building during the time limit?
-			if(prevEvt->Type()==BWrepGameData::CMD_BUILD && prevEvt->UnitIdx()==buildingID)
-			{
-				//int mindist = (buildingID == BWrepGameData::OBJ_COMMANDCENTER || buildingID == BWrepGameData::OBJ_NEXUS) ? 8 : 2;
-				int mindistX = gAllUnits[buildingID].width;
-				int mindistY = gAllUnits[buildingID].height;
-
-				const BWrepActionBuild::Params *p = (const BWrepActionBuild::Params *)prevEvt->GetAction()->GetParamStruct();
-				if(abs(p->m_pos1-x)<mindistX && abs(p->m_pos2-y)<mindistY) 
-				{
-					bValidEvent=false;
-					break;
-				}
-			}
-
-			eventCount--;
-			prevEvt = eventCount==0 ? 0 : GetEvent(eventCount-1);
-		}
-	}	
-
-	if(!bValidEvent)
-	{
-		// discard the first event
-		_Discard(prevEvt); 
-		// remove building from build order
-		m_bo.RemoveBuildOrder(evt->ActionID(),prevEvt->Time(),buildingID);
-	}
-
-	return bValidEvent;
-}
-
-//------------------------------------------------------------------------------------------------------------
-
-bool ReplayEvtList::_IsValidTrainEvent(ReplayEvt *evt, ReplayEvt *prevEvt, int unitID)
+// map action id to the classifier command kind
+int ReplayEvtList::_GetEAPMKind(int actionID)
 {
-	// get previous event
-	int eventCount = GetEventCount();
-	assert(prevEvt!=0);
-
-	// if we have a previous event
-	bool bValidEvent=true;
-
-	// is it the same event than the previous one?
-	if(prevEvt->Type()==evt->Type() && prevEvt->UnitIdx()==unitID && evt->Time()-prevEvt->Time()<=10)
-		IncSimilar();
-
-	// compute acceptable amount of similar train depending on game advancement
-	int limitSimilar = 5; 
-	if(evt->Time()<2000) limitSimilar = 3;
-	else if(evt->Time()<4000) limitSimilar = 4;
-	else if(evt->Time()<8000) limitSimilar = 5;
-
-	// if the sum of similar units great than the acceptable limit
-	if(GetSimilar()>=limitSimilar) 
+	switch(actionID)
 	{
-		// discard event
-		bValidEvent=false;
-		_Discard(evt);
+	case BWrepGameData::CMD_SELECT:
+	case BWrepGameData::CMD_DESELECTAUTO:
+		return EAPMClassifier::K_SELECT;
+	case BWrepGameData::CMD_SHIFTSELECT:
+		return EAPMClassifier::K_SHIFTSELECT;
+	case BWrepGameData::CMD_SHIFTDESELECT:
+		return EAPMClassifier::K_SHIFTDESELECT;
+	case BWrepGameData::CMD_HOTKEY:
+		return EAPMClassifier::K_HOTKEY;
+	case BWrepGameData::CMD_TRAIN:
+	case BWrepGameData::CMD_HATCH:
+	case BWrepGameData::CMD_MERGEARCHON:
+	case BWrepGameData::CMD_MERGEDARKARCHON:
+		return EAPMClassifier::K_TRAIN;
+	case BWrepGameData::CMD_BUILD:
+		return EAPMClassifier::K_BUILD;
+	case BWrepGameData::CMD_MORPH:
+		return EAPMClassifier::K_MORPH;
+	case BWrepGameData::CMD_RESEARCH:
+	case BWrepGameData::CMD_UPGRADE:
+		return EAPMClassifier::K_TECH;
+	case BWrepGameData::CMD_CANCEL:
+	case BWrepGameData::CMD_CANCELHATCH:
+	case BWrepGameData::CMD_CANCELTRAIN:
+	case BWrepGameData::CMD_0X31:
+	case BWrepGameData::CMD_0X33:
+	case BWrepGameData::CMD_0X34:
+		return EAPMClassifier::K_CANCEL;
+	case BWrepGameData::CMD_VISION:
+	case BWrepGameData::CMD_ALLY:
+	case BWrepGameData::CMD_LEAVEGAME:
+	case BWrepGameData::CMD_MESSAGE:
+		return EAPMClassifier::K_NOTGAME;
 	}
-
-	return bValidEvent;
+	return EAPMClassifier::K_OTHER;
 }
 
 //------------------------------------------------------------------------------------------------------------
 
-bool ReplayEvtList::_IsValidUpgradeEvent(ReplayEvt *evt, ReplayEvt *prevEvt, int techID)
+// classify action for the effective APM, returns false if it is not effective.
+// revoked is the index of an earlier event that is not effective anymore (-1 if none)
+bool ReplayEvtList::_ClassifyEvent(const IStarcraftAction *action, int objectID, int bx, int by, bool invalid, int& revoked)
 {
-//	assert(evt->Time()!=18230);
-
-	// check that we are not doing the same upgrade multiple times
-	bool bValidEvent=true;
-	if(m_upgradesCount[techID]==(unsigned int)gAllTechs[techID].maxtry)
-		bValidEvent=false;
-
-	// if event is possible
-	if(bValidEvent)
+	int size=0;
+	const void *params = action->GetParamStruct(&size);
+	EAPMClassifier::Command cmd(action->GetTime(),_GetEAPMKind(action->GetID()),action->GetID(),params,size);
+	cmd.m_object = objectID;
+	cmd.m_invalid = invalid;
+	if(cmd.m_kind==EAPMClassifier::K_BUILD && objectID>=0 && objectID<MAXUNIT)
 	{
-		// if we have a previous event
-		if(prevEvt!=0)
-		{
-			// is it the same event than the previous one?
-			if(prevEvt->Type()==evt->Type() && prevEvt->UnitIdx()==techID && evt->Time()-prevEvt->Time()<=15)
-				bValidEvent=false;
-		}
+		cmd.m_x = bx;
+		cmd.m_y = by;
+		GetBuildingSize(objectID,&cmd.m_width,&cmd.m_height);
 	}
 
-	// discard event if necessary
-	if(!bValidEvent) _Discard(evt);
-
-	return bValidEvent;
+	// one command per event, so sequence numbers are event indices
+	int reason = m_eapm.Classify(cmd,&revoked);
+	assert(revoked<GetEventCount());
+	return reason==EAPMClassifier::EFFECTIVE;
 }
 
 //------------------------------------------------------------------------------------------------------------
@@ -1617,7 +2050,7 @@ int ReplayEvtList::GetSelectionForHatch(int unitType, unsigned long now) const
 void ReplayEvtList::ProcessMapCoverage(unsigned long actime)
 {
 	// new slot?
-	if(m_mapSurface!=0)
+	if(m_coverage!=0)
 	{
 		int slot = actime/RES_INTERVAL_TICK;
 		if(m_currentSlot!=slot)
@@ -1625,16 +2058,11 @@ void ReplayEvtList::ProcessMapCoverage(unsigned long actime)
 			// if we already processed a current slot
 			if(m_currentSlot!=-1)
 			{
-				// process current map surface
-				MapElem sum(0,0);
-				unsigned __int64 unit=0;
-				m_mapSurface->Sum(sum,unit);
-				for(int i=m_currentSlot;i<slot;i++)
-				{
-					GetResourceFromIdx(i)->SetMapCoverage(sum.m_buildingid);
-					GetResourceFromIdx(i)->SetMapCoverageUnit(unit);
-				}
-				m_mapSurface->ClearUnit();
+				// store coverage for current slot
+				int build = m_coverage->GetBuildingCoverage();
+				for(int i=m_currentSlot;i<slot && i<m_resCount;i++)
+					GetResourceFromIdx(i)->SetMapCoverage(build);
+				m_coverage->EndSlots(m_currentSlot,slot);
 			}
 			m_currentSlot = slot;
 		}
@@ -1643,7 +2071,7 @@ void ReplayEvtList::ProcessMapCoverage(unsigned long actime)
 
 //------------------------------------------------------------------------------------------------------------
 
-unsigned long ReplayEvtList::AddEvent(IStarcraftAction *action, const char* &parameters)
+unsigned long ReplayEvtList::AddEvent(IStarcraftAction *action)
 {
 	int actionID = action->GetID();
 	int objectID = -1;
@@ -1658,6 +2086,9 @@ unsigned long ReplayEvtList::AddEvent(IStarcraftAction *action, const char* &par
 	// count events in beginning of game
 	if(action->GetTime()<MINAPMVALIDTIME) {eventValidForAPM=false; m_eventsBegin++;}
 
+	// snapshot player state before first action after each checkpoint
+	_AddCheckpoints(action->GetTime());
+
 	// get previous event
 	ReplayEvt *prevEvt = eventCount==0 ? 0 : GetEvent(eventCount-1);
 
@@ -1665,67 +2096,87 @@ unsigned long ReplayEvtList::AddEvent(IStarcraftAction *action, const char* &par
 	int buildingid = _HandleBuild(action,bx,by);
 
 	// adjust action data & get unit ID
-	_AdjustData(action, actionID, objectID, parameters, subcmd );
+	_AdjustData(action, actionID, objectID, subcmd );
 
 	// handle selection of units
 	bool suspect = _HandleSelection(action);
+	_PostUnits(action);
 
 	// create event - this will initialize the corresponding resource slot if not done yet
-	ReplayEvt evt(this, action,GetSelection(), actionID,subcmd,objectID,prevEvt, suspect);
+	ReplayEvt evt(this, action,m_currentAction,GetSelection(), actionID,subcmd,objectID,prevEvt, suspect);
+
+	// units added by a train or merge, tech of a research or upgrade
+	bool isTrain = actionID == BWrepGameData::CMD_TRAIN || actionID == BWrepGameData::CMD_HATCH || 
+		actionID == BWrepGameData::CMD_MERGEARCHON || actionID == BWrepGameData::CMD_MERGEDARKARCHON;
+	int unitsToAdd = 
+		//actionID == BWrepGameData::CMD_HATCH ? GetSelectionForHatch(objectID,evt.Time()) : 
+		actionID == BWrepGameData::CMD_HATCH ? GetSelection() : 
+		actionID == BWrepGameData::CMD_MERGEARCHON ? GetSelection()/2 :
+		actionID == BWrepGameData::CMD_MERGEDARKARCHON ? GetSelection()/2 : 1;
+	int techID = -1;
+	if(actionID == BWrepGameData::CMD_UPGRADE || actionID == BWrepGameData::CMD_RESEARCH)
+	{
+		techID = actionID == BWrepGameData::CMD_UPGRADE ? ReplayResource::GetUpgradeTech(objectID) :
+			ReplayResource::GetResearchTech(objectID, m_race==IStarcraftPlayer::RACE_TERRAN);
+		evt.SetUnitIdx(techID);
+	}
+
+	// nothing to train, or upgrade already done as many times as possible
+	bool invalid = (isTrain && unitsToAdd<=0) || (techID>=0 && m_upgradesCount[techID]==(unsigned int)gAllTechs[techID].maxtry);
+
+	// is action effective?
+	int revoked;
+	if(!_ClassifyEvent(action, techID>=0 ? techID : objectID, bx, by, invalid, revoked)) _Discard(&evt);
+
+	// did it make an earlier event useless? (replaced selection, building placed again)
+	bool rebuild=false;
+	if(revoked>=0)
+	{
+		ReplayEvt *oldEvt = GetEvent(revoked);
+		_Discard(oldEvt);
+		if(oldEvt->ActionID()==BWrepGameData::CMD_BUILD || oldEvt->ActionID()==BWrepGameData::CMD_MORPH)
+		{
+			// remove first building from build order, resources were already spent for it
+			m_bo.RemoveBuildOrder(oldEvt->ActionID(),oldEvt->Time(),objectID);
+			rebuild=true;
+		}
+	}
 
 	// update resources
-	if(prevEvt!=0)
+	if(prevEvt!=0 && !evt.IsDiscarded())
 	{
-		if(actionID == BWrepGameData::CMD_TRAIN || actionID == BWrepGameData::CMD_HATCH || 
-			actionID == BWrepGameData::CMD_MERGEARCHON || actionID == BWrepGameData::CMD_MERGEDARKARCHON) 
+		if(isTrain) 
 		{
-			// is train event valid?
-			if(_IsValidTrainEvent(&evt, prevEvt, objectID))
-			{
-				// update resources and distribution
-				int unitsToAdd = 
-					//actionID == BWrepGameData::CMD_HATCH ? GetSelectionForHatch(objectID,evt.Time()) : 
-					actionID == BWrepGameData::CMD_HATCH ? GetSelection() : 
-					actionID == BWrepGameData::CMD_MERGEARCHON ? GetSelection()/2 :
-					actionID == BWrepGameData::CMD_MERGEDARKARCHON ? GetSelection()/2 : 1;
-				if(unitsToAdd>0) evt.UpdateResourceTrain(objectID,unitsToAdd);
-				else _Discard(&evt);
-
-				// add each unit of the selection
-				for(int k=0;k<unitsToAdd;k++)
-				{
-					AddUnit(objectID,evt.Time());
+			// update resources and distribution
+			evt.UpdateResourceTrain(GetResource(evt.Time()),objectID,unitsToAdd);
 
-					// double units for zerlings and scourges
-					if(objectID==BWrepGameData::OBJ_ZERGLING || objectID==BWrepGameData::OBJ_SCOURGE) 
-						AddUnit(objectID,evt.Time());
-				}
+			// add each unit of the selection
+			for(int k=0;k<unitsToAdd;k++)
+			{
+				AddUnit(objectID,evt.Time());
 
-				// clear selection to avoid double hatch
-				if(actionID == BWrepGameData::CMD_HATCH) m_currentSelection=0;
+				// double units for zerlings and scourges
+				if(objectID==BWrepGameData::OBJ_ZERGLING || objectID==BWrepGameData::OBJ_SCOURGE) 
+					AddUnit(objectID,evt.Time());
 			}
+
+			// clear selection to avoid double hatch
+			if(actionID == BWrepGameData::CMD_HATCH) m_currentSelection=0;
 		}
 		else if(buildingid>=0)
 		{
-			// is build event valid?
-			if(_IsValidBuildEvent(&evt, prevEvt, objectID))
+			// update resources and distribution
+			if(!rebuild)
 			{
-				// update resources and distribution
-				evt.UpdateResourceBuild(objectID);
+				evt.UpdateResourceBuild(GetResource(evt.Time()),objectID);
 				_AddBuilding(objectID,bx,by,evt.Time());
 			}
 		}
-		else if(actionID == BWrepGameData::CMD_UPGRADE || actionID == BWrepGameData::CMD_RESEARCH)  
+		else if(techID>=0)  
 		{
-			// is upgrade event valid?
-			int techID = ReplayResource::_FindTech(parameters==0?action->GetParameters(GetElemList()):parameters);
-			if(techID>=0 && _IsValidUpgradeEvent(&evt, prevEvt, techID))
-			{
-				// update resources and distribution
-				evt.UpdateResourceUpgrade(techID);
-				AddUpgrade(techID);
-			}
-			evt.SetUnitIdx(techID);
+			// update resources and distribution
+			evt.UpdateResourceUpgrade(GetResource(evt.Time()),techID);
+			AddUpgrade(techID);
 		}
 	}
 
@@ -1754,6 +2205,9 @@ unsigned long ReplayEvtList::AddEvent(IStarcraftAction *action, const char* &par
 		}
 	}
 
+	// log selection changes
+	_LogSelection(action->GetTime());
+
 	// new slot?
 	ProcessMapCoverage(action->GetTime());
 										
@@ -1775,6 +2229,14 @@ int ReplayEvtList::GetStandardAPMDev(int delta, int deltaMap)
 	unsigned long totdev=0;
 	int apm = GetActionPerMinute();
 
+	// need working slots
+	bool compacted = m_resources==0;
+	if(compacted) _ExpandResources();
+
+	// map coverage for units on a window of slots
+	unsigned short *mapcover = (unsigned short*)calloc(GetSlotCount()+1,sizeof(unsigned short));
+	if(m_coverage!=0) m_coverage->ComputeMovingCoverage(GetSlotCount(),deltaMap,mapcover);
+
 	// reset activity measurement maximums
 	m_resmax.ClearAPM();
 	m_resmax.SetMovingMapCoverage(0);
@@ -1837,6 +2299,10 @@ int ReplayEvtList::GetStandardAPMDev(int delta, int deltaMap)
 		int apmmicro = tottime==0 ? 0 : game->Sec2Tick(60*totactionMicro)/tottime;
 		int apmmacro = tottime==0 ? 0 : game->Sec2Tick(60*totactionMacro)/tottime;
 
+		// effective actions on the same window
+		int last = min(GetSlotCount()-1,slot+delta);
+		int eapmlocal = m_eapm.GetAPM(last,last-max(0,slot-delta)+1,game->Sec2Tick(60),true);
+
 		// udpate minimum apm
 		unsigned long tick = Slot2Time(slot);
 		if(apmlocal<m_apmMini && tick>=minTickForMini && tick<maxTickForMini) m_apmMini=apmlocal;
@@ -1845,6 +2311,7 @@ int ReplayEvtList::GetStandardAPMDev(int delta, int deltaMap)
 		if(apmlocal>levalApmLocalMax) apmlocal=levalApmLocalMax;
 		if(apmmicro>levalApmLocalMax) apmmicro=levalApmLocalMax;
 		if(apmmacro>levalApmLocalMax) apmmacro=levalApmLocalMax;
+		if(eapmlocal>levalApmLocalMax) eapmlocal=levalApmLocalMax;
 
 		// store
 		res->SetAPM(apmlocal);
@@ -1853,23 +2320,10 @@ int ReplayEvtList::GetStandardAPMDev(int delta, int deltaMap)
 		res->SetLegalAPM(apmlocal);
 		res->SetBPM(bpmlocal);
 		res->SetUPM(upmlocal);
+		res->SetEAPM(eapmlocal);
 
-		// compute local map coverage for units on a window of slots
-		unsigned __int64 mapcover = 0;
-		for(int j=min(GetSlotCount()-1,slot+deltaMap); j>=0 && j>=slot-deltaMap; j--)
-		{
-			ReplayResource *prevres = &m_resources[j];
-			mapcover |= prevres->MapCoverageUnit();
-		}
-
-		// count squares
-		int squareCount=0;
-		for(int j=0;j<64;j++)
-		{
-			if((mapcover&1)!=0) squareCount++;
-			mapcover>>=1;
-		}
-		res->SetMovingMapCoverage(squareCount);
+		// local map coverage for units on a window of slots
+		res->SetMovingMapCoverage(mapcover[slot]);
 
 		// update all maxes for resources
 		m_resmax.UpdateMax(*res,(tick>=MINAPMVALIDTIMEFORMAX));
@@ -1886,6 +2340,9 @@ int ReplayEvtList::GetStandardAPMDev(int delta, int deltaMap)
 
 	// compute final deviation
 	m_apmDev = GetSlotCount()==0?0:totdev/GetSlotCount();
+	free(mapcover);
+	m_pyramid.Clear();
+	if(compacted) CompactResources();
 	return m_apmDev;
 }
 
@@ -1976,25 +2433,161 @@ ReplayEvtList *Replay::_GetListFromPlayerName(const char *playername, int race)
 
 //------------------------------------------------------------------------------------------------------------
 
-unsigned long Replay::_AddEvent(IStarcraftAction *action, const char *playername, int race, const char* &parameters)
+void Replay::_QueueEvent(int actionIdx, unsigned long time, const char *playername, int race)
 {
-	unsigned long offevt=0;
-	m_currentlist = 0;
-
 	// record time for last action
-	if(action->GetTime()>m_timeEnd) m_timeEnd=action->GetTime();
+	if(time>m_timeEnd) m_timeEnd=time;
 
 	// find existing list for that player (if any)
-	m_currentlist = _GetListFromPlayerName(playername,race);
+	ReplayEvtList *list = _GetListFromPlayerName(playername,race);
+
+	// queue action, it will be processed by the player's analysis worker
+	if(list) list->QueueAction(actionIdx);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+// process all actions queued for that player
+void ReplayEvtList::ProcessQueuedActions(const IStarcraftActionList *actions)
+{
+	for(unsigned long i=0; i<m_queued.GetCount(); i++)
+	{
+		m_currentAction = *(int*)m_queued.GetPtr(i*sizeof(int));
+		AddEvent((IStarcraftAction *)actions->GetAction(m_currentAction));
+	}
+	m_queued.Clear();
+	m_postings.Finish();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+// shared by the analysis workers
+struct AnalysisJob
+{
+	Replay *m_replay;
+	volatile LONG m_next;
+	int m_last;
+	int m_tasks;
+	unsigned long m_time; // TASK_STATE only
+	ReplayPlayerState *m_states;
+};
+
+UINT Replay::_AnalysisWorker(LPVOID param)
+{
+	AnalysisJob *job = (AnalysisJob *)param;
 
-	// if we have a list
-	if(m_currentlist) 
+	// take next player until all are done
+	for(;;)
 	{
-		// add event in list
-		offevt=m_currentlist->AddEvent(action,parameters);
+		int i = (int)InterlockedIncrement(&job->m_next)-1;
+		if(i>=job->m_last) break;
+		ReplayEvtList *list = job->m_replay->GetEvtList(i);
+		if(job->m_tasks&TASK_STATE) list->GetPlayerState(job->m_time,job->m_states[i]);
+		job->m_replay->_AnalyzePlayer(list,job->m_tasks);
+	}
+	return 0;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void Replay::_AnalyzePlayer(ReplayEvtList *list, int tasks)
+{
+	// build events from queued actions
+	if(tasks&TASK_EVENTS) 
+		list->ProcessQueuedActions(m_gfile->QueryActions());
+
+	// process last slots for map coverage
+	if(tasks&TASK_COVERAGE) 
+		list->ProcessMapCoverage(m_timeEnd);
+
+	// update resources
+	if(tasks&TASK_APM) 
+		list->GetStandardAPMDev(gTimeWindow[m_apmStyle], gTimeWindowMap[m_mapStyle]);
+
+	// resources are complete, compact them
+	if(tasks&TASK_TIMELINE) 
+		list->CompactResources();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+// run analysis tasks for players [first, GetPlayerCount()[, one worker thread per cpu
+void Replay::_AnalyzePlayers(int first, int tasks, unsigned long time, ReplayPlayerState *states)
+{
+	int count = GetPlayerCount()-first;
+	if(count<=0) return;
+
+	// how many workers?
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	int workers = min(count,(int)si.dwNumberOfProcessors);
+	workers = min(workers,MAXIMUM_WAIT_OBJECTS);
+
+	AnalysisJob job;
+	job.m_replay = this;
+	job.m_next = first;
+	job.m_last = GetPlayerCount();
+	job.m_tasks = tasks;
+	job.m_time = time;
+	job.m_states = states;
+	assert(states!=0 || (tasks&TASK_STATE)==0);
+
+	// single cpu or single player: no need for threads
+	if(workers<=1) {_AnalysisWorker(&job); return;}
+
+	// start workers
+	CWinThread *threads[MAXIMUM_WAIT_OBJECTS];
+	HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+	int started=0;
+	for(int i=0; i<workers; i++)
+	{
+		CWinThread *thread = AfxBeginThread(_AnalysisWorker,&job,THREAD_PRIORITY_NORMAL,0,CREATE_SUSPENDED);
+		if(thread==0) break;
+		thread->m_bAutoDelete=FALSE;
+		thread->ResumeThread();
+		threads[started] = thread;
+		handles[started++] = thread->m_hThread;
+	}
+
+	// the calling thread works too (and does everything if no worker could be started)
+	_AnalysisWorker(&job);
+
+	// wait for all of them
+	if(started>0) WaitForMultipleObjects(started,handles,TRUE,INFINITE);
+	for(int i=0; i<started; i++) delete threads[i];
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+// map actions must be added in replay action order, so merge lists from all players
+void Replay::_MergeMapActions()
+{
+	int count = GetPlayerCount();
+	int *cursor = new int[count];
+	memset(cursor,0,sizeof(int)*count);
+
+	for(;;)
+	{
+		// find player with the oldest pending action
+		int best=-1;
+		const ReplayMapPending *bestAction=0;
+		for(int i=0; i<count; i++)
+		{
+			const ReplayEvtList *list = GetEvtList(i);
+			if(cursor[i]>=list->GetPendingMapCount()) continue;
+			const ReplayMapPending *pending = list->GetPendingMap(cursor[i]);
+			if(bestAction==0 || pending->m_seq<bestAction->m_seq) {best=i; bestAction=pending;}
+		}
+		if(best<0) break;
+
+		// add it to replay map
+		if(m_mapAnim!=0) m_mapAnim->AddPending(bestAction);
+		cursor[best]++;
 	}
 
-	return offevt;
+	// free pending actions
+	for(int i=0; i<count; i++) GetEvtList(i)->ClearPendingMap();
+	delete[]cursor;
 }
 
 //------------------------------------------------------------------------------------------------------------
@@ -2111,11 +2704,73 @@ void Replay::_ClearMaps()
 {
 	delete m_mapAnim;
 	m_mapAnim=0;
+	delete m_spatial;
+	m_spatial=0;
 }
 
 //------------------------------------------------------------------------------------------------------------
 
-void Replay::_CreateTileset()
+// add action to spatial index if it has a map position
+void Replay::_IndexAction(int actionIdx, const IStarcraftAction *action)
+{
+	int x,y,kind;
+	switch(action->GetID())
+	{
+		case BWrepGameData::CMD_MOVE:
+		{
+			const BWrepActionMove::Params *p = (const BWrepActionMove::Params *)action->GetParamStruct();
+			x=p->m_pos1; y=p->m_pos2; kind=ActionSpatialIndex::MOVE;
+			break;
+		}
+		case BWrepGameData::CMD_ATTACK:
+		{
+			const BWrepActionAttack::Params *p = (const BWrepActionAttack::Params *)action->GetParamStruct();
+			x=p->m_pos1; y=p->m_pos2; kind=ActionSpatialIndex::ATTACK;
+			break;
+		}
+		case BWrepGameData::CMD_BUILD:
+		{
+			// build position is in map squares
+			const BWrepActionBuild::Params *p = (const BWrepActionBuild::Params *)action->GetParamStruct();
+			x=p->m_pos1*MOVE_SCALE; y=p->m_pos2*MOVE_SCALE; kind=ActionSpatialIndex::BUILD;
+			break;
+		}
+		case BWrepGameData::CMD_MINIMAPPING:
+		{
+			const BWrepActionMinimapPing::Params *p = (const BWrepActionMinimapPing::Params *)action->GetParamStruct();
+			x=p->m_x; y=p->m_y; kind=ActionSpatialIndex::PING;
+			break;
+		}
+		default:
+			return;
+	}
+	m_spatial->Add(kind,x,y,action->GetPlayerID(),action->GetTime(),actionIdx);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+// compute map assets (tileset, start locations, resources) from the map section
+MapAssetRecord *Replay::_ExtractMapAssets() const
+{
+	const IStarcraftMap *map = m_gfile->QueryMap();
+
+	// get tile section info
+	const IStarcraftMapSection *tile= map->GetSection(SECTION_MTXM);
+	if(tile==0) tile= map->GetTileSection();
+	assert(tile==0 || tile->GetSize()==(unsigned long)(2*map->GetWidth()*map->GetHeight()) ||
+		tile->GetSize()==(unsigned long)(map->GetWidth()*map->GetHeight()));
+
+	// start locations and resources are in the unit section
+	const IStarcraftMapSection *units= map->GetSection(SECTION_UNIT);
+	return MapAssetRecord::Extract(map->GetHash(),map->GetWidth(),map->GetHeight(),
+		tile==0 ? 0 : tile->GetData(),tile==0 ? 0 : tile->GetSize(),
+		units==0 ? 0 : units->GetData(),units==0 ? 0 : units->GetSize());
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+// returns false if map section is corrupt
+bool Replay::_CreateTileset()
 {
 	// clear all maps
 	_ClearMaps();
@@ -2124,63 +2779,61 @@ void Replay::_CreateTileset()
 	m_mapAnim = new	ReplayMapAnimated(this, m_gfile->QueryHeader()->getMapWidth(),m_gfile->QueryHeader()->getMapHeight());
 	MapSurface *tileset = m_mapAnim->GetTileSet();
 
-	// get tile section info
-	const IStarcraftMapSection *tile= m_gfile->QueryMap()->GetSection(SECTION_MTXM);
-	if(tile==0) tile= m_gfile->QueryMap()->GetTileSection();
+	// allocate spatial index
+	m_spatial = new ActionSpatialIndex(m_gfile->QueryHeader()->getMapWidth(),m_gfile->QueryHeader()->getMapHeight());
 
-	// make sure size is ok
-	int mapsize = m_gfile->QueryMap()->GetWidth()*m_gfile->QueryMap()->GetHeight();
-	if(tile!=0 && (tile->GetSize()==(unsigned long)(2*mapsize) || tile->GetSize()==(unsigned long)mapsize))
+	// map assets are computed once per map (the map section isnt even unpacked if they're in cache)
+	MapAssetCache *cache = BWChartDB::GetMapCache();
+	StarcraftMapHash hash = m_gfile->QueryMap()->GetHash();
+	MapAssetRecord *extracted = 0;
+	const MapAssetRecord *assets = hash==0 ? 0 : cache->Find(hash);
+	if(assets==0)
 	{
-		int inc = tile->GetSize()/(unsigned long)mapsize;
-		const unsigned char *psquare = tile->GetData();
-		for(int j=0;j<m_gfile->QueryMap()->GetHeight();j++)
-			for(int i=0;i<m_gfile->QueryMap()->GetWidth();i++)
+		if(!m_gfile->QueryMap()->Unpack()) return false;
+		assets = extracted = _ExtractMapAssets();
+		if(extracted!=0 && hash!=0) assets = cache->Add(extracted);
+	}
+	if(assets==0) return true;
+
+	// tileset
+	const unsigned char *psquare = assets->GetTiles();
+	if(psquare!=0)
+	{
+		for(int j=0;j<assets->m_height;j++)
+			for(int i=0;i<assets->m_width;i++)
 			{
 				tileset->SetSquare(i,j,MapElem(psquare[0],psquare[1]));
-				psquare+=inc;
+				psquare+=2;
 			}
 	}
-	else
-	{
-		assert(0);
-	}
 
-	// get unit section info
-	const BWrepMapSectionUNIT *units= (const BWrepMapSectionUNIT *)m_gfile->QueryMap()->GetSection(SECTION_UNIT);
-	if(units==0) return;
-	for(int i=0;i<units->GetUnitCount();i++)
+	// start locations and resources
+	const MapAssetUnit *units = assets->GetUnits();
+	for(int i=0;i<assets->m_unitCount;i++)
 	{
-		// add start locations
-		BWrepMapSectionUNIT::BWrepUnitDesc *desc = units->GetUnitDesc(i);
-		if(desc->unitid==BWrepMapSectionUNIT::UNIT_STARTLOCATION)
+		const MapAssetUnit& unit = units[i];
+		if(unit.m_kind==MapAssetUnit::STARTLOCATION)
 		{
 			const IStarcraftPlayer *player;
-			m_gfile->QueryHeader()->getPlayerFromIdx(player,desc->playerid);
+			m_gfile->QueryHeader()->getPlayerFromIdx(player,unit.m_playerid);
 			if(player->getName()!=0 && player->getName()[0]!=0)
 			{
 				// update start location
 				ReplayEvtList *list = _GetListFromPlayerName(player->getName(),player->getRace());
-				list->SetStartingLocation(desc->x/32,desc->y/32);
+				list->SetStartingLocation(unit.m_x,unit.m_y);
 
-				// add building at start location (nexus, cc, hatchery are all 4x3)
-				int x= desc->x/32;
-				int y= desc->y/32;
-				m_mapAnim->AddBuild(&ReplayMapAction(x,y,4,3,list->GetPlayerID(),0));
+				// add building at start location
+				m_mapAnim->AddBuild(&ReplayMapAction(unit.m_x,unit.m_y,unit.m_width,unit.m_height,list->GetPlayerID(),0));
 			}
 		}
-		else if(desc->unitid==BWrepMapSectionUNIT::UNIT_MINERAL1 || 
-			desc->unitid==BWrepMapSectionUNIT::UNIT_MINERAL2 || 
-			desc->unitid==BWrepMapSectionUNIT::UNIT_MINERAL3 || 
-			desc->unitid==BWrepMapSectionUNIT::UNIT_GEYSER)
+		else
 		{
-			int wx=2, wy=1;
-			if(desc->unitid==BWrepMapSectionUNIT::UNIT_GEYSER) {wx*=2;wy*=2;}
-			int x= desc->x/32;
-			int y= desc->y/32;
-			m_mapAnim->AddBuild(&ReplayMapAction(x,y,wx,wy,MAPMINERAL,0));
+			m_mapAnim->AddBuild(&ReplayMapAction(unit.m_x,unit.m_y,unit.m_width,unit.m_height,MAPMINERAL,0));
 		}
 	}
+
+	if(extracted!=0) free(extracted);
+	return true;
 }
 
 //------------------------------------------------------------------------------------------------------------
@@ -2232,7 +2885,6 @@ int Replay::Load(const char *filename, bool buildEnActionList, CListCtrl *listv,
 	CStringArray replacements;
 	const IStarcraftPlayer *player;
 	CString playerName;
-	const char *parameters=0;
 
 	// alloc replay
 	if(bClear || m_gfile==0)
@@ -2247,6 +2899,7 @@ int Replay::Load(const char *filename, bool buildEnActionList, CListCtrl *listv,
 
 	// init units arrays
 	BWrepGameData::InitUnits();
+	ReplayResource::InitTechs();
 
 	// reset
 	if(bClear) Clear();
@@ -2255,12 +2908,15 @@ int Replay::Load(const char *filename, bool buildEnActionList, CListCtrl *listv,
 
 	// load file
 	int prevCount = bClear ? 0 : m_gfile->QueryActions()->GetActionCount();
-	char *oldbase = bClear ? 0 : (char*)m_gfile->QueryActions()->GetAction(0);
 	int options = IStarcraftReplay::LOADACTIONS | IStarcraftReplay::LOADMAP;
 	if(!bClear) options |= IStarcraftReplay::ADDACTIONS;
 	if(!m_gfile->Load(filename,options,&m_hdrRWA,sizeof(AudioHeader))) {ferr=-1; goto Exit;}
 	m_filename = filename;
 
+	// action bitmaps must be rebuilt
+	m_actionBitmaps.Reset(0,0);
+	m_bitmapLists.Clear();
+
 	// any RWA data?
 	m_isRWA=false;
 	if(strncmp(m_hdrRWA.header,BWAUDIOMARKER,strlen(BWAUDIOMARKER))==0) 
@@ -2281,7 +2937,9 @@ int Replay::Load(const char *filename, bool buildEnActionList, CListCtrl *listv,
 
 	// create map & tileset
 	if(bClear) 
-		_CreateTileset();
+	{
+		if(!_CreateTileset()) {ferr=-1; goto Exit;}
+	}
 	// no map when multiple replays are mixed
 	else
 		_ClearMaps();
@@ -2315,15 +2973,23 @@ int Replay::Load(const char *filename, bool buildEnActionList, CListCtrl *listv,
 			}
 		}
 
-		// record event
-		parameters=0;
-		_AddEvent((IStarcraftAction *)action,playerName,player->getRace(),parameters);
+		// queue event for that player
+		_QueueEvent(i,action->GetTime(),playerName,player->getRace());
+
+		// index its position
+		if(m_spatial!=0) _IndexAction(i,action);
 
 		// insert dummy event (just for incrementing the number of elements in the virtual list control)
 		//if(listv!=0) 
 		//	listv->InsertItem(i,"", 0);
 	}
 
+	if(m_spatial!=0) m_spatial->Finish();
+
+	// build events for all new players
+	_AnalyzePlayers(existingPlayers.GetSize(),TASK_EVENTS);
+	_MergeMapActions();
+
 	tinter = GetTickCount()-tstart;
 
 	// if we're going to display charts
@@ -2332,29 +2998,18 @@ int Replay::Load(const char *filename, bool buildEnActionList, CListCtrl *listv,
 		// compute overall action distribution (for chart)
 		_ComputeActionDistribution();
 
-		// adjust previous pointers to actions
-		char *newbase = (char*)m_gfile->QueryActions()->GetAction(0);
-		for(int i=0; !bClear && i<existingPlayers.GetSize();i++)
-		{
-			ReplayEvtList *list = GetEvtList(i);
-			list->AdjustActionPointers(oldbase,newbase);
-		}
-
 		// compute standard deviation for APM & local activity measurements
 		m_apmStyle = APM_MEDIUM;
-		for(int i=existingPlayers.GetSize(); i<GetPlayerCount();i++)
-		{
-			ReplayEvtList *list = GetEvtList(i);
-
-			// process last slots for map coverage
-			list->ProcessMapCoverage(m_timeEnd);
-
-			// update resources
-			list->GetStandardAPMDev(gTimeWindow[m_apmStyle], gTimeWindowMap[m_mapStyle]);
+		_AnalyzePlayers(existingPlayers.GetSize(),TASK_COVERAGE|TASK_APM|TASK_TIMELINE);
 
-			// update all maxes for resources
-			m_resmax.UpdateMax(list->ResourceMax(),true);
-		}
+		// update all maxes for resources
+		for(int i=existingPlayers.GetSize(); i<GetPlayerCount();i++)
+			m_resmax.UpdateMax(GetEvtList(i)->ResourceMax(),true);
+	}
+	else
+	{
+		// no chart, just compact resources
+		_AnalyzePlayers(existingPlayers.GetSize(),TASK_TIMELINE);
 	}
 
 	// if there wasnt any action at all
@@ -2374,20 +3029,20 @@ int Replay::Load(const char *filename, bool buildEnActionList, CListCtrl *listv,
 	// sort	player's list
 	_Sort();
 
+	// mark suspicious events
+	_MarkSuspiciousEvents();
+
+	// mark events that are HACK signatures
+	_MarkHackCommands();
+
 	// if we're going to display charts
 	if(buildEnActionList)
 	{
-		// rebuild enabled action list
+		// rebuild enabled action list (after marking, for suspect and hack bitmaps)
 		_BuildEnableActionList();
 		if(listv!=0) listv->SetItemCountEx(GetEnActionCount(), LVSICF_NOSCROLL|LVSICF_NOINVALIDATEALL);
 	
 	}
-
-	// mark suspicious events
-	_MarkSuspiciousEvents();
-
-	// mark events that are HACK signatures
-	_MarkHackCommands();
 	
 Exit:
 	AfxGetApp()->WriteProfileString("LOG","LASTREP","");
@@ -2411,16 +3066,11 @@ bool Replay::UpdateAPM(int apmStyle, int mapStyle)
 	m_resmax.SetMovingMapCoverage(0);
 
 	// compute standard deviation for APM & local activity measurements
-	for(int i=0; i<GetPlayerCount();i++)
-	{
-		ReplayEvtList *list = GetEvtList(i);
-
-		// update resources
-		list->GetStandardAPMDev(gTimeWindow[m_apmStyle], gTimeWindowMap[m_mapStyle]);
+	_AnalyzePlayers(0,TASK_APM);
 
-		// update all maxes for resources
-		m_resmax.UpdateMax(list->ResourceMax(),true);
-	}
+	// update all maxes for resources
+	for(int i=0; i<GetPlayerCount();i++)
+		m_resmax.UpdateMax(GetEvtList(i)->ResourceMax(),true);
 
 	return true;
 }
@@ -2462,6 +3112,8 @@ void Replay::Clear()
 {
 	m_Done=false; 
 	m_players.RemoveAll(); 
+	m_deletedPlayers.RemoveAll(); 
+	m_arena.Reset();
 	m_resmax.Clear(); 
 	m_timeEnd=0;
 	m_lastBOTime=0;
@@ -2651,14 +3303,10 @@ int Replay::GetTypeIdx(const ReplayEvt *evt) const
 
 //------------------------------------------------------------------------------------------------------------
 
-// adjust all actions addresses
-void ReplayEvtList::AdjustActionPointers(char *oldbase, char *newbase)
+// get action for an event of that list (events keep an index, actions may be reallocated)
+const IStarcraftAction *ReplayEvtList::GetEvtAction(const ReplayEvt *evt) const
 {
-	for(int i=0;i<GetEventCount();i++)
-	{
-		ReplayEvt *evt = GetEvent(i);
-		evt->SetAction((const BWrepAction*)(newbase+((char*)evt->GetAction()-oldbase)));
-	}
+	return m_replay->QueryFile()->QueryActions()->GetAction(evt->ActionIdx());
 }
 
 //------------------------------------------------------------------------------------------------------------
@@ -2694,9 +3342,10 @@ int ReplayEvtList::GetMicroAPM() const
 {
 
 	int total=0,vslot=0;
+	ReplayTimeline::Cursor cursor;
 	for(int slot=0;slot<GetSlotCount();slot++)
 	{
-		ReplayResource *res = &m_resources[slot];
+		const ReplayResource *res = &ReadResource(cursor,slot);
 		if(slot*RES_INTERVAL_TICK > MINAPMVALIDTIME)
 		{
 			total += res->MicroAPM(); 
@@ -2713,9 +3362,10 @@ int ReplayEvtList::GetMacroAPM() const
 {
 
 	int total=0,vslot=0;
+	ReplayTimeline::Cursor cursor;
 	for(int slot=0;slot<GetSlotCount();slot++)
 	{
-		ReplayResource *res = &m_resources[slot];
+		const ReplayResource *res = &ReadResource(cursor,slot);
 		if(slot*RES_INTERVAL_TICK > MINAPMVALIDTIME)
 		{
 			total += res->MacroAPM(); 
@@ -2870,57 +3520,94 @@ short BWElement::ObjectID(unsigned long time, unsigned long* timeIdentification)
 
 //------------------------------------------------------------------------------------------------------------
 
-// rebuild enabled action list
-void Replay::_BuildEnableActionList()
+// set action bits in the category bitmaps, the suspect and hack bitmaps, and the bitmap
+// of the player owning the action
+void Replay::_BuildActionBitmaps()
 {
-	// clear existing list
-	m_enabledActions.Clear();
+	int count = QueryFile()->QueryActions()->GetActionCount();
+
+	// event lists owning actions (removed players still own their actions)
+	int i;
+	m_bitmapLists.Clear();
+	for(i=0; i<GetPlayerCount(); i++)
+	{
+		ReplayEvtList *list = GetEvtList(i);
+		m_bitmapLists.Add(&list,sizeof(list));
+	}
+	for(i=0; i<m_deletedPlayers.GetSize(); i++)
+	{
+		ReplayEvtList *list = (ReplayEvtList *)m_deletedPlayers.GetAt(i);
+		m_bitmapLists.Add(&list,sizeof(list));
+	}
+	ReplayEvtList **lists = (ReplayEvtList **)m_bitmapLists.GetPtr(0);
+	int listCount = (int)m_bitmapLists.GetCount();
+	m_actionBitmaps.Reset(count,__BM_LISTS+listCount);
 
 	// for each action
-	int count = QueryFile()->QueryActions()->GetActionCount();
-	m_suspectCount=0;
-	m_hackCount=0;
-	for(int i=0; i<count; i++)
+	int listIdx=0;
+	for(i=0; i<count; i++)
 	{
-		// skip if player is disabled
+		// owner list (usually same as previous action)
 		const IStarcraftAction *action = QueryFile()->QueryActions()->GetAction(i);
 		ReplayEvtList *list = (ReplayEvtList *)action->GetUserData(0);
-		if(!list->IsEnabled()) continue;
+		if(listIdx>=listCount || lists[listIdx]!=list)
+			for(listIdx=0; listIdx<listCount && lists[listIdx]!=list; listIdx++);
+		if(listIdx<listCount) m_actionBitmaps.Set(__BM_LISTS+listIdx,i);
 
 		// get event
 		ReplayEvt *evt = list->GetEvent(action->GetUserData(1));
 		assert(evt!=0);
+		if(evt->IsSuspect()) m_actionBitmaps.Set(BM_SUSPECT,i);
+		if(evt->IsHack()) m_actionBitmaps.Set(BM_HACK,i);
 
-		// count suspect events
-		if(evt->IsSuspect()) m_suspectCount++;
-
-		// count hack events
-		if(evt->IsHack()) m_hackCount++;
-
-		// apply filter (if any)
-		bool add = (m_filter&FLT_OTHERS)!=0;
+		// category
+		int bitmap = BM_OTHERS;
 		if(action->GetID()==BWrepGameData::CMD_SELECT)
-			add = (m_filter&FLT_SELECT)!=0;
+			bitmap = BM_SELECT;
 		else if(action->GetID()==BWrepGameData::CMD_BUILD || action->GetID()==BWrepGameData::CMD_MORPH)
-			add = (m_filter&FLT_BUILD)!=0;
+			bitmap = BM_BUILD;
 		else if(action->GetID()==BWrepGameData::CMD_TRAIN || action->GetID()==BWrepGameData::CMD_HATCH)
-			add = (m_filter&FLT_TRAIN)!=0;
+			bitmap = BM_TRAIN;
 		else if(action->GetID()==BWrepGameData::CMD_MESSAGE)
-			add = (m_filter&FLT_CHAT)!=0;
-	
-		if(!add && (m_filter&FLT_SUSPECT)!=0)
-		{
-			if(evt->IsSuspect()) add=true;
-		}
+			bitmap = BM_CHAT;
+		m_actionBitmaps.Set(bitmap,i);
+	}
+}
 
-		if(!add && (m_filter&FLT_HACK)!=0)
-		{
-			if(evt->IsHack()) add=true;
-		}
+//------------------------------------------------------------------------------------------------------------
 
-		// add action
-		if(add) m_enabledActions.Add(&action,sizeof(action));
+void Replay::_BuildEnableActionList()
+{
+	// bitmaps are only built once per load
+	if(m_actionBitmaps.GetActionCount()!=QueryFile()->QueryActions()->GetActionCount())
+		_BuildActionBitmaps();
+
+	// actions from the categories in filter (or suspect/hack events if requested)
+	int any[__BM_LISTS];
+	int anyCount=0;
+	if((m_filter&FLT_SELECT)!=0) any[anyCount++]=BM_SELECT;
+	if((m_filter&FLT_BUILD)!=0) any[anyCount++]=BM_BUILD;
+	if((m_filter&FLT_TRAIN)!=0) any[anyCount++]=BM_TRAIN;
+	if((m_filter&FLT_CHAT)!=0) any[anyCount++]=BM_CHAT;
+	if((m_filter&FLT_OTHERS)!=0) any[anyCount++]=BM_OTHERS;
+	if((m_filter&FLT_SUSPECT)!=0) any[anyCount++]=BM_SUSPECT;
+	if((m_filter&FLT_HACK)!=0) any[anyCount++]=BM_HACK;
+
+	// from enabled players
+	int listCount = (int)m_bitmapLists.GetCount();
+	int *mask = new int[listCount+1];
+	int maskCount=0;
+	for(int i=0; i<listCount; i++)
+	{
+		const ReplayEvtList *list = *(const ReplayEvtList **)m_bitmapLists.GetPtr(i*sizeof(ReplayEvtList *));
+		if(list->IsEnabled()) mask[maskCount++]=__BM_LISTS+i;
 	}
+	m_actionBitmaps.Select(any,anyCount,mask,maskCount);
+	delete[]mask;
+
+	// count suspect and hack events
+	m_suspectCount = m_actionBitmaps.CountInMask(BM_SUSPECT);
+	m_hackCount = m_actionBitmaps.CountInMask(BM_HACK);
 }
 
 //------------------------------------------------------------------------------------------------------------
@@ -2966,16 +3653,15 @@ void Replay::_MarkHackCommands()
 				// selection hack
 				ReplayEvt *evt = list->GetEvent(act->GetUserData(1));
 				assert(evt!=0);
-				m_hackCount++;
-				evt->SetHack();
+				_SetHack(evt);
 			}
 			else if(p->m_unitCount>1 && list->GetRaceIdx()!=IStarcraftPlayer::RACE_ZERG)
 			{
 				// count hopw many buildings in the selection
 				int buildingCount=0;
-				for(int i=0;i<p->m_unitCount;i++)
+				for(int k=0;k<p->m_unitCount;k++)
 				{
-					short objid = list->GetObjectID(p->m_unitid[i],act->GetTime());
+					short objid = list->GetObjectID(p->m_unitid[k],act->GetTime());
 					if(BWrepGameData::IsBuilding((int)objid)) buildingCount++;
 				}
 
@@ -2984,8 +3670,7 @@ void Replay::_MarkHackCommands()
 					// InHale selection hack
 					ReplayEvt *evt = list->GetEvent(act->GetUserData(1));
 					assert(evt!=0);
-					m_hackCount++;
-					evt->SetHack();
+					_SetHack(evt);
 				}
 			}
 		}
@@ -3001,8 +3686,7 @@ void Replay::_MarkHackCommands()
 				// Protoss Mineral/Gaz hack
 				ReplayEvt *evt = list->GetEvent(act->GetUserData(1));
 				assert(evt!=0);
-				m_hackCount++;
-				evt->SetHack();
+				_SetHack(evt);
 			}
 		}
 		// TERRAN MINERAL HACK : mineral goes up to 1000, CC explodes
@@ -3035,8 +3719,7 @@ void Replay::_MarkHackCommands()
 					// Terran Mineral/Gaz hack
 					ReplayEvt *evt = list->GetEvent(act->GetUserData(1));
 					assert(evt!=0);
-					m_hackCount++;
-					evt->SetHack();
+					_SetHack(evt);
 				}
 
 				// move up
@@ -3106,8 +3789,7 @@ void Replay::_MarkSuspiciousEvents()
 							assert(evt!=0);
 
 							// event is suspect
-							m_suspectCount++;
-							evt->SetSuspect();
+							_SetSuspect(evt);
 						}
 					}
 				}
@@ -3297,23 +3979,24 @@ int Replay::ExportToText(const char *textfile, bool useSeconds, char csep)
 //-----------------------------------------------------------------------------------------------------------------
 
 // ctor
-ReplayEvt::ReplayEvt(ReplayEvtList *parent, const IStarcraftAction *action, unsigned char sel, int cmd, int subcmd, int objid, const ReplayEvt *prevEvt, bool suspect) 
-	: m_parent(parent)
-	, m_action(action)
-	, m_selection(sel)
+ReplayEvt::ReplayEvt(ReplayEvtList *parent, const IStarcraftAction *action, unsigned long actionIdx, unsigned char sel, int cmd, int subcmd, int objid, const ReplayEvt *prevEvt, bool suspect) 
+	: m_actionIdx(actionIdx)
+	, m_time(action->GetTime())
 	, m_type(cmd,subcmd)
 	, m_unitIdx((unsigned char)objid)
-	, m_bDiscarded(false)
-	, m_suspect(suspect)
-	, m_hack(false)
-	, m_isobj(true)
+	, m_selection(sel)
+	, m_actionID((unsigned char)action->GetID())
+	, m_bDiscarded(0)
+	, m_suspect(suspect?1:0)
+	, m_hack(0)
+	, m_isobj(1)
 {
 	// initialize the corresponding time slot 
-	ReplayResource *res = pResources();
+	ReplayResource *res = parent->GetResource(m_time);
 	if(prevEvt!=0) 
 	{
 		// if resource slot for this tick has not yet been initialized, do it now
-		if(!res->IsInitDone()) m_parent->InitResource(Time());
+		if(!res->IsInitDone()) parent->InitResource(m_time);
 	}
 	else
 		res->SetInitDone();
@@ -3328,41 +4011,36 @@ int ReplayEvt::GetBWCoachID() const
 
 //-----------------------------------------------------------------------------------------------------------------
 
-// resources
-const ReplayResource& ReplayEvt::Resources() const 
-{
-	return *(m_parent->GetResource(Time()));
-}
-
-ReplayResource* ReplayEvt::pResources() 
-{
-	return m_parent->GetResource(Time());
-}
-
-//-----------------------------------------------------------------------------------------------------------------
-
 // update resources
-void ReplayEvt::UpdateResourceTrain(int unitID,int unitsToAdd) 
+void ReplayEvt::UpdateResourceTrain(ReplayResource *res, int unitID,int unitsToAdd) 
 {
 	m_unitIdx = unitID; 
-	pResources()->UpdateResourceTrain(unitID,unitsToAdd);
+	res->UpdateResourceTrain(unitID,unitsToAdd);
 }
 
-void ReplayEvt::UpdateResourceBuild(int unitID) 
+void ReplayEvt::UpdateResourceBuild(ReplayResource *res, int unitID) 
 {
 	m_unitIdx = unitID; 
-	pResources()->UpdateResourceBuild(unitID);
+	res->UpdateResourceBuild(unitID);
 }
 
-void ReplayEvt::UpdateResourceUpgrade(int techID) 
+void ReplayEvt::UpdateResourceUpgrade(ReplayResource *res, int techID) 
 {
-	m_isobj=false;
+	m_isobj=0;
 	m_unitIdx = techID; 
-	pResources()->UpdateResourceUpgrade(techID);
+	res->UpdateResourceUpgrade(techID);
 }
 
 //-----------------------------------------------------------------------------------------------------------------
 
+ReplayResource *ReplayEvtList::GetResourceFromIdx(int idx)
+{
+	_ExpandResources();
+	if(idx<0) idx=0;
+	if(idx>=m_resCount) idx=m_resCount-1;
+	return &m_resources[idx];
+}
+
 // RECURSIVE
 void ReplayEvtList::InitResource(unsigned long tick)
 {
@@ -3375,6 +4053,52 @@ void ReplayEvtList::InitResource(unsigned long tick)
 
 //-----------------------------------------------------------------------------------------------------------------
 
+const ReplayResource& ReplayEvtList::ReadResource(ReplayTimeline::Cursor& cursor, int slot) const
+{
+	// still analysing
+	if(m_resources!=0) {assert(slot>=0 && slot<m_resCount); return m_resources[slot];}
+	return m_timeline.Seek(cursor,slot);
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
+// move working slots to the timeline
+void ReplayEvtList::CompactResources()
+{
+	if(m_resources==0) return;
+	m_timeline.Build(m_resources,m_resCount);
+	m_arena.Free(m_resources,sizeof(ReplayResource)*m_resCount);
+	m_resources=0;
+
+	// series may have changed
+	m_pyramid.Clear();
+}
+
+// min/max/sum of resource values per bucket (built on first use)
+const ReplayPyramid& ReplayEvtList::GetPyramid() const
+{
+	if(m_pyramid.IsEmpty())
+	{
+		ReplayTimeline::Cursor cursor;
+		m_pyramid.Init(m_resCount);
+		for(int slot=0;slot<m_resCount;slot++)
+			m_pyramid.Add(slot,ReadResource(cursor,slot));
+	}
+	return m_pyramid;
+}
+
+// decode timeline in working slots
+void ReplayEvtList::_ExpandResources()
+{
+	if(m_resources!=0) return;
+	m_resources = (ReplayResource*)m_arena.Alloc(sizeof(ReplayResource)*m_resCount);
+	memset(m_resources,0,sizeof(ReplayResource)*m_resCount);
+	m_timeline.Expand(m_resources);
+	m_timeline.Clear();
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
 int ReplayEvtList::GetSlotCount() const 
 {
 	return m_replay->GetGameLength()/RES_INTERVAL_TICK;
@@ -3382,8 +4106,8 @@ int ReplayEvtList::GetSlotCount() const
 
 //-----------------------------------------------------------------------------------------------------------------
 
-// build botree
-void ReplayBuildOrder::MakeBoNodeList(BONodeList* bo)
+// build bo node list
+void ReplayBuildOrder::MakeBoNodeList(BONodeList* bo, CDWordArray *times)
 {
 	ReplayObjectSequence all(ReplayObjectSequence::OBJECT,ReplayObjectSequence::MAXBO);
 	int i;
@@ -3407,6 +4131,7 @@ void ReplayBuildOrder::MakeBoNodeList(BONodeList* bo)
 
 	// convert bo to node list 
 	bo->RemoveAll();
+	if(times!=0) times->RemoveAll();
 	for(i=0;i<all.GetCount();i++)
 	{
 		int content = all.GetObject(i);
@@ -3414,21 +4139,78 @@ void ReplayBuildOrder::MakeBoNodeList(BONodeList* bo)
 		if(content>=1024) {content-=1024; type = BONode::UPG;}
 		else if(content>=512) {content-=512; type = BONode::RES;}
 		else if(content>=256) {content-=256; type = BONode::UNIT;}
-		bo->AddNode(new BONode(0,content,type));
+		bo->AddNode(new BONode(content,type));
+		if(times!=0) times->Add(all.GetTime(i));
 	}
 }
 
 //-----------------------------------------------------------------------------------------------------------------
 
 // get build order including buildings, units, research, upgrade in one sequence
-void ReplayEvtList::GetFinalBuildOrder(CString& bo)
+void ReplayEvtList::GetFinalBuildOrder(CString& bo, CString& times)
 {
 	// build node list
 	BONodeList nodelist;
-	m_bo.MakeBoNodeList(&nodelist);
+	CDWordArray ticks;
+	m_bo.MakeBoNodeList(&nodelist,&ticks);
 
 	// convert to string
 	nodelist.ToString(bo);
+
+	// node times in seconds
+	times="";
+	CString strtime;
+	const IStarcraftGame *header = m_replay->QueryFile()->QueryHeader();
+	for(int i=0;i<ticks.GetSize();i++)
+	{
+		strtime.Format("%04X",min(header->Tick2Sec(ticks[i]),0xFFFF));
+		times+=strtime;
+	}
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
+// downsampled curves of the player (apm, supply, workers & army trained)
+void ReplayEvtList::GetSparkline(ReplaySparkline& spark)
+{
+	spark.Clear();
+	int count = m_resCount;
+	if(count<=0) return;
+
+	// local apm of every slot
+	GetStandardAPMDev(-1,-1);
+
+	// workers trained in every slot (resources only count all units)
+	unsigned long *values = (unsigned long*)calloc(4*count,sizeof(unsigned long));
+	unsigned long *apm=values, *supply=values+count, *workers=values+2*count, *army=values+3*count;
+	for(int i=1;i<GetEventCount();i++)
+	{
+		const ReplayEvt *evt = GetEvent(i);
+		int cmd = evt->Type().m_cmd;
+		if(evt->IsDiscarded() || (cmd!=BWrepGameData::CMD_TRAIN && cmd!=BWrepGameData::CMD_HATCH)) continue;
+		int unitID = evt->UnitIdx();
+		if(unitID!=BWrepGameData::OBJ_SCV && unitID!=BWrepGameData::OBJ_PROBE && unitID!=BWrepGameData::OBJ_DRONE) continue;
+		workers[min(count-1,Time2Slot(evt->Time()))] += cmd==BWrepGameData::CMD_HATCH ? evt->GetSelection() : 1;
+	}
+
+	// read timeline
+	ReplayTimeline::Cursor cursor;
+	unsigned long trained=0;
+	for(int slot=0;slot<count;slot++)
+	{
+		const ReplayResource& res = ReadResource(cursor,slot);
+		trained += workers[slot];
+		workers[slot] = trained;
+		apm[slot] = res.APM();
+		supply[slot] = res.Supply();
+		army[slot] = res.Units()>trained ? res.Units()-trained : 0;
+	}
+
+	spark.SetSerie(ReplaySparkline::S_APM,apm,count,true);
+	spark.SetSerie(ReplaySparkline::S_SUPPLY,supply,count,false);
+	spark.SetSerie(ReplaySparkline::S_WORKERS,workers,count,false);
+	spark.SetSerie(ReplaySparkline::S_ARMY,army,count,false);
+	free(values);
 }
 
 //-----------------------------------------------------------------------------------------------------------------
@@ -5,9 +5,17 @@
 #include "BWrepAPI.h"
 #include "BWrepActions.h"
 #include "bwmap.h"
+#include "coverage.h"
+#include "spatialindex.h"
+#include "unitpostings.h"
+#include "actionbitmap.h"
+#include "hotkeylog.h"
+#include "eapm.h"
+#include "sparkline.h"
 
-class BOTree;
 class BONodeList;
+class ReplayEvtList;
+class MapAssetRecord;
 
 #include "../common/audioheader.h"
 
@@ -19,6 +27,8 @@ class BONodeList;
 #define MAXSELECTION 12
 #define IdxAction(cmd,subcmd) (subcmd==-1 ? cmd : BWrepGameData::_CMD_MAX_+subcmd)
 #define RES_INTERVAL_TICK 25 // ticks
+#define MAPCOVERAGE_SIDE 8 // default map coverage grid (cells per side)
+#define PLAYERSTATE_CHECKPOINT_TICKS 1440 // 1'00
 
 extern const char *_MkTime(const IStarcraftGame *header, unsigned long time, bool hhmmss);
 
@@ -35,6 +45,7 @@ extern const char *_MkTime(const IStarcraftGame *header, unsigned long time, boo
 #define DEF_CLR_MACRO RGB(160,0,16)
 #define DEF_CLR_MAPCOVERAGE RGB(73,206,255)
 #define DEF_CLR_MMCOVERAGE RGB(206,73,73)
+#define DEF_CLR_EAPM RGB(255,128,0)
 
 //--- default chart line size ---------
 
@@ -49,6 +60,7 @@ extern const char *_MkTime(const IStarcraftGame *header, unsigned long time, boo
 #define DEF_LSIZE_MACRO 1
 #define DEF_LSIZE_MAPCOVERAGE 2
 #define DEF_LSIZE_MMCOVERAGE 1
+#define DEF_LSIZE_EAPM 1
 
 //------------------------------------------------------------------------------------------------------------
 
@@ -73,6 +85,8 @@ public:
 
 class ReplayResource
 {
+	friend class ReplayTimeline;
+
 public:
 	enum {A_TOTAL, A_BUILD,A_TRAIN,A_OTHER,A_HOTKEY,A_MICRO,A_MACRO,__A_MAX};
 
@@ -94,9 +108,9 @@ private:
 	unsigned short m_legalActionPerMinute;
 	unsigned short m_microAPM;
 	unsigned short m_macroAPM;
-	unsigned __int64 m_mapCoverageUnit;
 	unsigned short m_mapCoverageBuild;
 	unsigned short m_mapMovingMapCoverage;
+	unsigned short m_effectiveActionPerMinute;
 
 public:
 	ReplayResource() {Clear();}
@@ -110,6 +124,7 @@ public:
 		SetUPM(0);
 		SetMicroAPM(0);
 		SetMacroAPM(0);
+		SetEAPM(0);
 	}
 	// init done?
 	bool IsInitDone() const {return m_initDone;}
@@ -138,8 +153,8 @@ public:
 	unsigned short MicroAPM() const {return m_microAPM;}
 	unsigned short MacroAPM() const {return m_macroAPM;}
 	unsigned short MapCoverage() const {return m_mapCoverageBuild;}
-	unsigned __int64 MapCoverageUnit() const {return m_mapCoverageUnit;}
 	unsigned short MovingMapCoverage() const {return m_mapMovingMapCoverage;}
+	unsigned short EAPM() const {return m_effectiveActionPerMinute;}
 
 	// update resources
 	void UpdateResourceBuild(int unitID);
@@ -154,8 +169,8 @@ public:
 	void SetBPM(int apm) {m_buildPerMinute=(unsigned short)apm;}
 	void SetUPM(int apm) {m_unitPerMinute=(unsigned short)apm;}
 	void SetMapCoverage(int build) {m_mapCoverageBuild=(unsigned short)build;}
-	void SetMapCoverageUnit(unsigned __int64 unit) {m_mapCoverageUnit=unit;}
 	void SetMovingMapCoverage(int val) {m_mapMovingMapCoverage=(unsigned short)val;}
+	void SetEAPM(int apm) {m_effectiveActionPerMinute=(unsigned short)apm;}
 
 	// update max value
 	void UpdateMax(const ReplayResource& res, bool updateAPM);
@@ -174,11 +189,29 @@ public:
 		if(i==8) return MacroAPM();
 		if(i==9) return MapCoverage();
 		if(i==10) return MovingMapCoverage();
+		if(i==11) return EAPM();
 		return 0;
 	}
 
+	// set value (same index as Value)
+	void SetValue(int i, unsigned long val)
+	{
+		if(i==0) m_minerals=val;
+		else if(i==1) m_gaz=val;
+		else if(i==2) m_supply=(unsigned short)(val*2);
+		else if(i==3) m_units=(unsigned short)val;
+		else if(i==4) SetAPM(val);
+		else if(i==5) SetBPM(val);
+		else if(i==6) SetUPM(val);
+		else if(i==7) SetMicroAPM(val);
+		else if(i==8) SetMacroAPM(val);
+		else if(i==9) SetMapCoverage(val);
+		else if(i==10) SetMovingMapCoverage(val);
+		else if(i==11) SetEAPM(val);
+	}
+
 	// return pre-defined colors for each resource
-	enum {CLR_MINERAL,CLR_GAS,CLR_SUPPLY,CLR_UNITS,CLR_APM,CLR_BPM,CLR_UPM,CLR_MICRO,CLR_MACRO,CLR_MAPCOVERAGE,CLR_MMCOVERAGE,__CLR_MAX};
+	enum {CLR_MINERAL,CLR_GAS,CLR_SUPPLY,CLR_UNITS,CLR_APM,CLR_BPM,CLR_UPM,CLR_MICRO,CLR_MACRO,CLR_MAPCOVERAGE,CLR_MMCOVERAGE,CLR_EAPM,__CLR_MAX};
 	static COLORREF m_gColors[__CLR_MAX];
 	static int m_gLineSize[__CLR_MAX];
 	static COLORREF GetUniqueColor(int i) {return i>=__CLR_MAX ? RGB(255,255,255) : m_gColors[i];}
@@ -186,36 +219,166 @@ public:
 
 	static int MaxValue() {return __CLR_MAX;}
 	static COLORREF GetColor(int i, int player=-1, int maxplayer=-1);
-	static int _FindTech(const char *parameters);
+
+	// technic index (in gAllTechs) from research or upgrade id
+	static void InitTechs();
+	static int GetResearchTech(int researchID, bool terran);
+	static int GetUpgradeTech(int upgradeID);
+	static int _FindTech(const char *name);
+};
+
+//------------------------------------------------------------------------------------------------------------
+
+#define TIMELINE_CHECKPOINT 32 // slots
+
+// compact storage for all resource slots of a player.
+// counters are stored as deltas from previous slot in a byte stream (with full values every 
+// TIMELINE_CHECKPOINT slots for random access), action counts only when not 0, 
+// and activity measurements in columns of 1 or 2 bytes per slot.
+class ReplayTimeline
+{
+public:
+	// reading position in the timeline (reading forward from it is cheap)
+	class Cursor
+	{
+		friend class ReplayTimeline;
+		int m_slot; // slot in m_res (-1 if none)
+		unsigned long m_offset; // offset of next slot in stream
+		ReplayResource m_res;
+	public:
+		Cursor() : m_slot(-1), m_offset(0) {}
+	};
+
+	ReplayTimeline() : m_count(0), m_stream(0), m_streamSize(0), m_checkpoints(0), m_columns(0), m_columnsSize(0) {}
+	~ReplayTimeline() {Clear();}
+
+	// release everything
+	void Clear();
+
+	// build timeline from slots
+	void Build(const ReplayResource *slots, int count);
+
+	// decode all slots
+	void Expand(ReplayResource *slots) const;
+
+	// decode one slot
+	const ReplayResource& Seek(Cursor& cursor, int slot) const;
+
+	// number of slots
+	int GetCount() const {return m_count;}
+
+	// memory used (bytes)
+	unsigned long GetSize() const;
+
+private:
+	enum {F_MINERALS=1,F_GAZ=2,F_SUPPLY=4,F_UNITS=8,F_ACTIONS=16,F_COVERAGE=32};
+	enum {S_APM,S_BPM,S_UPM,S_LEGALAPM,S_MICROAPM,S_MACROAPM,S_MMCOVERAGE,S_EAPM,__S_MAX};
+
+	// counters before a checkpoint slot
+	struct Checkpoint
+	{
+		unsigned long m_offset;
+		unsigned long m_minerals;
+		unsigned long m_gaz;
+		unsigned short m_supply;
+		unsigned short m_units;
+		unsigned short m_coverage;
+	};
+
+	int m_count;
+
+	// delta stream
+	unsigned char *m_stream;
+	unsigned long m_streamSize;
+	Checkpoint *m_checkpoints;
+
+	// activity measurement columns
+	unsigned char *m_columns;
+	unsigned long m_columnsSize;
+	unsigned long m_columnOffset[__S_MAX];
+	unsigned char m_columnWidth[__S_MAX];
+	unsigned char m_columnAlias[__S_MAX]; // column with the same values
+
+	unsigned long _Encode(const ReplayResource *slots, int count, unsigned char *out);
+	void _Decode(Cursor& cursor) const;
+	unsigned short _GetColumn(int serie, int slot) const;
+	static unsigned short _GetSerie(const ReplayResource& res, int serie);
+	static void _SetSerie(ReplayResource& res, int serie, unsigned short val);
+};
+
+//------------------------------------------------------------------------------------------------------------
+
+#define PYRAMID_LEVELS 4 // 25, 100, 400 and 1600 ticks per bucket
+#define PYRAMID_PIXELS 4 // minimum pixels per bucket when drawing
+
+// min/max/sum of all resource values (see ReplayResource::Value) per bucket of 4, 16 and 64 slots.
+// level 0 (1 slot per bucket) is the timeline itself.
+class ReplayPyramid
+{
+public:
+	struct Bucket
+	{
+		unsigned long m_min;
+		unsigned long m_max;
+		unsigned long m_sum;
+	};
+
+	ReplayPyramid() : m_count(0) {memset(m_buckets,0,sizeof(m_buckets));}
+	~ReplayPyramid() {Clear();}
+
+	// release everything
+	void Clear();
+	bool IsEmpty() const {return m_count==0;}
+
+	// build: call Add for all slots in order
+	void Init(int slotCount);
+	void Add(int slot, const ReplayResource& res);
+
+	// bucket size
+	static int GetSlotsPerBucket(int level) {return 1<<(2*level);}
+	static unsigned long GetTicksPerBucket(int level) {return RES_INTERVAL_TICK*GetSlotsPerBucket(level);}
+
+	// best level to draw a time span on a number of pixels
+	static int GetLevel(unsigned long ticks, int pixels);
+
+	// read buckets (level>0)
+	int GetBucketCount(int level) const {return (m_count+GetSlotsPerBucket(level)-1)/GetSlotsPerBucket(level);}
+	const Bucket& GetBucket(int level, int bucket, int serie) const 
+		{assert(level>0 && level<PYRAMID_LEVELS && bucket<GetBucketCount(level)); return m_buckets[level][bucket*ReplayResource::__CLR_MAX+serie];}
+
+	// all max values of a bucket
+	void GetMax(int level, int bucket, ReplayResource& res) const;
+
+private:
+	int m_count;
+	Bucket *m_buckets[PYRAMID_LEVELS];
 };
 
 //------------------------------------------------------------------------------------------------------------
 
-// event description
+// event description (16 bytes, the owning ReplayEvtList gives access to action & resources)
 class ReplayEvt
 {
 private:
-	const IStarcraftAction *m_action;
+	unsigned long m_actionIdx; // index of action in replay action list
+	unsigned long m_time;
 	ReplayEvtType m_type;
 	unsigned char m_unitIdx; // unit if type is CMD_TRAIN, building if CMD_BUILD, tech if CMD_UPGRADE/CMD_RESEARCH
-	bool m_bDiscarded;
 	unsigned char m_selection;
-	bool m_suspect;
-	bool m_hack;
-	bool m_isobj; // take info from gAllUnits, otherwise from gAllTechs
-
-	// resources
-	//ReplayResource m_res;
-	class ReplayEvtList *m_parent;
+	unsigned char m_actionID; // action id before adjustment (m_type may differ)
+	unsigned char m_bDiscarded:1;
+	unsigned char m_suspect:1;
+	unsigned char m_hack:1;
+	unsigned char m_isobj:1; // take info from gAllUnits, otherwise from gAllTechs
 
 public:
 	// ctor
-	ReplayEvt(ReplayEvtList *parent, const IStarcraftAction *action, unsigned char sel, int cmd, int subcmd, int objid, const ReplayEvt *prevEvt, bool suspect); 
+	ReplayEvt(ReplayEvtList *parent, const IStarcraftAction *action, unsigned long actionIdx, unsigned char sel, int cmd, int subcmd, int objid, const ReplayEvt *prevEvt, bool suspect); 
 
 	// update resources
-	void UpdateResourceTrain(int unitID,int unitsToAdd);
-	void UpdateResourceBuild(int unitID);
-	void UpdateResourceUpgrade(int techID);
+	void UpdateResourceTrain(ReplayResource *res, int unitID,int unitsToAdd);
+	void UpdateResourceBuild(ReplayResource *res, int unitID);
+	void UpdateResourceUpgrade(ReplayResource *res, int techID);
 
 	// selection
 	unsigned char GetSelection() const {return m_selection;}
@@ -228,39 +391,34 @@ public:
 	int GetBWCoachID() const;
 
 	// returns trues if event is suspect
-	bool IsSuspect() const {return m_suspect;}
-	void SetSuspect() {m_suspect=true;}
+	bool IsSuspect() const {return m_suspect!=0;}
+	void SetSuspect() {m_suspect=1;}
 
 	// returns trues if event is a hack signature
-	bool IsHack() const {return m_hack;}
-	void SetHack() {m_hack=true;}
+	bool IsHack() const {return m_hack!=0;}
+	void SetHack() {m_hack=1;}
 
 	// unit index
 	void SetUnitIdx(int idx) {m_unitIdx=idx;} 
 	int UnitIdx() const {return m_unitIdx;} // if type is TYP_TRAIN
 
 	// discard
-	bool IsDiscarded() const {return m_bDiscarded;}
-	void Discard() {m_bDiscarded=true;}
+	bool IsDiscarded() const {return m_bDiscarded!=0;}
+	void Discard() {m_bDiscarded=1;}
 
-	// resources
-	const ReplayResource& Resources() const;
-	ReplayResource* pResources();
+	// action (see ReplayEvtList::GetEvtAction)
+	unsigned long ActionIdx() const {return m_actionIdx;}
 
-	// action
-	const IStarcraftAction *GetAction() const {return m_action;}
-	IStarcraftAction *GetActionPtr() {return (IStarcraftAction *)m_action;}
-	void SetAction(const IStarcraftAction *action) {m_action=action;}
-
-	unsigned long Time() const {assert(m_action!=0); return m_action->GetTime();}
-	int ActionID() const {return m_action->GetID();}
+	unsigned long Time() const {return m_time;}
+	int ActionID() const {return m_actionID;}
 	COLORREF GetColor() const;
 
 	static void Clear();
-
-	DECLARE_LOCAL_HEAP(32768)
 };
 
+// events are stored packed in the event list, check their size at compile time
+typedef char ReplayEvtSizeCheck[sizeof(ReplayEvt)==16?1:-1];
+
 //------------------------------------------------------------------------------------------------------------
 
 class ReplayObjectSequence
@@ -347,7 +505,7 @@ public:
 	void AddBuildOrder(int actionID, unsigned long time, int objectID);
 	void RemoveBuildOrder(int actionID, unsigned long time, int objectID);
 
-	void MakeBoNodeList(BONodeList* bo);
+	void MakeBoNodeList(BONodeList* bo, CDWordArray *times=0);
 };
 
 //------------------------------------------------------------------------------------------------------------
@@ -377,15 +535,13 @@ public:
 	void SetObjectID(short objectID,unsigned long time,unsigned long realtime, bool reset=false);
 	short ObjectID(unsigned long time, unsigned long* timeIdentification=0) const;
 	unsigned long TimeFirstSeen() const {return m_timeFirst;}
-
-	DECLARE_LOCAL_HEAP(32768)
 };
 
 class BWElementList	: public IUnitIDToObjectID
 {
 public:
 	// ctor
-	BWElementList(Replay *replay) : m_replay(replay) {}
+	BWElementList(Replay *replay, Arena *arena=0) : m_replay(replay), m_elements(65536,arena) {}
 
 	// parent replay
 	Replay *m_replay;
@@ -428,17 +584,45 @@ public:
 	short m_hotkeyUnits[MAXSELECTION];
 };
 
-class HotKeyEvent : public CObject
+//------------------------------------------------------------------------------------------------------------
+
+// selection and hot keys of a player at a given time (see ReplayEvtList::GetPlayerState)
+class ReplayPlayerState
 {
-	HotKey *m_phk;
 public:
-	HotKeyEvent(unsigned long time, short slot, HotKey *hk, short type) : m_time(time), m_slot(slot), m_phk(hk), m_type(type) {}
-	//~HotKeyEvent() {if(m_isAssignment) delete m_phk;}
-	const HotKey *GetHotKey() const {return m_phk;}
-	unsigned long m_time; // tick
-	short m_slot;
-	enum {ASSIGN,SELECT,ADD};
-	short m_type;
+	enum {MAXHOTKEY=16};
+	ReplayPlayerState() : m_time(0), m_selection(0) 
+		{memset(m_selectedUnits,0,sizeof(m_selectedUnits)); memset(m_selectedObjects,0xFF,sizeof(m_selectedObjects)); 
+		 for(int i=0;i<MAXHOTKEY;i++) m_hotkeys[i]=HOTKEYLOG_NOGROUP;}
+
+	unsigned long m_time;
+
+	// selected units
+	int m_selection;
+	short m_selectedUnits[MAXSELECTION];
+	short m_selectedObjects[MAXSELECTION]; // identity of selected units at m_time (-1 if unknown)
+
+	// units in each hot key slot (group in player hot key log, HOTKEYLOG_NOGROUP if never assigned)
+	int m_hotkeys[MAXHOTKEY];
+};
+
+// action referencing a unit, with unit identity at that time (see ReplayEvtList::GetUnitHistory)
+class ReplayUnitPosting
+{
+public:
+	int m_actionIdx;
+	int m_role; // UnitPostings::SELECT, HOTKEY, ORDER or TARGET
+	unsigned long m_time;
+	short m_objectID; // -1 if not identified yet
+};
+
+// player state snapshot, with positions in hot key events and selection log
+class ReplayPlayerCheckpoint
+{
+public:
+	ReplayPlayerState m_state;
+	unsigned long m_hkevent;
+	unsigned long m_selchange;
 };
 
 //------------------------------------------------------------------------------------------------------------
@@ -454,12 +638,18 @@ private:
 	// parent replay
 	Replay *m_replay;
 
+	// local arena for all player data (released with the replay arena)
+	Arena m_arena;
+
 	// player name & id
 	char m_playername[128+1];
 	int m_playerid;
 
-	// all resources
+	// all resources (working slots during analysis, then compacted in the timeline)
 	ReplayResource *m_resources;
+	int m_resCount;
+	ReplayTimeline m_timeline;
+	mutable ReplayPyramid m_pyramid;
 	int m_currentSlot;
 
 	// player race
@@ -473,7 +663,7 @@ private:
 	int m_startY;
 
 	// hot key events
-	MemoryBlock m_hkevents;  // block with all events of type HotKeyEvent
+	HotKeyLog m_hklog;
  	bool m_hotkeyIsUsed[MAXHOTKEY];
 
 	// actions from the beginning to ignore for APM
@@ -482,6 +672,9 @@ private:
 	// actions discarded (for computing VAPM)
 	int m_discardedActions;
 
+	// effective actions classifier (decides which actions are discarded)
+	EAPMClassifier m_eapm;
+
 	// last action id
 	int m_lastActionID;
 	int m_lastSelection;
@@ -493,9 +686,19 @@ private:
 	int m_currentSelection;
 	short m_selectedUnits[MAXSELECTION];
 
+	// selection log (time, unit count, unit ids for every change) and state checkpoints
+	MemoryBlock m_selchanges;
+	MemoryBlock m_checkpoints; // block with all ReplayPlayerCheckpoint
+	int m_loggedSelection;
+	short m_loggedUnits[MAXSELECTION];
+	int m_lastHotKey[MAXHOTKEY]; // group after last assign or add
+	int m_lastAssign[MAXHOTKEY]; // group after last assign
+
+	// actions referencing each unit
+	UnitPostings m_postings;
+
 	// array for unit & building distribution
 	unsigned long *m_objects;
-	int m_similarUnits;
 
 	// array for unit distribution
 	unsigned long *m_upgrades;
@@ -517,10 +720,15 @@ private:
 	// pointer to replay map
 	ReplayMapAnimated *m_mapAnim;
 
-	// map surface for map coverage
-	MapSurface *m_mapSurface;
-	int m_mapDividerX;
-	int m_mapDividerY;
+	// actions queued for that player (indexes in replay action list)
+	MemoryBlock m_queued;
+	int m_currentAction;
+
+	// map actions waiting to be merged in replay map (ReplayMapPending)
+	MemoryBlock m_pendingMap;
+
+	// map coverage
+	CoverageGrid *m_coverage;
 
 	// apm standard dev
 	mutable int m_apmDev;
@@ -561,12 +769,14 @@ private:
 
 	// special stuff to do for some actions
 	bool _HandleSelection(const IStarcraftAction *action);
+	void _AddCheckpoints(unsigned long time);
+	void _LogSelection(unsigned long time);
+	void _PostUnits(const IStarcraftAction *action);
 	bool _UpdateSelection(const BWrepActionSelect::Params *p, unsigned long time);
 	int _HandleBuild(const IStarcraftAction *action, int& bx, int& by);
-	void _AdjustData(const IStarcraftAction *action, int& actionID, int &unitID, const char * &parameters, int& subcmd );
-	bool _IsValidBuildEvent(ReplayEvt *evt, ReplayEvt *prevEvt, int unitID);
-	bool _IsValidTrainEvent(ReplayEvt *evt, ReplayEvt *prevEvt, int unitID);
-	bool _IsValidUpgradeEvent(ReplayEvt *evt, ReplayEvt *prevEvt, int techID);
+	void _AdjustData(const IStarcraftAction *action, int& actionID, int &unitID, int& subcmd );
+	bool _ClassifyEvent(const IStarcraftAction *action, int objectID, int bx, int by, bool invalid, int& revoked);
+	static int _GetEAPMKind(int actionID);
 	int _ActionPerMinute(unsigned long time, int eventCount) const;
 	int _BuildActionPerMinute(const IStarcraftAction *action, const ReplayEvt *prevEvt,bool bIsValidEvent);
 	int _TrainActionPerMinute(const ReplayEvt *evt, const ReplayEvt *prevEvt,bool bIsValidEvent);
@@ -581,10 +791,14 @@ private:
 
 	// add actions
 	void _AddBuilding(int idx, int x, int y, unsigned long time);
+	void _AddMapAction(int kind, const ReplayMapAction& act);
 
 	// to call when event is finished creating
 	void _Complete(ReplayEvt *evt, int currentSelection);
 
+	// decode timeline in working slots
+	void _ExpandResources();
+
 public:
 	ReplayEvtList(Replay *replay, ReplayMapAnimated *mapAnim, const char *playername, int id, int race);
 	~ReplayEvtList();
@@ -592,11 +806,21 @@ public:
 	// process map coverage
 	void ProcessMapCoverage(unsigned long actime);
 
-	// get resource from time
-	ReplayResource *GetResourceFromIdx(int idx) {return &m_resources[idx];}
-	ReplayResource *GetResource(unsigned long tick) {return &m_resources[tick/RES_INTERVAL_TICK];}
-	ReplayResource *GetPrevResource(unsigned long tick) {return &m_resources[(tick/RES_INTERVAL_TICK)-1];}
+	// get working resource slot from time (the timeline is decoded again if it was compacted,
+	// slots after the end of the game map to the last one, GetPrevResource returns 0 for the first slot)
+	ReplayResource *GetResourceFromIdx(int idx);
+	ReplayResource *GetResource(unsigned long tick) {return GetResourceFromIdx(Time2Slot(tick));}
+	ReplayResource *GetPrevResource(unsigned long tick) {return tick<RES_INTERVAL_TICK ? 0 : GetResourceFromIdx(Time2Slot(tick)-1);}
 	void InitResource(unsigned long tick);
+
+	// read resource for a slot (use the same cursor to read consecutive slots)
+	const ReplayResource& ReadResource(ReplayTimeline::Cursor& cursor, int slot) const;
+
+	// move working slots to the timeline
+	void CompactResources();
+
+	// min/max/sum of resource values per bucket (built on first use)
+	const ReplayPyramid& GetPyramid() const;
 	int GetSlotCount() const;
 	int Time2Slot(unsigned long tick) const {return tick/RES_INTERVAL_TICK;}
 	unsigned long Slot2Time(int slot) const {return slot>=0 ? slot*RES_INTERVAL_TICK : 0;}
@@ -625,14 +849,29 @@ public:
 	int GetMacroAPM() const;
 
 	// hot key events
-	unsigned long GetHKEventCount() const {return m_hkevents.GetCount();}
-	const HotKeyEvent *GetHKEvent(int idx) const {return (const HotKeyEvent *)m_hkevents.GetPtr(idx*sizeof(HotKeyEvent));}
+	unsigned long GetHKEventCount() const {return m_hklog.GetCount();}
+	const HotKeyEvent *GetHKEvent(int idx) const {return m_hklog.GetEvent(idx);}
+	const HotKeyLog& GetHotKeyLog() const {return m_hklog;}
+
+	// hot key slot statistics, recalls per minute of game
+	const HotKeySlotStats& GetHotKeyStats(int slot) const {return m_hklog.GetSlotStats(slot);}
+	double GetHotKeyRecallRate(int slot) const;
 	unsigned long GetHKEventTimeMax() const {return GetHKEventCount()==0?0:GetHKEvent(GetHKEventCount()-1)->m_time;}
 	bool IsHotKeyUsed(int slot) const {return m_hotkeyIsUsed[slot];}
 
 
+	// queue action for that player (processed later by ProcessQueuedActions)
+	void QueueAction(int actionIdx) {m_queued.Add(&actionIdx,sizeof(actionIdx));}
+	int GetQueuedCount() const {return m_queued.GetCount();}
+	void ProcessQueuedActions(const IStarcraftActionList *actions);
+
+	// map actions recorded while processing queued actions
+	int GetPendingMapCount() const {return m_pendingMap.GetCount();}
+	const ReplayMapPending *GetPendingMap(int i) const {return (const ReplayMapPending *)m_pendingMap.GetPtr(i*sizeof(ReplayMapPending));}
+	void ClearPendingMap() {m_pendingMap.Clear();}
+
 	// add actions
-	unsigned long AddEvent(IStarcraftAction *action, const char* &parameters);
+	unsigned long AddEvent(IStarcraftAction *action);
 	void AddUnit(int idx, unsigned long time);
 	void AddEvtType(int idx, bool eventValidForAPM);
 	void AddUpgrade(int idx);
@@ -654,6 +893,9 @@ public:
 	const ReplayEvt* GetEvent(unsigned long i) const {return (const ReplayEvt*)(m_events.GetPtr(i*sizeof(ReplayEvt)));}
 	ReplayEvt* GetEvent(unsigned long i) {return (ReplayEvt*)(m_events.GetPtr(i*sizeof(ReplayEvt)));}
 
+	// get action for an event of that list
+	const IStarcraftAction *GetEvtAction(const ReplayEvt *evt) const;
+
 	// get max number of indexes for a distribution
 	int GetDistMax(int type) const 
 	{
@@ -720,9 +962,6 @@ public:
 	int GetValidActionPerMinute() const {return GetActionPerMinute(true);}
 
 	// similar units
-	void IncSimilar() {m_similarUnits++;}
-	void ResetSimilar() {m_similarUnits=0;}
-	int GetSimilar() const {return m_similarUnits;}
 
 	// selected units
 	void AddToSelection(short unitid); 
@@ -731,6 +970,12 @@ public:
 	int GetSelectionForHatch(int unitType, unsigned long now) const;
 	short GetSelectedUnitID(int i) const {return i<m_currentSelection ? m_selectedUnits[i] : -1;}
 
+	// selection and hot keys at any time (thread safe once analysis is done)
+	void GetPlayerState(unsigned long time, ReplayPlayerState& state) const;
+
+	// actions referencing a unit, in action order (returns the number of actions, stores at most maxPostings)
+	int GetUnitHistory(short unitID, ReplayUnitPosting *postings, int maxPostings) const;
+
 	// assign hotkey
 	void AssignHotKey(int slot, unsigned long time);
 	void SelectHotKey(int slot, unsigned long time);
@@ -745,11 +990,11 @@ public:
 	// build order for upgrades
 	const ReplayObjectSequence& GetBuildOrderUpgrade() const {return m_bo.Upgrade();}
 
-	// get final build order as a string
-	void GetFinalBuildOrder(CString& bo);
+	// get final build order as a string, and the time of its nodes (4 hex digits per node, in seconds)
+	void GetFinalBuildOrder(CString& bo, CString& times);
 
-	// adjust all actions addresses
-	void AdjustActionPointers(char *oldbase, char *newbase);
+	// downsampled curves of the player (apm, supply, workers & army trained)
+	void GetSparkline(ReplaySparkline& spark);
 
 	// return name of orginial object name for a suspect event
 	bool GetSuspectEventOrigin(const IStarcraftAction *action, CString& origin, bool hhmmss);
@@ -764,13 +1009,19 @@ public:
 class Replay
 {
 private:
+	// memory for all player data, released in one go when the replay is cleared
+	Arena m_arena;
+
 	// list of ReplayEvtList objects
 	XObArray m_players; 
 	XObArray m_deletedPlayers; 
 	int *m_listref;
 
-	// enabled actions (IStarcraftAction* objects)
-	MemoryBlock m_enabledActions;
+	// bitmaps over actions (categories, suspect, hack, then one per event list in m_bitmapLists)
+	// and enabled actions selected from them
+	enum {BM_SELECT,BM_BUILD,BM_TRAIN,BM_CHAT,BM_OTHERS,BM_SUSPECT,BM_HACK,__BM_LISTS};
+	ActionBitmapIndex m_actionBitmaps;
+	MemoryBlock m_bitmapLists; // block with all ReplayEvtList* owning actions
 
 	// filter for enabled actions
 	int m_filter;
@@ -789,6 +1040,9 @@ private:
 	int m_apmStyle;
 	int m_mapStyle;
 
+	// map coverage grid size
+	int m_coverageSide;
+
 	IStarcraftReplay *m_gfile;
 	CString m_filename;
 	unsigned long m_timeEnd;
@@ -797,11 +1051,14 @@ private:
 	mutable unsigned long m_lastBOTime;
 	mutable unsigned long m_lastHKEventTimeMax;
 	int m_overalActionCount;
-	ReplayEvtList *m_currentlist;
 
 	// animated map
 	ReplayMapAnimated *m_mapAnim;
 
+	// index of actions with a map position
+	ActionSpatialIndex *m_spatial;
+	void _IndexAction(int actionIdx, const IStarcraftAction *action);
+
 	// returns true if we have event for a player 
 	bool _HaveEventsForPlayer(const char *name, const CStringArray& existingPlayers) const;
 	void _GetUniquePlayerName(CString& playerName, const CStringArray& existingPlayers);
@@ -811,6 +1068,10 @@ private:
 
 	// rebuild enabled action list
 	void _BuildEnableActionList();
+	void _BuildActionBitmaps();
+	// events are marked before the bitmaps are built (they read the marks)
+	void _SetSuspect(ReplayEvt *evt) {m_suspectCount++; evt->SetSuspect();}
+	void _SetHack(ReplayEvt *evt) {m_hackCount++; evt->SetHack();}
 
 	// mark suspicious events
 	void _MarkSuspiciousEvents();
@@ -821,17 +1082,27 @@ private:
 	// get previous player action
 	const IStarcraftAction *_GetPreviousPlayerAction(int i, int playerID) const;
 
-	unsigned long _AddEvent(IStarcraftAction *action, const char *playername, int race, const char* &parameters);
+	void _QueueEvent(int actionIdx, unsigned long time, const char *playername, int race);
 	void _Sort();
-	void _CreateTileset();
+	bool _CreateTileset();
+	MapAssetRecord *_ExtractMapAssets() const;
 	void _ClearMaps();
 	void _ComputeActionDistribution();
 	ReplayEvtList *_GetListFromPlayerName(const char *playername, int race);
 
+	// per player analysis (players are independent, so each one runs on its own worker)
+	enum {TASK_EVENTS=1,TASK_COVERAGE=2,TASK_APM=4,TASK_TIMELINE=8,TASK_STATE=16};
+	void _AnalyzePlayers(int first, int tasks, unsigned long time=0, ReplayPlayerState *states=0);
+	void _AnalyzePlayer(ReplayEvtList *list, int tasks);
+	static UINT _AnalysisWorker(LPVOID param);
+
+	// merge map actions recorded by every player into replay map
+	void _MergeMapActions();
+
 public:
-	Replay() : m_timeEnd(0), m_lastBOTime(0), m_lastHKEventTimeMax(0), m_Done(false), m_mapAnim(0), m_gfile(0),
-		m_listref(0), m_filter(FLT_ALL), m_isRWA(false), m_apmStyle(APM_MEDIUM), m_mapStyle(APM_MEDIUM), m_suspectCount(0), m_hackCount(0) {}
-	~Replay() { delete m_mapAnim; delete[]m_listref;if(m_gfile!=0) m_gfile->Release();m_gfile=0;}
+	Replay() : m_timeEnd(0), m_lastBOTime(0), m_lastHKEventTimeMax(0), m_Done(false), m_mapAnim(0), m_spatial(0), m_gfile(0),
+		m_listref(0), m_filter(FLT_ALL), m_isRWA(false), m_apmStyle(APM_MEDIUM), m_mapStyle(APM_MEDIUM), m_coverageSide(MAPCOVERAGE_SIDE), m_suspectCount(0), m_hackCount(0) {}
+	~Replay() { delete m_mapAnim; delete m_spatial; delete[]m_listref;if(m_gfile!=0) m_gfile->Release();m_gfile=0;}
 
 	// load replay
 	int Load(const char *filename, bool buildEnActionList, class CListCtrl *listv, bool bClear);
@@ -851,6 +1122,13 @@ public:
 	// get file name
 	const char *GetFileName() const {return m_filename;}
 
+	// replay arena
+	Arena *GetArena() {return &m_arena;}
+
+	// map coverage grid size (cells per side, for replays loaded after the call)
+	void SetCoverageSide(int side) {m_coverageSide = max(1,min(side,COVERAGE_MAXSIDE));}
+	int GetCoverageSide() const {return m_coverageSide;}
+
 	// get event list for one player
 	ReplayEvtList* GetEvtList(int i) {return (ReplayEvtList*)m_players.GetAt(i);}
 	const ReplayEvtList* GetEvtList(int i) const {return (ReplayEvtList*)m_players.GetAt(i);}
@@ -859,6 +1137,10 @@ public:
 	// return object id from any unit id
 	bool GetAnyObjectID(short unitID, unsigned long time, short *objID);
 
+	// selection and hot keys of every player at any time, sampled in parallel
+	// (states must hold GetPlayerCount() entries)
+	void GetPlayerStates(unsigned long time, ReplayPlayerState *states) {_AnalyzePlayers(0,TASK_STATE,time,states);}
+
 	// clear everything
 	void Clear();
 
@@ -884,6 +1166,16 @@ public:
 	// game animated map
 	ReplayMapAnimated *GetMapAnim() const {return m_mapAnim;}
 
+	// index of moves, attacks, builds and minimap pings (0 if there is no map), built once per load
+	const ActionSpatialIndex *GetSpatialIndex() const {return m_spatial;}
+
+	// actions with a map position in rectangle [x1,x2]x[y1,y2] (pixels) and time range [t1,t2], by the
+	// given players (bit per player id) and of the given kinds (ActionSpatialIndex bits). Returns the number
+	// of matching actions, their indices in the action list go in results if there are no more than maxResults
+	int QueryActions(int x1, int y1, int x2, int y2, unsigned long t1, unsigned long t2,
+		unsigned long players, int kinds, int *results, int maxResults) const
+		{return m_spatial==0 ? 0 : m_spatial->Query(x1,y1,x2,y2,t1,t2,players,kinds,results,maxResults);}
+
 	// get time of latest action in the build orders
 	unsigned long GetLastBuildOrderTime() const 
 	{
@@ -946,8 +1238,8 @@ public:
 	void EnablePlayer(ReplayEvtList *list, bool val);
 
 	// get action from enabled players only
-	const IStarcraftAction *GetEnAction(int iItemIndx) const {return *((const IStarcraftAction **)m_enabledActions.GetPtr(iItemIndx*sizeof(IStarcraftAction *)));}
-	unsigned long GetEnActionCount() const {return m_enabledActions.GetCount();}
+	const IStarcraftAction *GetEnAction(int iItemIndx) const {return QueryFile()->QueryActions()->GetAction(m_actionBitmaps.GetAt(iItemIndx));}
+	unsigned long GetEnActionCount() const {return m_actionBitmaps.GetCount();}
 
 	// find next suspect event
 	int GetNextSuspectEvent(int selectedAction);
@@ -0,0 +1,515 @@
+// replaybitmap.cpp : implementation of the ReplayBitmap and ReplayFilterIndex classes
+//
+
+#include "replaybitmap.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define WORDBITS 64
+#define BITSETWORDS 1024 // 64K bits
+#define ARRAYMAX 4096 // bigger containers are bitsets
+
+enum {OP_OR, OP_AND, OP_ANDNOT};
+
+//---------------------------------------------------------------------------------------
+
+ReplayBitmap::ReplayBitmap() : m_containers(0), m_count(0), m_size(0)
+{
+}
+
+ReplayBitmap::ReplayBitmap(const ReplayBitmap& src) : m_containers(0), m_count(0), m_size(0)
+{
+	*this = src;
+}
+
+ReplayBitmap::~ReplayBitmap()
+{
+	Clear();
+}
+
+ReplayBitmap& ReplayBitmap::operator=(const ReplayBitmap& src)
+{
+	if(this==&src) return *this;
+	Clear();
+	for(int i=0;i<src.m_count;i++)
+	{
+		Container c;
+		_Copy(c,src.m_containers[i]);
+		_Append(c);
+	}
+	return *this;
+}
+
+void ReplayBitmap::Clear()
+{
+	for(int i=0;i<m_count;i++) _Free(m_containers[i]);
+	free(m_containers);
+	m_containers=0;
+	m_count=m_size=0;
+}
+
+int ReplayBitmap::_PopCount(ReplayBitmapWord w)
+{
+#if defined(__GNUC__)
+	return __builtin_popcountll(w);
+#else
+	// no popcnt instruction on every cpu
+	w = w - ((w>>1) & 0x5555555555555555ui64);
+	w = (w & 0x3333333333333333ui64) + ((w>>2) & 0x3333333333333333ui64);
+	w = (w + (w>>4)) & 0x0F0F0F0F0F0F0F0Fui64;
+	return (int)((w*0x0101010101010101ui64)>>56);
+#endif
+}
+
+//---------------------------------------------------------------------------------------
+
+void ReplayBitmap::_Copy(Container& dst, const Container& src)
+{
+	dst = src;
+	if(src.m_bits!=0)
+	{
+		dst.m_bits = (ReplayBitmapWord*)malloc(BITSETWORDS*sizeof(ReplayBitmapWord));
+		memcpy(dst.m_bits,src.m_bits,BITSETWORDS*sizeof(ReplayBitmapWord));
+	}
+	else
+	{
+		dst.m_size = src.m_card>0 ? src.m_card : 1;
+		dst.m_array = (unsigned short*)malloc(dst.m_size*sizeof(unsigned short));
+		memcpy(dst.m_array,src.m_array,src.m_card*sizeof(unsigned short));
+	}
+}
+
+void ReplayBitmap::_Free(Container& c)
+{
+	free(c.m_array);
+	free(c.m_bits);
+	c.m_array=0;
+	c.m_bits=0;
+}
+
+void ReplayBitmap::_ToBitset(Container& c)
+{
+	if(c.m_bits!=0) return;
+	c.m_bits = (ReplayBitmapWord*)malloc(BITSETWORDS*sizeof(ReplayBitmapWord));
+	memset(c.m_bits,0,BITSETWORDS*sizeof(ReplayBitmapWord));
+	for(int i=0;i<c.m_card;i++) c.m_bits[c.m_array[i]/WORDBITS] |= (ReplayBitmapWord)1<<(c.m_array[i]%WORDBITS);
+	free(c.m_array);
+	c.m_array=0;
+	c.m_size=0;
+}
+
+void ReplayBitmap::_ToArray(Container& c)
+{
+	if(c.m_bits==0) return;
+	c.m_size = c.m_card>0 ? c.m_card : 1;
+	c.m_array = (unsigned short*)malloc(c.m_size*sizeof(unsigned short));
+	int n=0;
+	for(int w=0;w<BITSETWORDS;w++)
+		for(ReplayBitmapWord bits=c.m_bits[w];bits!=0;bits&=bits-1)
+			c.m_array[n++] = (unsigned short)(w*WORDBITS+_PopCount((bits&(0-bits))-1));
+	assert(n==c.m_card);
+	free(c.m_bits);
+	c.m_bits=0;
+}
+
+// small bitsets become arrays again
+void ReplayBitmap::_Normalize(Container& c)
+{
+	if(c.m_bits!=0 && c.m_card<=ARRAYMAX) _ToArray(c);
+}
+
+bool ReplayBitmap::_Test(const Container& c, unsigned int low)
+{
+	if(c.m_bits!=0) return (c.m_bits[low/WORDBITS]>>(low%WORDBITS)&1)!=0;
+	int lo=0, hi=c.m_card-1;
+	while(lo<=hi)
+	{
+		int mid=(lo+hi)/2;
+		if(c.m_array[mid]==low) return true;
+		if(c.m_array[mid]<low) lo=mid+1; else hi=mid-1;
+	}
+	return false;
+}
+
+// container operation (containers have the same key)
+void ReplayBitmap::_Op(Container& c, const Container& other, int op)
+{
+	int i,j,n;
+
+	if(c.m_bits==0 && other.m_bits==0)
+	{
+		// merge sorted arrays
+		int size = op==OP_OR ? c.m_card+other.m_card : c.m_card;
+		unsigned short *out = (unsigned short*)malloc((size>0 ? size : 1)*sizeof(unsigned short));
+		for(i=0,j=0,n=0;i<c.m_card || j<other.m_card;)
+		{
+			if(j==other.m_card || (i<c.m_card && c.m_array[i]<other.m_array[j]))
+			{
+				if(op!=OP_AND) out[n++]=c.m_array[i];
+				i++;
+			}
+			else if(i==c.m_card || other.m_array[j]<c.m_array[i])
+			{
+				if(op==OP_OR) out[n++]=other.m_array[j];
+				else if(i==c.m_card) break;
+				j++;
+			}
+			else
+			{
+				if(op!=OP_ANDNOT) out[n++]=c.m_array[i];
+				i++; j++;
+			}
+		}
+		free(c.m_array);
+		c.m_array=out;
+		c.m_size=size>0 ? size : 1;
+		c.m_card=n;
+		if(c.m_card>ARRAYMAX) _ToBitset(c);
+	}
+	else if(c.m_bits==0 && op!=OP_OR)
+	{
+		// array and bitset: keep what the bitset has (or hasnt)
+		for(i=0,n=0;i<c.m_card;i++)
+			if(_Test(other,c.m_array[i])==(op==OP_AND))
+				c.m_array[n++]=c.m_array[i];
+		c.m_card=n;
+	}
+	else if(op==OP_AND && other.m_bits==0)
+	{
+		// bitset and array: result is part of the array
+		unsigned short *out = (unsigned short*)malloc((other.m_card>0 ? other.m_card : 1)*sizeof(unsigned short));
+		for(i=0,n=0;i<other.m_card;i++)
+			if(_Test(c,other.m_array[i]))
+				out[n++]=other.m_array[i];
+		free(c.m_bits);
+		c.m_bits=0;
+		c.m_array=out;
+		c.m_size=other.m_card>0 ? other.m_card : 1;
+		c.m_card=n;
+	}
+	else
+	{
+		// work on bitsets
+		_ToBitset(c);
+		if(other.m_bits!=0)
+		{
+			if(op==OP_OR) for(i=0;i<BITSETWORDS;i++) c.m_bits[i] |= other.m_bits[i];
+			else if(op==OP_AND) for(i=0;i<BITSETWORDS;i++) c.m_bits[i] &= other.m_bits[i];
+			else for(i=0;i<BITSETWORDS;i++) c.m_bits[i] &= ~other.m_bits[i];
+		}
+		else
+		{
+			for(i=0;i<other.m_card;i++)
+			{
+				ReplayBitmapWord bit = (ReplayBitmapWord)1<<(other.m_array[i]%WORDBITS);
+				if(op==OP_OR) c.m_bits[other.m_array[i]/WORDBITS] |= bit;
+				else c.m_bits[other.m_array[i]/WORDBITS] &= ~bit;
+			}
+		}
+		for(i=0,n=0;i<BITSETWORDS;i++) n+=_PopCount(c.m_bits[i]);
+		c.m_card=n;
+		_Normalize(c);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+
+// index of container with that key, or -(insertion index)-1
+int ReplayBitmap::_Find(unsigned int key) const
+{
+	int lo=0, hi=m_count-1;
+	while(lo<=hi)
+	{
+		int mid=(lo+hi)/2;
+		if(m_containers[mid].m_key==key) return mid;
+		if(m_containers[mid].m_key<key) lo=mid+1; else hi=mid-1;
+	}
+	return -lo-1;
+}
+
+ReplayBitmap::Container *ReplayBitmap::_Insert(int idx, unsigned int key)
+{
+	if(m_count==m_size)
+	{
+		m_size = m_size==0 ? 4 : m_size*2;
+		m_containers = (Container*)realloc(m_containers,m_size*sizeof(Container));
+	}
+	memmove(m_containers+idx+1,m_containers+idx,(m_count-idx)*sizeof(Container));
+	m_count++;
+
+	Container *c = &m_containers[idx];
+	c->m_key=key;
+	c->m_card=0;
+	c->m_size=4;
+	c->m_array=(unsigned short*)malloc(c->m_size*sizeof(unsigned short));
+	c->m_bits=0;
+	return c;
+}
+
+void ReplayBitmap::_Append(const Container& c)
+{
+	if(m_count==m_size)
+	{
+		m_size = m_size==0 ? 4 : m_size*2;
+		m_containers = (Container*)realloc(m_containers,m_size*sizeof(Container));
+	}
+	m_containers[m_count++]=c;
+}
+
+void ReplayBitmap::Add(unsigned int row)
+{
+	unsigned int key = row>>16;
+	unsigned short low = (unsigned short)(row&0xFFFF);
+
+	// rows are mostly added in increasing order, try last container first
+	Container *c;
+	if(m_count>0 && m_containers[m_count-1].m_key==key) c=&m_containers[m_count-1];
+	else
+	{
+		int idx=_Find(key);
+		c = idx>=0 ? &m_containers[idx] : _Insert(-idx-1,key);
+	}
+
+	if(c->m_bits!=0)
+	{
+		ReplayBitmapWord bit = (ReplayBitmapWord)1<<(low%WORDBITS);
+		if((c->m_bits[low/WORDBITS]&bit)==0) {c->m_bits[low/WORDBITS]|=bit; c->m_card++;}
+		return;
+	}
+
+	// find position in array
+	int pos=c->m_card;
+	if(pos>0 && c->m_array[pos-1]>=low)
+	{
+		int lo=0, hi=c->m_card-1;
+		while(lo<=hi)
+		{
+			int mid=(lo+hi)/2;
+			if(c->m_array[mid]==low) return;
+			if(c->m_array[mid]<low) lo=mid+1; else hi=mid-1;
+		}
+		pos=lo;
+	}
+
+	if(c->m_card==c->m_size)
+	{
+		c->m_size*=2;
+		c->m_array=(unsigned short*)realloc(c->m_array,c->m_size*sizeof(unsigned short));
+	}
+	memmove(c->m_array+pos+1,c->m_array+pos,(c->m_card-pos)*sizeof(unsigned short));
+	c->m_array[pos]=low;
+	c->m_card++;
+	if(c->m_card>ARRAYMAX) _ToBitset(*c);
+}
+
+bool ReplayBitmap::Contains(unsigned int row) const
+{
+	int idx=_Find(row>>16);
+	return idx>=0 && _Test(m_containers[idx],row&0xFFFF);
+}
+
+int ReplayBitmap::GetCardinality() const
+{
+	int card=0;
+	for(int i=0;i<m_count;i++) card+=m_containers[i].m_card;
+	return card;
+}
+
+int ReplayBitmap::ToArray(unsigned int *rows) const
+{
+	int n=0;
+	for(int i=0;i<m_count;i++)
+	{
+		const Container& c = m_containers[i];
+		unsigned int high = c.m_key<<16;
+		if(c.m_bits==0)
+			for(int k=0;k<c.m_card;k++) rows[n++] = high|c.m_array[k];
+		else
+			for(int w=0;w<BITSETWORDS;w++)
+				for(ReplayBitmapWord bits=c.m_bits[w];bits!=0;bits&=bits-1)
+					rows[n++] = high|(w*WORDBITS+_PopCount((bits&(0-bits))-1));
+	}
+	return n;
+}
+
+//---------------------------------------------------------------------------------------
+
+void ReplayBitmap::Or(const ReplayBitmap& other)
+{
+	if(this==&other || other.m_count==0) return;
+
+	// merge containers by key
+	Container *old = m_containers;
+	int count = m_count;
+	m_containers=0; m_count=m_size=0;
+	int i=0, j=0;
+	while(i<count || j<other.m_count)
+	{
+		if(j==other.m_count || (i<count && old[i].m_key<other.m_containers[j].m_key))
+			_Append(old[i++]);
+		else if(i==count || other.m_containers[j].m_key<old[i].m_key)
+		{
+			Container c;
+			_Copy(c,other.m_containers[j++]);
+			_Append(c);
+		}
+		else
+		{
+			_Op(old[i],other.m_containers[j++],OP_OR);
+			_Append(old[i++]);
+		}
+	}
+	free(old);
+}
+
+void ReplayBitmap::And(const ReplayBitmap& other)
+{
+	if(this==&other) return;
+
+	int i=0, j=0, n=0;
+	for(;i<m_count;i++)
+	{
+		// container without counterpart goes away
+		while(j<other.m_count && other.m_containers[j].m_key<m_containers[i].m_key) j++;
+		if(j==other.m_count || other.m_containers[j].m_key!=m_containers[i].m_key) {_Free(m_containers[i]); continue;}
+		_Op(m_containers[i],other.m_containers[j],OP_AND);
+		if(m_containers[i].m_card==0) _Free(m_containers[i]);
+		else m_containers[n++]=m_containers[i];
+	}
+	m_count=n;
+}
+
+void ReplayBitmap::AndNot(const ReplayBitmap& other)
+{
+	if(this==&other) {Clear(); return;}
+
+	int i=0, j=0, n=0;
+	for(;i<m_count;i++)
+	{
+		while(j<other.m_count && other.m_containers[j].m_key<m_containers[i].m_key) j++;
+		if(j<other.m_count && other.m_containers[j].m_key==m_containers[i].m_key)
+			_Op(m_containers[i],other.m_containers[j],OP_ANDNOT);
+		if(m_containers[i].m_card==0) _Free(m_containers[i]);
+		else m_containers[n++]=m_containers[i];
+	}
+	m_count=n;
+}
+
+//---------------------------------------------------------------------------------------
+
+ReplayFilterIndex::ReplayFilterIndex() : m_rowNames(0), m_rowSize(0)
+{
+	memset(&m_maps,0,sizeof(m_maps));
+	memset(&m_names,0,sizeof(m_names));
+}
+
+ReplayFilterIndex::~ReplayFilterIndex()
+{
+	Clear();
+}
+
+void ReplayFilterIndex::Clear()
+{
+	int i;
+	m_all.Clear();
+	for(i=0;i<MAXMATCHUPS;i++) m_matchups[i].Clear();
+	m_rwa.Clear();
+	m_hacked.Clear();
+	for(i=0;i<=MAXPLAYERS;i++) m_playerCounts[i].Clear();
+	_FreeRows(m_maps);
+	_FreeRows(m_names);
+	free(m_rowNames);
+	m_rowNames=0;
+	m_rowSize=0;
+}
+
+void ReplayFilterIndex::_FreeRows(IdRows& ids)
+{
+	for(int i=0;i<ids.m_count;i++) delete ids.m_rows[i];
+	free(ids.m_rows);
+	memset(&ids,0,sizeof(ids));
+}
+
+void ReplayFilterIndex::_AddRow(IdRows& ids, int id, int row)
+{
+	if(id<0) return;
+	if(id>=ids.m_size)
+	{
+		int size = ids.m_size==0 ? 1024 : ids.m_size*2;
+		while(size<=id) size*=2;
+		ids.m_rows = (ReplayBitmap**)realloc(ids.m_rows,size*sizeof(ReplayBitmap*));
+		memset(ids.m_rows+ids.m_size,0,(size-ids.m_size)*sizeof(ReplayBitmap*));
+		ids.m_size=size;
+	}
+	if(id>=ids.m_count) ids.m_count=id+1;
+	if(ids.m_rows[id]==0) ids.m_rows[id]=new ReplayBitmap;
+	ids.m_rows[id]->Add(row);
+}
+
+void ReplayFilterIndex::AddRow(int row, int matchup, bool rwa, bool hacked, int mapId, const int *playerIds, int playerCount)
+{
+	assert(row>=0);
+	if(playerCount>MAXPLAYERS) playerCount=MAXPLAYERS;
+	if(playerCount<0) playerCount=0;
+
+	m_all.Add(row);
+	if(matchup>=0 && matchup<MAXMATCHUPS) m_matchups[matchup].Add(row);
+	if(rwa) m_rwa.Add(row);
+	if(hacked) m_hacked.Add(row);
+	m_playerCounts[playerCount].Add(row);
+	_AddRow(m_maps,mapId,row);
+
+	// player names of row
+	if(row>=m_rowSize)
+	{
+		int size = m_rowSize==0 ? 1024 : m_rowSize*2;
+		while(size<=row) size*=2;
+		m_rowNames = (int*)realloc(m_rowNames,size*MAXPLAYERS*sizeof(int));
+		memset(m_rowNames+m_rowSize*MAXPLAYERS,0xFF,(size-m_rowSize)*MAXPLAYERS*sizeof(int));
+		m_rowSize=size;
+	}
+	for(int k=0,slot=0;k<playerCount;k++)
+	{
+		if(playerIds[k]<0) continue;
+		m_rowNames[row*MAXPLAYERS+slot++]=playerIds[k];
+		_AddRow(m_names,playerIds[k],row);
+	}
+}
+
+void ReplayFilterIndex::_Select(const IdRows& ids, const bool *selected, ReplayBitmap& result)
+{
+	result.Clear();
+	for(int id=0;id<ids.m_count;id++)
+		if(selected[id] && ids.m_rows[id]!=0) result.Or(*ids.m_rows[id]);
+}
+
+void ReplayFilterIndex::SelectMaps(const bool *selected, ReplayBitmap& result) const
+{
+	_Select(m_maps,selected,result);
+}
+
+void ReplayFilterIndex::SelectPlayers(const bool *selected, int minCount, ReplayBitmap& result) const
+{
+	if(minCount<=0) {result=m_all; return;}
+
+	// rows with at least one of the names
+	ReplayBitmap candidates;
+	_Select(m_names,selected,candidates);
+	if(minCount==1) {result=candidates; return;}
+
+	// count players with one of the names in each candidate row
+	result.Clear();
+	int count = candidates.GetCardinality();
+	unsigned int *rows = (unsigned int*)malloc((count>0 ? count : 1)*sizeof(unsigned int));
+	candidates.ToArray(rows);
+	for(int i=0;i<count;i++)
+	{
+		const int *names = m_rowNames+rows[i]*MAXPLAYERS;
+		int found=0;
+		for(int k=0;k<MAXPLAYERS && names[k]>=0;k++)
+			if(selected[names[k]]) found++;
+		if(found>=minCount) result.Add(rows[i]);
+	}
+	free(rows);
+}
@@ -0,0 +1,141 @@
+// replaybitmap.h : interface of the ReplayBitmap and ReplayFilterIndex classes
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __REPLAYBITMAP_H
+#define __REPLAYBITMAP_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+//--------------------------------------------------------------------------------------
+
+#ifdef _WIN32
+typedef unsigned __int64 ReplayBitmapWord;
+#else
+typedef unsigned long long ReplayBitmapWord;
+#endif
+
+// Compressed set of row numbers.
+//
+// Rows are split in chunks of 64K by their high 16 bits, and every chunk that isnt
+// empty has a container: a sorted array of the low 16 bits while it has up to 4096
+// rows, a bitset of 64K bits (8 KB) when it has more. Sparse sets (a player, a map)
+// stay small and dense ones (a matchup) are combined a word at a time.
+//
+class ReplayBitmap
+{
+public:
+	ReplayBitmap();
+	ReplayBitmap(const ReplayBitmap& src);
+	~ReplayBitmap();
+	ReplayBitmap& operator=(const ReplayBitmap& src);
+
+	void Clear();
+	void Add(unsigned int row);
+	bool Contains(unsigned int row) const;
+	int GetCardinality() const;
+
+	// set operations (result in this bitmap)
+	void Or(const ReplayBitmap& other);
+	void And(const ReplayBitmap& other);
+	void AndNot(const ReplayBitmap& other);
+
+	// copy rows in increasing order (rows must have room for GetCardinality() values), returns count
+	int ToArray(unsigned int *rows) const;
+
+private:
+	struct Container
+	{
+		unsigned int m_key; // high 16 bits of rows
+		int m_card; // number of rows
+		int m_size; // array capacity (0 for a bitset)
+		unsigned short *m_array;
+		ReplayBitmapWord *m_bits;
+	};
+
+	Container *m_containers;
+	int m_count;
+	int m_size;
+
+	int _Find(unsigned int key) const;
+	Container *_Insert(int idx, unsigned int key);
+	void _Append(const Container& c);
+
+	static void _Copy(Container& dst, const Container& src);
+	static void _Free(Container& c);
+	static void _ToBitset(Container& c);
+	static void _ToArray(Container& c);
+	static void _Normalize(Container& c);
+	static bool _Test(const Container& c, unsigned int low);
+	static void _Op(Container& c, const Container& other, int op);
+	static int _PopCount(ReplayBitmapWord w);
+};
+
+//--------------------------------------------------------------------------------------
+
+// Bitmaps of replay rows for the browser filters: all rows, rows by matchup, RWA
+// flag, hack flag and number of players, and rows by map and player name id (ids of
+// the application name table). Player name ids of each row are kept too, to count
+// how many players of a replay match a name filter.
+//
+class ReplayFilterIndex
+{
+public:
+	enum {MAXPLAYERS=8, MAXMATCHUPS=8};
+
+	ReplayFilterIndex();
+	~ReplayFilterIndex();
+
+	void Clear();
+
+	// add a row (rows are added in increasing order, -1 for unknown name ids)
+	void AddRow(int row, int matchup, bool rwa, bool hacked, int mapId, const int *playerIds, int playerCount);
+
+	// rows by property
+	const ReplayBitmap& GetAll() const {return m_all;}
+	const ReplayBitmap& GetMatchup(int mu) const {return m_matchups[mu];}
+	const ReplayBitmap& GetRWA() const {return m_rwa;}
+	const ReplayBitmap& GetHacked() const {return m_hacked;}
+	const ReplayBitmap& GetPlayerCount(int count) const {return m_playerCounts[count];}
+
+	// map and player name ids of rows are below these
+	int GetMapIdCount() const {return m_maps.m_count;}
+	int GetNameIdCount() const {return m_names.m_count;}
+	bool HasMap(int id) const {return m_maps.m_rows[id]!=0;}
+	bool HasName(int id) const {return m_names.m_rows[id]!=0;}
+
+	// rows on one of the selected maps (selected[id] for every map id below GetMapIdCount)
+	void SelectMaps(const bool *selected, ReplayBitmap& result) const;
+
+	// rows with at least minCount players having one of the selected names
+	void SelectPlayers(const bool *selected, int minCount, ReplayBitmap& result) const;
+
+private:
+	// rows of every name id (0 for ids without rows)
+	struct IdRows
+	{
+		ReplayBitmap **m_rows;
+		int m_count;
+		int m_size;
+	};
+
+	ReplayBitmap m_all;
+	ReplayBitmap m_matchups[MAXMATCHUPS];
+	ReplayBitmap m_rwa;
+	ReplayBitmap m_hacked;
+	ReplayBitmap m_playerCounts[MAXPLAYERS+1];
+	IdRows m_maps;
+	IdRows m_names;
+
+	// player name ids of every row (-1 for empty slots)
+	int *m_rowNames;
+	int m_rowSize;
+
+	static void _FreeRows(IdRows& ids);
+	static void _AddRow(IdRows& ids, int id, int row);
+	static void _Select(const IdRows& ids, const bool *selected, ReplayBitmap& result);
+};
+
+#endif
@@ -66,6 +66,9 @@ void ReplayInfo::Save(int file)
 
 	// bo info (for all players)
 	SaveBO();
+
+	// curves (for all players)
+	SaveSparklines();
 }
 
 //-----------------------------------------------------------------------------------------------------------------
@@ -82,6 +85,16 @@ void ReplayInfo::SaveBO()
 		desc += boDef;
 	}
 
+	// node times (if known, after a @)
+	bool timed=false;
+	for(int i=0;i<m_playerCount;i++) if(!m_boTimes[i].IsEmpty()) timed=true;
+	for(int i=0;timed && i<m_playerCount;i++)
+	{
+		CString boDef;
+		boDef.Format("@%s\\", (const char*)m_boTimes[i]);
+		desc += boDef;
+	}
+
 	// write bos to file
 	CString tmpDir;
 	BWChartDB::WriteEntry(BWChartDB::FILE_BOS,Dir(tmpDir),Name(),desc,false);
@@ -89,6 +102,31 @@ void ReplayInfo::SaveBO()
 
 //-----------------------------------------------------------------------------------------------------------------
 
+void ReplayInfo::SetSparkline(int k, const ReplaySparkline& spark)
+{
+	ASSERT(k>=0 && k<MAXPLAYER);
+	if(m_sparks.GetSize()<(k+1)*(int)sizeof(ReplaySparkline)) m_sparks.SetSize((k+1)*sizeof(ReplaySparkline));
+	memcpy(m_sparks.GetData()+k*sizeof(ReplaySparkline),&spark,sizeof(ReplaySparkline));
+}
+
+void ReplayInfo::SaveSparklines()
+{
+	if(GetSparkline(0)==0) return;
+
+	// sparkline of every player (raw bytes)
+	int count=0;
+	while(count<m_playerCount && GetSparkline(count)!=0) count++;
+	CByteArray data;
+	data.SetSize(ReplaySparkline::GetRecordSize(count));
+	ReplaySparkline::WriteRecord(GetSparkline(0),count,data.GetData());
+
+	// write sparklines to file
+	CString tmpDir;
+	BWChartDB::WriteData(BWChartDB::FILE_SPARKS,Dir(tmpDir),Name(),(const char *)data.GetData(),(int)data.GetSize());
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
 static char *strtokbis( char *strToken, const char *delimiter )
 {
 	static char *next=0;
@@ -101,8 +139,16 @@ static char *strtokbis( char *strToken, const char *delimiter )
 
 //-----------------------------------------------------------------------------------------------------------------
 
+bool ReplayInfo::HasHackCount(const char *data)
+{
+	int len = strlen(data);
+	return len<2 || data[len-1]!='\\' || data[len-2]!='?';
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
 // dir/file/data must be in regular format
-bool ReplayInfo::ExtractInfo(const char *dir, const char *file, char *data)
+bool ReplayInfo::ExtractInfo(const char *dir, const char *file, char *data, bool loadExtras)
 {
 	// rebuild path to replay
 	char path[256];
@@ -186,6 +232,9 @@ bool ReplayInfo::ExtractInfo(const char *dir, const char *file, char *data)
 		m_hackCount=atoi(p);
 	}
 
+	// comments and bos are not always needed
+	if(!loadExtras) return true;
+
 	// try to load comments
 	char buffini[2048];
 	BWChartDB::ReadEntry(BWChartDB::FILE_COMMENTS,dir,file,buffini,sizeof(buffini));
@@ -201,20 +250,54 @@ bool ReplayInfo::ExtractInfo(const char *dir, const char *file, char *data)
 	BWChartDB::ReadEntry(BWChartDB::FILE_BOS,dir,file,buffini,sizeof(buffini),false);
 	if(buffini[0]!=0)
 	{
-		int pidx=0;
+		int pidx=0,tidx=0;
 		char *p=strtokbis(buffini,"\\");
 		while(p!=0)
 		{
-			m_bo[pidx++]=p;
+			if(p[0]=='@') {if(tidx<MAXPLAYER) m_boTimes[tidx++]=p+1;}
+			else if(pidx<MAXPLAYER) m_bo[pidx++]=p;
 			p=strtokbis(0,"\\");
 		}
 	}
 
+	// try to load sparklines (records of another format are ignored)
+	char buffspark[1+MAXPLAYER*(2+ReplaySparkline::DATASIZE)+1];
+	int size = BWChartDB::ReadData(BWChartDB::FILE_SPARKS,dir,file,buffspark,sizeof(buffspark));
+	if(size>0 && size<(int)sizeof(buffspark))
+	{
+		ReplaySparkline sparks[MAXPLAYER];
+		int count = ReplaySparkline::ReadRecord((const unsigned char *)buffspark,size,sparks,MAXPLAYER);
+		for(int k=0;k<count;k++) SetSparkline(k,sparks[k]);
+	}
+
 	return true;
 }
 
 //-----------------------------------------------------------------------------------------------------------------
 
+void ReplayInfo::GetPlayerStats(int k, AggregateStats& stats) const
+{
+	memset(&stats,0,sizeof(stats));
+	stats.m_games=1;
+	stats.m_apm=m_apm[k];
+	stats.m_duration=m_duration;
+	if(m_race[k]==IStarcraftPlayer::RACE_TERRAN) {stats.m_gamesAsT=1; stats.m_apmAsT=m_apm[k];}
+	else if(m_race[k]==IStarcraftPlayer::RACE_ZERG) {stats.m_gamesAsZ=1; stats.m_apmAsZ=m_apm[k];}
+	else if(m_race[k]==IStarcraftPlayer::RACE_PROTOSS) {stats.m_gamesAsP=1; stats.m_apmAsP=m_apm[k];}
+	if(m_race[k]>=0 && m_race[k]<4) stats.m_raceDist[m_race[k]]=1;
+	stats.m_apmDev=m_apmDev[k];
+}
+
+void ReplayInfo::GetMapStats(AggregateStats& stats) const
+{
+	memset(&stats,0,sizeof(stats));
+	stats.m_games=1;
+	for(int k=0; k<m_playerCount; k++) {stats.m_apm+=m_apm[k]; stats.m_apmCount++;}
+	stats.m_duration=m_duration;
+}
+
+//-----------------------------------------------------------------------------------------------------------------
+
 bool ReplayInfo::IsFavorite()
 {
 	char buffini[2048];
@@ -16,6 +16,8 @@ extern char * _ConverFromHex(const char *str);
 #define BWREP_VERSION_116 0x24
 
 #include "../common/audioheader.h"
+#include "aggregates.h"
+#include "sparkline.h"
 
 //------------------------------------------------------------
 
@@ -27,8 +29,9 @@ private:
 
 public:
 	// ctor
-	ReplayInfo() : m_engineType(0), m_engineVersion(0), m_matchUp(0), m_isRWA(false)
+	ReplayInfo() : m_engineType(0), m_engineVersion(0), m_matchUp(0), m_isRWA(false), m_mapId(-1), m_row(-1)
 	{
+		memset(m_playerId,0xFF,sizeof(m_playerId));
 		memset(m_apm,0,sizeof(m_apm));
 		memset(m_race,0,sizeof(m_race));
 		memset(m_start,0,sizeof(m_start));
@@ -38,11 +41,13 @@ public:
 	}
 	ReplayInfo(const ReplayInfo& src)
 	{
+		m_row=-1;
 		m_playerCount=src.m_playerCount;
 		m_hackCount=src.m_hackCount;
 		m_path = src.m_path;
 		m_map = src.m_map;
 		m_mainMap = src.m_mainMap;
+		m_mapId = src.m_mapId;
 		m_date = src.m_date;
 		m_filedate = src.m_filedate;
 		m_comment = src.m_comment;
@@ -56,12 +61,15 @@ public:
 		{
 			m_mainName[i]=src.m_mainName[i]; 
 			m_player[i] = src.m_player[i]; 
+			m_playerId[i] = src.m_playerId[i];
 			m_apm[i]=src.m_apm[i]; 
 			m_race[i]=src.m_race[i]; 
 			m_start[i]=src.m_start[i]; 
 			m_apmDev[i]=src.m_apmDev[i];
 			m_bo[i]=src.m_bo[i];
+			m_boTimes[i]=src.m_boTimes[i];
 		}
+		m_sparks.Copy(src.m_sparks);
 	}
 
 	// get matchup
@@ -86,6 +94,7 @@ public:
 	// map name
 	CString m_map;
 	CString m_mainMap;
+	int m_mapId; // in NameTable (-1 if not set)
 
 	// date of game creation
 	CTime m_date;
@@ -103,6 +112,7 @@ public:
 	enum {MAXPLAYER=8};
 	CString m_player[MAXPLAYER];
 	CString m_mainName[MAXPLAYER];
+	int m_playerId[MAXPLAYER]; // in NameTable (-1 if not set)
 
 	// player apm
 	int m_apm[MAXPLAYER];
@@ -119,19 +129,40 @@ public:
 	// overall build order
 	CString m_bo[MAXPLAYER];
 
+	// time of build order nodes (4 hex digits per node, in seconds, empty if unknown)
+	CString m_boTimes[MAXPLAYER];
+
+	// downsampled curves of every player (empty if unknown)
+	CByteArray m_sparks;
+	const ReplaySparkline *GetSparkline(int k) const
+		{return (k+1)*(int)sizeof(ReplaySparkline)<=m_sparks.GetSize() ? (const ReplaySparkline *)m_sparks.GetData()+k : 0;}
+	void SetSparkline(int k, const ReplaySparkline& spark);
+
 	// game duration
 	int m_duration; // in seconds
 
 	// comment
 	CString m_comment;
 
+	// row in the browser sort index (-1 if not indexed)
+	int m_row;
+
 	// save replay
 	void Save(int nfile);
 	void SaveBO();
+	void SaveSparklines();
+
+	// load replay (records older than VER_CURRENT have the valid actions and build orders
+	// of the discard rules used before the effective actions classifier)
+	enum {VER_F=0,VER_N=1, VER_P=2, VER_S=3, VER_CURRENT};
+	bool ExtractInfo(const char *dir, const char *file, char *data, bool loadExtras=true);
+
+	// the headless ingestion doesnt detect hacks and writes "?" as hack count
+	static bool HasHackCount(const char *data);
 
-	// load replay
-	enum {VER_F=0,VER_N=1, VER_P=2, VER_CURRENT};
-	bool ExtractInfo(const char *dir, const char *file, char *data);
+	// what the replay adds to player k and to its map statistics
+	void GetPlayerStats(int k, AggregateStats& stats) const;
+	void GetMapStats(AggregateStats& stats) const;
 
 	// delete replay
 	void Delete(int nfile);
@@ -167,6 +198,15 @@ public:
 		return str;
 	}
 
+	// game date for sorting, as an integer (0 if unknown)
+	int DateKey() const
+	{
+		static int thisYear=0;
+		if(thisYear==0) thisYear = CTime::GetCurrentTime().GetYear();
+		if(m_date.GetYear()<1995 || m_date.GetYear()>thisYear) return 0;
+		return m_date.GetYear()*10000+m_date.GetMonth()*100+m_date.GetDay();
+	}
+
 	// game date for display
 	const char *DateForDisplay(CString& str)
 	{
@@ -185,6 +225,11 @@ public:
 		return str;
 	}
 
+	int FileDateKey() const
+	{
+		return m_filedate.GetYear()*10000+m_filedate.GetMonth()*100+m_filedate.GetDay();
+	}
+
 	const char *Duration(CString& str)
 	{
 		int totals = m_duration;
@@ -243,6 +288,20 @@ public:
 	int AvgApmAsZ() const {return m_gamesAsZ==0?0:m_apmAsZ/m_gamesAsZ;}
 	int AvgApmAsP() const {return m_gamesAsP==0?0:m_apmAsP/m_gamesAsP;}
 
+	// add (sign=1) or subtract (sign=-1) replay stats
+	void AddStats(const AggregateStats& stats, int sign)
+	{
+		m_games+=sign*stats.m_games;
+		m_gamesAsT+=sign*stats.m_gamesAsT;
+		m_gamesAsZ+=sign*stats.m_gamesAsZ;
+		m_gamesAsP+=sign*stats.m_gamesAsP;
+		m_apm+=sign*stats.m_apm;
+		m_apmAsT+=sign*stats.m_apmAsT;
+		m_apmAsZ+=sign*stats.m_apmAsZ;
+		m_apmAsP+=sign*stats.m_apmAsP;
+		m_duration+=sign*stats.m_duration;
+	}
+
 	const char *AvgDuration(CString& str)
 	{
 		int totals = m_games==0 ? 0:m_duration/m_games;
@@ -263,6 +322,12 @@ public:
 
 	void AddRace(int race) {m_raceDist[race]++;}
 	void AddApmDev(int apmdev) {m_apmDev+=apmdev;}
+	void AddStats(const AggregateStats& stats, int sign)
+	{
+		BaseInfo::AddStats(stats,sign);
+		for(int i=0;i<4;i++) m_raceDist[i]+=sign*stats.m_raceDist[i];
+		m_apmDev+=sign*stats.m_apmDev;
+	}
 	int GetRaceCount(int race) const {int tot=(m_raceDist[0]+m_raceDist[1]+m_raceDist[2]+m_raceDist[3]); return tot==0?0:(100*m_raceDist[race])/tot;}
 	int GetApmDev() const {return m_games==0?0:m_apmDev/m_games;}
 	int GetApmDevPer() const {return (m_games==0 || AvgApm()==0)?0:(100*GetApmDev())/AvgApm();}
@@ -274,6 +339,8 @@ public:
 	MapInfo() : m_apmCount(0) {}
 	int m_apmCount;
 
+	void AddStats(const AggregateStats& stats, int sign) {BaseInfo::AddStats(stats,sign); m_apmCount+=sign*stats.m_apmCount;}
+
 	int AvgApm() const {return m_apmCount==0?0:m_apm/m_apmCount;}
 	int AvgDur() const {return m_games==0?0:m_duration/m_games;}
 };
@@ -0,0 +1,566 @@
+// replaystore.cpp : implementation of the ReplayStore class
+//
+
+#include "replaystore.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define SNAPSHOT_MAGIC 0x53525742 // "BWRS"
+#define LOG_MAGIC 0x4C525742 // "BWRL"
+#define MAXKEYLEN 0x10000
+#define MAXVALLEN 0x1000000
+
+// snapshot file: header, entries sorted by key, then keys and values
+struct SnapshotHeader
+{
+	unsigned int m_magic;
+	unsigned int m_count;
+};
+
+struct SnapshotEntry
+{
+	unsigned int m_keyOff;
+	unsigned int m_keyLen;
+	unsigned int m_valOff;
+	unsigned int m_valLen;
+};
+
+// log file: records with key and value padded to 4 bytes (m_valLen<0 for deletion)
+struct LogHeader
+{
+	unsigned int m_magic;
+	int m_keyLen;
+	int m_valLen;
+};
+
+static int _Padding(int size) {return (4-(size&3))&3;}
+static char _Fold(char c) {return c>='A' && c<='Z' ? c-'A'+'a' : c;}
+
+//---------------------------------------------------------------------------------------
+
+ReplayStore::ReplayStore() : m_path(0), m_file(0), m_mapping(0), m_view(0), m_viewSize(0), m_snapCount(0), m_recordCount(0),
+	m_log(0), m_logCount(0), m_records(0), m_count(0), m_size(0), m_index(512)
+{
+#ifdef _WIN32
+	m_lock = malloc(sizeof(CRITICAL_SECTION));
+	InitializeCriticalSection((CRITICAL_SECTION*)m_lock);
+#else
+	m_lock = malloc(sizeof(pthread_mutex_t));
+	pthread_mutex_init((pthread_mutex_t*)m_lock,0);
+#endif
+}
+
+ReplayStore::~ReplayStore()
+{
+	Close();
+#ifdef _WIN32
+	DeleteCriticalSection((CRITICAL_SECTION*)m_lock);
+#else
+	pthread_mutex_destroy((pthread_mutex_t*)m_lock);
+#endif
+	free(m_lock);
+}
+
+void ReplayStore::_Lock() const
+{
+#ifdef _WIN32
+	EnterCriticalSection((CRITICAL_SECTION*)m_lock);
+#else
+	pthread_mutex_lock((pthread_mutex_t*)m_lock);
+#endif
+}
+
+void ReplayStore::_Unlock() const
+{
+#ifdef _WIN32
+	LeaveCriticalSection((CRITICAL_SECTION*)m_lock);
+#else
+	pthread_mutex_unlock((pthread_mutex_t*)m_lock);
+#endif
+}
+
+const char *ReplayStore::GetLogFileName(char *buffer, int bufsize, const char *path)
+{
+	buffer[0]=0;
+	if((int)strlen(path)+5>bufsize) return buffer;
+	strcpy(buffer,path);
+	strcat(buffer,".log");
+	return buffer;
+}
+
+//---------------------------------------------------------------------------------------
+
+int ReplayStore::_Compare(const char *key1, int len1, const char *key2, int len2)
+{
+	int len = len1<len2 ? len1 : len2;
+	for(int i=0; i<len; i++)
+	{
+		unsigned char c1 = (unsigned char)_Fold(key1[i]);
+		unsigned char c2 = (unsigned char)_Fold(key2[i]);
+		if(c1!=c2) return c1<c2 ? -1 : 1;
+	}
+	return len1-len2;
+}
+
+int ReplayStore::_CompareRecords(const void *r1, const void *r2)
+{
+	const Record *rec1 = *(const Record **)r1;
+	const Record *rec2 = *(const Record **)r2;
+	return _Compare(rec1->m_data,rec1->m_keyLen,rec2->m_data,rec2->m_keyLen);
+}
+
+//---------------------------------------------------------------------------------------
+
+// returns false if snapshot exists but cant be mapped
+bool ReplayStore::_Map()
+{
+	assert(m_view==0);
+	bool ok=true;
+#ifdef _WIN32
+	HANDLE hFile = ::CreateFileA(m_path,GENERIC_READ,FILE_SHARE_READ|FILE_SHARE_WRITE,0,OPEN_EXISTING,0,0);
+	if(hFile!=INVALID_HANDLE_VALUE)
+	{
+		m_file = hFile;
+		m_viewSize = ::GetFileSize(hFile,0);
+		if(m_viewSize>0) m_mapping = ::CreateFileMappingA(hFile,0,PAGE_READONLY,0,0,0);
+		if(m_mapping!=0) m_view = (const char*)::MapViewOfFile(m_mapping,FILE_MAP_READ,0,0,0);
+		if(m_viewSize>0 && m_view==0) ok=false;
+	}
+	else if(::GetLastError()!=ERROR_FILE_NOT_FOUND && ::GetLastError()!=ERROR_PATH_NOT_FOUND) ok=false;
+#else
+	int fd = open(m_path,O_RDONLY);
+	struct stat st;
+	if(fd>=0 && fstat(fd,&st)==0 && st.st_size>0)
+	{
+		void *view = mmap(0,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+		if(view!=MAP_FAILED) {m_view = (const char*)view; m_viewSize = st.st_size;}
+		else ok=false;
+	}
+	if(fd>=0) close(fd);
+	else if(errno!=ENOENT) ok=false;
+#endif
+	if(m_view==0) m_viewSize=0;
+
+	// check header and index (a bad snapshot is ignored)
+	m_snapCount=0;
+	if(m_viewSize>=sizeof(SnapshotHeader))
+	{
+		const SnapshotHeader *header = (const SnapshotHeader *)m_view;
+		if(header->m_magic==SNAPSHOT_MAGIC &&
+			header->m_count<=(m_viewSize-sizeof(SnapshotHeader))/sizeof(SnapshotEntry))
+			m_snapCount = (int)header->m_count;
+	}
+	return ok;
+}
+
+void ReplayStore::_Unmap()
+{
+#ifdef _WIN32
+	if(m_view!=0) ::UnmapViewOfFile(m_view);
+	if(m_mapping!=0) ::CloseHandle(m_mapping);
+	if(m_file!=0) ::CloseHandle(m_file);
+#else
+	if(m_view!=0) munmap((void*)m_view,m_viewSize);
+#endif
+	m_view=0;
+	m_mapping=0;
+	m_file=0;
+	m_viewSize=0;
+	m_snapCount=0;
+}
+
+const char *ReplayStore::_SnapshotKey(int idx, int *keyLen) const
+{
+	const SnapshotEntry *entry = (const SnapshotEntry *)(m_view+sizeof(SnapshotHeader))+idx;
+	if(entry->m_keyOff>m_viewSize || entry->m_keyLen>m_viewSize-entry->m_keyOff) {*keyLen=0; return "";}
+	*keyLen = (int)entry->m_keyLen;
+	return m_view+entry->m_keyOff;
+}
+
+const char *ReplayStore::_SnapshotValue(int idx, int *valLen) const
+{
+	const SnapshotEntry *entry = (const SnapshotEntry *)(m_view+sizeof(SnapshotHeader))+idx;
+	if(entry->m_valOff>m_viewSize || entry->m_valLen>m_viewSize-entry->m_valOff) {*valLen=0; return "";}
+	*valLen = (int)entry->m_valLen;
+	return m_view+entry->m_valOff;
+}
+
+int ReplayStore::_FindSnapshot(const char *key, int keyLen) const
+{
+	int low=0, high=m_snapCount-1;
+	while(low<=high)
+	{
+		int mid = (low+high)/2;
+		int len;
+		const char *midKey = _SnapshotKey(mid,&len);
+		int cmp = _Compare(midKey,len,key,keyLen);
+		if(cmp<0) low=mid+1;
+		else if(cmp>0) high=mid-1;
+		else return mid;
+	}
+	return -1;
+}
+
+//---------------------------------------------------------------------------------------
+
+void ReplayStore::_ClearRecords()
+{
+	for(int i=0; i<m_count; i++) free(m_records[i].m_data);
+	free(m_records);
+	m_records=0;
+	m_count=m_size=0;
+	m_index.Clear();
+	m_logCount=0;
+}
+
+int ReplayStore::_FindRecord(const char *key, int keyLen) const
+{
+	unsigned long hash = HashIndex::HashNoCase(key,keyLen);
+	for(int pos=m_index.First(hash); pos>=0; pos=m_index.Next(pos,hash))
+	{
+		const Record& rec = m_records[m_index.GetID(pos)];
+		if(_Compare(rec.m_data,rec.m_keyLen,key,keyLen)==0) return m_index.GetID(pos);
+	}
+	return -1;
+}
+
+// value==0 for deletion
+void ReplayStore::_Set(const char *key, int keyLen, const char *value, int valLen)
+{
+	char *data = (char*)malloc(keyLen+(value!=0 ? valLen : 0));
+	memcpy(data,key,keyLen);
+	if(value!=0 && valLen>0) memcpy(data+keyLen,value,valLen);
+
+	// number of records in store
+	int r = _FindRecord(key,keyLen);
+	bool existed = r>=0 ? m_records[r].m_valLen>=0 : _FindSnapshot(key,keyLen)>=0;
+	if(existed && value==0) m_recordCount--;
+	else if(!existed && value!=0) m_recordCount++;
+
+	// replace existing record
+	if(r>=0)
+	{
+		free(m_records[r].m_data);
+		m_records[r].m_data = data;
+		m_records[r].m_valLen = value!=0 ? valLen : -1;
+		return;
+	}
+
+	// new record
+	if(m_count==m_size)
+	{
+		m_size = m_size==0 ? 256 : 2*m_size;
+		m_records = (Record*)realloc(m_records,m_size*sizeof(Record));
+	}
+	Record& rec = m_records[m_count++];
+	rec.m_data = data;
+	rec.m_keyLen = keyLen;
+	rec.m_valLen = value!=0 ? valLen : -1;
+	m_index.Add(HashIndex::HashNoCase(key,keyLen),m_count-1);
+}
+
+//---------------------------------------------------------------------------------------
+
+void ReplayStore::_ReadLog()
+{
+	char logPath[1024];
+	m_log = fopen(GetLogFileName(logPath,sizeof(logPath),m_path),"r+b");
+	if(m_log==0) return;
+
+	// read all valid records
+	long validSize=0;
+	char *buffer=0;
+	int bufferSize=0;
+	LogHeader header;
+	while(fread(&header,sizeof(header),1,m_log)==1)
+	{
+		if(header.m_magic!=LOG_MAGIC || header.m_keyLen<=0 || header.m_keyLen>MAXKEYLEN || header.m_valLen>MAXVALLEN) break;
+		int size = header.m_keyLen+(header.m_valLen>0 ? header.m_valLen : 0);
+		size += _Padding(size);
+		if(size>bufferSize)
+		{
+			bufferSize = size;
+			buffer = (char*)realloc(buffer,bufferSize);
+		}
+		if(fread(buffer,size,1,m_log)!=1) break;
+		_Set(buffer,header.m_keyLen,header.m_valLen>=0 ? buffer+header.m_keyLen : 0,header.m_valLen);
+		validSize += sizeof(header)+size;
+		m_logCount++;
+	}
+	free(buffer);
+
+	// anything after last valid record is dropped
+	fflush(m_log);
+#ifdef _WIN32
+	_chsize(_fileno(m_log),validSize);
+#else
+	if(ftruncate(fileno(m_log),validSize)!=0) {}
+#endif
+	fseek(m_log,validSize,SEEK_SET);
+}
+
+bool ReplayStore::_AppendLog(const char *key, int keyLen, const char *value, int valLen)
+{
+	if(m_log==0)
+	{
+		char logPath[1024];
+		m_log = fopen(GetLogFileName(logPath,sizeof(logPath),m_path),"w+b");
+		if(m_log==0) return false;
+	}
+
+	LogHeader header;
+	header.m_magic = LOG_MAGIC;
+	header.m_keyLen = keyLen;
+	header.m_valLen = value!=0 ? valLen : -1;
+	static const char pad[4]={0,0,0,0};
+	int size = keyLen+(value!=0 ? valLen : 0);
+	bool ok = fwrite(&header,sizeof(header),1,m_log)==1 && fwrite(key,keyLen,1,m_log)==1;
+	if(ok && value!=0 && valLen>0) ok = fwrite(value,valLen,1,m_log)==1;
+	if(ok && _Padding(size)>0) ok = fwrite(pad,_Padding(size),1,m_log)==1;
+	fflush(m_log);
+	m_logCount++;
+	return ok;
+}
+
+//---------------------------------------------------------------------------------------
+
+bool ReplayStore::Open(const char *path)
+{
+	Close();
+	_Lock();
+	m_path = (char*)malloc(strlen(path)+1);
+	strcpy(m_path,path);
+
+	// map snapshot (if we cant, leave the store closed rather than overwrite it later)
+	if(!_Map())
+	{
+		_Unmap();
+		free(m_path);
+		m_path=0;
+		_Unlock();
+		return false;
+	}
+
+	// read log
+	m_recordCount=m_snapCount;
+	_ReadLog();
+
+	// log wasnt merged last time (we didnt close properly), do it now
+	if(m_logCount>1024 && m_logCount>m_snapCount/8) _Compact();
+	_Unlock();
+	return true;
+}
+
+void ReplayStore::Close()
+{
+	_Lock();
+	if(m_path!=0 && m_logCount>0) _Compact();
+	_Unmap();
+	if(m_log!=0) fclose(m_log);
+	m_log=0;
+	_ClearRecords();
+	m_recordCount=0;
+	free(m_path);
+	m_path=0;
+	_Unlock();
+}
+
+//---------------------------------------------------------------------------------------
+
+void ReplayStore::Put(const char *key, int keyLen, const char *value, int valLen)
+{
+	assert(keyLen>0 && keyLen<=MAXKEYLEN && valLen>=0 && valLen<=MAXVALLEN);
+	_Lock();
+	_Set(key,keyLen,value,valLen);
+	if(m_path!=0) _AppendLog(key,keyLen,value,valLen);
+	_Unlock();
+}
+
+void ReplayStore::Delete(const char *key, int keyLen)
+{
+	_Lock();
+	// nothing to do if it's not there
+	int r = _FindRecord(key,keyLen);
+	if(r>=0 ? m_records[r].m_valLen>=0 : _FindSnapshot(key,keyLen)>=0)
+	{
+		_Set(key,keyLen,0,0);
+		if(m_path!=0) _AppendLog(key,keyLen,0,0);
+	}
+	_Unlock();
+}
+
+int ReplayStore::Read(const char *key, int keyLen, char *buffer, int bufsize) const
+{
+	assert(bufsize>0);
+	_Lock();
+	const char *value=0;
+	int valLen=-1;
+	int r = _FindRecord(key,keyLen);
+	if(r>=0)
+	{
+		valLen = m_records[r].m_valLen;
+		value = m_records[r].m_data+m_records[r].m_keyLen;
+	}
+	else
+	{
+		int idx = _FindSnapshot(key,keyLen);
+		if(idx>=0) value = _SnapshotValue(idx,&valLen);
+	}
+
+	// copy value
+	int len = valLen<0 ? 0 : valLen<bufsize ? valLen : bufsize-1;
+	if(len>0) memcpy(buffer,value,len);
+	buffer[len]=0;
+	_Unlock();
+	return valLen;
+}
+
+//---------------------------------------------------------------------------------------
+
+void ReplayStore::Enumerate(ReplayStoreCallback fn, void *context) const
+{
+	_Lock();
+	_Enumerate(fn,context);
+	_Unlock();
+}
+
+void ReplayStore::_Enumerate(ReplayStoreCallback fn, void *context) const
+{
+	// records from log in key order
+	const Record **sorted = (const Record **)malloc((m_count+1)*sizeof(Record *));
+	for(int r=0; r<m_count; r++) sorted[r]=&m_records[r];
+	qsort(sorted,m_count,sizeof(Record *),_CompareRecords);
+
+	// merge them with snapshot (log records replace snapshot ones)
+	int total = m_snapCount+m_count;
+	int i=0, j=0;
+	while(i<m_snapCount || j<m_count)
+	{
+		int keyLen=0, valLen=0, cmp;
+		const char *key = i<m_snapCount ? _SnapshotKey(i,&keyLen) : 0;
+		if(i>=m_snapCount) cmp=1;
+		else if(j>=m_count) cmp=-1;
+		else cmp=_Compare(key,keyLen,sorted[j]->m_data,sorted[j]->m_keyLen);
+		int percentage = total==0 ? 100 : (int)((100.0*(i+j))/total);
+		if(cmp<0)
+		{
+			const char *value = _SnapshotValue(i,&valLen);
+			fn(context,key,keyLen,value,valLen,percentage);
+			i++;
+			continue;
+		}
+		if(cmp==0) i++;
+		const Record *rec = sorted[j++];
+		if(rec->m_valLen>=0) fn(context,rec->m_data,rec->m_keyLen,rec->m_data+rec->m_keyLen,rec->m_valLen,percentage);
+	}
+
+	free(sorted);
+}
+
+//---------------------------------------------------------------------------------------
+
+struct CompactContext
+{
+	FILE *m_fp;
+	SnapshotEntry *m_entries;
+	int m_count;
+	unsigned long m_offset;
+	bool m_ok;
+};
+
+static void _WriteRecord(void *context, const char *key, int keyLen, const char *value, int valLen, int /*percentage*/)
+{
+	CompactContext *ctx = (CompactContext *)context;
+	if(!ctx->m_ok) return;
+
+	// offsets are 32 bits
+	if(ctx->m_offset+keyLen+valLen<ctx->m_offset || ctx->m_offset+keyLen+valLen>0xFFFFFFFFUL) {ctx->m_ok=false; return;}
+
+	SnapshotEntry& entry = ctx->m_entries[ctx->m_count++];
+	entry.m_keyOff = (unsigned int)ctx->m_offset;
+	entry.m_keyLen = (unsigned int)keyLen;
+	entry.m_valOff = (unsigned int)(ctx->m_offset+keyLen);
+	entry.m_valLen = (unsigned int)valLen;
+	if(fwrite(key,keyLen,1,ctx->m_fp)!=1) ctx->m_ok=false;
+	if(valLen>0 && fwrite(value,valLen,1,ctx->m_fp)!=1) ctx->m_ok=false;
+	ctx->m_offset += keyLen+valLen;
+}
+
+static void _CountRecord(void *context, const char *, int, const char *, int, int)
+{
+	(*(int*)context)++;
+}
+
+bool ReplayStore::Compact()
+{
+	_Lock();
+	bool ok = m_path!=0 && _Compact();
+	_Unlock();
+	return ok;
+}
+
+bool ReplayStore::_Compact()
+{
+	// count records
+	int count=0;
+	_Enumerate(_CountRecord,&count);
+
+	// write new snapshot to temporary file: keys and values after index, then header and index
+	char tmpPath[1024];
+	if(strlen(m_path)+5>sizeof(tmpPath)) return false;
+	strcpy(tmpPath,m_path);
+	strcat(tmpPath,".tmp");
+	FILE *fp = fopen(tmpPath,"wb");
+	if(fp==0) return false;
+	CompactContext ctx;
+	ctx.m_fp = fp;
+	ctx.m_entries = (SnapshotEntry *)malloc((count+1)*sizeof(SnapshotEntry));
+	ctx.m_count = 0;
+	ctx.m_offset = sizeof(SnapshotHeader)+count*sizeof(SnapshotEntry);
+	ctx.m_ok = fseek(fp,(long)ctx.m_offset,SEEK_SET)==0;
+	_Enumerate(_WriteRecord,&ctx);
+	SnapshotHeader header;
+	header.m_magic = SNAPSHOT_MAGIC;
+	header.m_count = (unsigned int)ctx.m_count;
+	if(ctx.m_ok && fseek(fp,0,SEEK_SET)==0 && fwrite(&header,sizeof(header),1,fp)==1)
+		ctx.m_ok = count==0 || fwrite(ctx.m_entries,count*sizeof(SnapshotEntry),1,fp)==1;
+	else
+		ctx.m_ok = false;
+	free(ctx.m_entries);
+	if(fclose(fp)!=0) ctx.m_ok=false;
+	if(!ctx.m_ok) {remove(tmpPath); return false;}
+
+	// replace snapshot atomically (must be unmapped first), old one is kept if it fails
+	_Unmap();
+#ifdef _WIN32
+	bool renamed = ::MoveFileExA(tmpPath,m_path,MOVEFILE_REPLACE_EXISTING)!=0;
+#else
+	bool renamed = rename(tmpPath,m_path)==0;
+#endif
+	if(!renamed) remove(tmpPath);
+
+	// empty log
+	if(renamed)
+	{
+		char logPath[1024];
+		if(m_log!=0) fclose(m_log);
+		m_log=0;
+		remove(GetLogFileName(logPath,sizeof(logPath),m_path));
+		_ClearRecords();
+	}
+	_Map();
+	return renamed;
+}
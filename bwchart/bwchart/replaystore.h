@@ -0,0 +1,112 @@
+// replaystore.h : interface of the ReplayStore class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __REPLAYSTORE_H
+#define __REPLAYSTORE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdio.h>
+#include <stddef.h>
+#include "hashindex.h"
+
+//--------------------------------------------------------------------------------------
+
+// called for every record by ReplayStore::Enumerate (percentage of records done so far)
+typedef void (*ReplayStoreCallback)(void *context, const char *key, int keyLen, const char *value, int valLen, int percentage);
+
+// Embedded key/value store for the replay database.
+//
+// Records are kept in two files: a snapshot (records sorted by key, with an index of
+// fixed size entries) that is mapped in memory as is, and an append-only log of the
+// records written or deleted since. The log is read at Open into a hash table, and
+// merged into a new snapshot at Close (or at Open when it got too big).
+//
+// Keys compare like INI names (ASCII case is ignored), values are binary.
+//
+class ReplayStore
+{
+public:
+	ReplayStore();
+	~ReplayStore();
+
+	// open store (files are created on first write), false if it cant be mapped
+	bool Open(const char *path);
+	void Close();
+	bool IsOpen() const {return m_path!=0;}
+
+	// write record snapshot and empty log
+	bool Compact();
+
+	// store or remove a record
+	void Put(const char *key, int keyLen, const char *value, int valLen);
+	void Delete(const char *key, int keyLen);
+
+	// copy value into buffer (zero terminated, truncated to bufsize), returns value size or -1 if not found
+	int Read(const char *key, int keyLen, char *buffer, int bufsize) const;
+
+	// call fn for every record in key order (store must not be modified from fn)
+	void Enumerate(ReplayStoreCallback fn, void *context) const;
+
+	// number of records in snapshot and log
+	int GetSnapshotCount() const {return m_snapCount;}
+	int GetLogCount() const {return m_logCount;}
+
+	// number of records (deleted ones are not counted)
+	int GetRecordCount() const {return m_recordCount;}
+
+	// log file name for a store
+	static const char *GetLogFileName(char *buffer, int bufsize, const char *path);
+
+private:
+	// record written since last snapshot (m_valLen<0 if deleted)
+	struct Record
+	{
+		char *m_data; // key followed by value
+		int m_keyLen;
+		int m_valLen;
+	};
+
+	// snapshot file and its mapping
+	char *m_path;
+	void *m_file;
+	void *m_mapping;
+	const char *m_view;
+	size_t m_viewSize;
+	int m_snapCount;
+	int m_recordCount;
+
+	// log file and records read from it or added since Open
+	FILE *m_log;
+	int m_logCount;
+	Record *m_records;
+	int m_count;
+	int m_size;
+
+	// records by key
+	HashIndex m_index;
+
+	void *m_lock;
+
+	bool _Map();
+	void _Unmap();
+	void _ClearRecords();
+	void _ReadLog();
+	void _Enumerate(ReplayStoreCallback fn, void *context) const;
+	bool _AppendLog(const char *key, int keyLen, const char *value, int valLen);
+	void _Set(const char *key, int keyLen, const char *value, int valLen);
+	int _FindRecord(const char *key, int keyLen) const;
+	int _FindSnapshot(const char *key, int keyLen) const;
+	const char *_SnapshotKey(int idx, int *keyLen) const;
+	const char *_SnapshotValue(int idx, int *valLen) const;
+	bool _Compact();
+	void _Lock() const;
+	void _Unlock() const;
+	static int _Compare(const char *key1, int len1, const char *key2, int len2);
+	static int _CompareRecords(const void *r1, const void *r2);
+};
+
+#endif
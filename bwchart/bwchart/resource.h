@@ -365,13 +365,16 @@
 #define ID__WATCHREPLAY_BW115           32903
 #define IDS_CT_MAPCOVERGAGE             32903
 #define ID__WATCHREPLAY_BW116           32904
+#define IDS_COL_BONEXT                  32907
+#define ID__FINDSIMILAR                 32905
+#define IDS_COL_ACTIVITY                32906
 
 // Next default values for new objects
 // 
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        152
-#define _APS_NEXT_COMMAND_VALUE         32897
+#define _APS_NEXT_COMMAND_VALUE         32908
 #define _APS_NEXT_CONTROL_VALUE         1155
 #define _APS_NEXT_SYMED_VALUE           114
 #endif
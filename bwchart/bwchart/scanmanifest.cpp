@@ -0,0 +1,308 @@
+// scanmanifest.cpp : implementation of the ScanManifest class
+//
+
+#include "scanmanifest.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#define MANIFEST_MAGIC 0x4D535742 // "BWSM"
+#define MANIFEST_VERSION 1
+
+struct ManifestHeader
+{
+	unsigned int m_magic;
+	unsigned int m_version;
+	int m_dirCount;
+	int m_fileCount;
+	int m_subCount;
+	int m_poolUsed;
+};
+
+static char _Fold(char c) {return c>='A' && c<='Z' ? c-'A'+'a' : c;}
+
+// names compare like windows file names (ASCII case is ignored)
+static bool _SameName(const char *str1, const char *str2)
+{
+	for(; *str1!=0 && _Fold(*str1)==_Fold(*str2); str1++, str2++);
+	return *str1==*str2;
+}
+
+//---------------------------------------------------------------------------------------
+
+ScanManifest::ScanManifest() : m_dirs(0), m_dirCount(0), m_dirSize(0), m_files(0), m_fileCount(0), m_fileSize(0),
+	m_subs(0), m_subCount(0), m_subSize(0), m_pool(0), m_poolUsed(0), m_poolSize(0),
+	m_dirIndex(64), m_fileIndex(256), m_idIndex(256), m_tablesBuilt(false)
+{
+}
+
+ScanManifest::~ScanManifest()
+{
+	Clear();
+}
+
+void ScanManifest::Clear()
+{
+	_FreeTables();
+	free(m_dirs);
+	m_dirs=0;
+	m_dirCount=m_dirSize=0;
+	free(m_files);
+	m_files=0;
+	m_fileCount=m_fileSize=0;
+	free(m_subs);
+	m_subs=0;
+	m_subCount=m_subSize=0;
+	free(m_pool);
+	m_pool=0;
+	m_poolUsed=m_poolSize=0;
+}
+
+//---------------------------------------------------------------------------------------
+
+bool ScanManifest::Load(const char *path)
+{
+	Clear();
+	FILE *fp = fopen(path,"rb");
+	if(fp==0) return false;
+
+	// get file size
+	fseek(fp,0,SEEK_END);
+	double fsize=(double)ftell(fp);
+	fseek(fp,0,SEEK_SET);
+
+	// read header and arrays (sizes must match file size)
+	ManifestHeader header;
+	bool ok = fread(&header,sizeof(header),1,fp)==1 && header.m_magic==MANIFEST_MAGIC && header.m_version==MANIFEST_VERSION &&
+		header.m_dirCount>=0 && header.m_fileCount>=0 && header.m_subCount>=0 && header.m_poolUsed>0 &&
+		fsize==(double)sizeof(header)+(double)header.m_dirCount*sizeof(Directory)+(double)header.m_fileCount*sizeof(File)+
+			(double)header.m_subCount*sizeof(int)+header.m_poolUsed;
+	if(ok)
+	{
+		m_dirs = (Directory*)malloc((header.m_dirCount+1)*sizeof(Directory));
+		m_files = (File*)malloc((header.m_fileCount+1)*sizeof(File));
+		m_subs = (int*)malloc((header.m_subCount+1)*sizeof(int));
+		m_pool = (char*)malloc(header.m_poolUsed);
+		ok = m_dirs!=0 && m_files!=0 && m_subs!=0 && m_pool!=0 &&
+			(header.m_dirCount==0 || fread(m_dirs,header.m_dirCount*sizeof(Directory),1,fp)==1) &&
+			(header.m_fileCount==0 || fread(m_files,header.m_fileCount*sizeof(File),1,fp)==1) &&
+			(header.m_subCount==0 || fread(m_subs,header.m_subCount*sizeof(int),1,fp)==1) &&
+			fread(m_pool,header.m_poolUsed,1,fp)==1;
+		m_dirCount = m_dirSize = header.m_dirCount;
+		m_fileCount = m_fileSize = header.m_fileCount;
+		m_subCount = m_subSize = header.m_subCount;
+		m_poolUsed = m_poolSize = header.m_poolUsed;
+	}
+	fclose(fp);
+
+	// check it
+	int i;
+	ok = ok && m_pool[m_poolUsed-1]==0;
+	for(i=0; ok && i<m_dirCount; i++)
+	{
+		const Directory& dir = m_dirs[i];
+		ok = dir.m_path>=0 && dir.m_path<m_poolUsed && dir.m_firstFile>=0 && dir.m_fileCount>=0 &&
+			dir.m_fileCount<=m_fileCount-dir.m_firstFile && dir.m_firstSub>=0 && dir.m_subCount>=0 &&
+			dir.m_subCount<=m_subCount-dir.m_firstSub;
+	}
+	for(i=0; ok && i<m_fileCount; i++)
+		ok = m_files[i].m_name>=0 && m_files[i].m_name<m_poolUsed && m_files[i].m_dir>=0 && m_files[i].m_dir<m_dirCount;
+	for(i=0; ok && i<m_subCount; i++)
+		ok = m_subs[i]>=0 && m_subs[i]<m_poolUsed;
+	if(!ok) Clear();
+	return ok;
+}
+
+bool ScanManifest::Save(const char *path) const
+{
+	FILE *fp = fopen(path,"wb");
+	if(fp==0) return false;
+	ManifestHeader header;
+	header.m_magic = MANIFEST_MAGIC;
+	header.m_version = MANIFEST_VERSION;
+	header.m_dirCount = m_dirCount;
+	header.m_fileCount = m_fileCount;
+	header.m_subCount = m_subCount;
+	header.m_poolUsed = m_poolUsed==0 ? 1 : m_poolUsed;
+	bool ok = fwrite(&header,sizeof(header),1,fp)==1 &&
+		(m_dirCount==0 || fwrite(m_dirs,m_dirCount*sizeof(Directory),1,fp)==1) &&
+		(m_fileCount==0 || fwrite(m_files,m_fileCount*sizeof(File),1,fp)==1) &&
+		(m_subCount==0 || fwrite(m_subs,m_subCount*sizeof(int),1,fp)==1) &&
+		(m_poolUsed==0 ? fwrite("",1,1,fp)==1 : fwrite(m_pool,m_poolUsed,1,fp)==1);
+	if(fclose(fp)!=0) ok=false;
+	if(!ok) remove(path);
+	return ok;
+}
+
+//---------------------------------------------------------------------------------------
+
+int ScanManifest::_AddString(const char *str)
+{
+	int len = (int)strlen(str)+1;
+	if(m_poolUsed+len>m_poolSize)
+	{
+		m_poolSize = m_poolSize==0 ? 4096 : 2*m_poolSize;
+		while(m_poolUsed+len>m_poolSize) m_poolSize*=2;
+		m_pool = (char*)realloc(m_pool,m_poolSize);
+	}
+	int off = m_poolUsed;
+	memcpy(m_pool+off,str,len);
+	m_poolUsed += len;
+	return off;
+}
+
+int ScanManifest::AddDirectory(const char *path, const ManifestStat& stat)
+{
+	_FreeTables();
+	if(m_dirCount==m_dirSize)
+	{
+		m_dirSize = m_dirSize==0 ? 64 : 2*m_dirSize;
+		m_dirs = (Directory*)realloc(m_dirs,m_dirSize*sizeof(Directory));
+	}
+	Directory& dir = m_dirs[m_dirCount];
+	dir.m_path = _AddString(path);
+	dir.m_stat = stat;
+	dir.m_firstFile = m_fileCount;
+	dir.m_fileCount = 0;
+	dir.m_firstSub = m_subCount;
+	dir.m_subCount = 0;
+	return m_dirCount++;
+}
+
+void ScanManifest::AddFile(int dir, const char *name, const ManifestStat& stat)
+{
+	// files of a directory are contiguous
+	assert(dir==m_dirCount-1);
+	_FreeTables();
+	if(m_fileCount==m_fileSize)
+	{
+		m_fileSize = m_fileSize==0 ? 256 : 2*m_fileSize;
+		m_files = (File*)realloc(m_files,m_fileSize*sizeof(File));
+	}
+	File& file = m_files[m_fileCount++];
+	file.m_name = _AddString(name);
+	file.m_dir = dir;
+	file.m_stat = stat;
+	m_dirs[dir].m_fileCount++;
+}
+
+void ScanManifest::AddSubdirectory(int dir, const char *name)
+{
+	assert(dir==m_dirCount-1);
+	if(m_subCount==m_subSize)
+	{
+		m_subSize = m_subSize==0 ? 64 : 2*m_subSize;
+		m_subs = (int*)realloc(m_subs,m_subSize*sizeof(int));
+	}
+	m_subs[m_subCount++] = _AddString(name);
+	m_dirs[dir].m_subCount++;
+}
+
+//---------------------------------------------------------------------------------------
+
+unsigned long ScanManifest::_HashID(const ManifestStat& stat)
+{
+	ManifestValue key = stat.m_fileid^((ManifestValue)stat.m_size<<17);
+	return (unsigned long)((key^(key>>29)^(key>>47))*2654435761UL)&0xFFFFFFFFUL;
+}
+
+void ScanManifest::_FreeTables() const
+{
+	m_dirIndex.Clear();
+	m_fileIndex.Clear();
+	m_idIndex.Clear();
+	m_tablesBuilt=false;
+}
+
+void ScanManifest::_BuildTables() const
+{
+	int i;
+
+	// directories by path
+	for(i=0; i<m_dirCount; i++)
+		m_dirIndex.Add(HashIndex::HashNoCase(m_pool+m_dirs[i].m_path),i);
+
+	// files by directory and name, and by file id
+	for(i=0; i<m_fileCount; i++)
+	{
+		m_fileIndex.Add(HashIndex::HashNoCase(m_pool+m_files[i].m_name,-1,m_files[i].m_dir),i);
+		if(m_files[i].m_stat.m_fileid!=0) m_idIndex.Add(_HashID(m_files[i].m_stat),i);
+	}
+	m_tablesBuilt=true;
+}
+
+int ScanManifest::FindDirectory(const char *path) const
+{
+	if(!m_tablesBuilt) _BuildTables();
+	unsigned long hash = HashIndex::HashNoCase(path);
+	for(int pos=m_dirIndex.First(hash); pos>=0; pos=m_dirIndex.Next(pos,hash))
+		if(_SameName(m_pool+m_dirs[m_dirIndex.GetID(pos)].m_path,path)) return m_dirIndex.GetID(pos);
+	return -1;
+}
+
+int ScanManifest::FindFile(int dir, const char *name) const
+{
+	if(dir<0) return -1;
+	if(!m_tablesBuilt) _BuildTables();
+	unsigned long hash = HashIndex::HashNoCase(name,-1,dir);
+	for(int pos=m_fileIndex.First(hash); pos>=0; pos=m_fileIndex.Next(pos,hash))
+	{
+		const File& file = m_files[m_fileIndex.GetID(pos)];
+		if(file.m_dir==dir && _SameName(m_pool+file.m_name,name)) return m_fileIndex.GetID(pos);
+	}
+	return -1;
+}
+
+int ScanManifest::FindFileByID(const ManifestStat& stat) const
+{
+	if(stat.m_fileid==0) return -1;
+	if(!m_tablesBuilt) _BuildTables();
+	unsigned long hash = _HashID(stat);
+	for(int pos=m_idIndex.First(hash); pos>=0; pos=m_idIndex.Next(pos,hash))
+	{
+		const File& file = m_files[m_idIndex.GetID(pos)];
+		if(file.m_stat.m_fileid==stat.m_fileid && file.m_stat.m_size==stat.m_size) return m_idIndex.GetID(pos);
+	}
+	return -1;
+}
+
+//---------------------------------------------------------------------------------------
+
+bool ScanManifest::Stat(const char *path, ManifestStat& stat, bool withID)
+{
+	stat.m_size=0;
+	stat.m_mtime=0;
+	stat.m_fileid=0;
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if(!::GetFileAttributesExA(path,GetFileExInfoStandard,&data)) return false;
+	if((data.dwFileAttributes&FILE_ATTRIBUTE_DIRECTORY)==0) stat.m_size = data.nFileSizeLow;
+	stat.m_mtime = ((ManifestValue)data.ftLastWriteTime.dwHighDateTime<<32)|data.ftLastWriteTime.dwLowDateTime;
+	if(withID)
+	{
+		// file index needs a handle
+		HANDLE hFile = ::CreateFileA(path,0,FILE_SHARE_READ|FILE_SHARE_WRITE,0,OPEN_EXISTING,FILE_FLAG_BACKUP_SEMANTICS,0);
+		if(hFile!=INVALID_HANDLE_VALUE)
+		{
+			BY_HANDLE_FILE_INFORMATION info;
+			if(::GetFileInformationByHandle(hFile,&info))
+				stat.m_fileid = ((ManifestValue)info.nFileIndexHigh<<32)|info.nFileIndexLow;
+			::CloseHandle(hFile);
+		}
+	}
+#else
+	struct stat st;
+	if(::stat(path,&st)!=0) return false;
+	if(!S_ISDIR(st.st_mode)) stat.m_size = (unsigned long)st.st_size;
+	stat.m_mtime = (ManifestValue)st.st_mtime;
+	if(withID) stat.m_fileid = (ManifestValue)st.st_ino;
+#endif
+	return true;
+}
@@ -0,0 +1,128 @@
+// scanmanifest.h : interface of the ScanManifest class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __SCANMANIFEST_H
+#define __SCANMANIFEST_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include "hashindex.h"
+
+//--------------------------------------------------------------------------------------
+
+#ifdef _WIN32
+typedef unsigned __int64 ManifestValue;
+#else
+typedef unsigned long long ManifestValue;
+#endif
+
+// file or directory signature
+class ManifestStat
+{
+public:
+	unsigned long m_size;
+	ManifestValue m_mtime; // last write time (FILETIME on Windows)
+	ManifestValue m_fileid; // file index on Windows, inode elsewhere (0 if unknown)
+
+	bool SameContent(const ManifestStat& stat) const {return m_size==stat.m_size && m_mtime==stat.m_mtime;}
+};
+
+// Directories and files seen by the last scan of the replay library.
+//
+// Each directory has its signature, then its files and sub directories (names only,
+// they have their own directory entry). A manifest is built during a scan and saved,
+// the next scan looks up the previous one: a directory with the same signature didnt
+// get files added, removed or renamed, and a file with the same size and time wasnt
+// modified. Files can also be found by file id and size, to follow renames and moves.
+//
+class ScanManifest
+{
+public:
+	ScanManifest();
+	~ScanManifest();
+
+	void Clear();
+
+	// load/save manifest file, false on error
+	bool Load(const char *path);
+	bool Save(const char *path) const;
+
+	// build: add a directory, then its files and sub directories (before adding the next directory)
+	int AddDirectory(const char *path, const ManifestStat& stat);
+	void AddFile(int dir, const char *name, const ManifestStat& stat);
+	void AddSubdirectory(int dir, const char *name);
+
+	// look up (-1 if not found)
+	int FindDirectory(const char *path) const;
+	int FindFile(int dir, const char *name) const;
+	int FindFileByID(const ManifestStat& stat) const;
+
+	// directories
+	int GetDirectoryCount() const {return m_dirCount;}
+	const char *GetDirectoryPath(int dir) const {return m_pool+m_dirs[dir].m_path;}
+	const ManifestStat& GetDirectoryStat(int dir) const {return m_dirs[dir].m_stat;}
+	int GetFileCount(int dir) const {return m_dirs[dir].m_fileCount;}
+	int GetFile(int dir, int i) const {return m_dirs[dir].m_firstFile+i;}
+	int GetSubdirectoryCount(int dir) const {return m_dirs[dir].m_subCount;}
+	const char *GetSubdirectory(int dir, int i) const {return m_pool+m_subs[m_dirs[dir].m_firstSub+i];}
+
+	// files
+	int GetTotalFileCount() const {return m_fileCount;}
+	const char *GetFileName(int file) const {return m_pool+m_files[file].m_name;}
+	const ManifestStat& GetFileStat(int file) const {return m_files[file].m_stat;}
+	int GetFileDirectory(int file) const {return m_files[file].m_dir;}
+
+	// signature of a file or directory from the file system (false if it doesnt exist)
+	static bool Stat(const char *path, ManifestStat& stat, bool withID);
+
+private:
+	struct Directory
+	{
+		int m_path; // offset in pool
+		ManifestStat m_stat;
+		int m_firstFile;
+		int m_fileCount;
+		int m_firstSub;
+		int m_subCount;
+	};
+
+	struct File
+	{
+		int m_name;
+		int m_dir;
+		ManifestStat m_stat;
+	};
+
+	Directory *m_dirs;
+	int m_dirCount;
+	int m_dirSize;
+
+	File *m_files;
+	int m_fileCount;
+	int m_fileSize;
+
+	int *m_subs;
+	int m_subCount;
+	int m_subSize;
+
+	// names and paths
+	char *m_pool;
+	int m_poolUsed;
+	int m_poolSize;
+
+	// lookup tables (built on first look up)
+	mutable HashIndex m_dirIndex;
+	mutable HashIndex m_fileIndex;
+	mutable HashIndex m_idIndex;
+	mutable bool m_tablesBuilt;
+
+	int _AddString(const char *str);
+	void _BuildTables() const;
+	void _FreeTables() const;
+	static unsigned long _HashID(const ManifestStat& stat);
+};
+
+#endif
@@ -0,0 +1,103 @@
+// sparkline.cpp : implementation of the ReplaySparkline class
+//
+
+#include "sparkline.h"
+#include <string.h>
+#include <assert.h>
+
+//---------------------------------------------------------------------------------------
+
+void ReplaySparkline::Clear()
+{
+	memset(m_max,0,sizeof(m_max));
+	memset(m_points,0,sizeof(m_points));
+}
+
+//---------------------------------------------------------------------------------------
+
+void ReplaySparkline::SetSerie(int serie, const unsigned long *values, int count, bool average)
+{
+	assert(serie>=0 && serie<__S_MAX);
+	unsigned long points[POINTS];
+	unsigned long max=0;
+
+	// slots of every point (a slot per point at least for short games)
+	for(int p=0; p<POINTS; p++)
+	{
+		points[p]=0;
+		if(count<=0) continue;
+		int first = p*count/POINTS;
+		int last = (p+1)*count/POINTS;
+		if(last<=first) last=first+1;
+		unsigned long sum=0, high=0;
+		for(int s=first; s<last; s++)
+		{
+			sum+=values[s];
+			if(values[s]>high) high=values[s];
+		}
+		points[p] = average ? sum/(last-first) : high;
+		if(points[p]>0xFFFF) points[p]=0xFFFF;
+		if(points[p]>max) max=points[p];
+	}
+
+	// quantize
+	m_max[serie] = (unsigned short)max;
+	for(int p=0; p<POINTS; p++)
+		m_points[serie][p] = max==0 ? 0 : (unsigned char)((points[p]*255+max/2)/max);
+}
+
+//---------------------------------------------------------------------------------------
+
+// maxes (low byte first) then points
+void ReplaySparkline::ToData(unsigned char *data) const
+{
+	for(int i=0; i<__S_MAX; i++)
+	{
+		*data++ = (unsigned char)(m_max[i]&0xFF);
+		*data++ = (unsigned char)(m_max[i]>>8);
+	}
+	memcpy(data,m_points,sizeof(m_points));
+}
+
+bool ReplaySparkline::FromData(const unsigned char *data, int size)
+{
+	if(size!=DATASIZE) return false;
+	for(int i=0; i<__S_MAX; i++, data+=2)
+		m_max[i] = (unsigned short)(data[0] | data[1]<<8);
+	memcpy(m_points,data,sizeof(m_points));
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+
+int ReplaySparkline::WriteRecord(const ReplaySparkline *sparks, int count, unsigned char *data)
+{
+	assert(count>=0 && count<256);
+	unsigned char *p = data;
+	*p++ = (unsigned char)count;
+	for(int k=0; k<count; k++)
+	{
+		*p++ = (unsigned char)(DATASIZE&0xFF);
+		*p++ = (unsigned char)(DATASIZE>>8);
+		sparks[k].ToData(p);
+		p += DATASIZE;
+	}
+	return (int)(p-data);
+}
+
+int ReplaySparkline::ReadRecord(const unsigned char *data, int size, ReplaySparkline *sparks, int maxCount)
+{
+	if(size<1) return -1;
+	int count = data[0];
+	int pos = 1;
+	for(int k=0; k<count; k++)
+	{
+		if(pos+2>size) return -1;
+		int len = data[pos] | data[pos+1]<<8;
+		pos += 2;
+		if(pos+len>size) return -1;
+		if(k<maxCount && !sparks[k].FromData(data+pos,len)) return -1;
+		pos += len;
+	}
+	return pos==size ? (count<maxCount ? count : maxCount) : -1;
+}
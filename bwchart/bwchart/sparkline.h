@@ -0,0 +1,55 @@
+// sparkline.h : interface of the ReplaySparkline class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __SPARKLINE_H
+#define __SPARKLINE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+//--------------------------------------------------------------------------------------
+
+// Curves of one player over a whole game, downsampled to POINTS points and quantized
+// to one byte per point (255 is the highest point of a curve, whose value is kept).
+// Small enough to be stored with the replay record, so replay lists can draw curves
+// without reading the replays.
+//
+class ReplaySparkline
+{
+public:
+	enum {POINTS=64};
+	enum {S_APM, S_SUPPLY, S_WORKERS, S_ARMY, __S_MAX};
+	enum {DATASIZE=2*__S_MAX+__S_MAX*POINTS}; // bytes of ToData
+
+	ReplaySparkline() {Clear();}
+	void Clear();
+
+	// downsample the values of a serie (one per timeline slot), every point is the
+	// average or the highest value of its slots
+	void SetSerie(int serie, const unsigned long *values, int count, bool average);
+
+	// read a serie
+	unsigned short GetMax(int serie) const {return m_max[serie];}
+	unsigned char GetPoint(int serie, int point) const {return m_points[serie][point];}
+	unsigned long GetValue(int serie, int point) const {return ((unsigned long)m_points[serie][point]*m_max[serie]+127)/255;}
+
+	// as bytes (data must hold DATASIZE bytes), returns false if data is not a sparkline
+	void ToData(unsigned char *data) const;
+	bool FromData(const unsigned char *data, int size);
+
+	// record of the sparklines of a replay: player count, then the size (2 bytes) and
+	// the bytes of every sparkline
+	static int GetRecordSize(int count) {return 1+count*(2+DATASIZE);}
+	static int WriteRecord(const ReplaySparkline *sparks, int count, unsigned char *data);
+
+	// reads up to maxCount sparklines, returns how many (-1 if data is not a record)
+	static int ReadRecord(const unsigned char *data, int size, ReplaySparkline *sparks, int maxCount);
+
+private:
+	unsigned short m_max[__S_MAX];
+	unsigned char m_points[__S_MAX][POINTS];
+};
+
+#endif
@@ -0,0 +1,151 @@
+// spatialindex.cpp : implementation of the ActionSpatialIndex class
+//
+
+#include "spatialindex.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+//---------------------------------------------------------------------------------------
+
+ActionSpatialIndex::ActionSpatialIndex(int mapWidth, int mapHeight) : m_entries(0), m_count(0), m_size(0),
+	m_finished(false), m_cellFirst(0)
+{
+	// map squares are 32 pixels
+	m_cellsX = ((mapWidth*32)>>SPATIAL_CELLSHIFT)+1;
+	m_cellsY = ((mapHeight*32)>>SPATIAL_CELLSHIFT)+1;
+}
+
+ActionSpatialIndex::~ActionSpatialIndex()
+{
+	free(m_entries);
+	free(m_cellFirst);
+}
+
+//---------------------------------------------------------------------------------------
+
+// cell for a position (positions outside the map go in border cells)
+int ActionSpatialIndex::_CellX(int x) const
+{
+	int cx = x<0 ? 0 : x>>SPATIAL_CELLSHIFT;
+	return cx<m_cellsX ? cx : m_cellsX-1;
+}
+
+int ActionSpatialIndex::_CellY(int y) const
+{
+	int cy = y<0 ? 0 : y>>SPATIAL_CELLSHIFT;
+	return cy<m_cellsY ? cy : m_cellsY-1;
+}
+
+void ActionSpatialIndex::Add(int kind, int x, int y, int playerid, unsigned long time, int actionIdx)
+{
+	assert(!m_finished);
+	if(m_count==m_size)
+	{
+		m_size = m_size==0 ? 1024 : 2*m_size;
+		m_entries = (Entry*)realloc(m_entries,m_size*sizeof(Entry));
+	}
+	Entry& entry = m_entries[m_count++];
+	entry.m_time = (unsigned int)time;
+	entry.m_actionIdx = actionIdx;
+	entry.m_x = (unsigned short)x;
+	entry.m_y = (unsigned short)y;
+	entry.m_playerid = (unsigned char)playerid;
+	entry.m_kind = (unsigned char)kind;
+}
+
+static int _CompareEntries(const void *p1, const void *p2)
+{
+	const ActionSpatialIndex::Entry *e1 = (const ActionSpatialIndex::Entry *)p1;
+	const ActionSpatialIndex::Entry *e2 = (const ActionSpatialIndex::Entry *)p2;
+	if(e1->m_time!=e2->m_time) return e1->m_time<e2->m_time ? -1 : 1;
+	return e1->m_actionIdx<e2->m_actionIdx ? -1 : e1->m_actionIdx>e2->m_actionIdx ? 1 : 0;
+}
+
+void ActionSpatialIndex::Finish()
+{
+	assert(!m_finished);
+	m_finished=true;
+
+	// actions usually come in time order
+	bool sorted=true;
+	for(int i=1; i<m_count && sorted; i++)
+		sorted = _CompareEntries(&m_entries[i-1],&m_entries[i])<=0;
+	if(!sorted) qsort(m_entries,m_count,sizeof(Entry),_CompareEntries);
+
+	// count actions per cell
+	int cellCount = m_cellsX*m_cellsY;
+	m_cellFirst = (int*)calloc(cellCount+1,sizeof(int));
+	int i;
+	for(i=0; i<m_count; i++)
+		m_cellFirst[_CellX(m_entries[i].m_x)+_CellY(m_entries[i].m_y)*m_cellsX+1]++;
+	for(i=0; i<cellCount; i++)
+		m_cellFirst[i+1]+=m_cellFirst[i];
+
+	// group actions by cell (keeps time order in each cell)
+	Entry *grouped = (Entry*)malloc((m_count>0 ? m_count : 1)*sizeof(Entry));
+	int *next = (int*)malloc(cellCount*sizeof(int));
+	memcpy(next,m_cellFirst,cellCount*sizeof(int));
+	for(i=0; i<m_count; i++)
+		grouped[next[_CellX(m_entries[i].m_x)+_CellY(m_entries[i].m_y)*m_cellsX]++] = m_entries[i];
+	free(next);
+	free(m_entries);
+	m_entries = grouped;
+	m_size = m_count;
+}
+
+//---------------------------------------------------------------------------------------
+
+// first entry with time>=time
+int ActionSpatialIndex::_LowerBound(const Entry *entries, int count, unsigned long time)
+{
+	int low=0, high=count;
+	while(low<high)
+	{
+		int mid = (low+high)/2;
+		if(entries[mid].m_time<time) low=mid+1;
+		else high=mid;
+	}
+	return low;
+}
+
+static int _CompareInts(const void *p1, const void *p2)
+{
+	int i1 = *(const int *)p1;
+	int i2 = *(const int *)p2;
+	return i1<i2 ? -1 : i1>i2 ? 1 : 0;
+}
+
+int ActionSpatialIndex::Query(int x1, int y1, int x2, int y2, unsigned long t1, unsigned long t2,
+	unsigned long players, int kinds, int *results, int maxResults) const
+{
+	assert(m_finished);
+	if(!m_finished || x1>x2 || y1>y2 || t1>t2) return 0;
+
+	int found=0;
+	int cx1=_CellX(x1), cx2=_CellX(x2);
+	int cy1=_CellY(y1), cy2=_CellY(y2);
+	for(int cy=cy1; cy<=cy2; cy++)
+		for(int cx=cx1; cx<=cx2; cx++)
+		{
+			// cells strictly inside the rectangle dont need the position test
+			// (border cells also hold positions outside the map)
+			bool inside = cx>cx1 && cx<cx2 && cy>cy1 && cy<cy2;
+
+			int cell = cx+cy*m_cellsX;
+			const Entry *entries = m_entries+m_cellFirst[cell];
+			int count = m_cellFirst[cell+1]-m_cellFirst[cell];
+			for(int i=_LowerBound(entries,count,t1); i<count && entries[i].m_time<=t2; i++)
+			{
+				const Entry& entry = entries[i];
+				if((entry.m_kind&kinds)==0 || (entry.m_playerid<32 && (players&(1UL<<entry.m_playerid))==0)) continue;
+				if(!inside && (entry.m_x<x1 || entry.m_x>x2 || entry.m_y<y1 || entry.m_y>y2)) continue;
+				if(results!=0 && found<maxResults) results[found]=entry.m_actionIdx;
+				found++;
+			}
+		}
+
+	// results come cell by cell
+	if(results!=0 && found<=maxResults) qsort(results,found,sizeof(int),_CompareInts);
+	return found;
+}
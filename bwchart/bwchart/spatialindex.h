@@ -0,0 +1,78 @@
+// spatialindex.h : interface of the ActionSpatialIndex class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __SPATIALINDEX_H
+#define __SPATIALINDEX_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+//--------------------------------------------------------------------------------------
+
+#define SPATIAL_CELLSHIFT 8 // cells are 256x256 pixels (8x8 map squares)
+#define SPATIAL_ALLPLAYERS 0xFFFFFFFF
+
+// Index of the actions with a map position (moves, attacks, builds, minimap pings).
+//
+// The map is cut in cells, and each cell holds its actions sorted by time, so a query
+// only visits the cells overlapping the rectangle and, in each of them, the actions
+// from the first one at or after the start time (binary search) to the end time.
+// Positions are in pixels.
+//
+class ActionSpatialIndex
+{
+public:
+	// action kinds (bits for queries)
+	enum {MOVE=1,ATTACK=2,BUILD=4,PING=8,ALLKINDS=15};
+
+	// indexed action
+	struct Entry
+	{
+		unsigned int m_time;
+		int m_actionIdx;
+		unsigned short m_x;
+		unsigned short m_y;
+		unsigned char m_playerid;
+		unsigned char m_kind;
+	};
+
+	// map size in squares
+	ActionSpatialIndex(int mapWidth, int mapHeight);
+	~ActionSpatialIndex();
+
+	// add action (actions can be added in any order)
+	void Add(int kind, int x, int y, int playerid, unsigned long time, int actionIdx);
+
+	// build cells (must be called after the last Add and before any query)
+	void Finish();
+
+	// number of indexed actions
+	int GetCount() const {return m_count;}
+
+	// actions of the given kinds by the given players (bit per player id) in rectangle [x1,x2]x[y1,y2]
+	// and time range [t1,t2], returns the number of matching actions and stores their indices
+	// (sorted) in results if there are no more than maxResults (results can be 0 to only count them)
+	int Query(int x1, int y1, int x2, int y2, unsigned long t1, unsigned long t2,
+		unsigned long players, int kinds, int *results, int maxResults) const;
+
+private:
+	int m_cellsX;
+	int m_cellsY;
+
+	// actions (grouped by cell once finished)
+	Entry *m_entries;
+	int m_count;
+	int m_size;
+	bool m_finished;
+
+	// first entry of each cell (cell count + 1 values)
+	int *m_cellFirst;
+
+	int _CellX(int x) const;
+	int _CellY(int y) const;
+	static int _LowerBound(const Entry *entries, int count, unsigned long time);
+};
+
+#endif
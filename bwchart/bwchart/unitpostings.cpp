@@ -0,0 +1,194 @@
+// unitpostings.cpp : implementation of the UnitPostings class
+//
+
+#include "unitpostings.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define ROLE_BITS 2
+#define MAXUNITID 0x10000
+
+//---------------------------------------------------------------------------------------
+
+static unsigned char *_PutVarint(unsigned char *p, unsigned long val)
+{
+	while(val>=0x80) {*p++ = (unsigned char)(val|0x80); val>>=7;}
+	*p++ = (unsigned char)val;
+	return p;
+}
+
+static const unsigned char *_GetVarint(const unsigned char *p, unsigned long& val)
+{
+	val=0;
+	for(int shift=0;;shift+=7)
+	{
+		unsigned char c = *p++;
+		val |= (unsigned long)(c&0x7F)<<shift;
+		if((c&0x80)==0) break;
+	}
+	return p;
+}
+
+//---------------------------------------------------------------------------------------
+
+UnitPostings::UnitPostings() : m_raw(0), m_rawCount(0), m_rawSize(0), m_units(0), m_unitCount(0),
+	m_stream(0), m_streamSize(0)
+{
+}
+
+UnitPostings::~UnitPostings()
+{
+	Clear();
+}
+
+void UnitPostings::Clear()
+{
+	free(m_raw);
+	m_raw=0;
+	m_rawCount=m_rawSize=0;
+	free(m_units);
+	m_units=0;
+	m_unitCount=0;
+	free(m_stream);
+	m_stream=0;
+	m_streamSize=0;
+}
+
+void UnitPostings::Add(unsigned short unitID, int actionIdx, int role)
+{
+	assert(role>=0 && role<(1<<ROLE_BITS));
+	assert(m_rawCount==0 || actionIdx>=m_raw[m_rawCount-1].m_actionIdx);
+	if(m_rawCount==m_rawSize)
+	{
+		m_rawSize = m_rawSize==0 ? 4096 : 2*m_rawSize;
+		m_raw = (Raw*)realloc(m_raw,m_rawSize*sizeof(Raw));
+	}
+	Raw& raw = m_raw[m_rawCount++];
+	raw.m_actionIdx = actionIdx;
+	raw.m_unitID = unitID;
+	raw.m_role = (unsigned char)role;
+}
+
+//---------------------------------------------------------------------------------------
+
+void UnitPostings::Finish()
+{
+	if(m_rawCount==0) return;
+
+	// postings per unit (existing lists and new ones)
+	int *counts = (int*)calloc(MAXUNITID,sizeof(int));
+	int i;
+	for(i=0; i<m_unitCount; i++) counts[m_units[i].m_unitID]=m_units[i].m_count;
+	for(i=0; i<m_rawCount; i++) counts[m_raw[i].m_unitID]++;
+
+	// group new postings by unit with a counting sort (keeps action order)
+	int *first = (int*)malloc((MAXUNITID+1)*sizeof(int));
+	int *newFirst = (int*)calloc(MAXUNITID+1,sizeof(int));
+	for(i=0; i<m_rawCount; i++) newFirst[m_raw[i].m_unitID+1]++;
+	int unitCount=0;
+	for(i=0; i<MAXUNITID; i++)
+	{
+		if(counts[i]>0) unitCount++;
+		newFirst[i+1]+=newFirst[i];
+	}
+	Raw *grouped = (Raw*)malloc(m_rawCount*sizeof(Raw));
+	memcpy(first,newFirst,(MAXUNITID+1)*sizeof(int));
+	for(i=0; i<m_rawCount; i++) grouped[first[m_raw[i].m_unitID]++] = m_raw[i];
+
+	// worst case is 5 bytes per posting
+	Unit *units = (Unit*)malloc(unitCount*sizeof(Unit));
+	unsigned char *stream = (unsigned char*)malloc(m_streamSize+5*m_rawCount);
+	unsigned char *p = stream;
+	int old=0, u=0;
+	for(i=0; i<MAXUNITID; i++)
+	{
+		if(counts[i]==0) continue;
+		units[u].m_unitID = (unsigned short)i;
+		units[u].m_count = counts[i];
+		units[u].m_offset = (unsigned long)(p-stream);
+
+		// copy existing list as is
+		int last=0;
+		if(old<m_unitCount && m_units[old].m_unitID==i)
+		{
+			Cursor cursor;
+			int actionIdx, role;
+			Find((unsigned short)i,cursor);
+			const unsigned char *start = cursor.m_ptr;
+			while(Next(cursor,actionIdx,role)) last=actionIdx;
+			memcpy(p,start,cursor.m_ptr-start);
+			p+=cursor.m_ptr-start;
+			old++;
+		}
+
+		// append new postings
+		for(int k=newFirst[i]; k<newFirst[i+1]; k++)
+		{
+			assert(grouped[k].m_actionIdx>=last);
+			unsigned long delta = (unsigned long)(grouped[k].m_actionIdx-last);
+			p = _PutVarint(p,(delta<<ROLE_BITS)|grouped[k].m_role);
+			last = grouped[k].m_actionIdx;
+		}
+		u++;
+	}
+	assert(u==unitCount);
+
+	free(counts);
+	free(first);
+	free(newFirst);
+	free(grouped);
+	free(m_raw);
+	m_raw=0;
+	m_rawCount=m_rawSize=0;
+
+	free(m_units);
+	free(m_stream);
+	m_units=units;
+	m_unitCount=unitCount;
+	m_streamSize=(unsigned long)(p-stream);
+	m_stream=(unsigned char*)realloc(stream,m_streamSize>0 ? m_streamSize : 1);
+}
+
+//---------------------------------------------------------------------------------------
+
+const UnitPostings::Unit *UnitPostings::_FindUnit(unsigned short unitID) const
+{
+	int low=0, high=m_unitCount-1;
+	while(low<=high)
+	{
+		int mid = (low+high)/2;
+		if(m_units[mid].m_unitID<unitID) low=mid+1;
+		else if(m_units[mid].m_unitID>unitID) high=mid-1;
+		else return &m_units[mid];
+	}
+	return 0;
+}
+
+int UnitPostings::GetCount(unsigned short unitID) const
+{
+	const Unit *unit = _FindUnit(unitID);
+	return unit==0 ? 0 : unit->m_count;
+}
+
+bool UnitPostings::Find(unsigned short unitID, Cursor& cursor) const
+{
+	const Unit *unit = _FindUnit(unitID);
+	if(unit==0) {cursor = Cursor(); return false;}
+	cursor.m_ptr = m_stream+unit->m_offset;
+	cursor.m_left = unit->m_count;
+	cursor.m_actionIdx = 0;
+	return true;
+}
+
+bool UnitPostings::Next(Cursor& cursor, int& actionIdx, int& role) const
+{
+	if(cursor.m_left==0) return false;
+	unsigned long val;
+	cursor.m_ptr = _GetVarint(cursor.m_ptr,val);
+	cursor.m_left--;
+	cursor.m_actionIdx += (int)(val>>ROLE_BITS);
+	actionIdx = cursor.m_actionIdx;
+	role = (int)(val&((1<<ROLE_BITS)-1));
+	return true;
+}
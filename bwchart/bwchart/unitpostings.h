@@ -0,0 +1,91 @@
+// unitpostings.h : interface of the UnitPostings class
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __UNITPOSTINGS_H
+#define __UNITPOSTINGS_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+//--------------------------------------------------------------------------------------
+
+// For every unit id, the sorted list of actions referencing that unit.
+//
+// Postings are appended during the analysis, then Finish groups them by unit and
+// stores each list as a byte stream of variable length deltas between action
+// indices (with the role in the low bits), so a unit history only decodes its own list.
+//
+class UnitPostings
+{
+public:
+	// how an action references a unit
+	enum {SELECT,HOTKEY,ORDER,TARGET};
+
+	// reading position in the list of a unit
+	class Cursor
+	{
+		friend class UnitPostings;
+		const unsigned char *m_ptr;
+		int m_left;
+		int m_actionIdx;
+	public:
+		Cursor() : m_ptr(0), m_left(0), m_actionIdx(0) {}
+	};
+
+	UnitPostings();
+	~UnitPostings();
+
+	// release everything
+	void Clear();
+
+	// add posting, action indices must not decrease
+	void Add(unsigned short unitID, int actionIdx, int role);
+
+	// group postings by unit (postings added after that go in a new batch merged on next Finish)
+	void Finish();
+
+	// number of units with postings, number of postings for a unit
+	int GetUnitCount() const {return m_unitCount;}
+	int GetCount(unsigned short unitID) const;
+
+	// start reading postings of a unit, false if there are none
+	bool Find(unsigned short unitID, Cursor& cursor) const;
+
+	// read next posting, false at end of list
+	bool Next(Cursor& cursor, int& actionIdx, int& role) const;
+
+	// memory used by finished lists (bytes)
+	unsigned long GetSize() const {return m_streamSize+m_unitCount*sizeof(Unit);}
+
+private:
+	struct Raw
+	{
+		int m_actionIdx;
+		unsigned short m_unitID;
+		unsigned char m_role;
+	};
+
+	struct Unit
+	{
+		unsigned short m_unitID;
+		int m_count;
+		unsigned long m_offset;
+	};
+
+	// postings not grouped yet
+	Raw *m_raw;
+	int m_rawCount;
+	int m_rawSize;
+
+	// units sorted by id, and their lists
+	Unit *m_units;
+	int m_unitCount;
+	unsigned char *m_stream;
+	unsigned long m_streamSize;
+
+	const Unit *_FindUnit(unsigned short unitID) const;
+};
+
+#endif
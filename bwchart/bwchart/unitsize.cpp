@@ -0,0 +1,94 @@
+// unitsize.cpp : building sizes of the replay unit ids
+//
+
+#include "unitsize.h"
+
+//---------------------------------------------------------------------------------------
+
+struct BuildingSize
+{
+	int id;
+	signed char width;
+	signed char height;
+};
+
+// sorted by unit id
+static const BuildingSize _sizes[] =
+{
+	// terran
+	{106,4,3},	// command center
+	{107,2,2},	// comsat station
+	{108,2,2},	// nuclear silo
+	{109,3,2},	// supply depot
+	{110,4,2},	// refinery
+	{111,4,3},	// barracks
+	{112,3,2},	// academy
+	{113,4,3},	// factory
+	{114,4,3},	// starport
+	{115,2,2},	// control tower
+	{116,4,3},	// science facility
+	{117,2,2},	// covert ops
+	{118,2,2},	// physics lab
+	{120,2,2},	// machine shop
+	{122,4,3},	// engineering bay
+	{123,3,2},	// armory
+	{124,2,2},	// missile turret
+	{125,2,2},	// bunker
+	// zerg
+	{131,4,3},	// hatchery
+	{132,-3,-3},	// lair
+	{133,-4,-3},	// hive
+	{134,2,2},	// nydus canal
+	{135,3,2},	// hydralisk den
+	{136,4,2},	// defiler mound
+	{137,-4,-3},	// greater spire
+	{138,3,2},	// queen's nest
+	{139,3,2},	// evolution chamber
+	{140,3,2},	// ultralisk cavern
+	{141,2,2},	// spire
+	{142,3,2},	// spawning pool
+	{143,2,2},	// creep colony
+	{144,2,2},	// spore colony
+	{146,2,2},	// sunken colony
+	{149,4,2},	// extractor
+	// protoss
+	{154,4,3},	// nexus
+	{155,3,2},	// robotics facility
+	{156,2,2},	// pylon
+	{157,4,2},	// assimilator
+	{159,3,2},	// observatory
+	{160,4,3},	// gateway
+	{162,2,2},	// photon cannon
+	{163,3,2},	// citadel of adun
+	{164,3,2},	// cybernetics core
+	{165,3,2},	// templar archives
+	{166,3,2},	// forge
+	{167,4,3},	// stargate
+	{169,3,2},	// fleet beacon
+	{170,3,2},	// arbiter tribunal
+	{171,3,2},	// robotics support bay
+	{172,3,2},	// shield battery
+};
+
+//---------------------------------------------------------------------------------------
+
+bool GetBuildingSize(int unitID, int *width, int *height)
+{
+	int lo=0;
+	int hi=sizeof(_sizes)/sizeof(_sizes[0]);
+	while(lo<hi)
+	{
+		int mid=(lo+hi)/2;
+		if(_sizes[mid].id<unitID) lo=mid+1;
+		else hi=mid;
+	}
+	if(lo<(int)(sizeof(_sizes)/sizeof(_sizes[0])) && _sizes[lo].id==unitID)
+	{
+		*width=_sizes[lo].width;
+		*height=_sizes[lo].height;
+		return true;
+	}
+	*width=0;
+	*height=0;
+	return false;
+}
@@ -0,0 +1,21 @@
+// unitsize.h : building sizes of the replay unit ids
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __UNITSIZE_H
+#define __UNITSIZE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+//--------------------------------------------------------------------------------------
+
+// Size in map squares of a building from its unit id (same ids and sizes as the
+// bwrep unit table). Buildings morphed from another one (lair, hive, greater spire)
+// have negative sizes like in bwrep.
+// Returns false and sets both sizes to 0 if the unit is not a building.
+//
+bool GetBuildingSize(int unitID, int *width, int *height);
+
+#endif
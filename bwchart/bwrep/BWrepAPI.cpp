@@ -516,18 +516,18 @@ bool BWrepFile::_LoadMap(FILE *fp, bool decode)
 	int mapSize=0;
 	unpack_section(fp, (byte*)&mapSize, sizeof(mapSize));
 
-	// alloc buffer to read it
-	byte *buffer = (byte *)calloc(mapSize,sizeof(byte));
-	if (buffer==0) return false;
+	// read packed map section
+	byte *packed=0;
+	int packedSize=0;
+	if (mapSize==0) return true; // empty map section, map stays empty
+	if (read_section(fp, &packed, &packedSize, mapSize)!=0) return false;
 
-	// unpack map section in buffer
-	unpack_section(fp, buffer, mapSize);
+	// keep it packed (dont free buffer, it belongs to m_oMap now), it will be unpacked and
+	// decoded only if a section is needed, users can skip that for known maps (see GetHash)
+	if(decode) m_oMap.SetPackedMap(packed,packedSize,mapSize,m_oHeader.getMapWidth(),m_oHeader.getMapHeight());
+	else free(packed);
 
-	// decode map (dont free buffer, it belongs to m_oMap now)
-	bool bOk = decode?m_oMap.DecodeMap(buffer,mapSize,m_oHeader.getMapWidth(),m_oHeader.getMapHeight()):true;
-	if(!decode) free(buffer);
-
-	return bOk;
+	return true;
 }
 #endif
 
@@ -244,6 +244,7 @@ public:
 
 	// game map
 	virtual const IStarcraftMap* QueryMap() const {return &m_oMap;}
+	virtual IStarcraftMap* QueryMap() {return &m_oMap;}
 
 	// release object
 	virtual void Release() {delete this;}
@@ -7,6 +7,14 @@
 #include "unpack.h"
 #include <assert.h>
 
+#ifdef _WIN32
+#define FNV_OFFSET 14695981039346656037ui64
+#define FNV_PRIME 1099511628211ui64
+#else
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+#endif
+
 //------------------------------------------------------------------------------------------------------------
 
 //
@@ -60,11 +68,56 @@ bool BWrepMap::DecodeMap(const unsigned char *buffer, int mapSize, int w, int h)
 
 //------------------------------------------------------------------------------------------------------------
 
+// keep packed map section
+void BWrepMap::SetPackedMap(unsigned char *packed, int packedSize, int mapSize, int w, int h)
+{
+	_Clear();
+	m_mapWidth=w;
+	m_mapHeight=h;
+	m_packed=packed;
+	m_packedSize=packedSize;
+	m_datasize=mapSize;
+
+	// FNV-1a on unpacked size and packed data (packed data starts with a checksum of the unpacked data)
+	StarcraftMapHash hash = FNV_OFFSET;
+	for(int i=0; i<(int)sizeof(mapSize); i++) {hash^=(unsigned char)(mapSize>>(8*i)); hash*=FNV_PRIME;}
+	for(int i=0; i<packedSize; i++) {hash^=packed[i]; hash*=FNV_PRIME;}
+	m_hash = hash==0 ? 1 : hash;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+// unpack and decode packed map section
+bool BWrepMap::Unpack()
+{
+	if(m_packed==0) return true;
+
+	// unpack in new buffer
+	int mapSize = m_datasize;
+	unsigned char *buffer = (unsigned char *)calloc(mapSize,sizeof(unsigned char));
+	if(buffer==0) return false;
+	if(unpack_section_mem(m_packed,m_packedSize,buffer,mapSize)!=0) {free(buffer); return false;}
+
+	// decode map (buffer belongs to the map now, packed section is released)
+	StarcraftMapHash hash = m_hash;
+	DecodeMap(buffer,mapSize,m_mapWidth,m_mapHeight);
+	m_hash = hash;
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
 void BWrepMap::_Clear() 
 {
 	m_sectionCount=0;
 	m_datasize=0;
 
+	// free packed section
+	if(m_packed!=0) free(m_packed);
+	m_packed=0;
+	m_packedSize=0;
+	m_hash=0;
+
 	// free data buffer
 	if(m_data!=0) free((void*)m_data);
 	m_data=0;
@@ -82,6 +135,7 @@ BWrepMap::~BWrepMap()
 // find section by name
 const BWrepMapSection* BWrepMap::GetSection(const char *name) const
 {
+	// no section until map is unpacked
 	for(int i=0; i<m_sectionCount; i++)
 	{
 		if(_stricmp(name,m_sections[i].GetTitle())==0)
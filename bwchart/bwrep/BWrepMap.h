@@ -80,7 +80,8 @@ public:
 class DllExport BWrepMap : public IStarcraftMap
 {
 public:
-	BWrepMap() : m_sectionCount(0), m_data(0), m_datasize(0) {}
+	BWrepMap() : m_sectionCount(0), m_data(0), m_datasize(0), m_packed(0), m_packedSize(0), m_hash(0), 
+		m_mapWidth(0), m_mapHeight(0) {}
 	~BWrepMap();
 
 	// map dimensions
@@ -93,13 +94,28 @@ public:
 	// get tile section info (2 bytes per map square)
 	virtual const BWrepMapSection* GetTileSection() const;
 
+	// hash of the packed map section
+	virtual StarcraftMapHash GetHash() const {return m_hash;}
+
+	// unpack and decode packed map section
+	virtual bool Unpack();
+
 	//-internal
 	bool DecodeMap(const unsigned char *buffer, int mapSize, int w, int h);
 
+	// keep packed map section (buffer belongs to the map), it's only unpacked 
+	// and decoded when Unpack is called
+	void SetPackedMap(unsigned char *packed, int packedSize, int mapSize, int w, int h);
+
 private:
 	const unsigned char *m_data;     // pointer to data
 	int m_datasize;	// data size
 
+	// packed map section (until unpacked)
+	unsigned char *m_packed;
+	int m_packedSize;
+	StarcraftMapHash m_hash;
+
 	// sections
 	enum {MAXSECTION=36};
 	BWrepMapSection m_sections[MAXSECTION];
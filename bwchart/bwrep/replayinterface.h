@@ -169,6 +169,12 @@ public:
 //----------------------------------------------------------------------------------------------------
 
 // map info
+#ifdef _WIN32
+typedef unsigned __int64 StarcraftMapHash;
+#else
+typedef unsigned long long StarcraftMapHash;
+#endif
+
 class IStarcraftMap
 {
 public:
@@ -181,6 +187,13 @@ public:
 
 	// get tile section info (2 bytes per map square)
 	virtual const IStarcraftMapSection* GetTileSection() const=0;
+
+	// hash of the packed map section (0 if map wasnt loaded), identical maps have the same hash
+	virtual StarcraftMapHash GetHash() const=0;
+
+	// unpack and decode the map section if it was kept packed (false if it's corrupt),
+	// sections are only available once the map is unpacked
+	virtual bool Unpack()=0;
 };
 
 
@@ -205,6 +218,7 @@ public:
 
 	// game map
 	virtual const IStarcraftMap* QueryMap() const=0;
+	virtual IStarcraftMap* QueryMap()=0;
 
 	// release object
 	virtual void Release()=0;
@@ -302,11 +302,31 @@ int unpack_rep_section(esi_t *myesi, replay_enc_t *rep)
     // retn
 }
 
+/*
+ *  section source (replay file or packed section already in memory)
+ */
+
+typedef struct section_src_s {
+    FILE            *file;
+    const byte      *mem;
+    int             memsize;
+} section_src_t;
+
+static size_t src_read(void *dst, size_t n, section_src_t *src)
+{
+    if (src->file != NULL) return fread(dst, 1, n, src->file);
+    if (n > (size_t)src->memsize) n = (size_t)src->memsize;
+    memcpy(dst, src->mem, n);
+    src->mem += n;
+    src->memsize -= (int)n;
+    return n;
+}
+
 /*
  *  unpack_section - 40E5B0 - unpacks a replay section 
  */
 
-int unpack_section(FILE *file, byte *result, int size)
+static int unpack_section_src(section_src_t *src, byte *result, int size)
 {
     replay_enc_t    rep;
     esi_t           myesi;
@@ -315,16 +335,16 @@ int unpack_section(FILE *file, byte *result, int size)
 	unsigned int length=0,len=0;
 
     if (size == 0) return 4;
-    if (fread(&check, 1, 4, file) == 0) return 4;
-    if (fread(&count, 1, 4, file) == 0) return 4;
+    if (src_read(&check, 4, src) == 0) return 4;
+    if (src_read(&count, 4, src) == 0) return 4;
     /* clear myesi struct */
     memset(&myesi, 0, sizeof(myesi));
 
     for (n=0, m1C=0; n < count; n++, m1C+=sizeof(buffer), m20+=len)
     {
-        if (fread(&length, 1, 4, file) == 0) return 4;
+        if (src_read(&length, 4, src) == 0) return 4;
         if (length > (unsigned int)(size-m20)) return 4;
-        if (fread(result, 1, length, file) == 0) return 4;
+        if (src_read(result, length, src) == 0) return 4;
         if (length == (int)(min(size-m1C, sizeof(buffer)))) continue;
 
         // init rep struct 
@@ -352,6 +372,69 @@ int unpack_section(FILE *file, byte *result, int size)
     return 0;
 }
 
+int unpack_section(FILE *file, byte *result, int size)
+{
+    section_src_t   src = {file, NULL, 0};
+    return unpack_section_src(&src, result, size);
+}
+
+/*
+ *  unpack_section_mem - unpacks a section read with read_section
+ */
+
+int unpack_section_mem(const byte *packed, int packedSize, byte *result, int size)
+{
+    section_src_t   src = {NULL, packed, packedSize};
+    return unpack_section_src(&src, result, size);
+}
+
+/*
+ *  read_section - reads a packed section as is (check, chunk count and chunks)
+ *  size is the unpacked size, the buffer returned in packed must be freed (NULL on error)
+ */
+
+int read_section(FILE *file, byte **packed, int *packedSize, int size)
+{
+    int             count, n, used, alloc;
+	unsigned int length=0;
+    byte            *buf;
+
+    *packed = NULL;
+    *packedSize = 0;
+    if (size == 0) return 4;
+
+    alloc = 8 + 4*0x10 + 0x2000;
+    buf = (byte*)malloc(alloc);
+    if (buf == NULL) return 4;
+    if (fread(buf, 1, 8, file) != 8) {free(buf); return 4;}
+    memcpy(&count, buf+4, 4);
+    used = 8;
+
+    for (n=0; n < count; n++)
+    {
+        if (fread(&length, 1, 4, file) != 4) break;
+        if (length > (unsigned int)size) break;
+        if (used+4+(int)length > alloc)
+        {
+            byte *newbuf;
+            alloc = 2*(used+4+(int)length);
+            newbuf = (byte*)realloc(buf, alloc);
+            if (newbuf == NULL) break;
+            buf = newbuf;
+        }
+        memcpy(buf+used, &length, 4);
+        if (fread(buf+used+4, 1, length, file) != length) break;
+        used += 4+(int)length;
+    }
+
+    /* truncated or corrupt section */
+    if (n != count) {free(buf); return 4;}
+
+    *packed = buf;
+    *packedSize = used;
+    return 0;
+}
+
 void replay_unpack(replay_dec_t *rep, const char *path, int sections)
 {
     int             repID;
@@ -33,5 +33,8 @@ typedef struct replay_dec_s {
 /* function prototypes */
 /* int replay_pack(replay_dec_t *replay, const char *path); */
 void replay_unpack(replay_dec_t *replay, const char *path, int sections);
+int unpack_section(FILE *file, byte *result, int size);
+int unpack_section_mem(const byte *packed, int packedSize, byte *result, int size);
+int read_section(FILE *file, byte **packed, int *packedSize, int size);
 
 #endif /* _unpack_h */
@@ -11,15 +11,32 @@
 #include <functional>
 #include <vector>
 #include <unordered_map>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <atomic>
 
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <zlib.h>
 
+#include "eapm.h"
+#include "mapcache.h"
+#include "mapframe.h"
+#include "ingest.h"
+#include "replaystore.h"
+#include "sparkline.h"
+#include "spatialindex.h"
+#include "unitsize.h"
+
 namespace scr
 {
 
+// trace frames and commands while parsing
+bool g_trace = true;
+
 std::string&& FmtStr(const char* fmt, ...)
 {
   va_list va;
@@ -669,6 +686,54 @@ struct Frame
     UnitInfo units[1<<(sizeof(nunit)<<3)];
   };
 
+  struct __attribute__((packed)) ShiftSelect121
+  {
+    CommandHead head;
+    unsigned char nunit;
+    Select121::UnitInfo units[1<<(sizeof(nunit)<<3)];
+  };
+
+  struct __attribute__((packed)) ShiftDeselect121
+  {
+    CommandHead head;
+    unsigned char nunit;
+    Select121::UnitInfo units[1<<(sizeof(nunit)<<3)];
+  };
+
+  struct __attribute__((packed)) RightClick121
+  {
+    CommandHead head;
+
+    unsigned short x;
+    unsigned short y;
+    /* 0xffff for using position x/y, or move to specific unit */
+    unsigned short unitid;
+    unsigned short u1;
+    unsigned short unit_type;
+    unsigned char queued;
+  };
+
+  struct __attribute__((packed)) TargetedOrder121
+  {
+    CommandHead head;
+
+    unsigned short x;
+    unsigned short y;
+    unsigned short unitid;
+    unsigned short u1;
+    unsigned short unit_type;
+    unsigned char order;
+    unsigned char queued;
+  };
+
+  struct __attribute__((packed)) Unload121
+  {
+    CommandHead head;
+
+    unsigned short unitid;
+    unsigned short u1;
+  };
+
 };
 static const std::unordered_map<unsigned char, std::pair<const char*, int>> g_cmd_info = 
 {
@@ -743,9 +808,48 @@ static const std::unordered_map<unsigned char, std::pair<const char*, int>> g_cm
   {0x5A,  {"MergeDarkArchon",     sizeof(Frame::MergeDarkArchon)     }},
   {0x5b,  {"MakeGamePublic",      sizeof(Frame::MakeGamePublic)      }},
   {0x5c,  {"Chat",                sizeof(Frame::Chat)                }},
+  {0x60,  {"RightClick121",       sizeof(Frame::RightClick121)       }},
+  {0x61,  {"TargetedOrder121",    sizeof(Frame::TargetedOrder121)    }},
+  {0x62,  {"Unload121",           sizeof(Frame::Unload121)           }},
   {0x63,  {"Select121",           sizeof(Frame::Select121)           }},
+  {0x64,  {"ShiftSelect121",      sizeof(Frame::ShiftSelect121)      }},
+  {0x65,  {"ShiftDeselect121",    sizeof(Frame::ShiftDeselect121)    }},
 };
 
+// length of a command, head included (select commands are only as long as their unit list)
+int CommandLen(unsigned char cmdid, const char* cmd, int nleft)
+{
+  auto cmd_info = g_cmd_info.find(cmdid);
+  if (cmd_info == g_cmd_info.end())
+  {
+    return -6;
+  }
+
+  int ncmd = cmd_info->second.second;
+  switch (cmdid)
+  {
+    case 0x09:
+    case 0x0A:
+    case 0x0B:
+      if (nleft < 3)
+      {
+        return -6;
+      }
+      ncmd = 3 + 2*(unsigned char)cmd[2];
+      break;
+    case 0x63:
+    case 0x64:
+    case 0x65:
+      if (nleft < 3)
+      {
+        return -6;
+      }
+      ncmd = 3 + 4*(unsigned char)cmd[2];
+      break;
+  }
+  return ncmd;
+}
+
 void DumpCmdInfo()
 {
   for (const auto& info: g_cmd_info)
@@ -756,6 +860,22 @@ void DumpCmdInfo()
 
 struct Replay
 {
+  // player slot of the header
+  struct __attribute__((packed)) PlayerRecord
+  {
+    unsigned int number;
+    /* -1 for computer or none, else 0-7 (playerid of the commands) */
+    int slot;
+    /* 0x01 computer
+     * 0x02 human
+     * */
+    unsigned char type;
+    /* 0x00 zerg, 0x01 terran, 0x02 protoss, 0x06 random */
+    unsigned char race;
+    unsigned char u1;
+    char name[25];
+  };
+
   std::string replayid;
   unsigned int u;
   union Header
@@ -775,7 +895,7 @@ struct Replay
       unsigned char u4;
       unsigned char map_name[26];
       unsigned char u5[38];
-      unsigned char player_records[432];
+      PlayerRecord player_records[12];
       unsigned int player_color[8];
       unsigned char player_index[8];
     } data;
@@ -783,6 +903,9 @@ struct Replay
   };
   Header header;
   std::vector<Frame> frames;
+  // map section (scenario.chk), and hash of its packed data (as bwrep)
+  std::string map;
+  MapAssetHash map_hash = 0;
 };
 
 void DumpReplay(const char* loghd, const Replay& replay)
@@ -880,37 +1003,46 @@ int ParseCommand(const char* data, int size, Replay* replay)
       return read_len;
     }
 
-    fprintf(stderr, "frame.time: {pasted: %u, command_len: %hhu}\n", frame.time.pasted, frame.time.command_len);
+    if (g_trace) fprintf(stderr, "frame.time: {pasted: %u, command_len: %hhu}\n", frame.time.pasted, frame.time.command_len);
+
+    // command_len is the length in bytes of all the commands of the frame
+    int end = read_len + frame.time.command_len;
+    if (end > size)
+    {
+      return -6;
+    }
 
-    for (int i = 0; i < frame.time.command_len; i++)
+    while (read_len < end)
     {
       Frame::CommandHead head = {};
-      read_len = Lookahead(data, size, read_len, sizeof(head), &head);
+      read_len = Lookahead(data, end, read_len, sizeof(head), &head);
       if (read_len < 0)
       {
         return read_len;
       }
 
-      fprintf(stderr, "head: { playerid: %hhu, cmdid: 0x%hhX\n", head.playerid, head.cmdid);
+      if (g_trace) fprintf(stderr, "head: { playerid: %hhu, cmdid: 0x%hhX\n", head.playerid, head.cmdid);
 
-      auto cmd_info = g_cmd_info.find(head.cmdid);
-      if (cmd_info == g_cmd_info.end())
+      int ncmd = CommandLen(head.cmdid, data+read_len, end-read_len);
+      if (ncmd < 0)
       {
-        fprintf(stderr, "unknown cmd[0x%hhx]\n", head.cmdid);
-        return -6;
+        // like bwrep, the rest of the frame is lost
+        if (g_trace) fprintf(stderr, "unknown cmd[0x%hhx]\n", head.cmdid);
+        read_len = end;
+        break;
       }
 
-      int ncmd = cmd_info->second.second;
-      std::shared_ptr<Frame::Command> cmd((Frame::Command*)operator new(ncmd));
-      read_len = Forward(data, size, read_len, ncmd, cmd.get());
+      std::shared_ptr<Frame::Command> cmd((Frame::Command*)operator new(ncmd), [](Frame::Command* cmd){operator delete(cmd);});
+      read_len = Forward(data, end, read_len, ncmd, cmd.get());
       if (read_len < 0)
       {
         return read_len;
       }
+      frame.command.push_back(std::move(cmd));
     }
     replay->frames.push_back(std::move(frame));
   }
-  return 0;
+  return read_len;
 }
 
 int ParseFrame(const char* data, int size, Replay* replay)
@@ -981,7 +1113,13 @@ int ParseMapData(const char* data, int size, Replay* replay)
   {
     return -6;
   }
-  // TODO
+  MapAssetHasher hasher(len.data);
+  for (const auto& data: chunk.datas)
+  {
+    hasher.Add(data.data(), data.size());
+  }
+  replay->map_hash = hasher.GetHash();
+  replay->map = std::move(chunk.raw);
   return read_len;
 }
 
@@ -1037,7 +1175,7 @@ int Parse(const char* data, int size, Replay* replay)
     &ParseGap,
     &ParseHeader,
     &ParseFrame,
-    // &ParseMapData,
+    &ParseMapData,
     // &ParseRwaData,
   };
 
@@ -1056,6 +1194,858 @@ int Parse(const char* data, int size, Replay* replay)
   return 0;
 }
 
+// frames are 1/23.8 s, apm doesnt count the first 2 minutes (like bwchart)
+const double kFramesPerSecond = 23.8;
+const unsigned int kMinApmFrames = 2880;
+
+// commands that count as player actions (not lobby, network or chat)
+bool IsAction(unsigned char cmdid)
+{
+  return (cmdid >= 0x09 && cmdid <= 0x36 && (cmdid < 0x0D || cmdid > 0x12))
+      || cmdid == 0x5A || (cmdid >= 0x60 && cmdid <= 0x65);
+}
+
+// apm of a player, and its standard deviation over the minutes of the game
+void GetApm(const Replay& replay, int playerid, int* apm, int* apm_dev)
+{
+  const double minute = 60*kFramesPerSecond;
+  std::vector<int> minutes;
+  unsigned int last = 0;
+  int count = 0;
+  int count_begin = 0;
+  for (const auto& frame: replay.frames)
+  {
+    for (const auto& cmd: frame.command)
+    {
+      if (cmd->head.playerid != playerid || !IsAction(cmd->head.cmdid))
+      {
+        continue;
+      }
+      count++;
+      last = frame.time.pasted;
+      if (last < kMinApmFrames)
+      {
+        count_begin++;
+        continue;
+      }
+      size_t idx = (last - kMinApmFrames) / minute;
+      if (minutes.size() <= idx)
+      {
+        minutes.resize(idx+1);
+      }
+      minutes[idx]++;
+    }
+  }
+
+  *apm = 0;
+  *apm_dev = 0;
+  if (count == 0 || last == 0)
+  {
+    return;
+  }
+  double frames = last;
+  if (frames > kMinApmFrames)
+  {
+    frames -= kMinApmFrames;
+    count -= count_begin;
+  }
+  *apm = minute*count/frames;
+
+  // last minute isnt complete
+  int full = (last - std::min(last, kMinApmFrames)) / minute;
+  if (full > 0)
+  {
+    double sum = 0;
+    for (int i = 0; i < full; i++)
+    {
+      sum += (minutes[i] - *apm) * (minutes[i] - *apm);
+    }
+    *apm_dev = sqrt(sum / full);
+  }
+}
+
+// effective apm: commands as the bwchart classifier sees them
+int EapmKind(unsigned char cmdid)
+{
+  switch (cmdid)
+  {
+    case 0x09: case 0x63: return EAPMClassifier::K_SELECT;
+    case 0x0A: case 0x64: return EAPMClassifier::K_SHIFTSELECT;
+    case 0x0B: case 0x65: return EAPMClassifier::K_SHIFTDESELECT;
+    case 0x13: return EAPMClassifier::K_HOTKEY;
+    case 0x1F: case 0x23: case 0x2A: case 0x5A: return EAPMClassifier::K_TRAIN;
+    case 0x0C: return EAPMClassifier::K_BUILD;
+    case 0x35: return EAPMClassifier::K_MORPH;
+    case 0x30: case 0x32: return EAPMClassifier::K_TECH;
+    case 0x18: case 0x19: case 0x20: case 0x31: case 0x33: case 0x34: return EAPMClassifier::K_CANCEL;
+  }
+  return EAPMClassifier::K_OTHER;
+}
+
+// buckets of 12 frames: 2 minutes and 1 minute (1428 frames) are whole buckets
+const unsigned long kEapmBucketFrames = 12;
+
+// feed the actions of a player to the classifier
+void ClassifyActions(const Replay& replay, int playerid, EAPMClassifier* eapm)
+{
+  for (const auto& frame: replay.frames)
+  {
+    for (const auto& cmd: frame.command)
+    {
+      unsigned char cmdid = cmd->head.cmdid;
+      if (cmd->head.playerid != playerid || !IsAction(cmdid))
+      {
+        continue;
+      }
+      const char* raw = (const char*)cmd.get();
+      int ncmd = CommandLen(cmdid, raw, INT32_MAX);
+      EAPMClassifier::Command c(frame.time.pasted, EapmKind(cmdid), cmdid, raw + sizeof(cmd->head), ncmd - sizeof(cmd->head));
+      switch (cmdid)
+      {
+        case 0x1F: c.m_object = ((const Frame::Train*)raw)->unit_type; break;
+        case 0x23: c.m_object = ((const Frame::Hatch*)raw)->unit_type; break;
+        case 0x35: c.m_object = ((const Frame::Morph*)raw)->build_unit_type; break;
+        case 0x30: c.m_object = ((const Frame::Research*)raw)->research_id; break;
+        case 0x32: c.m_object = 0x100 + ((const Frame::Upgrade*)raw)->upgrade_id; break;
+        case 0x0C:
+        {
+          const Frame::Build* build = (const Frame::Build*)raw;
+          c.m_object = build->build_unitid;
+          c.m_x = build->x;
+          c.m_y = build->y;
+          GetBuildingSize(build->build_unitid, &c.m_width, &c.m_height);
+          break;
+        }
+      }
+      eapm->Classify(c);
+    }
+  }
+}
+
+// worker unit ids (bwrep unit table)
+const int kUnitSCV = 0x07;
+const int kUnitDrone = 0x29;
+const int kUnitProbe = 0x40;
+
+// curves of a player for the replay list, from the apm of every eapm bucket and the
+// workers trained so far. Supply and army need the game state and stay empty here,
+// the browser computes them when it parses the replay again.
+void GetSparkline(const Replay& replay, int playerid, const EAPMClassifier& eapm, ReplaySparkline* spark)
+{
+  spark->Clear();
+  int count = eapm.GetBucketCount();
+  if (count <= 0)
+  {
+    return;
+  }
+
+  std::vector<unsigned long> apm(count), workers(count);
+  for (int i = 0; i < count; i++)
+  {
+    apm[i] = eapm.GetAPM(i, 1, 60*kFramesPerSecond, false);
+  }
+
+  // one worker per train or hatch command (selected larvae arent tracked)
+  for (const auto& frame: replay.frames)
+  {
+    for (const auto& cmd: frame.command)
+    {
+      unsigned char cmdid = cmd->head.cmdid;
+      if (cmd->head.playerid != playerid || (cmdid != 0x1F && cmdid != 0x23))
+      {
+        continue;
+      }
+      const char* raw = (const char*)cmd.get();
+      int unit = cmdid == 0x1F ? ((const Frame::Train*)raw)->unit_type : ((const Frame::Hatch*)raw)->unit_type;
+      if (unit == kUnitSCV || unit == kUnitDrone || unit == kUnitProbe)
+      {
+        workers[std::min(count - 1, (int)(frame.time.pasted / kEapmBucketFrames))]++;
+      }
+    }
+  }
+  for (int i = 1; i < count; i++)
+  {
+    workers[i] += workers[i - 1];
+  }
+
+  spark->SetSerie(ReplaySparkline::S_APM, apm.data(), count, true);
+  spark->SetSerie(ReplaySparkline::S_WORKERS, workers.data(), count, false);
+}
+
+// effective apm of a player on the whole game (like GetApm, without the first 2 minutes)
+int GetEapm(const EAPMClassifier& eapm)
+{
+  int count = eapm.GetBucketCount();
+  int first = kMinApmFrames / kEapmBucketFrames;
+  if (count <= first)
+  {
+    first = 0;
+  }
+  return eapm.GetAPM(count - 1, count - first, 60*kFramesPerSecond, true);
+}
+
+// apm and effective apm of the players, then both per minute
+void DumpApm(const Replay& replay)
+{
+  const unsigned long minute = 60*kFramesPerSecond;
+  const int window = minute / kEapmBucketFrames;
+  for (const auto& player: replay.header.data.player_records)
+  {
+    if (player.slot < 0 || player.type == 0)
+    {
+      continue;
+    }
+    int apm, apm_dev;
+    GetApm(replay, player.slot, &apm, &apm_dev);
+    EAPMClassifier eapm(kEapmBucketFrames);
+    ClassifyActions(replay, player.slot, &eapm);
+    if (eapm.GetTotalActions() == 0)
+    {
+      continue;
+    }
+    printf("%.*s: apm %d, eapm %d, actions %d, effective %d\n", (int)sizeof(player.name), player.name,
+           apm, GetEapm(eapm), eapm.GetTotalActions(), eapm.GetTotalEffectiveActions());
+    printf("  minute apm/eapm:");
+    for (int end = window - 1; end < eapm.GetBucketCount() + window - 1; end += window)
+    {
+      printf(" %d/%d", eapm.GetAPM(end, window, minute, false), eapm.GetAPM(end, window, minute, true));
+    }
+    printf("\n");
+  }
+}
+
+// tiles, start locations and resources of the map (like Replay::_ExtractMapAssets in bwchart)
+MapAssetRecord* ExtractMapAssets(const Replay& replay)
+{
+  const std::string& chk = replay.map;
+  int width = replay.header.data.map_width;
+  int height = replay.header.data.map_height;
+  std::string tiles;
+  std::string units;
+
+  // sections: name, length, data. Like the game, a later MTXM overwrites the beginning of
+  // the tiles (protected maps have a junk one first) and UNIT sections add up
+  size_t off = 0;
+  while (off + 8 <= chk.size())
+  {
+    char name[4];
+    int len;
+    memcpy(name, chk.data()+off, sizeof(name));
+    memcpy(&len, chk.data()+off+4, sizeof(len));
+    off += 8;
+    if (len < 0 || (size_t)len > chk.size() - off)
+    {
+      break;
+    }
+    const char* section = chk.data() + off;
+    off += len;
+
+    if (memcmp(name, "MTXM", 4) == 0)
+    {
+      tiles.resize(2*width*height);
+      tiles.replace(0, std::min((size_t)len, tiles.size()), section, std::min((size_t)len, tiles.size()));
+    }
+    else if (memcmp(name, "UNIT", 4) == 0)
+    {
+      units.append(section, len);
+    }
+  }
+
+  return MapAssetRecord::Extract(replay.map_hash, width, height, (const unsigned char*)tiles.data(), tiles.size(),
+                                 (const unsigned char*)units.data(), units.size());
+}
+
+// feed the headless renderer with the map and the actions (like ReplayMapAnimated::InitRenderer),
+// players are colored by command player id
+void InitRenderer(const Replay& replay, const MapAssetRecord& assets, MapFrameRenderer* renderer)
+{
+  // tiles, then start locations of the players and resources
+  renderer->SetTiles(assets);
+  const Replay::Header::Data& hd = replay.header.data;
+  int playerids[12];
+  for (int i = 0; i < 12; i++)
+  {
+    const Replay::PlayerRecord& player = hd.player_records[i];
+    playerids[i] = player.slot >= 0 && player.name[0] != '\0' ? player.slot : -1;
+  }
+  renderer->AddMapUnits(assets, playerids, 12);
+
+  // buildings placed, and moves or attacks on a position
+  for (const auto& frame: replay.frames)
+  {
+    for (const auto& cmd: frame.command)
+    {
+      const char* raw = (const char*)cmd.get();
+      int playerid = cmd->head.playerid;
+      switch (cmd->head.cmdid)
+      {
+        case 0x0C:
+        {
+          // build, add-on, warp or morph of a drone (not a landing)
+          const Frame::Build* build = (const Frame::Build*)raw;
+          if (build->build_unit_type == 0x19 || build->build_unit_type == 0x1E || build->build_unit_type == 0x1F
+              || build->build_unit_type == 0x24)
+          {
+            int w, h;
+            GetBuildingSize(build->build_unitid, &w, &h);
+            renderer->AddAction(MapFrameRenderer::BUILD, build->x, build->y, w, h, playerid, frame.time.pasted);
+          }
+          break;
+        }
+        case 0x14:
+        {
+          const Frame::Move* move = (const Frame::Move*)raw;
+          renderer->AddAction(MapFrameRenderer::MOVE, move->x/32, move->y/32, 1, 1, playerid, frame.time.pasted);
+          break;
+        }
+        case 0x15:
+        {
+          const Frame::Action* action = (const Frame::Action*)raw;
+          renderer->AddAction(MapFrameRenderer::MOVE, action->x/32, action->y/32, 1, 1, playerid, frame.time.pasted);
+          break;
+        }
+        case 0x60:
+        {
+          const Frame::RightClick121* click = (const Frame::RightClick121*)raw;
+          renderer->AddAction(MapFrameRenderer::MOVE, click->x/32, click->y/32, 1, 1, playerid, frame.time.pasted);
+          break;
+        }
+        case 0x61:
+        {
+          const Frame::TargetedOrder121* order = (const Frame::TargetedOrder121*)raw;
+          renderer->AddAction(MapFrameRenderer::MOVE, order->x/32, order->y/32, 1, 1, playerid, frame.time.pasted);
+          break;
+        }
+      }
+    }
+  }
+  renderer->Restart();
+}
+
+// render mode: write the animated map every step seconds as PPM frames,
+// map assets are kept in the cache file if there is one
+int Render(const char* path, const char* dir, int step, const char* cache_path)
+{
+  g_trace = false;
+  std::string rep;
+  int ret = LoadFile(path, &rep);
+  if (ret != 0)
+  {
+    fprintf(stderr, "ERR:%d: Load(%s) failed\n", ret, path);
+    return ret;
+  }
+  Replay replay;
+  ret = Parse(rep.data(), rep.size(), &replay);
+  if (ret != 0)
+  {
+    fprintf(stderr, "ERR:%d: Parse(%s) failed\n", ret, path);
+    return ret;
+  }
+
+  // map assets are computed once per map (like Replay::_CreateTileset)
+  MapAssetCache cache;
+  if (cache_path != nullptr && !cache.Open(cache_path))
+  {
+    fprintf(stderr, "ERR: Open(%s) failed\n", cache_path);
+    return -1;
+  }
+  const MapAssetRecord* assets = cache.Find(replay.map_hash);
+  bool cached = assets != nullptr;
+  if (!cached)
+  {
+    std::unique_ptr<MapAssetRecord, void(*)(void*)> extracted(ExtractMapAssets(replay), free);
+    if (extracted)
+    {
+      assets = cache.Add(extracted.get());
+    }
+  }
+  if (assets == nullptr || assets->m_width == 0 || assets->m_height == 0)
+  {
+    fprintf(stderr, "ERR: no map in %s\n", path);
+    return -1;
+  }
+  MapFrameRenderer renderer(assets->m_width, assets->m_height);
+  InitRenderer(replay, *assets, &renderer);
+
+  // one frame per step, and the last one at the end of the game
+  unsigned long end = replay.header.data.game_frames;
+  unsigned long inc = std::max(1UL, (unsigned long)(step*kFramesPerSecond));
+  int count = 0;
+  for (unsigned long time = std::min(inc, end); ; time = std::min(time + inc, end))
+  {
+    renderer.Render(time);
+    std::string name = dir + std::string("/frame_") + std::to_string(count) + ".ppm";
+    if (!renderer.WritePPM(name.c_str()))
+    {
+      fprintf(stderr, "ERR: write %s failed\n", name.c_str());
+      return -1;
+    }
+    count++;
+    if (time >= end)
+    {
+      break;
+    }
+  }
+  printf("map: %dx%d%s\n", assets->m_width, assets->m_height, cached ? " (cached)" : "");
+  printf("frames: %d\n", count);
+  return 0;
+}
+
+// action with a map position, as indexed for queries (position in pixels)
+struct PositionAction
+{
+  unsigned long time;
+  int playerid;
+  int kind;
+  int x;
+  int y;
+};
+
+// positional actions of all the players, in replay order
+void GetPositionActions(const Replay& replay, std::vector<PositionAction>* actions)
+{
+  for (const auto& frame: replay.frames)
+  {
+    for (const auto& cmd: frame.command)
+    {
+      const char* raw = (const char*)cmd.get();
+      PositionAction action = {frame.time.pasted, cmd->head.playerid, 0, 0, 0};
+      switch (cmd->head.cmdid)
+      {
+        case 0x0C:
+        {
+          // build position is in map squares
+          const Frame::Build* build = (const Frame::Build*)raw;
+          action.kind = ActionSpatialIndex::BUILD;
+          action.x = build->x*32;
+          action.y = build->y*32;
+          break;
+        }
+        case 0x14:
+        {
+          const Frame::Move* move = (const Frame::Move*)raw;
+          action.kind = ActionSpatialIndex::MOVE;
+          action.x = move->x;
+          action.y = move->y;
+          break;
+        }
+        case 0x15:
+        {
+          const Frame::Action* target = (const Frame::Action*)raw;
+          action.kind = ActionSpatialIndex::ATTACK;
+          action.x = target->x;
+          action.y = target->y;
+          break;
+        }
+        case 0x58:
+        {
+          const Frame::MinimapPing* ping = (const Frame::MinimapPing*)raw;
+          action.kind = ActionSpatialIndex::PING;
+          action.x = ping->x;
+          action.y = ping->y;
+          break;
+        }
+        case 0x60:
+        {
+          const Frame::RightClick121* click = (const Frame::RightClick121*)raw;
+          action.kind = ActionSpatialIndex::MOVE;
+          action.x = click->x;
+          action.y = click->y;
+          break;
+        }
+        case 0x61:
+        {
+          const Frame::TargetedOrder121* order = (const Frame::TargetedOrder121*)raw;
+          action.kind = ActionSpatialIndex::ATTACK;
+          action.x = order->x;
+          action.y = order->y;
+          break;
+        }
+      }
+      if (action.kind != 0)
+      {
+        actions->push_back(action);
+      }
+    }
+  }
+}
+
+// query mode: the replay is parsed and its actions indexed once, then every line of the query
+// file (stdin if none) is a query:
+//   <x1> <y1> <x2> <y2> <from sec> <to sec> [kinds] [player]
+// for actions of the given kinds (m=move, a=attack, b=build, p=ping, all by default) in a rectangle
+// (pixels) and a time range, for all players or the named one
+int Query(const char* path, const char* query_path)
+{
+  g_trace = false;
+  std::string rep;
+  int ret = LoadFile(path, &rep);
+  if (ret != 0)
+  {
+    fprintf(stderr, "ERR:%d: Load(%s) failed\n", ret, path);
+    return ret;
+  }
+  Replay replay;
+  ret = Parse(rep.data(), rep.size(), &replay);
+  if (ret != 0)
+  {
+    fprintf(stderr, "ERR:%d: Parse(%s) failed\n", ret, path);
+    return ret;
+  }
+
+  FILE* queries = stdin;
+  if (query_path != nullptr && strcmp(query_path, "-") != 0)
+  {
+    queries = fopen(query_path, "r");
+    if (queries == nullptr)
+    {
+      fprintf(stderr, "ERR: open(%s) failed\n", query_path);
+      return -1;
+    }
+  }
+  std::shared_ptr<FILE> _queries(queries, [](FILE* fp){if (fp != stdin) fclose(fp);});
+
+  // index positional actions
+  const Replay::Header::Data& hd = replay.header.data;
+  std::vector<PositionAction> actions;
+  GetPositionActions(replay, &actions);
+  ActionSpatialIndex index(hd.map_width, hd.map_height);
+  for (int i = 0; i < (int)actions.size(); i++)
+  {
+    index.Add(actions[i].kind, actions[i].x, actions[i].y, actions[i].playerid, actions[i].time, i);
+  }
+  index.Finish();
+  printf("indexed: %d\n", index.GetCount());
+
+  static const char* kKindNames[] = {"", "move", "attack", "", "build", "", "", "", "ping"};
+  char line[256];
+  int count_queries = 0;
+  while (fgets(line, sizeof(line), queries) != nullptr)
+  {
+    int x1, y1, x2, y2, from, to;
+    char kinds[8] = "mabp";
+    char name[32] = "";
+    int n = sscanf(line, "%d %d %d %d %d %d %7s %31s", &x1, &y1, &x2, &y2, &from, &to, kinds, name);
+    if (n <= 0)
+    {
+      continue;
+    }
+    if (n < 6)
+    {
+      fprintf(stderr, "ERR: bad query: %s", line);
+      continue;
+    }
+    count_queries++;
+
+    // players and action kinds
+    unsigned long players = SPATIAL_ALLPLAYERS;
+    if (name[0] != '\0')
+    {
+      players = 0;
+      for (const auto& player: hd.player_records)
+      {
+        if (player.slot >= 0 && player.slot < 32 && strncmp(player.name, name, sizeof(player.name)) == 0)
+        {
+          players |= 1UL << player.slot;
+        }
+      }
+      if (players == 0)
+      {
+        fprintf(stderr, "ERR: no player %s in %s\n", name, path);
+        continue;
+      }
+    }
+    int kindmask = 0;
+    for (const char* k = kinds; *k != '\0'; k++)
+    {
+      kindmask |= *k == 'm' ? ActionSpatialIndex::MOVE : *k == 'a' ? ActionSpatialIndex::ATTACK
+        : *k == 'b' ? ActionSpatialIndex::BUILD : *k == 'p' ? ActionSpatialIndex::PING : 0;
+    }
+
+    // count matches, then get them
+    unsigned long t1 = (unsigned long)(from*kFramesPerSecond);
+    unsigned long t2 = (unsigned long)(to*kFramesPerSecond);
+    int count = index.Query(x1, y1, x2, y2, t1, t2, players, kindmask, nullptr, 0);
+    std::vector<int> results(count);
+    index.Query(x1, y1, x2, y2, t1, t2, players, kindmask, results.data(), count);
+
+    printf("query %d: %d %d %d %d %d %d %s %s\n", count_queries, x1, y1, x2, y2, from, to, kinds, name);
+    for (int idx: results)
+    {
+      const PositionAction& action = actions[idx];
+      int sec = (int)(action.time/kFramesPerSecond);
+      const char* player = "";
+      int len = 0;
+      for (const auto& record: hd.player_records)
+      {
+        if (record.slot == action.playerid)
+        {
+          player = record.name;
+          len = strnlen(record.name, sizeof(record.name));
+          break;
+        }
+      }
+      printf("%02d:%02d %.*s %s %d,%d\n", sec/60, sec%60, len, player, kKindNames[action.kind], action.x, action.y);
+    }
+    printf("actions: %d\n", count);
+  }
+  printf("queries: %d\n", count_queries);
+  return 0;
+}
+
+// start location of a player (index in the header) as a clock value, like
+// ReplayEvtList::GetStartingLocation in bwchart, 0 if the map has none for it
+int GetStartClock(const Replay& replay, const MapAssetRecord& assets, int idx)
+{
+  const MapAssetUnit* units = assets.GetUnits();
+  for (int i = 0; i < assets.m_unitCount; i++)
+  {
+    if (units[i].m_kind != MapAssetUnit::STARTLOCATION || units[i].m_playerid != idx)
+    {
+      continue;
+    }
+    const double division = 12.0;
+    const double pi = 3.14159265358979;
+    double dx = units[i].m_x - assets.m_width/2;
+    double dy = assets.m_height/2 - units[i].m_y;
+    double r = sqrt(dx*dx+dy*dy);
+    double alpha = acos(dx/r);
+    if (dy < 0) alpha = -alpha;
+    if (dx < 0 && dy > 0) alpha = (5.0*pi)/2.0-alpha;
+    else alpha = pi/2.0-alpha;
+    alpha += pi/division;
+    int loc = (int)(division*(alpha/(2.0*pi)));
+    if (loc == 0) loc = (int)division;
+
+    // lost temple: use the common positions 12,9,6,3
+    const char* name = (const char*)replay.header.data.map_name;
+    std::string map_name(name, strnlen(name, sizeof(replay.header.data.map_name)));
+    std::transform(map_name.begin(), map_name.end(), map_name.begin(), ::tolower);
+    if (map_name.find("temple") != std::string::npos)
+    {
+      if (loc == 2 || loc == 4) loc = 3;
+      else if (loc == 7 || loc == 5) loc = 6;
+      else if (loc == 10 || loc == 8) loc = 9;
+    }
+    return loc;
+  }
+  return 0;
+}
+
+// ingest mode: parse the replays of a directory tree into a replay store
+class ReplayParser : public IngestParser
+{
+ public:
+  // actions and effective actions of all the parsed players are added to the counters
+  ReplayParser(std::atomic<long>* actions, std::atomic<long>* effective) : actions_(actions), effective_(effective) {}
+
+  // same record as the bwchart replay list:
+  // version \ file date \ game date \ map \ player count \ {player \apm\race\apmdev\start} \ duration \ engine \ rwa \ hack count
+  int Parse(const char* path, IngestRecord* record) override
+  {
+    std::string rep;
+    int ret = LoadFile(path, &rep);
+    if (ret != 0)
+    {
+      return ret;
+    }
+
+    Replay replay;
+    ret = scr::Parse(rep.data(), rep.size(), &replay);
+    if (ret != 0)
+    {
+      return ret;
+    }
+
+    struct stat path_stat;
+    if (stat(path, &path_stat) != 0)
+    {
+      return -3;
+    }
+
+    // start locations come from the map
+    std::unique_ptr<MapAssetRecord, void(*)(void*)> assets(ExtractMapAssets(replay), free);
+
+    // players that did something (observers are skipped)
+    const Replay::Header::Data& hd = replay.header.data;
+    std::ostringstream players;
+    std::vector<ReplaySparkline> sparks;
+    int player_count = 0;
+    for (int i = 0; i < 12; i++)
+    {
+      const Replay::PlayerRecord& player = hd.player_records[i];
+      if (player.slot < 0 || player.type == 0)
+      {
+        continue;
+      }
+      int apm, apm_dev;
+      GetApm(replay, player.slot, &apm, &apm_dev);
+      if (apm == 0)
+      {
+        continue;
+      }
+      EAPMClassifier eapm(kEapmBucketFrames);
+      ClassifyActions(replay, player.slot, &eapm);
+      *actions_ += eapm.GetTotalActions();
+      *effective_ += eapm.GetTotalEffectiveActions();
+      sparks.resize(player_count + 1);
+      GetSparkline(replay, player.slot, eapm, &sparks[player_count]);
+      int start = assets ? GetStartClock(replay, *assets, i) : 0;
+      players << Field(player.name, sizeof(player.name)) << " \\" << apm << '\\' << (int)player.race
+              << '\\' << apm_dev << '\\' << start << '\\';
+      player_count++;
+    }
+
+    std::ostringstream os;
+    os << kRecordVersion << '\\' << Date(path_stat.st_mtime) << '\\' << Date(hd.save_time)
+       << '\\' << Field(hd.map_name, sizeof(hd.map_name)) << '\\' << player_count << '\\'
+       << players.str()
+       << (int)(hd.game_frames / kFramesPerSecond) << '\\'
+       << Engine(hd.engine) << '\\'
+       << "0:\\"  // rwa audio is only appended to 1.16 replays, which this parser doesnt read
+       << "?\\";  // hacks arent detected here, the browser parses the replay again
+
+    std::string desc = os.str();
+    record->m_size = desc.size();
+    record->m_data = (char*)malloc(desc.size());
+    memcpy(record->m_data, desc.data(), desc.size());
+
+    // sparklines record (like ReplayInfo::SaveSparklines)
+    if (player_count > 0)
+    {
+      record->m_extraSize = ReplaySparkline::GetRecordSize(player_count);
+      record->m_extra = (char*)malloc(record->m_extraSize);
+      ReplaySparkline::WriteRecord(sparks.data(), player_count, (unsigned char*)record->m_extra);
+    }
+    return 0;
+  }
+
+ private:
+  // record version of bwchart (ReplayInfo::VER_CURRENT)
+  static const int kRecordVersion = 4;
+
+  std::atomic<long>* actions_;
+  std::atomic<long>* effective_;
+
+  static std::string Field(const void* field, int size)
+  {
+    return std::string((const char*)field, strnlen((const char*)field, size));
+  }
+
+  static std::string Date(time_t date)
+  {
+    struct tm tm = {};
+    char buf[16] = "01/01/1971";
+    if (localtime_r(&date, &tm) != nullptr)
+    {
+      strftime(buf, sizeof(buf), "%d/%m/%Y", &tm);
+    }
+    return buf;
+  }
+
+  // engine type, then version (newest version bwchart knows, 1.16)
+  static std::string Engine(unsigned char engine)
+  {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%02d:%d", engine, 0x24);
+    return buf;
+  }
+};
+
+class StoreWriter : public IngestHandler
+{
+ public:
+  // replay records go to store, sparklines to sparks
+  StoreWriter(ReplayStore* store, ReplayStore* sparks) : store_(store), sparks_(sparks), actions_(0), effective_(0) {}
+
+  bool Accept(const char* path, bool is_directory) override
+  {
+    return is_directory || IngestPipeline::HasExtension(path, ".rep");
+  }
+
+  IngestParser* CreateParser() override
+  {
+    return new ReplayParser(&actions_, &effective_);
+  }
+
+  // key is directory, then file name (like the bwchart database)
+  void Write(IngestRecord** records, int count) override
+  {
+    for (int i = 0; i < count; i++)
+    {
+      if (records[i]->m_status != 0)
+      {
+        fprintf(stderr, "ERR:%d: Load(%s) failed\n", records[i]->m_status, records[i]->m_path);
+        continue;
+      }
+      std::string key = records[i]->m_path;
+      size_t sep = key.rfind('/');
+      if (sep != std::string::npos)
+      {
+        key[sep] = '\0';
+      }
+      store_->Put(key.data(), key.size(), records[i]->m_data, records[i]->m_size);
+      if (records[i]->m_extra != nullptr)
+      {
+        sparks_->Put(key.data(), key.size(), records[i]->m_extra, records[i]->m_extraSize);
+      }
+    }
+  }
+
+ long GetActions() const { return actions_; }
+  long GetEffectiveActions() const { return effective_; }
+
+ private:
+  ReplayStore* store_;
+  ReplayStore* sparks_;
+  std::atomic<long> actions_;
+  std::atomic<long> effective_;
+};
+
+// sparklines store is next to the replay store, like the bwchart database files
+std::string GetSparklineStorePath(const char* db)
+{
+  std::string path = db;
+  size_t sep = path.rfind('/');
+  return path.substr(0, sep == std::string::npos ? 0 : sep + 1) + "sparklines.db";
+}
+
+int Ingest(const char* dir, const char* db, int workers)
+{
+  ReplayStore store;
+  if (!store.Open(db))
+  {
+    fprintf(stderr, "ERR: Open(%s) failed\n", db);
+    return -1;
+  }
+  std::string sparks_path = GetSparklineStorePath(db);
+  ReplayStore sparks;
+  if (!sparks.Open(sparks_path.c_str()))
+  {
+    fprintf(stderr, "ERR: Open(%s) failed\n", sparks_path.c_str());
+    return -1;
+  }
+
+  g_trace = false;
+  StoreWriter writer(&store, &sparks);
+  IngestPipeline pipeline(&writer, workers);
+  auto start = std::chrono::steady_clock::now();
+  int written = pipeline.Run(dir, true);
+  store.Close();
+  sparks.Close();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  printf("files: %d\n", pipeline.GetFileCount());
+  printf("parsed: %d\n", pipeline.GetParsedCount());
+  printf("failed: %d\n", pipeline.GetFailedCount());
+  printf("written: %d\n", written);
+  printf("actions: %ld (effective: %ld)\n", writer.GetActions(), writer.GetEffectiveActions());
+  printf("workers: %d\n", pipeline.GetWorkerCount());
+  printf("elapsed: %.3fs (%.0f files/s)\n", elapsed.count(),
+         elapsed.count() > 0 ? pipeline.GetFileCount() / elapsed.count() : 0.0);
+  return 0;
+}
+
 }
 
 int main(int argc, char** argv)
@@ -1066,11 +2056,60 @@ int main(int argc, char** argv)
   if (argc < 2)
   {
     fprintf(stderr, "%s <replay file>\n", argv[0]);
+    fprintf(stderr, "%s -a <replay file>\n", argv[0]);
+    fprintf(stderr, "%s -i <replay dir> <store> [workers]\n", argv[0]);
+    fprintf(stderr, "%s -r <replay file> <frame dir> [seconds] [map cache]\n", argv[0]);
+    fprintf(stderr, "%s -q <replay file> [query file]\n", argv[0]);
     return 1;
   }
 
+  if (strcmp(argv[1], "-q") == 0)
+  {
+    if (argc < 3)
+    {
+      fprintf(stderr, "%s -q <replay file> [query file]\n", argv[0]);
+      fprintf(stderr, "  query lines: <x1> <y1> <x2> <y2> <from sec> <to sec> [mabp] [player]\n");
+      return 1;
+    }
+    return scr::Query(argv[2], argc > 3 ? argv[3] : nullptr);
+  }
+
+  if (strcmp(argv[1], "-r") == 0)
+  {
+    if (argc < 4)
+    {
+      fprintf(stderr, "%s -r <replay file> <frame dir> [seconds] [map cache]\n", argv[0]);
+      return 1;
+    }
+    return scr::Render(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : 30, argc > 5 ? argv[5] : nullptr);
+  }
+
+  if (strcmp(argv[1], "-i") == 0)
+  {
+    if (argc < 4)
+    {
+      fprintf(stderr, "%s -i <replay dir> <store> [workers]\n", argv[0]);
+      fprintf(stderr, "  sparklines are written to sparklines.db in the store directory\n");
+      return 1;
+    }
+    return scr::Ingest(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : 0);
+  }
+
   // scr::DumpCmdInfo();
 
+  // apm mode: apm and effective apm of the players instead of the replay dump
+  bool apm = strcmp(argv[1], "-a") == 0;
+  if (apm)
+  {
+    if (argc < 3)
+    {
+      fprintf(stderr, "%s -a <replay file>\n", argv[0]);
+      return 1;
+    }
+    path = argv[2];
+    scr::g_trace = false;
+  }
+
   std::string rep;
   ret = scr::LoadFile(path, &rep);
   if (ret != 0)
@@ -1086,6 +2125,11 @@ int main(int argc, char** argv)
     return ret;
   }
 
+  if (apm)
+  {
+    scr::DumpApm(replay);
+    return 0;
+  }
   DumpReplay("", replay);
   return 0;
 }